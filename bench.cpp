@@ -0,0 +1,448 @@
+#include <malloc.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "diff.h"
+#include "hash.h"
+#include "libdiff.h"
+#include "oper.h"
+#include "profile.h"
+#include "render.h"
+#include "replace.h"
+#include "roots.h"
+
+const int BENCH_OPS = 8;
+
+const int MAX_BENCH_VARS = 8;
+
+const char BENCH_VARS[MAX_BENCH_VARS + 1] = "xyzabcuv";
+
+const OpType_t BENCH_OP_TYPES[BENCH_OPS] = {ADD_OP, SUB_OP, MUL_OP, DIV_OP, POW_OP, SIN_OP, COS_OP, LN_OP};
+
+enum BenchPhase_t {
+    PHASE_PARSE    = 0,
+    PHASE_DIFF     = 1,
+    PHASE_EASIER   = 2,
+    PHASE_VALUE    = 3,
+    PHASE_TAILOR   = 4,
+    PHASE_TEX      = 5,
+    PHASE_COUNT    = 6,
+};
+
+const char PHASE_NAMES[PHASE_COUNT][16] = {"parse", "nodeDiff", "easierEqu", "funcValue", "tailor", "diffToTex"};
+
+struct BenchOptions_t {
+    uint64_t seed         = 1;
+    int      minDepth     = 2;
+    int      maxDepth     = 8;
+    int      width        = 4;          // summands on top level
+    int      varCount     = 1;
+    double   constDensity = 0.3;        // probability of number in leaf
+    unsigned opWeights[BENCH_OPS] = {4, 2, 4, 1, 1, 1, 1, 1};   // + - * / ^ sin cos ln
+    int      reps         = 10;
+    int      points       = 100;        // funcValue calls per repetition
+    int      tailorOrder  = 2;
+    int      leakRounds   = 0;          // rounds of leak check over the whole corpus, 0 - usual benchmark
+};
+
+struct BenchPhaseStats_t {
+    uint64_t ns          = 0;
+    size_t   ops         = 0;
+    size_t   nodes       = 0;           // nodes of input, processed in phase
+    size_t   allocations = 0;
+    size_t   peak        = 0;
+};
+
+// generated equation in parser syntax
+struct BenchText_t {
+    char*  data = nullptr;
+    size_t size = 0;
+    size_t len  = 0;
+};
+
+extern FILE* texFile;
+
+extern ReplTable_t texLetters;
+
+// keeps compiler from throwing computed values away
+static volatile double benchSink = 0;
+
+static uint64_t benchRand(uint64_t* state) {
+    *state += 0x9e3779b97f4a7c15;
+    return hashMix(*state);
+}
+
+static double benchUniform(uint64_t* state) {
+    return (double) (benchRand(state) >> 11) / (double) (1ull << 53);
+}
+
+static int benchAppend(BenchText_t* text, const char* string) {
+    size_t length = strlen(string);
+
+    if (text->len + length + 1 > text->size) {
+        size_t newSize = text->size ? text->size * 2 : MAX_WORD_LENGTH;
+        while (newSize < text->len + length + 1) newSize *= 2;
+
+        char* data = (char*) realloc(text->data, newSize);
+        DIFF_CHECK(!data, DIFF_NO_MEM);
+
+        text->data = data;
+        text->size = newSize;
+    }
+
+    memcpy(text->data + text->len, string, length + 1);
+    text->len += length;
+
+    return DIFF_OK;
+}
+
+static OpType_t benchOper(uint64_t* state, const BenchOptions_t* options) {
+    unsigned total = 0;
+    for (int i = 0; i < BENCH_OPS; i++) total += options->opWeights[i];
+    if (!total) return ADD_OP;
+
+    unsigned choice = (unsigned) (benchRand(state) % total);
+    for (int i = 0; i < BENCH_OPS; i++) {
+        if (choice < options->opWeights[i]) return BENCH_OP_TYPES[i];
+        choice -= options->opWeights[i];
+    }
+
+    return ADD_OP;
+}
+
+static void benchLeaf(BenchText_t* text, uint64_t* state, const BenchOptions_t* options) {
+    char leaf[32] = "";
+
+    if (benchUniform(state) < options->constDensity) {
+        snprintf(leaf, sizeof(leaf), "%d", 1 + (int) (benchRand(state) % 9));
+    } else {
+        leaf[0] = BENCH_VARS[benchRand(state) % (uint64_t) options->varCount];
+    }
+
+    benchAppend(text, leaf);
+}
+
+// full tree of given depth, exponent of power is always small number, so derivatives stay polynomial in size
+static void benchExpr(BenchText_t* text, uint64_t* state, int depth, const BenchOptions_t* options) {
+    if (depth <= 0) {
+        benchLeaf(text, state, options);
+        return;
+    }
+
+    OpType_t oper = benchOper(state, options);
+    switch (oper) {
+        case SIN_OP:
+        case COS_OP:
+        case LN_OP:
+        case TAN_OP:
+        case EXP_OP:
+        case SQRT_OP:
+        case ASIN_OP:
+        case ACOS_OP:
+        case ATAN_OP:
+        case SINH_OP:
+        case COSH_OP:
+        case ABS_OP:
+            benchAppend(text, DIFF_OPERS[oper].name);
+            benchAppend(text, "(");
+            benchExpr(text, state, depth - 1, options);
+            benchAppend(text, ")");
+            break;
+        case POW_OP:
+            {
+                char exponent[32] = "";
+                snprintf(exponent, sizeof(exponent), ")^%d", 2 + (int) (benchRand(state) % 3));
+
+                benchAppend(text, "(");
+                benchExpr(text, state, depth - 1, options);
+                benchAppend(text, exponent);
+            }
+            break;
+        case ADD_OP:
+        case SUB_OP:
+        case MUL_OP:
+        case DIV_OP:
+            benchAppend(text, "(");
+            benchExpr(text, state, depth - 1, options);
+            benchAppend(text, DIFF_OPERS[oper].name);
+            benchExpr(text, state, depth - 1, options);
+            benchAppend(text, ")");
+            break;
+        case OPT_DEFAULT:
+        default:
+            benchLeaf(text, state, options);
+            break;
+    }
+}
+
+static int benchGenerate(BenchText_t* text, uint64_t seed, int depth, const BenchOptions_t* options) {
+    DIFF_CHECK(!text || !options, DIFF_NULL);
+
+    text->len = 0;
+    DIFF_CHECK(benchAppend(text, "") != DIFF_OK, DIFF_NO_MEM);
+
+    uint64_t state = seed;
+    for (int i = 0; i < options->width; i++) {
+        if (i) benchAppend(text, "+");
+        benchExpr(text, &state, depth, options);
+    }
+
+    return DIFF_OK;
+}
+
+static void phaseStart(uint64_t* start, size_t* allocated) {
+    diffStats.peak = diffStats.allocated - diffStats.freed;
+    *allocated = diffStats.allocated;
+    *start     = clockNs();
+}
+
+static void phaseEnd(BenchPhaseStats_t* stats, uint64_t start, size_t allocated, size_t ops, size_t nodes) {
+    stats->ns          += clockNs() - start;
+    stats->ops         += ops;
+    stats->nodes       += nodes;
+    stats->allocations += diffStats.allocated - allocated;
+    stats->peak         = max(stats->peak, diffStats.peak);
+}
+
+static int benchRun(const BenchText_t* text, const BenchOptions_t* options, BenchPhaseStats_t* stats, size_t* treeSize) {
+    DIFF_CHECK(!text || !options || !stats, DIFF_NULL);
+
+    double* coefs = (double*) calloc((size_t) options->tailorOrder + 1, sizeof(double));
+    DIFF_CHECK(!coefs, DIFF_NO_MEM);
+
+    uint64_t start = 0;
+    size_t   allocated = 0;
+
+    for (int rep = 0; rep < options->reps; rep++) {
+        char* line = text->data;
+
+        phaseStart(&start, &allocated);
+        DiffNode_t* root = parseEquation(&line);
+        phaseEnd(&stats[PHASE_PARSE], start, allocated, 1, 0);
+
+        size_t nodes = getTreeSize(root);
+        stats[PHASE_PARSE].nodes += nodes;
+        if (!root) {
+            free(coefs);
+            return DIFF_NULL;
+        }
+        *treeSize = nodes;
+
+        phaseStart(&start, &allocated);
+        DiffNode_t* derivative = nodeDiff(root, nullptr);
+        phaseEnd(&stats[PHASE_DIFF], start, allocated, 1, nodes);
+        addPrevs(derivative);
+
+        size_t diffNodes = getTreeSize(derivative);
+        phaseStart(&start, &allocated);
+        easierEqu(derivative);
+        phaseEnd(&stats[PHASE_EASIER], start, allocated, 1, diffNodes);
+
+        double sum = 0;
+        phaseStart(&start, &allocated);
+        for (int i = 0; i < options->points; i++) sum += funcValue(root, 0.5 + i / (double) options->points);
+        phaseEnd(&stats[PHASE_VALUE], start, allocated, (size_t) options->points, (size_t) options->points * nodes);
+
+        phaseStart(&start, &allocated);
+        tailorCoefs(root, options->tailorOrder, 0.5, coefs);
+        phaseEnd(&stats[PHASE_TAILOR], start, allocated, 1, nodes);
+
+        diffNodes = getTreeSize(derivative);
+        phaseStart(&start, &allocated);
+        diffToTex(derivative);
+        phaseEnd(&stats[PHASE_TEX], start, allocated, 1, diffNodes);
+
+        benchSink = sum + coefs[0];
+
+        diffNodeDtor(derivative);
+        diffNodeDtor(root);
+    }
+
+    free(coefs);
+    return DIFF_OK;
+}
+
+// one job of CLI and library, every tree and buffer it makes has to be freed at the end
+static int leakJob(const BenchText_t* text, const BenchOptions_t* options, double* coefs) {
+    char* line = text->data;
+    DiffNode_t* root = parseEquation(&line);
+    DIFF_CHECK(!root, DIFF_NULL);
+
+    diffToTex(root);
+    tailor(root, options->tailorOrder, 0.5);
+    equTangent(root, 0.5);
+    equRoots(root, 0.5, 1.5);
+    equIntegral(root, 0.5, 1.5);
+    equCheb(root, 0.5, 1.5);
+    equDiff(root, nullptr);
+    tailorCoefs(root, options->tailorOrder, 0.5, coefs);
+
+    // infix is read back exactly: the same tree prints the same text
+    int err = DIFF_OK;
+    DiffNode_t* derivative = nullptr;
+    DiffNode_t* parsed     = nullptr;
+    char*       infix      = nullptr;
+    char*       again      = nullptr;
+    if (diffDerivative(root, 1, &derivative) == DIFF_OK && diffToString(derivative, DIFF_FORMAT_INFIX, &infix) == DIFF_OK) {
+        err = diffParse(infix, &parsed);
+        if (err == DIFF_OK) err = diffToString(parsed, DIFF_FORMAT_INFIX, &again);
+        if (err == DIFF_OK && strcmp(infix, again)) {
+            fprintf(stderr, "Infix is not read back: %s\n                       %s\n", infix, again);
+            err = DIFF_SYNTAX;
+        }
+    }
+    free(again);
+    free(infix);
+    diffFree(parsed);
+    diffFree(derivative);
+
+    diffNodeDtor(root);
+
+    // letters belong to one document
+    replTableDtor(&texLetters);
+    chebCacheDtor(&chebCache);
+
+    return err;
+}
+
+// Whole corpus is run again and again: no job may leave live nodes, and heap in use must not grow
+// after the first round, that warms up lazy buffers (stdout and so on). Run it without tcache of glibc,
+// otherwise freed chunks cached there look like used ones.
+static int benchLeakCheck(const BenchOptions_t* options) {
+    double* coefs = (double*) calloc((size_t) options->tailorOrder + 1, sizeof(double));
+    DIFF_CHECK(!coefs, DIFF_NO_MEM);
+
+    BenchText_t text     = {};
+    size_t      baseline = 0;
+    int         err      = DIFF_OK;
+
+    for (int round = 0; round < options->leakRounds && err == DIFF_OK; round++) {
+        size_t jobs = 0, liveMax = 0;
+
+        for (int depth = options->minDepth; depth <= options->maxDepth && err == DIFF_OK; depth++) {
+            err = benchGenerate(&text, options->seed, depth, options);
+
+            for (int rep = 0; rep < options->reps && err == DIFF_OK; rep++) {
+                diffStatsReset();
+                err = leakJob(&text, options, coefs);
+
+                liveMax = max(liveMax, diffStats.allocated - diffStats.freed);
+                jobs++;
+            }
+        }
+
+        // pooled nodes are not leaked, but they are heap in use too
+        diffNodePool(0);
+        size_t heap = mallinfo2().uordblks;
+        if (round <= 1) baseline = heap;
+
+        bool leaked = liveMax || heap > baseline;
+        printf("{\"round\": %d, \"jobs\": %zu, \"live_nodes_max\": %zu, \"heap_bytes\": %zu, \"growth\": %ld, \"leak\": %s}\n",
+               round, jobs, liveMax, heap, (long) heap - (long) baseline, leaked ? "true" : "false");
+        fflush(stdout);
+
+        if (err == DIFF_OK && leaked) err = DIFF_NO_MEM;
+    }
+
+    free(text.data);
+    free(coefs);
+
+    return err;
+}
+
+static void printPhase(const BenchOptions_t* options, int depth, size_t treeSize, size_t textSize,
+                       BenchPhase_t phase, const BenchPhaseStats_t* stats) {
+    double seconds = (double) stats->ns / 1e9;
+
+    printf("{\"seed\": %lu, \"depth\": %d, \"width\": %d, \"vars\": %d, \"const\": %lg, \"nodes\": %zu, \"chars\": %zu, "
+           "\"phase\": \"%s\", \"ops\": %zu, \"ns_per_op\": %.1lf, \"nodes_per_s\": %.4lg, \"peak_nodes\": %zu, "
+           "\"allocs_per_op\": %.1lf}\n",
+           options->seed, depth, options->width, options->varCount, options->constDensity, treeSize, textSize,
+           PHASE_NAMES[phase], stats->ops, stats->ops ? (double) stats->ns / (double) stats->ops : 0,
+           seconds > 0 ? (double) stats->nodes / seconds : 0, stats->peak,
+           stats->ops ? (double) stats->allocations / (double) stats->ops : 0);
+}
+
+static bool parseBenchArgs(int argc, char* argv[], BenchOptions_t* options) {
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+
+        if      (!strcmp(argv[i], "--seed")   && hasValue) options->seed         = strtoull(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "--depth")  && hasValue) options->minDepth     = options->maxDepth = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--from")   && hasValue) options->minDepth     = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--to")     && hasValue) options->maxDepth     = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--width")  && hasValue) options->width        = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--vars")   && hasValue) options->varCount     = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--const")  && hasValue) options->constDensity = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--reps")   && hasValue) options->reps         = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--points") && hasValue) options->points       = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--tailor") && hasValue) options->tailorOrder  = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--leak-check") && hasValue) options->leakRounds = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--mix")    && hasValue) {
+            unsigned* w = options->opWeights;
+            if (sscanf(argv[++i], "%u:%u:%u:%u:%u:%u:%u:%u", &w[0], &w[1], &w[2], &w[3], &w[4], &w[5], &w[6], &w[7]) != BENCH_OPS) {
+                return false;
+            }
+        } else {
+            return false;
+        }
+    }
+
+    return options->minDepth >= 0 && options->minDepth <= options->maxDepth && options->width > 0
+        && options->varCount > 0 && options->varCount <= MAX_BENCH_VARS && options->reps > 0
+        && options->points > 0 && options->tailorOrder >= 0 && options->leakRounds >= 0;
+}
+
+int main(int argc, char* argv[]) {
+    BenchOptions_t options = {};
+    if (!parseBenchArgs(argc, argv, &options)) {
+        fprintf(stderr, "Usage: %s [--seed N] [--depth N | --from N --to N] [--width N] [--vars N] [--const P]\n"
+                        "       [--mix add:sub:mul:div:pow:sin:cos:ln] [--reps N] [--points N] [--tailor N] [--leak-check rounds]\n", argv[0]);
+        return 1;
+    }
+
+    // allocations and live nodes are what is measured
+    diffStats.enabled = true;
+
+    // TeX goes nowhere, nothing is rendered
+    renderQueue = renderQueueCtor(RENDER_OFF, 0);
+    texFile     = fopen("/dev/null", "w");
+    if (!texFile) return 1;
+
+    if (options.leakRounds) {
+        int err = benchLeakCheck(&options);
+        fclose(texFile);
+        texFile = nullptr;
+        closeLogfile();
+
+        if (err != DIFF_OK) fprintf(stderr, "Leak check failed\n");
+        return err == DIFF_OK ? 0 : 1;
+    }
+
+    BenchText_t text = {};
+
+    for (int depth = options.minDepth; depth <= options.maxDepth; depth++) {
+        if (benchGenerate(&text, options.seed, depth, &options) != DIFF_OK) break;
+
+        BenchPhaseStats_t stats[PHASE_COUNT] = {};
+        size_t treeSize = 0;
+
+        diffStatsReset();
+        if (benchRun(&text, &options, stats, &treeSize) != DIFF_OK) {
+            fprintf(stderr, "Can't parse generated equation (depth %d)\n", depth);
+            break;
+        }
+
+        for (int phase = 0; phase < PHASE_COUNT; phase++) {
+            printPhase(&options, depth, treeSize, text.len, (BenchPhase_t) phase, &stats[phase]);
+        }
+        fflush(stdout);
+    }
+
+    free(text.data);
+    fclose(texFile);
+    texFile = nullptr;
+    closeLogfile();
+
+    return 0;
+}
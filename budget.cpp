@@ -0,0 +1,124 @@
+#include "budget.h"
+#include "diff.h"
+#include "profile.h"
+
+thread_local DiffBudget_t* diffBudget = nullptr;
+
+// the first exceeded limit stays
+static void budgetExceed(DiffBudget_t* budget, BudgetLimit_t limit) {
+    int none = BUDGET_NONE;
+    budget->exceeded.compare_exchange_strong(none, limit, std::memory_order_relaxed);
+}
+
+void diffBudgetCtor(DiffBudget_t* budget, const DiffLimits_t* limits) {
+    if (!budget) return;
+
+    budget->limits   = limits ? *limits : DiffLimits_t {};
+    budget->start    = clockNs();
+    budget->deadline = budget->limits.timeMs ? budget->start + budget->limits.timeMs * 1000000 : 0;
+
+    budget->live      = 0;
+    budget->peak      = 0;
+    budget->allocated = 0;
+    budget->bytes     = 0;
+    budget->peakBytes = 0;
+    budget->ticks     = 0;
+
+    budget->output.store(0);
+    budget->outputTicks.store(0);
+    budget->exceeded.store(BUDGET_NONE);
+}
+
+// nodes and buffers of current thread are counted by budget till diffBudgetEnd()
+void diffBudgetBegin(DiffBudget_t* budget) {
+    diffBudget = budget;
+}
+
+void diffBudgetEnd(void) {
+    diffBudget = nullptr;
+}
+
+void budgetNodeAlloc(DiffBudget_t* budget) {
+    if (!budget) return;
+
+    budget->allocated++;
+    if (++budget->live > budget->peak) budget->peak = budget->live;
+    if (budget->limits.nodes && budget->live > budget->limits.nodes) budgetExceed(budget, BUDGET_NODES);
+
+    budgetAlloc(sizeof(DiffNode_t));
+}
+
+// nodes, made before job, may be freed by it too
+void budgetNodeFree(DiffBudget_t* budget) {
+    if (!budget) return;
+
+    if (budget->live) budget->live--;
+    budgetFree(sizeof(DiffNode_t));
+}
+
+void budgetAlloc(size_t bytes) {
+    DiffBudget_t* budget = diffBudget;
+    if (!budget) return;
+
+    budget->bytes += bytes;
+    if (budget->bytes > budget->peakBytes) budget->peakBytes = budget->bytes;
+    if (budget->limits.bytes && budget->bytes > budget->limits.bytes) budgetExceed(budget, BUDGET_BYTES);
+}
+
+void budgetFree(size_t bytes) {
+    DiffBudget_t* budget = diffBudget;
+    if (!budget) return;
+
+    budget->bytes = budget->bytes > bytes ? budget->bytes - bytes : 0;
+}
+
+// called before every formula of TeX (by any thread), true - nothing should be printed anymore
+bool budgetOutput(DiffBudget_t* budget, FILE* file) {
+    if (!budget || !file) return false;
+    if (budget->exceeded.load(std::memory_order_relaxed) == BUDGET_OUTPUT) return true;
+    if (!budget->limits.output) return false;
+
+    if (budget->outputTicks.fetch_add(1, std::memory_order_relaxed) % BUDGET_OUTPUT_PERIOD == 0) {
+        long position = ftell(file);
+        if (position > 0) budget->output.store((size_t) position, std::memory_order_relaxed);
+    }
+
+    if (budget->output.load(std::memory_order_relaxed) <= budget->limits.output) return false;
+
+    budgetExceed(budget, BUDGET_OUTPUT);
+    return true;
+}
+
+// Cheap check for loops over nodes: one load, clock is read only once per BUDGET_CLOCK_PERIOD calls.
+bool budgetExceeded(void) {
+    DiffBudget_t* budget = diffBudget;
+    if (!budget) return false;
+
+    if (budget->deadline && ++budget->ticks % BUDGET_CLOCK_PERIOD == 0 && clockNs() > budget->deadline) {
+        budgetExceed(budget, BUDGET_TIME);
+    }
+
+    return budget->exceeded.load(std::memory_order_relaxed) != BUDGET_NONE;
+}
+
+// error code for failed job: out of budget or out of memory
+int budgetError(void) {
+    return budgetExceeded() ? DIFF_BUDGET : DIFF_NO_MEM;
+}
+
+BudgetLimit_t budgetLimit(const DiffBudget_t* budget) {
+    if (!budget) return BUDGET_NONE;
+
+    return (BudgetLimit_t) budget->exceeded.load(std::memory_order_relaxed);
+}
+
+// statistics of aborted job as one JSON line
+void budgetReport(const DiffBudget_t* budget, FILE* file) {
+    if (!budget || !file) return;
+
+    fprintf(file, "{\"budget\": \"%s\", \"ms\": %.3lf, \"live_nodes\": %zu, \"peak_nodes\": %zu, \"allocated_nodes\": %zu, "
+                  "\"peak_bytes\": %zu, \"output_bytes\": %zu}\n",
+                  BUDGET_LIMIT_NAMES[budgetLimit(budget)], (double) (clockNs() - budget->start) / 1e6,
+                  budget->live, budget->peak, budget->allocated, budget->peakBytes,
+                  budget->output.load(std::memory_order_relaxed));
+}
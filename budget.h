@@ -0,0 +1,80 @@
+#ifndef BUDGET_H
+#define BUDGET_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+
+const unsigned BUDGET_CLOCK_PERIOD  = 1024;     // clock is read once per this many checks
+
+const unsigned BUDGET_OUTPUT_PERIOD = 32;       // size of output is read once per this many formulas
+
+enum BudgetLimit_t {
+    BUDGET_NONE   = 0,
+    BUDGET_NODES  = 1,
+    BUDGET_BYTES  = 2,
+    BUDGET_TIME   = 3,
+    BUDGET_OUTPUT = 4,
+};
+
+const char BUDGET_LIMIT_NAMES[][8] = {"none", "nodes", "bytes", "time", "output"};
+
+// limits of one job, 0 - no limit
+struct DiffLimits_t {
+    size_t   nodes  = 0;        // live tree nodes
+    size_t   bytes  = 0;        // tree nodes and heap buffers of walkers
+    uint64_t timeMs = 0;        // wall time
+    size_t   output = 0;        // size of TeX document
+};
+
+// Budget of running job. Allocator counts nodes and bytes of current thread, main traversals (nodeDiff, easierEqu,
+// tailor) check it between nodes and stop, when something is exceeded. Allocations themselves don't fail, so
+// trees stay whole and are freed as usual, job goes on only for a few nodes after limit.
+struct DiffBudget_t {
+    DiffLimits_t limits   = {};
+    uint64_t     start    = 0;      // ns of monotonic clock
+    uint64_t     deadline = 0;      // 0 - no deadline
+
+    size_t   live      = 0;
+    size_t   peak      = 0;
+    size_t   allocated = 0;
+    size_t   bytes     = 0;
+    size_t   peakBytes = 0;
+    unsigned ticks     = 0;
+
+    std::atomic<size_t>   output      {0};     // output is written by renderer thread too
+    std::atomic<unsigned> outputTicks {0};
+    std::atomic<int>      exceeded    {BUDGET_NONE};
+};
+
+// budget of current thread's job, nullptr - no limits
+extern thread_local DiffBudget_t* diffBudget;
+
+// budget of last job of openDiffFile()
+extern DiffBudget_t jobBudget;
+
+void diffBudgetCtor(DiffBudget_t* budget, const DiffLimits_t* limits);
+
+void diffBudgetBegin(DiffBudget_t* budget);
+
+void diffBudgetEnd(void);
+
+void budgetNodeAlloc(DiffBudget_t* budget);
+
+void budgetNodeFree(DiffBudget_t* budget);
+
+void budgetAlloc(size_t bytes);
+
+void budgetFree(size_t bytes);
+
+bool budgetOutput(DiffBudget_t* budget, FILE* file);
+
+bool budgetExceeded(void);
+
+int budgetError(void);
+
+BudgetLimit_t budgetLimit(const DiffBudget_t* budget);
+
+void budgetReport(const DiffBudget_t* budget, FILE* file);
+
+#endif
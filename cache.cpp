@@ -0,0 +1,307 @@
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "cache.h"
+#include "hash.h"
+#include "oper.h"
+#include "serial.h"
+
+DiffCache_t* diffCache = nullptr;
+
+struct CacheFile_t {
+    char   name[NAME_MAX + 1] = "";
+    size_t size  = 0;
+    time_t sec   = 0;
+    long   nsec  = 0;
+};
+
+static size_t align8(size_t size) {
+    return (size + sizeof(double) - 1) / sizeof(double) * sizeof(double);
+}
+
+int diffCacheOpen(DiffCache_t* cache, const char* dir, size_t maxSize) {
+    DIFF_CHECK(!cache || !dir, DIFF_NULL);
+
+    int written = snprintf(cache->dir, sizeof(cache->dir), "%s", dir);
+    DIFF_CHECK(written <= 0 || written >= MAX_CACHE_DIR, DIFF_FILE_NULL);
+
+    mkdir(cache->dir, 0755);
+
+    char lockPath[MAX_CACHE_PATH] = "";
+    snprintf(lockPath, sizeof(lockPath), "%s/lock", cache->dir);
+    cache->lockFd = open(lockPath, O_RDWR | O_CREAT, 0644);
+    DIFF_CHECK(cache->lockFd < 0, DIFF_FILE_NULL);
+
+    cache->maxSize = maxSize;
+    cache->hits    = 0;
+    cache->misses  = 0;
+    cache->stored  = 0;
+
+    // counts size of entries, that are already there
+    diffCacheEvict(cache);
+
+    return DIFF_OK;
+}
+
+void diffCacheClose(DiffCache_t* cache) {
+    if (!cache) return;
+
+    if (cache->lockFd >= 0) close(cache->lockFd);
+    cache->lockFd = -1;
+}
+
+uint64_t cacheKey(DiffNode_t* equation, CacheKind_t kind, int order, double x0) {
+    uint64_t x0Bits = 0;
+    if (compDouble(x0, 0)) x0 = 0;
+    memcpy(&x0Bits, &x0, sizeof(x0));
+
+    uint64_t key = hashMix(treeHash(equation) ^ CACHE_VERSION);
+    key = hashMix(key ^ DIFF_RULES_VERSION);
+    key = hashMix(key ^ (uint64_t) kind);
+    key = hashMix(key ^ (uint64_t) (uint32_t) order);
+    key = hashMix(key ^ x0Bits);
+
+    return key;
+}
+
+static void entryPath(const DiffCache_t* cache, char* path, CacheKind_t kind, uint64_t key) {
+    snprintf(path, MAX_CACHE_PATH, "%s/%d_%016lx.dfc", cache->dir, (int) kind, key);
+}
+
+// maps entry and checks that it was made for the same equation, returns nullptr if there is no such entry
+static const CacheHeader_t* cacheMap(DiffCache_t* cache, DiffNode_t* equation, CacheKind_t kind, int order, double x0,
+                                     DiffImage_t* image, size_t* mappedSize) {
+    uint64_t key = cacheKey(equation, kind, order, x0);
+
+    char path[MAX_CACHE_PATH] = "";
+    entryPath(cache, path, kind, key);
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return nullptr;
+
+    struct stat entryStat = {};
+    if (fstat(fd, &entryStat) < 0 || (size_t) entryStat.st_size < sizeof(CacheHeader_t)) {
+        close(fd);
+        return nullptr;
+    }
+
+    size_t size = (size_t) entryStat.st_size;
+    void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    // access time for LRU eviction
+    futimens(fd, nullptr);
+    close(fd);
+    if (mapped == MAP_FAILED) return nullptr;
+
+    // sizes of broken entry may be anything, each of them is checked against file before the sum
+    const CacheHeader_t* header = (const CacheHeader_t*) mapped;
+    size_t payload = size - sizeof(CacheHeader_t);
+    bool ok = !memcmp(header->magic, CACHE_MAGIC, sizeof(CACHE_MAGIC))
+           && header->version == CACHE_VERSION && header->kind == (uint32_t) kind && header->key == key
+           && header->order == order
+           && header->imageSize <= payload && header->coefCount <= payload / sizeof(double)
+           && align8((size_t) header->imageSize) + (size_t) header->coefCount * sizeof(double) == payload
+           && diffImageFromBuffer(image, (const char*) mapped + sizeof(CacheHeader_t), header->imageSize) == DIFF_OK;
+
+    // different equation with the same hash
+    if (ok) {
+        DiffNode_t* cached = diffImageTree(image, 0);
+        ok = compareSubtrees(cached, equation);
+        diffNodeDtor(cached);
+    }
+
+    if (!ok) {
+        munmap(mapped, size);
+        return nullptr;
+    }
+
+    *mappedSize = size;
+    return header;
+}
+
+DiffNode_t* diffCacheGetDerivative(DiffCache_t* cache, DiffNode_t* equation) {
+    if (!cache || !equation) return nullptr;
+
+    DiffImage_t image = {};
+    size_t size = 0;
+    const CacheHeader_t* header = cacheMap(cache, equation, CACHE_DERIVATIVE, 0, 0, &image, &size);
+    if (!header) {
+        cache->misses++;
+        return nullptr;
+    }
+
+    DiffNode_t* derivative = diffImageTree(&image, 1);
+    munmap(const_cast<CacheHeader_t*>(header), size);
+
+    if (derivative) cache->hits++;
+    else            cache->misses++;
+
+    return derivative;
+}
+
+int diffCacheGetTailor(DiffCache_t* cache, DiffNode_t* equation, int order, double x0, double* coefs) {
+    DIFF_CHECK(!cache || !equation || !coefs, DIFF_NULL);
+
+    DiffImage_t image = {};
+    size_t size = 0;
+    const CacheHeader_t* header = cacheMap(cache, equation, CACHE_TAILOR, order, x0, &image, &size);
+    if (!header || header->coefCount != (uint64_t) order + 1) {
+        if (header) munmap(const_cast<CacheHeader_t*>(header), size);
+
+        cache->misses++;
+        return DIFF_NULL;
+    }
+
+    memcpy(coefs, (const char*) header + sizeof(CacheHeader_t) + align8(header->imageSize), (size_t) (order + 1) * sizeof(double));
+    munmap(const_cast<CacheHeader_t*>(header), size);
+
+    cache->hits++;
+    return DIFF_OK;
+}
+
+static int cachePut(DiffCache_t* cache, CacheKind_t kind, int order, double x0,
+                    DiffNode_t* const* roots, uint32_t rootCount, const double* coefs, size_t coefCount) {
+    DIFF_CHECK(!cache || !roots || !roots[0], DIFF_NULL);
+
+    char tempPath[MAX_CACHE_PATH] = "";
+    snprintf(tempPath, sizeof(tempPath), "%s/.tmp_XXXXXX", cache->dir);
+
+    // unique name for every writer, entries are readable by other users as they were with fopen()
+    int fd = mkstemp(tempPath);
+    DIFF_CHECK(fd < 0, DIFF_FILE_NULL);
+    fchmod(fd, 0644);
+
+    FILE* file = fdopen(fd, "wb");
+    if (!file) {
+        close(fd);
+        unlink(tempPath);
+        return DIFF_FILE_NULL;
+    }
+
+    CacheHeader_t header = {};
+    memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    header.version   = CACHE_VERSION;
+    header.kind      = (uint32_t) kind;
+    header.order     = order;
+    header.key       = cacheKey(roots[0], kind, order, x0);
+    header.x0        = x0;
+    header.coefCount = coefCount;
+
+    const char zeros[sizeof(double)] = {};
+
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1
+           && diffImageWrite(file, roots, rootCount) == DIFF_OK;
+
+    if (ok) {
+        header.imageSize = (uint64_t) ftell(file) - sizeof(header);
+        size_t padding = align8(header.imageSize) - header.imageSize;
+
+        ok = fwrite(zeros, 1, padding, file) == padding
+          && (!coefCount || fwrite(coefs, sizeof(double), coefCount, file) == coefCount)
+          && fseek(file, 0, SEEK_SET) == 0
+          && fwrite(&header, sizeof(header), 1, file) == 1;
+    }
+
+    ok = (fclose(file) == 0) && ok;
+
+    char path[MAX_CACHE_PATH] = "";
+    entryPath(cache, path, kind, header.key);
+
+    if (!ok || rename(tempPath, path) != 0) {
+        unlink(tempPath);
+        return DIFF_FILE_NULL;
+    }
+
+    cache->stored++;
+    cache->size += sizeof(header) + align8(header.imageSize) + coefCount * sizeof(double);
+    if (cache->size > cache->maxSize) diffCacheEvict(cache);
+
+    return DIFF_OK;
+}
+
+int diffCachePutDerivative(DiffCache_t* cache, DiffNode_t* equation, DiffNode_t* derivative) {
+    DiffNode_t* roots[] = {equation, derivative};
+
+    return cachePut(cache, CACHE_DERIVATIVE, 0, 0, roots, 2, nullptr, 0);
+}
+
+int diffCachePutTailor(DiffCache_t* cache, DiffNode_t* equation, int order, double x0, const double* coefs) {
+    DIFF_CHECK(!coefs || order < 0, DIFF_NULL);
+
+    DiffNode_t* roots[] = {equation};
+
+    return cachePut(cache, CACHE_TAILOR, order, x0, roots, 1, coefs, (size_t) order + 1);
+}
+
+static int compareFileAge(const void* first, const void* second) {
+    const CacheFile_t* file1 = (const CacheFile_t*) first;
+    const CacheFile_t* file2 = (const CacheFile_t*) second;
+
+    if (file1->sec  != file2->sec)  return file1->sec  < file2->sec  ? -1 : 1;
+    if (file1->nsec != file2->nsec) return file1->nsec < file2->nsec ? -1 : 1;
+    return 0;
+}
+
+// removes least recently used entries, when cache gets bigger than its max size, and counts its size again
+void diffCacheEvict(DiffCache_t* cache) {
+    if (!cache || cache->lockFd < 0) return;
+    if (flock(cache->lockFd, LOCK_EX) != 0) return;
+
+    DIR* dir = opendir(cache->dir);
+    if (!dir) {
+        flock(cache->lockFd, LOCK_UN);
+        return;
+    }
+
+    CacheFile_t* files = nullptr;
+    size_t fileCount = 0, fileSize = 0, totalSize = 0;
+
+    for (dirent* entry = readdir(dir); entry; entry = readdir(dir)) {
+        size_t nameLen = strlen(entry->d_name);
+        if (nameLen < 4 || strcmp(entry->d_name + nameLen - 4, ".dfc")) continue;
+
+        char path[MAX_CACHE_PATH] = "";
+        snprintf(path, sizeof(path), "%s/%s", cache->dir, entry->d_name);
+
+        struct stat entryStat = {};
+        if (stat(path, &entryStat) < 0) continue;
+
+        if (fileCount >= fileSize) {
+            size_t newSize = fileSize ? fileSize * 2 : 64;
+            CacheFile_t* newFiles = (CacheFile_t*) realloc(files, newSize * sizeof(CacheFile_t));
+            if (!newFiles) break;
+
+            files    = newFiles;
+            fileSize = newSize;
+        }
+
+        CacheFile_t* file = &files[fileCount++];
+        snprintf(file->name, sizeof(file->name), "%s", entry->d_name);
+        file->size = (size_t) entryStat.st_size;
+        file->sec  = entryStat.st_mtim.tv_sec;
+        file->nsec = entryStat.st_mtim.tv_nsec;
+
+        totalSize += file->size;
+    }
+    closedir(dir);
+
+    if (totalSize > cache->maxSize) {
+        qsort(files, fileCount, sizeof(CacheFile_t), compareFileAge);
+
+        size_t target = (size_t) ((double) cache->maxSize * CACHE_EVICT_TO);
+        for (size_t i = 0; i < fileCount && totalSize > target; i++) {
+            char path[MAX_CACHE_PATH] = "";
+            snprintf(path, sizeof(path), "%s/%s", cache->dir, files[i].name);
+
+            if (unlink(path) == 0) totalSize -= files[i].size;
+        }
+    }
+
+    cache->size = totalSize;
+
+    free(files);
+    flock(cache->lockFd, LOCK_UN);
+}
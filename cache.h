@@ -0,0 +1,64 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdint.h>
+
+#include "diff.h"
+
+const char     CACHE_MAGIC[4]     = {'D', 'I', 'F', 'C'};
+const uint32_t CACHE_VERSION      = 3;        // of entry format, changes of derivative rules bump DIFF_RULES_VERSION (oper.h)
+const size_t   DEFAULT_CACHE_SIZE = 64 << 20;
+const double   CACHE_EVICT_TO     = 0.8;        // part of max size left after eviction
+const int      MAX_CACHE_DIR      = 2048;
+const int      MAX_CACHE_PATH     = 4096;
+
+enum CacheKind_t {
+    CACHE_DERIVATIVE = 1,
+    CACHE_TAILOR     = 2,
+};
+
+// entry file: header | image with equation (and derivative) | tailor coefficients
+struct CacheHeader_t {
+    char     magic[4]   = {};
+    uint32_t version    = 0;
+    uint32_t kind       = 0;
+    int32_t  order      = 0;
+    uint64_t key        = 0;
+    double   x0         = 0;
+    uint64_t imageSize  = 0;
+    uint64_t coefCount  = 0;
+};
+
+// Entries are written to temporary file and renamed, so readers never see half-written entry.
+// Eviction (least recently used first) is done under flock of lock file, so several processes may share one cache.
+// Size is counted on open and by eviction, between them written entries are added to it, so put doesn't read directory.
+struct DiffCache_t {
+    char   dir[MAX_CACHE_DIR] = "";
+    size_t maxSize             = DEFAULT_CACHE_SIZE;
+    size_t size                = 0;
+    int    lockFd              = -1;
+
+    std::atomic<size_t> hits   {0};
+    std::atomic<size_t> misses {0};
+    std::atomic<size_t> stored {0};
+};
+
+extern DiffCache_t* diffCache;
+
+int diffCacheOpen(DiffCache_t* cache, const char* dir, size_t maxSize = DEFAULT_CACHE_SIZE);
+
+void diffCacheClose(DiffCache_t* cache);
+
+uint64_t cacheKey(DiffNode_t* equation, CacheKind_t kind, int order, double x0);
+
+DiffNode_t* diffCacheGetDerivative(DiffCache_t* cache, DiffNode_t* equation);
+
+int diffCachePutDerivative(DiffCache_t* cache, DiffNode_t* equation, DiffNode_t* derivative);
+
+int diffCacheGetTailor(DiffCache_t* cache, DiffNode_t* equation, int order, double x0, double* coefs);
+
+int diffCachePutTailor(DiffCache_t* cache, DiffNode_t* equation, int order, double x0, const double* coefs);
+
+void diffCacheEvict(DiffCache_t* cache);
+
+#endif
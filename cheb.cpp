@@ -0,0 +1,334 @@
+#include <math.h>
+
+#include "cheb.h"
+#include "hash.h"
+#include "libdiff.h"
+
+// cos(pi * j * (k + 1/2) / CHEB_POINTS): values in nodes -> coefficients
+struct ChebTable_t {
+    double nodes [CHEB_POINTS]               = {};      // on [-1, 1]
+    double checks[CHEB_CHECKS]               = {};
+    double basis [CHEB_POINTS][CHEB_POINTS]  = {};
+};
+
+static const ChebTable_t* chebTable(void) {
+    static const ChebTable_t table = [] {
+        ChebTable_t result = {};
+        for (int k = 0; k < CHEB_POINTS; k++) {
+            result.nodes[k] = cos(M_PI * (k + 0.5) / CHEB_POINTS);
+            for (int j = 0; j < CHEB_POINTS; j++) result.basis[j][k] = cos(M_PI * j * (k + 0.5) / CHEB_POINTS);
+        }
+        for (int k = 0; k < CHEB_CHECKS; k++) result.checks[k] = cos(M_PI * k / CHEB_POINTS);
+
+        return result;
+    }();
+
+    return &table;
+}
+
+static double clenshaw(const double* coefs, int degree, double t) {
+    double b1 = 0, b2 = 0;
+    for (int j = degree; j > 0; j--) {
+        double b0 = 2 * t * b1 - b2 + coefs[j];
+        b2 = b1;
+        b1 = b0;
+    }
+
+    return t * b1 - b2 + coefs[0];
+}
+
+static double pieceValue(const ChebPiece_t* piece, double x) {
+    double t = (2 * x - piece->left - piece->right) / (piece->right - piece->left);
+    return clenshaw(piece->coefs, piece->degree, t);
+}
+
+// samples of piece go one after another: CHEB_POINTS nodes, then CHEB_CHECKS checks
+const int CHEB_SAMPLES = CHEB_POINTS + CHEB_CHECKS;
+
+static void piecePoints(const ChebPiece_t* piece, double* xs) {
+    const ChebTable_t* table = chebTable();
+    double center = (piece->left + piece->right) / 2;
+    double half   = (piece->right - piece->left) / 2;
+
+    for (int k = 0; k < CHEB_POINTS; k++) xs[k]               = center + half * table->nodes[k];
+    for (int k = 0; k < CHEB_CHECKS; k++) xs[CHEB_POINTS + k] = center + half * table->checks[k];
+
+    // ends exactly, they are not always center +- half
+    xs[CHEB_POINTS]                   = piece->right;
+    xs[CHEB_POINTS + CHEB_CHECKS - 1] = piece->left;
+}
+
+enum ChebFit_t {
+    CHEB_FITTED   = 0,
+    CHEB_SPLIT    = 1,
+    CHEB_UNDEFINED = 2,     // f is not defined in all the samples, piece is not split
+};
+
+// Coefficients by discrete cosine transform of values in nodes, error is the worst of deviation in checks and
+// of the last two coefficients. Tail of series, that is below tolerance, is dropped.
+static ChebFit_t pieceFit(ChebPiece_t* piece, const double* values, double tolerance) {
+    const ChebTable_t* table = chebTable();
+
+    int nans = 0;
+    for (int k = 0; k < CHEB_SAMPLES; k++) nans += isnan(values[k]);
+    if (nans == CHEB_SAMPLES) return CHEB_UNDEFINED;
+
+    double scale = 1;
+    for (int k = 0; k < CHEB_SAMPLES; k++) {
+        if (!isfinite(values[k])) return CHEB_SPLIT;
+        scale = fmax(scale, fabs(values[k]));
+    }
+
+    for (int j = 0; j < CHEB_POINTS; j++) {
+        double sum = 0;
+        for (int k = 0; k < CHEB_POINTS; k++) sum += values[k] * table->basis[j][k];
+        piece->coefs[j] = 2 * sum / CHEB_POINTS;
+    }
+    piece->coefs[0] /= 2;
+    piece->degree    = CHEB_POINTS - 1;
+
+    double error = fabs(piece->coefs[CHEB_POINTS - 1]) + fabs(piece->coefs[CHEB_POINTS - 2]);
+    for (int k = 0; k < CHEB_CHECKS; k++) {
+        error = fmax(error, fabs(clenshaw(piece->coefs, piece->degree, table->checks[k]) - values[CHEB_POINTS + k]));
+    }
+
+    double bound = tolerance * scale;
+    if (error > bound) return CHEB_SPLIT;
+
+    // |T_j| <= 1, so dropped coefficients add at most their sum
+    while (piece->degree > 0 && error + fabs(piece->coefs[piece->degree]) <= bound / 2) {
+        error += fabs(piece->coefs[piece->degree]);
+        piece->degree--;
+    }
+    piece->error = error / scale;
+
+    return CHEB_FITTED;
+}
+
+static int comparePieces(const void* first, const void* second) {
+    double left1 = ((const ChebPiece_t*) first)->left;
+    double left2 = ((const ChebPiece_t*) second)->left;
+
+    return (left1 > left2) - (left1 < left2);
+}
+
+// Pieces are fitted by rounds, as in integrate(): samples of all the new pieces are evaluated by blocks of compiled
+// program, pieces that are not fitted are split in halves. Pieces of CHEB_MIN_WIDTH, that still are not fitted
+// (pole, edge of domain), pieces out of domain and all the pieces after CHEB_MAX_PIECES stay exact.
+static int chebFit(DiffCheb_t* cheb, const DiffProgram_t* program) {
+    size_t  points   = CHEB_BATCH * CHEB_SAMPLES;
+    size_t  maxStack = max(program->maxStack, 1);
+    size_t* fresh    = (size_t*) calloc(CHEB_MAX_PIECES,   sizeof(size_t));
+    size_t* next     = (size_t*) calloc(CHEB_MAX_PIECES,   sizeof(size_t));
+    double* xs       = (double*) calloc(points,            sizeof(double));
+    double* values   = (double*) calloc(points,            sizeof(double));
+    double* stack    = (double*) calloc(maxStack * points, sizeof(double));
+
+    int err = fresh && next && xs && values && stack ? DIFF_OK : DIFF_NO_MEM;
+
+    const double* vars[VAR_COUNT] = {};
+    for (int var = 0; var < VAR_COUNT; var++) vars[var] = xs;
+
+    double minWidth = CHEB_MIN_WIDTH * (cheb->right - cheb->left);
+
+    ChebPiece_t* pieces = cheb->pieces;
+    pieces[0].left  = cheb->left;
+    pieces[0].right = cheb->right;
+    cheb->count     = 1;
+
+    size_t freshCount = err == DIFF_OK ? 1 : 0;
+    if (freshCount) fresh[0] = 0;
+
+    while (freshCount) {
+        size_t nextCount = 0;
+
+        for (size_t start = 0; start < freshCount; start += CHEB_BATCH) {
+            size_t count = freshCount - start < CHEB_BATCH ? freshCount - start : CHEB_BATCH;
+
+            for (size_t i = 0; i < count; i++) piecePoints(&pieces[fresh[start + i]], xs + i * CHEB_SAMPLES);
+            programEvalBlock(program, vars, count * CHEB_SAMPLES, stack, values);
+            cheb->evaluations += count * CHEB_SAMPLES;
+
+            for (size_t i = 0; i < count; i++) {
+                ChebPiece_t* piece = &pieces[fresh[start + i]];
+                ChebFit_t fit = pieceFit(piece, values + i * CHEB_SAMPLES, cheb->tolerance);
+                if (fit == CHEB_FITTED) continue;
+
+                if (fit == CHEB_UNDEFINED || piece->right - piece->left <= minWidth || cheb->count == CHEB_MAX_PIECES) {
+                    piece->exact = true;
+                    continue;
+                }
+
+                double middle = (piece->left + piece->right) / 2;
+                pieces[cheb->count]       = {};
+                pieces[cheb->count].left  = middle;
+                pieces[cheb->count].right = piece->right;
+                piece->right              = middle;
+
+                next[nextCount++] = fresh[start + i];
+                next[nextCount++] = cheb->count++;
+            }
+        }
+
+        size_t* swap = fresh;
+        fresh      = next;
+        next       = swap;
+        freshCount = nextCount;
+    }
+
+    free(fresh);
+    free(next);
+    free(xs);
+    free(values);
+    free(stack);
+
+    return err;
+}
+
+// Approximation of f^(order) on [left, right], error of every piece is below tolerance * max(1, |f|).
+int chebBuild(DiffCheb_t* cheb, DiffNode_t* root, int order, double left, double right, double tolerance) {
+    DIFF_CHECK(!cheb || !root, DIFF_NULL);
+    DIFF_CHECK(!(left < right) || order < 0 || !(tolerance > 0), DIFF_VALUE_NULL);
+
+    *cheb = {};
+    cheb->left      = left;
+    cheb->right     = right;
+    cheb->order     = order;
+    cheb->tolerance = tolerance;
+
+    int err = diffDerivative(root, order, &cheb->tree);
+    if (err != DIFF_OK) return err;
+
+    DiffProgram_t program = {};
+    err = programCompile(&program, cheb->tree);
+
+    if (err == DIFF_OK) {
+        cheb->pieces = (ChebPiece_t*) calloc(CHEB_MAX_PIECES, sizeof(ChebPiece_t));
+        err = cheb->pieces ? chebFit(cheb, &program) : DIFF_NO_MEM;
+    }
+    programDtor(&program);
+
+    if (err != DIFF_OK) {
+        chebDtor(cheb);
+        return err;
+    }
+
+    // only the pieces in use are kept
+    ChebPiece_t* pieces = (ChebPiece_t*) realloc(cheb->pieces, cheb->count * sizeof(ChebPiece_t));
+    if (pieces) cheb->pieces = pieces;
+
+    qsort(cheb->pieces, cheb->count, sizeof(ChebPiece_t), comparePieces);
+    for (size_t i = 0; i < cheb->count; i++) {
+        const ChebPiece_t* piece = &cheb->pieces[i];
+        if (piece->exact) {
+            cheb->exactCount++;
+            continue;
+        }
+
+        if (piece->degree > cheb->maxDegree) cheb->maxDegree = piece->degree;
+        cheb->error = fmax(cheb->error, piece->error);
+    }
+
+    return DIFF_OK;
+}
+
+double chebValue(const DiffCheb_t* cheb, double x) {
+    if (!cheb || !cheb->pieces) return 0;
+    if (!(x >= cheb->left && x <= cheb->right)) return funcValue(cheb->tree, x);
+
+    // the last piece, that starts not after x
+    size_t low = 0, high = cheb->count;
+    while (high - low > 1) {
+        size_t middle = (low + high) / 2;
+        if (cheb->pieces[middle].left <= x) low  = middle;
+        else                                high = middle;
+    }
+
+    const ChebPiece_t* piece = &cheb->pieces[low];
+    return piece->exact ? funcValue(cheb->tree, x) : pieceValue(piece, x);
+}
+
+void chebDtor(DiffCheb_t* cheb) {
+    if (!cheb) return;
+
+    free(cheb->pieces);
+    diffFree(cheb->tree);
+    *cheb = {};
+}
+
+// bit by bit: range, that differs in the last digit, is another approximation
+static bool sameDouble(double first, double second) {
+    return !memcmp(&first, &second, sizeof(first));
+}
+
+// approximation is built only once for equal expression, order, range and tolerance
+int chebCacheGet(DiffChebCache_t* cache, DiffNode_t* root, int order, double left, double right, double tolerance, const DiffCheb_t** cheb) {
+    DIFF_CHECK(!cache || !root || !cheb, DIFF_NULL);
+
+    *cheb = nullptr;
+    size_t hash = treeHash(root);
+    cache->clock++;
+
+    for (size_t i = 0; i < cache->count; i++) {
+        ChebEntry_t* entry = &cache->entries[i];
+        if (entry->hash != hash || entry->cheb.order != order) continue;
+        if (!sameDouble(entry->cheb.left, left) || !sameDouble(entry->cheb.right, right) ||
+            !sameDouble(entry->cheb.tolerance, tolerance)) continue;
+        if (!compareSubtrees(entry->source, root)) continue;
+
+        entry->used = cache->clock;
+        cache->hits++;
+        *cheb = &entry->cheb;
+        return DIFF_OK;
+    }
+
+    cache->misses++;
+
+    ChebEntry_t* entry = &cache->entries[0];
+    if (cache->count < CHEB_CACHE_SIZE) {
+        entry = &cache->entries[cache->count++];
+    } else {
+        for (size_t i = 1; i < cache->count; i++) {
+            if (cache->entries[i].used < entry->used) entry = &cache->entries[i];
+        }
+        chebDtor(&entry->cheb);
+        diffNodeDtor(entry->source);
+        entry->source = nullptr;
+    }
+
+    int err = chebBuild(&entry->cheb, root, order, left, right, tolerance);
+    if (err == DIFF_OK) {
+        entry->source = nodeCopy(root);
+        if (!entry->source) {
+            chebDtor(&entry->cheb);
+            err = DIFF_NO_MEM;
+        }
+    }
+    if (err != DIFF_OK) {
+        // the last entry is given back, others stay in their places
+        *entry = cache->entries[--cache->count];
+        cache->entries[cache->count] = {};
+        return err;
+    }
+
+    entry->hash = hash;
+    entry->used = cache->clock;
+    *cheb = &entry->cheb;
+
+    return DIFF_OK;
+}
+
+void chebCacheDtor(DiffChebCache_t* cache) {
+    if (!cache) return;
+
+    for (size_t i = 0; i < cache->count; i++) {
+        chebDtor(&cache->entries[i].cheb);
+        diffNodeDtor(cache->entries[i].source);
+        cache->entries[i] = {};
+    }
+
+    cache->count  = 0;
+    cache->clock  = 0;
+    cache->hits   = 0;
+    cache->misses = 0;
+}
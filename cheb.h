@@ -0,0 +1,77 @@
+#ifndef CHEB_H
+#define CHEB_H
+
+#include <stdint.h>
+
+#include "column.h"
+
+const int    CHEB_POINTS            = 25;           // Chebyshev nodes of one piece, degree is up to CHEB_POINTS - 1
+
+const int    CHEB_CHECKS            = CHEB_POINTS + 1;  // extrema between nodes (and ends), where fit is compared with f
+
+const size_t CHEB_BATCH             = 32;           // pieces evaluated at once (by CHEB_POINTS + CHEB_CHECKS points)
+
+const size_t CHEB_MAX_PIECES        = 4096;
+
+const double CHEB_MIN_WIDTH         = 1e-9;         // relative to range, narrower pieces are not split anymore
+
+const double CHEB_DEFAULT_TOLERANCE = 1e-10;
+
+const size_t CHEB_CACHE_SIZE        = 32;           // approximants in cache, least recently used is evicted
+
+// polynomial on [left, right] in Chebyshev basis of t = (2x - left - right) / (right - left)
+struct ChebPiece_t {
+    double left   = 0;
+    double right  = 0;
+    double coefs[CHEB_POINTS] = {};
+    int    degree = 0;
+    double error  = 0;          // bound of |p - f| / max(1, |f|), measured at checks and by tail of series
+    bool   exact  = false;      // f is not finite here or is not resolved till CHEB_MIN_WIDTH, tree is evaluated
+};
+
+// Piecewise Chebyshev approximation of f^(order) on [left, right]. Evaluation is binary search of piece
+// and Clenshaw's recurrence, so it doesn't depend on size of tree (except for exact pieces and x out of range).
+struct DiffCheb_t {
+    double       left        = 0;
+    double       right       = 0;
+    int          order       = 0;
+    double       tolerance   = 0;       // relative to max(1, |f|) on piece
+    ChebPiece_t* pieces      = nullptr; // sorted by x
+    size_t       count       = 0;
+    int          maxDegree   = 0;
+    double       error       = 0;       // the biggest relative bound of approximated pieces
+    size_t       exactCount  = 0;
+    size_t       evaluations = 0;       // samples of f, that were taken to build approximation
+    DiffNode_t*  tree        = nullptr; // f^(order) itself, owned
+};
+
+struct ChebEntry_t {
+    size_t      hash   = 0;             // of source expression
+    DiffNode_t* source = nullptr;       // copy of it, owned: hash only finds candidates
+    uint64_t    used   = 0;
+    DiffCheb_t  cheb   = {};
+};
+
+// approximants of expressions by structure, order and exact range and tolerance, not thread safe
+struct DiffChebCache_t {
+    ChebEntry_t entries[CHEB_CACHE_SIZE] = {};
+    size_t      count  = 0;
+    uint64_t    clock  = 0;
+    size_t      hits   = 0;
+    size_t      misses = 0;
+};
+
+// approximants of CLI jobs, they stay till closeLogfile() (so watch mode builds them once)
+extern DiffChebCache_t chebCache;
+
+int chebBuild(DiffCheb_t* cheb, DiffNode_t* root, int order, double left, double right, double tolerance = CHEB_DEFAULT_TOLERANCE);
+
+double chebValue(const DiffCheb_t* cheb, double x);
+
+void chebDtor(DiffCheb_t* cheb);
+
+int chebCacheGet(DiffChebCache_t* cache, DiffNode_t* root, int order, double left, double right, double tolerance, const DiffCheb_t** cheb);
+
+void chebCacheDtor(DiffChebCache_t* cache);
+
+#endif
@@ -0,0 +1,622 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "column.h"
+#include "eval.h"
+#include "libdiff.h"
+#include "poly.h"
+#include "system.h"
+#include "walk.h"
+
+// PROGRAM
+
+struct CompileWalk_t {
+    DiffProgram_t*   program  = nullptr;
+    const PolyMap_t* polys    = nullptr;
+    size_t           capacity = 0;
+    size_t           depth    = 0;
+    bool             failed   = false;
+};
+
+// polynomial goes as one instruction, constant one - as number
+static int compilePoly(ProgInstr_t* instr, const Poly_t* poly, uint32_t* varMask) {
+    if (!poly->var) {
+        instr->type = NUM;
+        instr->num  = poly->coefs[0];
+        return DIFF_OK;
+    }
+    DIFF_CHECK(poly->var < 'a' || poly->var > 'z', DIFF_VALUE_NULL);
+
+    instr->type   = VAR;
+    instr->var    = poly->var - 'a';
+    instr->degree = poly->degree;
+    instr->coefs  = (double*) calloc((size_t) poly->degree + 1, sizeof(double));
+    DIFF_CHECK(!instr->coefs, DIFF_NO_MEM);
+
+    memcpy(instr->coefs, poly->coefs, ((size_t) poly->degree + 1) * sizeof(double));
+    *varMask |= 1u << instr->var;
+
+    return DIFF_OK;
+}
+
+static WalkResult_t compileVisit(DiffNode_t* node, WalkEvent_t event, void* context) {
+    CompileWalk_t* walk    = (CompileWalk_t*) context;
+    DiffProgram_t* program = walk->program;
+
+    const Poly_t* poly = event == WALK_ENTER ? polyMapFind(walk->polys, node) : nullptr;
+    if (!poly && event != WALK_LEAVE) return WALK_NEXT;
+
+    if (program->length >= walk->capacity) {
+        size_t newCapacity = walk->capacity ? walk->capacity * 2 : 64;
+        ProgInstr_t* code = (ProgInstr_t*) realloc(program->code, newCapacity * sizeof(ProgInstr_t));
+        if (!code) {
+            walk->failed = true;
+            return WALK_STOP;
+        }
+
+        program->code  = code;
+        walk->capacity = newCapacity;
+    }
+
+    ProgInstr_t instr = {};
+    instr.type = node->type;
+
+    if (poly) {
+        if (compilePoly(&instr, poly, &program->varMask) != DIFF_OK) {
+            walk->failed = true;
+            return WALK_STOP;
+        }
+
+        program->code[program->length++] = instr;
+        program->maxStack = max(program->maxStack, ++walk->depth);
+        return WALK_SKIP;
+    }
+
+    switch (node->type) {
+        case NUM:
+            instr.num = node->value.num;
+            walk->depth++;
+            break;
+        case VAR:
+            if (node->value.var < 'a' || node->value.var > 'z') {
+                walk->failed = true;
+                return WALK_STOP;
+            }
+
+            instr.var = node->value.var - 'a';
+            program->varMask |= 1u << instr.var;
+            walk->depth++;
+            break;
+        case OP:
+            instr.opt = node->value.opt;
+            // binary operator takes two columns and puts one
+            if (node->left) walk->depth--;
+            break;
+        case NODET_DEFAULT:
+        default:
+            walk->failed = true;
+            return WALK_STOP;
+    }
+
+    program->code[program->length++] = instr;
+    program->maxStack = max(program->maxStack, walk->depth);
+
+    return WALK_NEXT;
+}
+
+int programCompile(DiffProgram_t* program, DiffNode_t* tree) {
+    DIFF_CHECK(!program || !tree, DIFF_NULL);
+
+    *program = {};
+
+    PolyMap_t polys = {};
+    polyMapCtor(&polys, tree);
+
+    CompileWalk_t walk = {};
+    walk.program = program;
+    walk.polys   = &polys;
+
+    int err = treeWalk(tree, compileVisit, &walk);
+    polyMapDtor(&polys);
+
+    if (err != DIFF_OK || walk.failed || walk.depth != 1) {
+        programDtor(program);
+        return DIFF_VALUE_NULL;
+    }
+
+    return DIFF_OK;
+}
+
+void programDtor(DiffProgram_t* program) {
+    if (!program) return;
+
+    for (size_t pc = 0; pc < program->length; pc++) free(program->code[pc].coefs);
+    free(program->code);
+    *program = {};
+}
+
+// stack has place for maxStack columns of count rows, vars[i] - column of variable 'a' + i
+void programEvalBlock(const DiffProgram_t* program, const double* const* vars, size_t count, double* stack, double* result) {
+    programEval(program, vars, count, stack, result);
+}
+
+// OUTPUTS
+
+static int addOutput(ColumnOutput_t* outputs, int* outputCount, DiffNode_t* tree, const char* name, DiffSystem_t* system) {
+    ColumnOutput_t* output = &outputs[*outputCount];
+    snprintf(output->name, sizeof(output->name), "%s", name);
+
+    int err = programCompile(&output->program, tree);
+    if (err == DIFF_OK && system) {
+        err = systemAddOutput(system, tree);
+        if (err != DIFF_OK) programDtor(&output->program);
+    }
+    if (err == DIFF_OK) (*outputCount)++;
+
+    return err;
+}
+
+// expression goes as f<index>, its partial derivatives as f<index>_da, f<index>_db, ...
+// Jacobian is sparse: partials by variables, that are not in simplified expression, are not built at all
+static int addExpression(ColumnOutput_t* outputs, int* outputCount, const char* text, int index, bool gradient,
+                         DiffSystem_t* system) {
+    DiffNode_t* tree = nullptr;
+    size_t errorPos = 0;
+    if (diffParse(text, &tree, &errorPos) != DIFF_OK) {
+        fprintf(stderr, "Syntax error in expression %d: (pos=%zu) %s\n", index, errorPos, text + errorPos);
+        return DIFF_SYNTAX;
+    }
+    diffSimplify(tree);
+
+    char name[MAX_COLUMN_NAME] = "";
+    snprintf(name, sizeof(name), "f%d", index);
+
+    int err = addOutput(outputs, outputCount, tree, name, system);
+    uint32_t varMask = err == DIFF_OK ? outputs[*outputCount - 1].program.varMask : 0;
+
+    for (int var = 0; var < VAR_COUNT && gradient && err == DIFF_OK; var++) {
+        if (!(varMask & (1u << var))) continue;
+
+        DiffNode_t* partial = nodeDiff(tree, nullptr, (char) ('a' + var));
+        if (!partial) {
+            err = DIFF_NO_MEM;
+            break;
+        }
+        diffSimplify(partial);
+
+        snprintf(name, sizeof(name), "f%d_d%c", index, 'a' + var);
+        err = addOutput(outputs, outputCount, partial, name, system);
+        diffFree(partial);
+    }
+
+    diffFree(tree);
+    if (err != DIFF_OK) fprintf(stderr, "Can't compile expression %d (only variables a..z are allowed)\n", index);
+
+    return err;
+}
+
+// expressions of --expr, then lines of system file; with system they are also merged into one DAG
+int columnOutputsCtor(ColumnOutput_t* outputs, int* outputCount, const ColumnOptions_t* options, DiffSystem_t* system) {
+    DIFF_CHECK(!outputs || !outputCount || !options, DIFF_NULL);
+
+    *outputCount = 0;
+    int exprCount = 0;
+
+    for (int i = 0; i < options->exprCount; i++) {
+        int err = addExpression(outputs, outputCount, options->exprs[i], exprCount++, options->gradient, system);
+        if (err != DIFF_OK) return err;
+    }
+
+    if (options->systemPath) {
+        FILE* file = fopen(options->systemPath, "r");
+        if (!file) {
+            fprintf(stderr, "File %s not found!\n", options->systemPath);
+            return DIFF_FILE_NULL;
+        }
+
+        int  err = DIFF_OK;
+        char line[MAX_WORD_LENGTH] = "";
+        while (err == DIFF_OK && fgets(line, sizeof(line), file)) {
+            line[strcspn(line, "\r\n")] = '\0';
+            if (!*line) continue;
+
+            if (exprCount >= MAX_COLUMN_EXPRS) {
+                fprintf(stderr, "Too many expressions in %s (at most %d)\n", options->systemPath, MAX_COLUMN_EXPRS);
+                err = DIFF_VALUE_NULL;
+                break;
+            }
+
+            err = addExpression(outputs, outputCount, line, exprCount++, options->gradient, system);
+        }
+
+        fclose(file);
+        if (err != DIFF_OK) return err;
+    }
+
+    return system ? systemFinish(system) : DIFF_OK;
+}
+
+void columnOutputsDtor(ColumnOutput_t* outputs, int outputCount) {
+    if (!outputs) return;
+
+    for (int i = 0; i < outputCount; i++) programDtor(&outputs[i].program);
+}
+
+// BLOCKS
+
+// buffers for one block: columns of variables, stack of programs and results of every output
+struct ColumnBlock_t {
+    double*      vars[VAR_COUNT]              = {};
+    double*      results[MAX_COLUMN_OUTPUTS]  = {};
+    double*      stack    = nullptr;
+    size_t       size     = 0;
+    ScalarType_t scalar   = SCALAR_DOUBLE;
+    void*        scratch  = nullptr;      // variables, stack and result in scalar type, if it is not double
+
+    const DiffSystem_t* system = nullptr; // all the outputs are evaluated by one pass over its DAG
+    double*             slots  = nullptr;
+};
+
+static int columnBlockCtor(ColumnBlock_t* block, const ColumnOutput_t* outputs, int outputCount, uint32_t varMask, size_t size,
+                           ScalarType_t scalar, const DiffSystem_t* system) {
+    size_t   maxStack = 1;
+    uint32_t used     = 0;
+    for (int i = 0; i < outputCount; i++) {
+        maxStack = max(maxStack, outputs[i].program.maxStack);
+        used    |= outputs[i].program.varMask;
+    }
+
+    block->size   = size;
+    block->scalar = scalar;
+    block->stack  = (double*) calloc(maxStack * size, sizeof(double));
+    DIFF_CHECK(!block->stack, DIFF_NO_MEM);
+
+    if (system) {
+        block->system = system;
+        block->slots  = (double*) calloc(max(1, system->slotCount) * size, sizeof(double));
+        DIFF_CHECK(!block->slots, DIFF_NO_MEM);
+    }
+
+    if (scalar != SCALAR_DOUBLE) {
+        size_t columns = (size_t) __builtin_popcount(used) + maxStack + 1;
+        block->scratch = calloc(columns * size, sizeof(long double));
+        DIFF_CHECK(!block->scratch, DIFF_NO_MEM);
+    }
+
+    for (int var = 0; var < VAR_COUNT; var++) {
+        if (!(varMask & (1u << var))) continue;
+
+        block->vars[var] = (double*) calloc(size, sizeof(double));
+        DIFF_CHECK(!block->vars[var], DIFF_NO_MEM);
+    }
+    for (int i = 0; i < outputCount; i++) {
+        block->results[i] = (double*) calloc(size, sizeof(double));
+        DIFF_CHECK(!block->results[i], DIFF_NO_MEM);
+    }
+
+    return DIFF_OK;
+}
+
+static void columnBlockDtor(ColumnBlock_t* block) {
+    for (int var = 0; var < VAR_COUNT; var++)         free(block->vars[var]);
+    for (int i = 0; i < MAX_COLUMN_OUTPUTS; i++)     free(block->results[i]);
+    free(block->stack);
+    free(block->scratch);
+    free(block->slots);
+}
+
+static uint32_t outputsVarMask(const ColumnOutput_t* outputs, int outputCount) {
+    uint32_t varMask = 0;
+    for (int i = 0; i < outputCount; i++) varMask |= outputs[i].program.varMask;
+
+    return varMask;
+}
+
+// pages of input, that are already evaluated, are given back, so only current blocks stay in memory
+static void releaseMapped(const char* base, size_t from, size_t to) {
+    size_t page = (size_t) sysconf(_SC_PAGESIZE);
+
+    from = (from + page - 1) / page * page;
+    to   = to / page * page;
+    if (to > from) madvise(const_cast<char*>(base + from), to - from, MADV_DONTNEED);
+}
+
+static const char* mapFile(const char* path, size_t* size) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return nullptr;
+
+    struct stat fileStat = {};
+    if (fstat(fd, &fileStat) < 0 || fileStat.st_size <= 0) {
+        close(fd);
+        return nullptr;
+    }
+
+    *size = (size_t) fileStat.st_size;
+    void* mapped = mmap(nullptr, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) return nullptr;
+
+    madvise(mapped, *size, MADV_SEQUENTIAL);
+    return (const char*) mapped;
+}
+
+// CSV
+
+// fields of line are separated by commas, returns pointer after the line
+static const char* csvField(const char* cur, const char* end, char* field, bool* lineEnd) {
+    size_t length = 0;
+    while (cur < end && *cur != ',' && *cur != '\n') {
+        if (*cur != '\r' && *cur != ' ' && length + 1 < MAX_CSV_FIELD) field[length++] = *cur;
+        cur++;
+    }
+    field[length] = '\0';
+
+    *lineEnd = cur >= end || *cur == '\n';
+    return cur < end ? cur + 1 : cur;
+}
+
+static void writeCsvBlock(FILE* file, const ColumnBlock_t* block, int outputCount, size_t rows) {
+    for (size_t row = 0; row < rows; row++) {
+        for (int i = 0; i < outputCount; i++) {
+            fprintf(file, "%s%.17lg", i ? "," : "", block->results[i][row]);
+        }
+        fputc('\n', file);
+    }
+}
+
+// variables are converted to T, program is evaluated in T and result is converted back
+template <typename T>
+static void evalConverted(const DiffProgram_t* program, const double* const* vars, size_t count, void* scratch, double* result) {
+    T* columns = (T*) scratch;
+    const T* typedVars[VAR_COUNT] = {};
+
+    for (int var = 0; var < VAR_COUNT; var++) {
+        if (!(program->varMask & (1u << var))) continue;
+
+        for (size_t i = 0; i < count; i++) columns[i] = static_cast<T>(vars[var][i]);
+        typedVars[var] = columns;
+        columns += count;
+    }
+
+    T* typed = columns;
+    programEval(program, typedVars, count, typed + count, typed);
+
+    for (size_t i = 0; i < count; i++) result[i] = static_cast<double>(typed[i]);
+}
+
+static void evalProgram(ColumnBlock_t* block, const DiffProgram_t* program, const double* const* vars, size_t count, double* result) {
+    switch (block->scalar) {
+        case SCALAR_FLOAT:
+            evalConverted<float>(program, vars, count, block->scratch, result);
+            break;
+        case SCALAR_LONG_DOUBLE:
+            evalConverted<long double>(program, vars, count, block->scratch, result);
+            break;
+        case SCALAR_DOUBLE:
+        default:
+            programEvalBlock(program, vars, count, block->stack, result);
+            break;
+    }
+}
+
+static void evalBlock(ColumnBlock_t* block, const ColumnOutput_t* outputs, int outputCount, const double* const* vars, size_t rows) {
+    if (block->system) {
+        systemEval(block->system, vars, rows, block->slots, block->results);
+        return;
+    }
+
+    for (int i = 0; i < outputCount; i++) {
+        evalProgram(block, &outputs[i].program, vars, rows, block->results[i]);
+    }
+}
+
+// DAG is shared by outputs only in doubles and only when there is something to share
+static DiffSystem_t* columnSystemCtor(DiffSystem_t* system, const ColumnOptions_t* options) {
+    bool several = options->gradient || options->systemPath || options->exprCount > 1;
+    if (options->scalar != SCALAR_DOUBLE || !several) return nullptr;
+
+    return systemCtor(system) == DIFF_OK ? system : nullptr;
+}
+
+// header names columns, variable 'x' is taken from column "x"
+int evalCsvColumns(const char* inPath, const char* outPath, const ColumnOptions_t* options) {
+    DIFF_CHECK(!inPath || !outPath || !options, DIFF_NULL);
+
+    ColumnOutput_t* outputs = (ColumnOutput_t*) calloc(MAX_COLUMN_OUTPUTS, sizeof(ColumnOutput_t));
+    DIFF_CHECK(!outputs, DIFF_NO_MEM);
+
+    DiffSystem_t  systemData = {};
+    DiffSystem_t* system     = columnSystemCtor(&systemData, options);
+
+    int outputCount = 0;
+    int err = columnOutputsCtor(outputs, &outputCount, options, system);
+
+    size_t      size   = 0;
+    const char* mapped = err == DIFF_OK ? mapFile(inPath, &size) : nullptr;
+    FILE*       file   = mapped ? fopen(outPath, "w") : nullptr;
+    if (err == DIFF_OK && !file) err = DIFF_FILE_NULL;
+
+    ColumnBlock_t block = {};
+    uint32_t varMask = outputsVarMask(outputs, outputCount);
+    if (err == DIFF_OK) err = columnBlockCtor(&block, outputs, outputCount, varMask, max(1, options->block), options->scalar, system);
+
+    // column of every variable
+    int   columnVar[MAX_WORD_LENGTH] = {};
+    int   columnCount = 0;
+    char  field[MAX_CSV_FIELD] = "";
+    bool  lineEnd = false;
+
+    const char* cur = mapped;
+    const char* end = mapped + size;
+
+    if (err == DIFF_OK) {
+        uint32_t found = 0;
+        do {
+            cur = csvField(cur, end, field, &lineEnd);
+            int var = strlen(field) == 1 && 'a' <= field[0] && field[0] <= 'z' ? field[0] - 'a' : -1;
+
+            if (columnCount < MAX_WORD_LENGTH) columnVar[columnCount++] = var;
+            if (var >= 0) found |= 1u << var;
+        } while (!lineEnd);
+
+        if ((found & varMask) != varMask) {
+            fprintf(stderr, "Not every variable of expressions has column in %s\n", inPath);
+            err = DIFF_VALUE_NULL;
+        }
+    }
+
+    if (err == DIFF_OK) {
+        for (int i = 0; i < outputCount; i++) fprintf(file, "%s%s", i ? "," : "", outputs[i].name);
+        fputc('\n', file);
+    }
+
+    size_t rows = 0, line = 1;
+    const char* released = mapped;
+
+    while (err == DIFF_OK && cur < end) {
+        line++;
+        if (*cur == '\n' || *cur == '\r') {
+            cur++;
+            continue;
+        }
+
+        uint32_t read = 0;
+        int column = 0;
+        do {
+            cur = csvField(cur, end, field, &lineEnd);
+
+            int var = column < columnCount ? columnVar[column] : -1;
+            if (var >= 0 && (varMask & (1u << var))) {
+                char* fieldEnd = nullptr;
+                block.vars[var][rows] = strtod(field, &fieldEnd);
+                if (fieldEnd != field && !*fieldEnd) read |= 1u << var;
+            }
+            column++;
+        } while (!lineEnd);
+
+        if ((read & varMask) != varMask) {
+            fprintf(stderr, "Incorrect numbers in line %zu of %s\n", line, inPath);
+            err = DIFF_VALUE_NULL;
+            break;
+        }
+
+        if (++rows == block.size) {
+            evalBlock(&block, outputs, outputCount, block.vars, rows);
+            writeCsvBlock(file, &block, outputCount, rows);
+            rows = 0;
+
+            releaseMapped(mapped, (size_t) (released - mapped), (size_t) (cur - mapped));
+            released = cur;
+        }
+    }
+
+    if (err == DIFF_OK && rows) {
+        evalBlock(&block, outputs, outputCount, block.vars, rows);
+        writeCsvBlock(file, &block, outputCount, rows);
+    }
+
+    if (file && fclose(file) != 0 && err == DIFF_OK) err = DIFF_FILE_NULL;
+    if (mapped) munmap(const_cast<char*>(mapped), size);
+    else if (err == DIFF_OK) err = DIFF_FILE_NULL;
+
+    columnBlockDtor(&block);
+    columnOutputsDtor(outputs, outputCount);
+    systemDtor(system);
+    free(outputs);
+
+    return err;
+}
+
+// BINARY
+
+// every variable is file <dir>/<var>.f64 with raw doubles, every output goes to <dir>/<name>.f64
+int evalBinaryColumns(const char* inDir, const char* outDir, const ColumnOptions_t* options) {
+    DIFF_CHECK(!inDir || !outDir || !options, DIFF_NULL);
+
+    ColumnOutput_t* outputs = (ColumnOutput_t*) calloc(MAX_COLUMN_OUTPUTS, sizeof(ColumnOutput_t));
+    DIFF_CHECK(!outputs, DIFF_NO_MEM);
+
+    DiffSystem_t  systemData = {};
+    DiffSystem_t* system     = columnSystemCtor(&systemData, options);
+
+    int outputCount = 0;
+    int err = columnOutputsCtor(outputs, &outputCount, options, system);
+
+    uint32_t    varMask = outputsVarMask(outputs, outputCount);
+    const char* mapped[VAR_COUNT] = {};
+    size_t      sizes [VAR_COUNT] = {};
+    size_t      rows = SIZE_MAX;
+
+    char path[MAX_WORD_LENGTH] = "";
+    for (int var = 0; var < VAR_COUNT && err == DIFF_OK; var++) {
+        if (!(varMask & (1u << var))) continue;
+
+        snprintf(path, sizeof(path), "%s/%c.f64", inDir, 'a' + var);
+        mapped[var] = mapFile(path, &sizes[var]);
+        if (!mapped[var] || (rows != SIZE_MAX && rows != sizes[var] / sizeof(double))) {
+            fprintf(stderr, "Can't read column %s (or its size differs)\n", path);
+            err = DIFF_FILE_NULL;
+        }
+        rows = sizes[var] / sizeof(double);
+    }
+    if (err == DIFF_OK && rows == SIZE_MAX) {
+        fprintf(stderr, "Expressions have no variables, number of rows is unknown\n");
+        err = DIFF_VALUE_NULL;
+    }
+
+    if (err == DIFF_OK && mkdir(outDir, 0755) < 0 && errno != EEXIST) err = DIFF_FILE_NULL;
+
+    FILE* files[MAX_COLUMN_OUTPUTS] = {};
+    for (int i = 0; i < outputCount && err == DIFF_OK; i++) {
+        snprintf(path, sizeof(path), "%s/%s.f64", outDir, outputs[i].name);
+        files[i] = fopen(path, "wb");
+        if (!files[i]) err = DIFF_FILE_NULL;
+    }
+
+    // variables are read right from mapped files, so block needs only stack and results
+    ColumnBlock_t block = {};
+    if (err == DIFF_OK) err = columnBlockCtor(&block, outputs, outputCount, 0, max(1, options->block), options->scalar, system);
+
+    const double* vars[VAR_COUNT] = {};
+    for (size_t start = 0; err == DIFF_OK && start < rows; start += block.size) {
+        size_t count = rows - start < block.size ? rows - start : block.size;
+
+        for (int var = 0; var < VAR_COUNT; var++) {
+            if (mapped[var]) vars[var] = (const double*) mapped[var] + start;
+        }
+
+        evalBlock(&block, outputs, outputCount, vars, count);
+        for (int i = 0; i < outputCount && err == DIFF_OK; i++) {
+            if (fwrite(block.results[i], sizeof(double), count, files[i]) != count) err = DIFF_FILE_NULL;
+        }
+
+        for (int var = 0; var < VAR_COUNT; var++) {
+            if (mapped[var]) releaseMapped(mapped[var], start * sizeof(double), (start + count) * sizeof(double));
+        }
+    }
+
+    for (int i = 0; i < outputCount; i++) {
+        if (files[i] && fclose(files[i]) != 0 && err == DIFF_OK) err = DIFF_FILE_NULL;
+    }
+    for (int var = 0; var < VAR_COUNT; var++) {
+        if (mapped[var]) munmap(const_cast<char*>(mapped[var]), sizes[var]);
+    }
+
+    columnBlockDtor(&block);
+    columnOutputsDtor(outputs, outputCount);
+    systemDtor(system);
+    free(outputs);
+
+    return err;
+}
+
+int evalColumns(const char* in, const char* out, const ColumnOptions_t* options) {
+    DIFF_CHECK(!in || !out || !options, DIFF_NULL);
+
+    size_t length = strlen(in);
+    if (length > 4 && !strcmp(in + length - 4, ".csv")) return evalCsvColumns(in, out, options);
+
+    return evalBinaryColumns(in, out, options);
+}
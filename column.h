@@ -0,0 +1,69 @@
+#ifndef COLUMN_H
+#define COLUMN_H
+
+#include <stdint.h>
+
+#include "diff.h"
+#include "scalar.h"
+
+const int    VAR_COUNT            = 26;             // variables 'a'..'z'
+const size_t DEFAULT_COLUMN_BLOCK = 4096;           // rows evaluated at once
+const int    MAX_COLUMN_EXPRS     = 16;
+const int    MAX_COLUMN_OUTPUTS   = MAX_COLUMN_EXPRS * (VAR_COUNT + 1);
+const int    MAX_COLUMN_NAME      = 64;
+const int    MAX_CSV_FIELD        = 128;
+
+// one instruction of postfix program: push number or variable, or apply operator to top of stack,
+// variable with coefs is a polynomial of it, evaluated by Horner's method
+struct ProgInstr_t {
+    NodeType_t type   = NODET_DEFAULT;
+    OpType_t   opt    = OPT_DEFAULT;
+    int        var    = 0;              // index of variable, 0 for 'a'
+    double     num    = 0;
+    double*    coefs  = nullptr;        // owned by program
+    int        degree = 0;
+};
+
+// Tree compiled to postfix form, it is evaluated over whole blocks of rows:
+// every stack slot is a column of block, so inner loops are plain loops over arrays.
+struct DiffProgram_t {
+    ProgInstr_t* code     = nullptr;
+    size_t       length   = 0;
+    size_t       maxStack = 0;
+    uint32_t     varMask  = 0;          // bit i - program reads variable 'a' + i
+};
+
+// expression or its partial derivative, that goes to output column
+struct ColumnOutput_t {
+    char          name[MAX_COLUMN_NAME] = "";
+    DiffProgram_t program = {};
+};
+
+struct ColumnOptions_t {
+    const char* exprs[MAX_COLUMN_EXPRS] = {};
+    int         exprCount = 0;
+    const char* systemPath = nullptr;   // file with one expression per line, they go after exprs
+    bool        gradient  = false;      // partial derivatives by every used variable
+    size_t      block     = DEFAULT_COLUMN_BLOCK;
+    ScalarType_t scalar   = SCALAR_DOUBLE;  // programs are evaluated in this type, columns stay double
+};
+
+int programCompile(DiffProgram_t* program, DiffNode_t* tree);
+
+void programDtor(DiffProgram_t* program);
+
+void programEvalBlock(const DiffProgram_t* program, const double* const* vars, size_t count, double* stack, double* result);
+
+struct DiffSystem_t;
+
+int columnOutputsCtor(ColumnOutput_t* outputs, int* outputCount, const ColumnOptions_t* options, DiffSystem_t* system = nullptr);
+
+void columnOutputsDtor(ColumnOutput_t* outputs, int outputCount);
+
+int evalCsvColumns(const char* inPath, const char* outPath, const ColumnOptions_t* options);
+
+int evalBinaryColumns(const char* inDir, const char* outDir, const ColumnOptions_t* options);
+
+int evalColumns(const char* in, const char* out, const ColumnOptions_t* options);
+
+#endif
@@ -1,12 +1,58 @@
-#include "diff.h"
+#include <sys/mman.h>
+#include <unistd.h>
 
-FILE* texFile = nullptr;
-int   onClose = atexit(closeLogfile);
+#include "diff.h"
+#include "budget.h"
+#include "cache.h"
+#include "cheb.h"
+#include "dump.h"
+#include "emit.h"
+#include "eval.h"
+#include "integral.h"
+#include "oper.h"
+#include "poly.h"
+#include "profile.h"
+#include "render.h"
+#include "replace.h"
+#include "report.h"
+#include "roots.h"
+#include "serial.h"
+#include "steps.h"
+#include "walk.h"
+#include "watch.h"
+
+FILE* texFile   = nullptr;
+FILE* traceFile = nullptr;
+
+DiffChebCache_t chebCache = {};
+
+DiffOptions_t diffOptions = {};
+DiffCache_t   jobCache    = {};
+DiffBudget_t  jobBudget   = {};
+
+DiffStats_t diffStats = {};
+
+// freed nodes of this thread, reused by next diffNodeCtor (turned on by long-living server workers)
+struct NodePool_t {
+    DiffNode_t* first = nullptr;
+    size_t      count = 0;
+    size_t      limit = 0;
+};
+
+static thread_local NodePool_t nodePool = {};
+
+RenderQueue_t* renderQueue = nullptr;
+char           texPath[MAX_ARTIFACT_LENGTH] = "";
+
+// letters are shared by all the steps of derivation
+ReplTable_t texLetters = {};
 
 DiffNode_t* newNodeOper(OpType_t oper, DiffNode_t* left, DiffNode_t* right) {
     if (!right) return nullptr;
 
     DiffNode_t* node = diffNodeCtor(left, right, nullptr);
+    if (!node) return nullptr;
+
     node->type = OP;
     node->value.opt = oper;
 
@@ -16,7 +62,16 @@ DiffNode_t* newNodeOper(OpType_t oper, DiffNode_t* left, DiffNode_t* right) {
 // SUPPORT
 
 DiffNode_t* diffNodeCtor(DiffNode_t* left, DiffNode_t* right, DiffNode_t* prev, int* err) {
-    DiffNode_t* diffNode = (DiffNode_t*) calloc(1, sizeof(DiffNode_t));
+    DiffNode_t* diffNode = nodePool.first;
+    if (diffNode) {
+        nodePool.first = diffNode->left;
+        nodePool.count--;
+        __builtin_prefetch(nodePool.first, 1);
+        *diffNode = {};
+    } else {
+        diffNode = (DiffNode_t*) calloc(1, sizeof(DiffNode_t));
+    }
+
     if (!diffNode) {
         if (err) *err |= DIFF_NO_MEM;
         return nullptr;
@@ -26,9 +81,53 @@ DiffNode_t* diffNodeCtor(DiffNode_t* left, DiffNode_t* right, DiffNode_t* prev,
     diffNode->right = right;
     diffNode->prev  = prev;
 
+    if (diffStats.enabled) {
+        size_t live = diffStats.allocated.fetch_add(1, std::memory_order_relaxed) + 1
+                    - diffStats.freed.load(std::memory_order_relaxed);
+        size_t peak = diffStats.peak.load(std::memory_order_relaxed);
+        while (live > peak && !diffStats.peak.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {}
+    }
+
+    budgetNodeAlloc(diffBudget);
     return diffNode;
 }
 
+// frees only one node, not its subtree
+void diffNodeFree(DiffNode_t* node) {
+    if (!node) return;
+
+    if (diffStats.enabled) diffStats.freed.fetch_add(1, std::memory_order_relaxed);
+    budgetNodeFree(diffBudget);
+
+    if (nodePool.count < nodePool.limit) {
+        node->left     = nodePool.first;
+        nodePool.first = node;
+        nodePool.count++;
+        return;
+    }
+
+    free(node);
+}
+
+// how many freed nodes current thread keeps for reuse, 0 turns pool off and frees everything in it
+void diffNodePool(size_t limit) {
+    nodePool.limit = limit;
+
+    while (nodePool.count > limit) {
+        DiffNode_t* node = nodePool.first;
+        nodePool.first = node->left;
+        nodePool.count--;
+        free(node);
+    }
+}
+
+void diffStatsReset(void) {
+    diffStats.allocated = 0;
+    diffStats.freed     = 0;
+    diffStats.copied    = 0;
+    diffStats.peak      = 0;
+}
+
 DiffNode_t* newNumNode(DiffNode_t* left, DiffNode_t* right, DiffNode_t* prev, double value) {
     DiffNode_t* node = diffNodeCtor(left, right, prev);
     node->type      = NUM;
@@ -38,7 +137,7 @@ DiffNode_t* newNumNode(DiffNode_t* left, DiffNode_t* right, DiffNode_t* prev, do
 }
 
 bool compDouble(const double value1, const double value2) {
-    return fabs(value1 - value2) < EPSILON;
+    return scalarEqual(value1, value2);
 }
 
 size_t max(size_t first, size_t second) {
@@ -46,31 +145,57 @@ size_t max(size_t first, size_t second) {
     return second;
 }
 
-size_t getTreeDepth(DiffNode_t* node) {
+// 0 and DIFF_NO_MEM in err, when stack can't grow
+size_t getTreeDepth(DiffNode_t* node, int* err) {
     if (!node) return 0;
-    
-    size_t leftNode  = getTreeDepth(node->left);
-    size_t rightNode = getTreeDepth(node->right);
 
-    return max(leftNode, rightNode) + 1;
-}
+    WalkStack_t stack = {};
+    walkStackCtor(&stack);
+    int error = walkStackPush(&stack, node, 1);
 
-size_t getMaxTreeWidth(DiffNode_t* node) {
-    size_t height = getTreeDepth(node);
-    size_t maxW = 1;
+    size_t depth = 0;
+    while (error == DIFF_OK && stack.count) {
+        WalkFrame_t frame = stack.frames[--stack.count];
+        depth = max(depth, frame.state);
 
-    for (size_t i = 1; i <= height; i++) {
-        size_t w = getTreeWidth(node);
-        maxW = max(maxW, w);
+        if (frame.node->left)                      error = walkStackPush(&stack, frame.node->left,  frame.state + 1);
+        if (error == DIFF_OK && frame.node->right) error = walkStackPush(&stack, frame.node->right, frame.state + 1);
     }
 
-    return maxW;
+    walkStackDtor(&stack);
+    if (err && error != DIFF_OK) *err = error;
+    return error == DIFF_OK ? depth : 0;
 }
 
+size_t getMaxTreeWidth(DiffNode_t* node) {
+    return max(1, getTreeWidth(node));
+}
+
+// count of empty children, binary tree of n nodes has n + 1 of them
 size_t getTreeWidth(DiffNode_t* node) {
-    if (!node) return 1;
+    return getTreeSize(node) + 1;
+}
+
+// 0 and DIFF_NO_MEM in err, when stack can't grow
+size_t getTreeSize(DiffNode_t* node, int* err) {
+    if (!node) return 0;
+
+    WalkStack_t stack = {};
+    walkStackCtor(&stack);
+    int error = walkStackPush(&stack, node);
+
+    size_t size = 0;
+    while (error == DIFF_OK && stack.count) {
+        DiffNode_t* current = stack.frames[--stack.count].node;
+        size++;
+
+        if (current->left)                      error = walkStackPush(&stack, current->left);
+        if (error == DIFF_OK && current->right) error = walkStackPush(&stack, current->right);
+    }
 
-    return getTreeWidth(L(node)) + getTreeWidth(R(node));
+    walkStackDtor(&stack);
+    if (err && error != DIFF_OK) *err = error;
+    return error == DIFF_OK ? size : 0;
 }
 
 bool isNodeInList(const DiffNode_t* node, DiffNode_t** replaced, const int* replacedIndex) {
@@ -83,24 +208,17 @@ bool isNodeInList(const DiffNode_t* node, DiffNode_t** replaced, const int* repl
     return false;
 }
 
-bool compareSubtrees(DiffNode_t* node1, DiffNode_t* node2) {
-    if (!node1 || !node2) return false;
-
+static bool compareNodes(const DiffNode_t* node1, const DiffNode_t* node2) {
     if (node1->type != node2->type) return false;
 
     switch (node1->type) {
             case OP:
-                if (node1->value.opt == node2->value.opt) {
-                    if (node1->right && node2->right) return compareSubtrees(node1->right, node2->right);
-                    if (node2->left  && node2->left)  return compareSubtrees(node1->left,  node2->left);
-                }
-                break;
+                if (node1->value.opt != node2->value.opt)                   return false;
+                return !node1->left == !node2->left && !node1->right == !node2->right;
             case NUM:
-                if (compDouble(node1->value.num, node2->value.num)) return true;
-                break;
+                return compDouble(node1->value.num, node2->value.num);
             case VAR:
-                if (node1->value.var == node2->value.var) return true;
-                break;
+                return node1->value.var == node2->value.var;
             case NODET_DEFAULT:
             default:
                 break;
@@ -108,6 +226,27 @@ bool compareSubtrees(DiffNode_t* node1, DiffNode_t* node2) {
     return false;
 }
 
+bool compareSubtrees(DiffNode_t* node1, DiffNode_t* node2) {
+    if (!node1 || !node2) return false;
+
+    WalkStack_t stack = {};
+    walkStackCtor(&stack);
+    bool equal = walkStackPush(&stack, node1, 0, node2) == DIFF_OK;
+
+    while (equal && stack.count) {
+        WalkFrame_t frame = stack.frames[--stack.count];
+
+        equal = compareNodes(frame.node, frame.other);
+        if (!equal) break;
+
+        if (frame.node->left  && walkStackPush(&stack, frame.node->left,  0, frame.other->left)  != DIFF_OK) equal = false;
+        if (frame.node->right && walkStackPush(&stack, frame.node->right, 0, frame.other->right) != DIFF_OK) equal = false;
+    }
+
+    walkStackDtor(&stack);
+    return equal;
+}
+
 size_t factorial(int POW_OP) {
     size_t res = 1;
     for (int i = 2; i <= POW_OP; i++) {
@@ -124,11 +263,14 @@ size_t factorial(int POW_OP) {
 // T    = ST{['*' | '/']ST}*
 // ST   = P{[^]P}*
 // P    = '(' E ')' | X
-// X    = ['a'-'z' | sin P | cos P | ln P] | N
+// X    = ['a'-'z' | F P] | N
+// F    = name of function from DIFF_OPERS (sin, cos, ln, tan, exp, sqrt, ...)
 // N    = ['0'-'9']+
 
 DiffNode_t* setOper(DiffNode_t* val1, DiffNode_t* val2, OpType_t oper) {
     DiffNode_t* operVal = diffNodeCtor(nullptr, nullptr, nullptr);
+    if (!operVal) return nullptr;
+
     operVal->type = OP;
     operVal->value.opt = oper;
     L(operVal) = val1;
@@ -140,37 +282,22 @@ DiffNode_t* setOper(DiffNode_t* val1, DiffNode_t* val2, OpType_t oper) {
 DiffNode_t* getN(char** s) {
     if (!s || !(*s)) return nullptr;
 
-    double val = 0;
-    int pointCount = 0, fracNumsCount = 1;
     const char* oldS = *s;
+    if (**s == '-') (*s)++;
 
-    bool hasFract = false;
-    bool isNeg = false;
-    if (**s == '-') {
-        isNeg = true;
-        (*s)++;
-    }
-
+    int pointCount = 0;
     while (('0' <= **s && '9' >= **s) || **s == '.') {
-        if (pointCount >= 2) {
-            fprintf(stderr, "Incorrect number format.\n");
-            return nullptr;
-        }
-        if (**s == '.') {
-            hasFract = true;
-            pointCount++;
-        } else if (hasFract) {
-            val += (**s - '0') / (pow(10, fracNumsCount++));
-        }else {
-            val = val * 10 + (**s - '0');
-        }
-
+        if (**s == '.' && ++pointCount >= 2) return nullptr;
         (*s)++;
     }
 
-    if (isNeg) val *= -1;
+    size_t length = (size_t) (*s - oldS);
+    if (!length || length >= DIFF_NUMBER_SIZE) return nullptr;
 
-    if(*s == oldS) return nullptr;
+    // strtod() rounds correctly, so printed number is read back to the same double
+    char text[DIFF_NUMBER_SIZE] = "";
+    memcpy(text, oldS, length);
+    double val = strtod(text, nullptr);
 
     DiffNode_t* numNode = diffNodeCtor(nullptr, nullptr, nullptr);
     numNode->type = NUM;
@@ -179,148 +306,185 @@ DiffNode_t* getN(char** s) {
     return numNode;
 }
 
-DiffNode_t* getP(char** s) {
-    if (!s || !(*s)) return nullptr;
-
-    DiffNode_t* val = nullptr;
-    if (**s == '(') {
-        (*s)++;
-        val = getE(s);
-        if(**s != ')') return nullptr;
-        (*s)++;
-    } else {
-        return getX(s);
-    }
-
-    return val;
+// bracket is not an operator, it has the lowest priority
+static int operPriority(uint32_t oper) {
+    return oper < (uint32_t) OP_COUNT ? DIFF_OPERS[oper].priority : 0;
 }
 
-DiffNode_t* parseTrig(OpType_t oper, char** s) {
-    if (!s || !(*s)) return nullptr;
-
-    DiffNode_t* rightNode = getP(s);
-    return setOper(nullptr, rightNode, oper);
+static bool isPrefixOper(uint32_t oper) {
+    return oper < (uint32_t) OP_COUNT && DIFF_OPERS[oper].arity == 1;
 }
 
-DiffNode_t* getX(char** s) {
-    if (!s || !(*s)) return nullptr;
+// takes operands from stack and puts there new operator node
+static bool applyOper(WalkValues_t* operands, uint32_t oper) {
+    size_t need = isPrefixOper(oper) ? 1 : 2;
+    if (operands->count < need) return false;
 
-    DiffNode_t* node = nullptr;
+    DiffNode_t* right = walkValuesPop(operands).node;
+    DiffNode_t* left  = need == 2 ? walkValuesPop(operands).node : nullptr;
 
-    if (!strncmp(*s, "cos", 3)) {
-        (*s) += 3;
-        return parseTrig(COS_OP, s);
-    }
-    if (!strncmp(*s, "sin", 3)) {
-        (*s) += 3;
-        return parseTrig(SIN_OP, s);
-    }
-    if (!strncmp(*s, "ln", 2)) {
-        (*s) += 2;
-        return parseTrig(LN_OP, s);
+    WalkValue_t value = {};
+    value.node = setOper(left, right, (OpType_t) oper);
+    if (!value.node || walkValuesPush(operands, value) != DIFF_OK) {
+        diffNodeDtor(left);
+        diffNodeDtor(right);
+        diffNodeDtor(value.node);
+        return false;
     }
 
-    if ('a' <= **s && **s <= 'z') {
-        node = diffNodeCtor(nullptr, nullptr, nullptr);
-        node->type = VAR;
-        node->value.var = **s;
-        (*s)++;
-    } else {
-        return getN(s);
+    return true;
+}
+
+// functions take only one primary: sin x^2 = (sin x)^2
+static bool applyPrefixOpers(WalkValues_t* operands, WalkValues_t* opers) {
+    while (opers->count && isPrefixOper(opers->values[opers->count - 1].index)) {
+        if (!applyOper(operands, walkValuesPop(opers).index)) return false;
     }
 
-    return node;
+    return true;
 }
 
-DiffNode_t* getT(char** s) {
-    if (!s || !(*s)) return nullptr;
+static bool pushOper(WalkValues_t* opers, uint32_t oper) {
+    WalkValue_t value = {};
+    value.index = oper;
 
-    DiffNode_t* val1 = getSt(s);
-    if (!(**s == '*' || **s == '/')) return val1;
+    return walkValuesPush(opers, value) == DIFF_OK;
+}
 
-    while (**s == '*' || **s == '/') {
-        char oper = **s;
-        (*s)++;
+// Operator precedence parser with explicit stacks of operands and operators.
+// It reads the same grammar as recursive descent did, but nesting of brackets is not limited by call stack.
+DiffNode_t* getG(char** s, bool quiet) {
+    if (!s || !(*s)) return nullptr;
 
-        DiffNode_t* val2 = getSt(s);
+    const uint32_t BRACKET = UINT32_MAX;
 
-        if (oper == '*') {
-            val1 = setOper(val1, val2, MUL_OP);
-        } else {
-            val1 = setOper(val1, val2, DIV_OP);
-        }
-    }
+    const char* start = *s;
 
-    return val1;
-}
+    WalkValues_t operands = {};
+    WalkValues_t opers    = {};
+    walkValuesCtor(&operands);
+    walkValuesCtor(&opers);
 
-DiffNode_t* getSt(char** s) {
-    if (!s || !(*s)) return nullptr;
+    bool ok            = true;
+    bool expectOperand = true;
 
-    DiffNode_t* val1 = getP(s);
-    if (!(**s == '^')) return val1;
+    while (ok) {
+        if (expectOperand) {
+            if (**s == '(') {
+                ok = pushOper(&opers, BRACKET);
+                (*s)++;
+                continue;
+            }
 
-    while (**s == '^') {
-        (*s)++;
-        DiffNode_t* val2 = getP(s);
+            size_t   length = 0;
+            OpType_t func   = operParse(*s, 1, &length);
+            if (func != OPT_DEFAULT) {
+                ok = pushOper(&opers, (uint32_t) func);
+                (*s) += length;
+                continue;
+            }
 
-        val1 = setOper(val1, val2, POW_OP);
-    }
+            WalkValue_t operand = {};
+            if ('a' <= **s && **s <= 'z') {
+                operand.node = diffNodeCtor(nullptr, nullptr, nullptr);
+                if (operand.node) {
+                    operand.node->type      = VAR;
+                    operand.node->value.var = **s;
+                }
+                (*s)++;
+            } else {
+                operand.node = getN(s);
+            }
 
-    return val1;
-}
+            ok = operand.node && walkValuesPush(&operands, operand) == DIFF_OK;
+            if (!ok) diffNodeDtor(operand.node);
 
-DiffNode_t* getE(char** s) {
-    if (!s || !(*s)) return nullptr;
+            ok = ok && applyPrefixOpers(&operands, &opers);
+            expectOperand = false;
+            continue;
+        }
 
-    DiffNode_t* val1 = getT(s);
-    if (!(**s == '+' || **s == '-')) return val1;
+        size_t   length = 0;
+        uint32_t oper   = (uint32_t) operParse(*s, 2, &length);
 
-    while (**s == '+' || **s == '-') {
-        char oper = **s;
-        (*s)++;
+        if (oper != (uint32_t) OPT_DEFAULT) {
+            // all operators are left associative, even ^
+            while (ok && opers.count && operPriority(opers.values[opers.count - 1].index) >= operPriority(oper)) {
+                ok = applyOper(&operands, walkValuesPop(&opers).index);
+            }
 
-        DiffNode_t* val2 = getT(s);
+            ok = ok && pushOper(&opers, oper);
+            expectOperand = true;
+            (*s) += length;
+        } else if (**s == ')') {
+            while (ok && opers.count && opers.values[opers.count - 1].index != BRACKET) {
+                ok = applyOper(&operands, walkValuesPop(&opers).index);
+            }
+
+            ok = ok && opers.count && walkValuesPop(&opers).index == BRACKET;
+            if (!ok) break;
 
-        if (oper == '+') {
-            val1 = setOper(val1, val2, ADD_OP);
+            (*s)++;
+            ok = applyPrefixOpers(&operands, &opers);
         } else {
-            val1 = setOper(val1, val2, SUB_OP);
+            break;
         }
     }
 
-    return val1;
-}
-
-DiffNode_t* getG(char** s) {
-    if (!s || !(*s)) return nullptr;
+    while (ok && opers.count) {
+        uint32_t oper = walkValuesPop(&opers).index;
+        ok = oper != BRACKET && applyOper(&operands, oper);
+    }
 
-    const char* start = *s;
-    DiffNode_t* node = getE(s);
-    if (**s != '\0' && **s != '\n') {
-        fprintf(stderr, "Syntax error: (pos=%ld) %s\n", *s - start, *s);
-        return nullptr;
+    DiffNode_t* node = nullptr;
+    if (ok && operands.count == 1 && (**s == '\0' || **s == '\n')) {
+        node = walkValuesPop(&operands).node;
+    } else if (!quiet) {
+        int context = (int) strcspn(*s, "\n");
+        if (context > SYNTAX_CONTEXT_LENGTH) context = SYNTAX_CONTEXT_LENGTH;
+        fprintf(stderr, "Syntax error: (pos=%ld) %.*s\n", *s - start, context, *s);
     }
 
+    while (operands.count) diffNodeDtor(walkValuesPop(&operands).node);
+
+    walkValuesDtor(&operands);
+    walkValuesDtor(&opers);
+
     return node;
 }
 
-void addPrevs(DiffNode_t* start) {
-    if (!start) return;
+int addPrevs(DiffNode_t* start) {
+    if (!start) return DIFF_OK;
+
+    WalkStack_t stack = {};
+    walkStackCtor(&stack);
+    int error = walkStackPush(&stack, start);
 
-    if (start->left && start->right) {
-        start->left->prev = start->right->prev = start;
+    while (error == DIFF_OK && stack.count) {
+        DiffNode_t* node = stack.frames[--stack.count].node;
+
+        if (node->left) {
+            node->left->prev = node;
+            error = walkStackPush(&stack, node->left);
+        }
+        if (error == DIFF_OK && node->right) {
+            node->right->prev = node;
+            error = walkStackPush(&stack, node->right);
+        }
     }
 
-    if (start->left)  addPrevs(start->left);
-    if (start->right) addPrevs(start->right);
+    walkStackDtor(&stack);
+    return error;
 }
 
-DiffNode_t* parseEquation(char** s) {
+DiffNode_t* parseEquation(char** s, bool quiet) {
     if (!s) return nullptr;
 
-    DiffNode_t* startNode = getG(s);
-    addPrevs(startNode);
+    DiffNode_t* startNode = getG(s, quiet);
+    if (addPrevs(startNode) != DIFF_OK) {
+        diffNodeDtor(startNode);
+        return nullptr;
+    }
 
     return startNode;
 }
@@ -328,27 +492,43 @@ DiffNode_t* parseEquation(char** s) {
 DiffNode_t* nodeCopy(DiffNode_t* nodeToCopy) {
     if (!nodeToCopy) return nullptr;
 
-    DiffNode_t* node = (DiffNode_t*) calloc(sizeof(DiffNode_t), 1);
-    memcpy(node, nodeToCopy, sizeof(DiffNode_t));
-    if (nodeToCopy->left)  {
-        node->left = nodeCopy(nodeToCopy->left);
+    DiffNode_t* root = diffNodeCtor(nullptr, nullptr, nullptr);
+    if (!root) return nullptr;
+
+    // frame keeps source node and its already allocated copy
+    WalkStack_t stack = {};
+    walkStackCtor(&stack);
+    int error = walkStackPush(&stack, nodeToCopy, 0, root);
+
+    while (error == DIFF_OK && stack.count) {
+        WalkFrame_t frame = stack.frames[--stack.count];
+        DiffNode_t* node  = frame.other;
+
+        DiffNode_t* prev = node->prev;
+        memcpy(node, frame.node, sizeof(DiffNode_t));
+        if (node != root) node->prev = prev;
+        if (diffStats.enabled) diffStats.copied.fetch_add(1, std::memory_order_relaxed);
+
+        node->left = node->right = nullptr;
+        if (frame.node->left)  node->left  = diffNodeCtor(nullptr, nullptr, node);
+        if (frame.node->right) node->right = diffNodeCtor(nullptr, nullptr, node);
+        if ((frame.node->left && !node->left) || (frame.node->right && !node->right)) error = DIFF_NO_MEM;
+
+        if (error == DIFF_OK && node->left)  error = walkStackPush(&stack, frame.node->left,  0, node->left);
+        if (error == DIFF_OK && node->right) error = walkStackPush(&stack, frame.node->right, 0, node->right);
     }
-    if (nodeToCopy->right) {
-        node->right = nodeCopy(nodeToCopy->right);
+
+    walkStackDtor(&stack);
+
+    // part of copy is not given back
+    if (error != DIFF_OK) {
+        diffNodeDtor(root);
+        return nullptr;
     }
 
-    return node;
+    return root;
 }
 
-#define replaceValVal(node, oper) {                                       \
-    (node)->type = NUM;                                                    \
-    (node)->value.num = L(node)->value.num oper R(node)->value.num;         \
-    free(L(node));                                                           \
-    free(R(node));                                                            \
-    L(node)  = nullptr;                                                        \
-    R(node) = nullptr;                                                          \
-}                                                                                \
-
 void hangNode(DiffNode_t* node, const DiffNode_t* info) {
     if (!node || !info) return;
 
@@ -356,85 +536,65 @@ void hangNode(DiffNode_t* node, const DiffNode_t* info) {
     node->value = info->value;
     node->right = info->right;
     node->left  = info->left;
+
+    if (node->left)  node->left->prev  = node;
+    if (node->right) node->right->prev = node;
 }
 
 // EASIER SECTION
 
-#define easierTrigVal(node, oper) {                                       \
-    node->type = NUM;                                                      \
-    node->value.num = oper(R(node)->value.num);                             \
-    free(L(node));                                                           \
-    free(R(node));                                                            \
-    L(node)  = nullptr;                                                        \
-    R(node) = nullptr;                                                          \
-}                                                                                \
-
+// children are numbers (function has only right one), operator is folded to number
 void easierValVal(DiffNode_t* node) {
     if (!node) return;
 
-    switch(node->value.opt) {
-        case ADD_OP:
-            replaceValVal(node, +);
-            break;
-        case SUB_OP:
-            replaceValVal(node, -);
-            break;
-        case MUL_OP:
-            replaceValVal(node, *);
-            break;
-        case DIV_OP:
-            replaceValVal(node, /);
-            break;
-        case POW_OP:
-            node->type = NUM;
-            // node->value.num = POW_OP(L(node)->value.num, R(node)->value.num);
-            free(L(node));                                                        
-            free(R(node));                                                        
-            L(node)  = nullptr;                                                     
-            R(node) = nullptr;                                                      
-            break;
-        case LN_OP:
-            easierTrigVal(node, log);                                                  
-            break;
-        case COS_OP:
-            easierTrigVal(node, cos);                                                  
-            break;
-        case SIN_OP:
-            easierTrigVal(node, sin);                                                  
-            break;
-        case OPT_DEFAULT:
-        default:
-            return;
-            break;
-    }
+    const DiffOper_t* oper = operFind(node->value.opt);
+    if (!oper) return;
+
+    double left = L(node) ? L(node)->value.num : 0;
+
+    node->type      = NUM;
+    node->value.num = oper->value(left, R(node)->value.num);
 
-    makeNodeEasy(node->prev);
+    diffNodeFree(L(node));
+    diffNodeFree(R(node));
+    L(node) = nullptr;
+    R(node) = nullptr;
+}
+
+// node keeps its address, so parent and steps, that point to it, stay valid
+static void setNumNode(DiffNode_t* node, double value) {
+    diffNodeDtor(node->left);
+    diffNodeDtor(node->right);
+
+    node->type      = NUM;
+    node->value.num = value;
+    node->left = node->right = nullptr;
 }
 
 void easierVarVal(DiffNode_t* node, DiffNode_t* varNode, DiffNode_t* valNode) {
     if (!node || !varNode) return;
-    if (IS_COS_OP(node) || IS_SIN_OP(node) || IS_LN_OP(node)) return;
+    if (IS_FUNC(node)) return;
     if (IS_DIV(node) && IS_NUM(L(node))) return;
 
-    if (compDouble(valNode->value.num, 1) && (IS_MUL_OP(node) || IS_POW_OP(node))) {
-        hangNode(valNode->prev, varNode);
-        free(valNode);
+    bool isRight = valNode == R(node);
+
+    if (compDouble(valNode->value.num, 1) && (IS_MUL_OP(node) || ((IS_POW_OP(node) || IS_DIV(node)) && isRight))) {
+        hangNode(node, varNode);
+        diffNodeFree(valNode);
+        diffNodeFree(varNode);
+    } else if (compDouble(valNode->value.num, 1) && IS_POW_OP(node)) {
+        setNumNode(node, 1);
     } else if (compDouble(valNode->value.num, 0)) {
-        node->type = NUM;
         if (IS_POW_OP(node)) {
-            node->value.num = 1;
-            node->left = node->right = nullptr;
+            setNumNode(node, isRight ? 1 : 0);
         } else if (IS_MUL_OP(node)) {
-            node->value.num = 0;
-            node->left = node->right = nullptr;
-        } else if (IS_ADD_OP(node)) {
-            hangNode(valNode->prev, varNode);
+            setNumNode(node, 0);
+        } else if (IS_ADD_OP(node) || (node->value.opt == SUB_OP && isRight)) {
+            hangNode(node, varNode);
+            diffNodeFree(valNode);
+            diffNodeFree(varNode);
         }
-    } else {
-        return;
     }
-
-    makeNodeEasy(node->prev);
 }
 
 void makeNodeEasy(DiffNode_t* node) {
@@ -447,132 +607,257 @@ void makeNodeEasy(DiffNode_t* node) {
         easierVarVal(node, R(node), L(node));
     } else if (IS_NUM(R(node))) {
         easierVarVal(node, L(node), R(node));
-    } else {
-        return;
     }
+}
+
+static WalkResult_t easierVisit(DiffNode_t* node, WalkEvent_t event, void* context) {
+    (void) context;
 
-    makeNodeEasy(node->prev);
+    if (budgetExceeded()) return WALK_STOP;
+    if (event == WALK_LEAVE) makeNodeEasy(node);
+    return WALK_NEXT;
 }
 
+// children are simplified first, so folded constants go up without walking back to the root
 void easierEqu(DiffNode_t* start) {
-    if (!start) return;
-
-    makeNodeEasy(start);
-    if (start->left)  easierEqu(start->left);
-    if (start->right) easierEqu(start->right);
+    treeWalk(start, easierVisit, nullptr);
 }
 
 // DIFF SECTION
 
-DiffNode_t* diffPow(DiffNode_t* startNode, FILE* file) {
+DiffNode_t* diffPow(DiffNode_t* startNode, DiffNode_t* dLeft, DiffNode_t* dRight, DiffSteps_t* steps) {
     if (!startNode) return nullptr;
 
     DiffNode_t* result = nullptr;
 
     if ((IS_OP(L(startNode)) || IS_VAR(L(startNode))) && IS_NUM(R(startNode))) {
 
-        double powVal = R(startNode)->value.num--;
-        result = MUL(MUL(dL, newNumNode(nullptr, nullptr, nullptr, powVal)), POW(cL, cR));
+        double powVal = R(startNode)->value.num;
+        result = MUL(MUL(dLeft, newNumNode(nullptr, nullptr, nullptr, powVal)),
+                     POW(cL, newNumNode(nullptr, nullptr, nullptr, powVal - 1)));
+        diffStepsRetire(steps, dRight);
 
     } else if ((IS_VAR(L(startNode)) || IS_OP(L(startNode))) && (IS_VAR(R(startNode)) || IS_OP(R(startNode)))) {
 
-        DiffNode_t* diffPart = MUL(LN(L(startNode)), cL);
-        result = MUL(nodeCopy(startNode), nodeDiff(diffPart, file));
-        diffNodeDtor(diffPart);
+        // (f^g)' = f^g * (g' * ln(f) + g * f' / f)
+        result = MUL(nodeCopy(startNode), ADD(MUL(dRight, LN(cL)), MUL(cR, DIV(dLeft, cL))));
 
     } else if (IS_NUM(L(startNode)) && (IS_OP(R(startNode)) || IS_VAR(R(startNode)))) {
 
-        result = MUL(nodeCopy(startNode), LN(L(startNode)));
+        result = MUL(MUL(nodeCopy(startNode), LN(cL)), dRight);
+        diffStepsRetire(steps, dLeft);
 
-    } else if (IS_NUM(L(startNode)) && IS_NUM(R(startNode))) {
-        free(L(startNode));
-        free(R(startNode));
-        startNode->type = NUM;
-        startNode->value.num  = 0;
-        L(startNode) = R(startNode) = nullptr;
-        return startNode;
+    } else {
+        result = newNumNode(nullptr, nullptr, nullptr, 0);
+        diffStepsRetire(steps, dLeft);
+        diffStepsRetire(steps, dRight);
     }
+
     return result;
 }
 
-DiffNode_t* nodeDiff(DiffNode_t* node, FILE* file) {
-    if (!node) return nullptr;
+// derivative of one operator, derivatives of its children are already taken
+static DiffNode_t* diffOper(DiffNode_t* startNode, DiffNode_t* dLeft, DiffNode_t* dRight, DiffSteps_t* steps) {
+    DiffNode_t* result = nullptr;
+    DiffRule_t  rule   = RULE_DEFAULT;
+
+    const DiffOper_t* oper = operFind(startNode->value.opt);
+    if (oper) {
+        rule   = oper->rule;
+        result = oper->diff(startNode, dLeft, dRight, steps, &rule);
+    } else {
+        diffStepsRetire(steps, dLeft);
+        diffStepsRetire(steps, dRight);
+    }
 
-    DiffNode_t* startNode = nodeCopy(node);
+    diffStepsPush(steps, startNode, result, rule);
+    return result;
+}
 
-    if (startNode->type == NUM) {
-        startNode->value.num = 0;
-        return startNode;
-    } 
+struct DiffWalk_t {
+    WalkValues_t       derivatives = {};
+    DiffSteps_t*       steps       = nullptr;
+    const PolyMap_t*   polys       = nullptr;
+    const MemoIndex_t* memoIndex   = nullptr;     // only in watch mode
+    char               var         = '\0';
+    bool               failed      = false;
+};
 
-    if (startNode->type == VAR) {
-        startNode->type = NUM;
-        startNode->value.num  = 1;
-        return startNode;
+// polynomial subtree is differentiated at once by shift of its coefficients
+static DiffNode_t* diffPoly(DiffNode_t* node, const Poly_t* poly, char var, DiffSteps_t* steps) {
+    Poly_t derivative = {};
+    if (var && poly->var != var) polyCtor(&derivative, 0, '\0');
+    else                         polyDiff(poly, &derivative);
+
+    DiffNode_t* result = polyToTree(&derivative);
+    polyDtor(&derivative);
+
+    diffStepsPush(steps, node, result, RULE_POLY);
+    return result;
+}
+
+// subtree is the same as in previous run of watch mode, its derivative is copied from memo
+static DiffNode_t* diffMemorized(DiffNode_t* node, const MemoIndex_t* memoIndex, DiffSteps_t* steps) {
+    size_t hash = 0;
+    if (!memoIndexFind(memoIndex, node, &hash)) return nullptr;
+
+    DiffNode_t* result = diffMemoGet(diffMemo, hash, node);
+    if (result) diffStepsPush(steps, node, result, RULE_MEMO);
+
+    return result;
+}
+
+static WalkResult_t diffVisit(DiffNode_t* node, WalkEvent_t event, void* context) {
+    DiffWalk_t* walk = (DiffWalk_t*) context;
+    WalkValue_t value = {};
+
+    // job is out of budget: what is already made is retired by nodeDiff()
+    if (budgetExceeded()) {
+        walk->failed = true;
+        return WALK_STOP;
     }
 
-    switch(startNode->value.opt) {
-        case ADD_OP:
-            startNode = ADD(dL, dR);
-            break;
-        case SUB_OP:
-            startNode = SUB(dL, dR);
-            break;
-        case MUL_OP:
-            startNode = ADD(MUL(dL, cR), MUL(cL, dR));
-            break;
-        case DIV_OP:
-            startNode = DIV(SUB(MUL(dL, cR), MUL(cL, dR)), POW(cR, newNumNode(nullptr, nullptr, nullptr, 2)));
-            break;
-        case POW_OP:
-            startNode = diffPow(startNode, file);
-            break;
-        case SIN_OP:
-            startNode = MUL(COS(cR), dR);
-            break;
-        case COS_OP:
-            startNode = MUL(MUL(newNumNode(nullptr, nullptr, nullptr, -1), SIN(cR)), dR);
-            break;
-        case LN_OP:
-            startNode = DIV(dR, cR);
-            break;
-        case OPT_DEFAULT:
-        default:
-            break;
+    const Poly_t* poly = event == WALK_ENTER ? polyMapFind(walk->polys, node) : nullptr;
+    if (event == WALK_ENTER && !poly && walk->memoIndex) value.node = diffMemorized(node, walk->memoIndex, walk->steps);
+
+    bool skip = poly || value.node;
+    if (!skip && event != WALK_LEAVE) return WALK_NEXT;
+
+    if (skip) {
+        if (poly) value.node = diffPoly(node, poly, walk->var, walk->steps);
+    } else if (IS_NUM(node) || IS_VAR(node)) {
+        bool isVar = IS_VAR(node) && (!walk->var || node->value.var == walk->var);
+        value.node = newNumNode(nullptr, nullptr, nullptr, isVar ? 1 : 0);
+    } else {
+        DiffNode_t* dLeft  = L(node) ? walkValuesPop(&walk->derivatives).node : nullptr;
+        DiffNode_t* dRight = R(node) ? walkValuesPop(&walk->derivatives).node : nullptr;
+
+        value.node = diffOper(node, dLeft, dRight, walk->steps);
+
+        size_t hash = 0;
+        if (walk->memoIndex && memoIndexFind(walk->memoIndex, node, &hash)) diffMemoPut(diffMemo, hash, node, value.node);
     }
 
-    if (file) {
-        printRandomPhrase(file);
-        printLineToTex(file, "$(");
-        nodeToTex(node, file);
-        printLineToTex(file, ")'$ = ");
-        diffToTex(startNode);
-        printLineToTex(file, "\n\n");
+    if (walkValuesPush(&walk->derivatives, value) != DIFF_OK) {
+        diffStepsRetire(walk->steps, value.node);
+        walk->failed = true;
+        return WALK_STOP;
     }
-    return startNode;
+
+    return skip ? WALK_SKIP : WALK_NEXT;
 }
 
-int equDiff(DiffNode_t* start) {
-    DIFF_CHECK(!start, DIFF_NULL);
+// Right children are differentiated first, so steps go in the same order as in former recursive version.
+// Partial derivative by var treats other letters as constants, '\0' - every letter is the variable.
+// Polynomial subtrees (see poly.h) are differentiated as coefficient vectors in one step.
+// In watch mode subtrees, that were differentiated by previous runs, come from memo (see watch.h).
+// Returns nullptr, when job runs out of memory or of its budget (see budget.h).
+DiffNode_t* nodeDiff(DiffNode_t* node, DiffSteps_t* steps, char var) {
+    if (!node) return nullptr;
+
+    // without memory for polynomials (or memo index) everything goes by usual rules
+    PolyMap_t polys = {};
+    polyMapCtor(&polys, node);
 
-    DiffNode_t* res = nodeDiff(start, texFile);
-    addPrevs(res);
+    MemoIndex_t memoIndex = {};
+    if (diffMemo && !var) memoIndexCtor(&memoIndex, node, diffMemo);
 
-    fprintf(texFile, "\\bigskip После очевидных упрощений имеем:\n\n");
-    easierEqu(res);
-    diffToTex(res);
+    DiffWalk_t walk = {};
+    walk.steps     = steps;
+    walk.polys     = &polys;
+    walk.memoIndex = memoIndex.count ? &memoIndex : nullptr;
+    walk.var       = var;
+    walkValuesCtor(&walk.derivatives);
 
+    if (treeWalk(node, diffVisit, &walk, WALK_RIGHT_FIRST) != DIFF_OK) walk.failed = true;
+
+    DiffNode_t* result = nullptr;
+    if (!walk.failed && walk.derivatives.count == 1) result = walkValuesPop(&walk.derivatives).node;
+
+    while (walk.derivatives.count) diffStepsRetire(steps, walkValuesPop(&walk.derivatives).node);
+    walkValuesDtor(&walk.derivatives);
+    polyMapDtor(&polys);
+    memoIndexDtor(&memoIndex);
+
+    return result;
+}
+
+// Simplified derivative of start. Steps are rendered only to files, that are open, without TeX and trace
+// differentiation doesn't collect them at all.
+int equDerivative(DiffNode_t* start, DiffNode_t** result) {
+    DIFF_CHECK(!start || !result, DIFF_NULL);
+
+    // derivative from cache (or from previous run of watch mode) is already simplified, but it has no steps,
+    // so it is taken only when there is no document to write them to
+    bool useSteps = texFile || traceFile;
+    DiffNode_t* res = nullptr;
+    if (!useSteps) res = diffCacheGetDerivative(diffCache, start);
+    if (!useSteps && !res) res = diffMemoGetSimplified(diffMemo, start);
+
+    if (!res) {
+        // memo copies derivatives while they are made, so in watch mode steps are rendered by this thread
+        DiffSteps_t steps = {};
+        if (useSteps) diffStepsCtor(&steps, texFile, traceFile, !diffMemo);
+
+        res = nodeDiff(start, useSteps ? &steps : nullptr);
+        if (useSteps) diffStepsDtor(&steps);
+        if (!res) return budgetError();
+        if (addPrevs(res) != DIFF_OK) {
+            diffNodeDtor(res);
+            return DIFF_NO_MEM;
+        }
+
+        ProfTimer_t easierTimer = {};
+        size_t sizeBefore = diffProfile.enabled ? getTreeSize(res) : 0;
+        profStart(&easierTimer, PROF_EASIER);
+        easierEqu(res);
+        profStop(&easierTimer);
+        if (diffProfile.enabled) profTreeSizes(sizeBefore, getTreeSize(res));
+
+        // easierEqu() was stopped on half way, such derivative is not remembered
+        if (budgetExceeded()) {
+            diffNodeDtor(res);
+            return DIFF_BUDGET;
+        }
+
+        if (diffCache) diffCachePutDerivative(diffCache, start, res);
+    }
+    diffMemoPutSimplified(diffMemo, start, res);
+
+    *result = res;
     return DIFF_OK;
 }
 
-char *mGetline(FILE *stream, char *s, char dump) {
-    if (!stream || !s) return nullptr;
+int equDiff(DiffNode_t* start, DiffNode_t** result) {
+    DIFF_CHECK(!start, DIFF_NULL);
+
+    ProfTimer_t timer = {};
+    profStart(&timer, PROF_EQU_DIFF);
 
+    DiffNode_t* res = nullptr;
+    int err = equDerivative(start, &res);
+
+    if (err == DIFF_OK) {
+        fprintf(texFile, "\\bigskip После очевидных упрощений имеем:\n\n");
+        diffToTex(res);
+
+        if (result) *result = res;
+        else        diffNodeDtor(res);
+    }
+
+    profStop(&timer);
+    return err;
+}
+
+// symbols, that don't fit to s, are skipped till the end of line
+char *mGetline(FILE *stream, char *s, size_t size, char dump) {
+    if (!stream || !s || !size) return nullptr;
+
+    char* end = s + size - 1;
     int val = fgetc(stream);
 
     while (val != EOF && val != '\n' && val != dump) {
-        *s = (char) val;
-        s++;
+        if (s < end) *s++ = (char) val;
 
         val = fgetc(stream);
     }
@@ -581,6 +866,64 @@ char *mGetline(FILE *stream, char *s, char dump) {
     return s;
 }
 
+static int readTextChunks(DiffText_t* text, FILE* file) {
+    size_t size = 0;
+
+    while (true) {
+        if (size + TEXT_CHUNK_SIZE + 1 > text->size) {
+            size_t newSize = text->size ? text->size * 2 : TEXT_CHUNK_SIZE + 1;
+            char*  newText = (char*) realloc(text->text, newSize);
+            DIFF_CHECK(!newText, DIFF_NO_MEM);
+
+            text->text = newText;
+            text->size = newSize;
+        }
+
+        size_t read = fread(text->text + size, 1, TEXT_CHUNK_SIZE, file);
+        size += read;
+        if (read < TEXT_CHUNK_SIZE) break;
+    }
+
+    text->text[size] = '\0';
+    text->size = size;
+    return DIFF_OK;
+}
+
+int diffTextOpen(DiffText_t* text, FILE* file) {
+    DIFF_CHECK(!text || !file, DIFF_NULL);
+
+    *text = {};
+
+    // tail of the last page is filled with zeros by kernel, it is the end of text
+    struct stat info = {};
+    size_t pageSize = (size_t) sysconf(_SC_PAGESIZE);
+    if (!fstat(fileno(file), &info) && S_ISREG(info.st_mode) && info.st_size > 0 && (size_t) info.st_size % pageSize) {
+        void* mapped = mmap(nullptr, (size_t) info.st_size, PROT_READ, MAP_PRIVATE, fileno(file), 0);
+        if (mapped != MAP_FAILED) {
+            madvise(mapped, (size_t) info.st_size, MADV_SEQUENTIAL);
+
+            text->text   = (char*) mapped;
+            text->size   = (size_t) info.st_size;
+            text->mapped = text->size;
+            return DIFF_OK;
+        }
+    }
+
+    int err = readTextChunks(text, file);
+    if (err != DIFF_OK) diffTextClose(text);
+
+    return err;
+}
+
+void diffTextClose(DiffText_t* text) {
+    if (!text) return;
+
+    if (text->mapped) munmap(text->text, text->mapped);
+    else              free(text->text);
+
+    *text = {};
+}
+
 void parseTailorArgs(DiffNode_t* root, FILE* readFile, char* line) {
     if (!root || !readFile || !line) return;
 
@@ -594,7 +937,10 @@ void parseTailorArgs(DiffNode_t* root, FILE* readFile, char* line) {
         return;
     }
 
+    ProfTimer_t timer = {};
+    profStart(&timer, PROF_TAILOR);
     tailor(root, pow, point);
+    profStop(&timer);
 }
 
 void parseGraphArgs(DiffNode_t* root, FILE* readFile, char* line) {
@@ -614,7 +960,28 @@ void parseGraphArgs(DiffNode_t* root, FILE* readFile, char* line) {
         return;
     }
 
+    ProfTimer_t timer = {};
+    profStart(&timer, PROF_DRAW_GRAPH);
     drawGraph(root, left, right);
+    profStop(&timer);
+
+    if (diffOptions.roots) {
+        profStart(&timer, PROF_ROOTS);
+        equRoots(root, left, right);
+        profStop(&timer);
+    }
+
+    if (diffOptions.integral) {
+        profStart(&timer, PROF_INTEGRAL);
+        equIntegral(root, left, right);
+        profStop(&timer);
+    }
+
+    if (diffOptions.chebTolerance > 0) {
+        profStart(&timer, PROF_CHEB);
+        equCheb(root, left, right);
+        profStop(&timer);
+    }
 }
 
 void parseTangentArgs(DiffNode_t* root, FILE* readFile, char* line) {
@@ -632,299 +999,505 @@ void parseTangentArgs(DiffNode_t* root, FILE* readFile, char* line) {
     equTangent(root, point);
 }
 
+int diffInputOpen(DiffInput_t* input, FILE* readFile) {
+    DIFF_CHECK(!input || !readFile, DIFF_NULL);
+
+    *input = {};
+
+    // equation is parsed right in the text of file, without copy and limit of length
+    DIFF_CHECK(diffTextOpen(&input->text, readFile) != DIFF_OK, DIFF_FILE_NULL);
+
+    DiffText_t* text   = &input->text;
+    char*       cursor = text->text;
+    input->root = parseEquation(&cursor);
+
+    // the other arguments are read from lines after equation (with '\0' at the end, so stream is never empty)
+    const char* args = (const char*) memchr(cursor, '\n', text->size - (size_t) (cursor - text->text));
+    args = args ? args + 1 : text->text + text->size;
+
+    input->line = (char*) calloc(MAX_WORD_LENGTH, sizeof(char));
+    input->args = fmemopen(const_cast<char*>(args), text->size - (size_t) (args - text->text) + 1, "r");
+    if (!input->line || !input->args) {
+        diffNodeDtor(input->root);
+        input->root = nullptr;
+        diffInputClose(input);
+        return DIFF_NO_MEM;
+    }
+
+    return DIFF_OK;
+}
+
+// root is not freed, it belongs to caller
+void diffInputClose(DiffInput_t* input) {
+    if (!input) return;
+
+    if (input->args) fclose(input->args);
+    free(input->line);
+    diffTextClose(&input->text);
+
+    *input = {};
+}
+
+// binary image and dump, that were asked by options, job out of budget is not saved
+void saveDerivative(DiffNode_t* root, DiffNode_t* derivative) {
+    if (!root) return;
+
+    if (!budgetExceeded() && diffOptions.savePath) {
+        DiffNode_t* roots[] = {root, derivative};
+        if (diffImageSave(diffOptions.savePath, roots, 2) != DIFF_OK) {
+            fprintf(stderr, "Can't save equation to %s\n", diffOptions.savePath);
+        }
+    }
+
+    if (derivative && diffOptions.dumpPath && graphDumpFile(derivative, diffOptions.dumpPath, diffOptions.dumpOptions) != DIFF_OK) {
+        fprintf(stderr, "Can't dump derivative to %s\n", diffOptions.dumpPath);
+    }
+}
+
 DiffNode_t* parseArgs(FILE* readFile) {
     if (!readFile) return nullptr;
 
-    char* line = (char*) calloc(MAX_WORD_LENGTH, sizeof(char));
-    mGetline(readFile, line);
-    DiffNode_t* root = parseEquation(&line);
+    DiffInput_t input = {};
+    if (diffInputOpen(&input, readFile) != DIFF_OK) return nullptr;
+
+    DiffNode_t* root     = input.root;
+    FILE*       argsFile = input.args;
+    char*       line     = input.line;
+
     fprintf(texFile, "Дано: ");
     diffToTex(root);
 
-    parseTailorArgs(root, readFile, line);
-    parseGraphArgs(root, readFile, line);
-    parseTangentArgs(root, readFile, line);
+    // job, that is out of budget, skips the rest of its parts
+    parseTailorArgs(root, argsFile, line);
+    if (!budgetExceeded()) parseGraphArgs(root, argsFile, line);
+    if (!budgetExceeded()) parseTangentArgs(root, argsFile, line);
+
+    DiffNode_t* derivative = nullptr;
+    if (!budgetExceeded() && equDiff(root, &derivative) != DIFF_OK) derivative = nullptr;
+
+    if (budgetExceeded()) {
+        fprintf(texFile, "\n\n\\bigskip Дальше считать слишком дорого (%s), на этом остановимся.\n\n",
+                         BUDGET_LIMIT_NAMES[budgetLimit(diffBudget)]);
+    }
+    saveDerivative(root, derivative);
+
+    diffNodeDtor(derivative);
+    diffInputClose(&input);
 
-    equDiff(root);
     return root;
 }
 
-DiffNode_t* openDiffFile(const char *fileName, const char *texName) {
+DiffNode_t* openDiffFile(const char *fileName, const char *texName, const DiffOptions_t* options) {
     if (!fileName) return nullptr;
 
+    if (options) diffOptions = *options;
+
+    // nothing is created for input, that can't be read
     FILE* readFile = fopen(fileName, "rb");
-    texFile  = fopen(texName, "w");
+    if (!readFile) return nullptr;
+
+    // JSON and infix go to stdout, there is no TeX document, no graph and no pdflatex
+    bool tex = diffOptions.output == OUTPUT_TEX;
+    if (tex) {
+        texFile = fopen(texName, "w");
+        snprintf(texPath, sizeof(texPath), "%s", texName);
+        if (!renderQueue) renderQueue = renderQueueCtor();
+    }
+    if (diffOptions.traceName) traceFile = fopen(diffOptions.traceName, "w");
+
+    if (tex && !texFile) {
+        if (traceFile) fclose(traceFile);
+        traceFile = nullptr;
+        fclose(readFile);
+        return nullptr;
+    }
+
+    if (diffOptions.cacheDir) {
+        size_t cacheSize = diffOptions.cacheSize ? diffOptions.cacheSize : DEFAULT_CACHE_SIZE;
+        if (diffCacheOpen(&jobCache, diffOptions.cacheDir, cacheSize) == DIFF_OK) diffCache = &jobCache;
+        else fprintf(stderr, "Can't open cache %s\n", diffOptions.cacheDir);
+    }
     initTex(texFile);
-    if (!readFile || !texFile) return nullptr;
 
     srand((unsigned int) time(NULL));
 
-    DiffNode_t* root = parseArgs(readFile);
+    if (diffOptions.profilePath) diffProfileStart(fileName);
+
+    diffBudgetCtor(&jobBudget, diffOptions.limits);
+    if (diffOptions.limits) diffBudgetBegin(&jobBudget);
+
+    ProfTimer_t timer = {};
+    profStart(&timer, PROF_PARSE_ARGS);
+    DiffNode_t* root = tex ? parseArgs(readFile) : reportArgs(readFile, stdout, diffOptions.output);
+    profStop(&timer);
     fclose(readFile);
 
+    diffBudgetEnd();
+    if (budgetLimit(&jobBudget) != BUDGET_NONE) {
+        fprintf(stderr, "Job %s is out of budget: ", fileName);
+        budgetReport(&jobBudget, stderr);
+    }
+
+    if (diffOptions.profilePath && diffProfileDump(diffOptions.profilePath) != DIFF_OK) {
+        fprintf(stderr, "Can't write profile to %s\n", diffOptions.profilePath);
+    }
+
     return root;
 }
 
+// Left child is rotated up till there is none, then node is freed and its right subtree goes next.
+// Destructor needs no stack, so it frees whole tree even when there is no memory at all.
 void diffNodeDtor(DiffNode_t* node) {
-    if (!node) return;
+    while (node) {
+        DiffNode_t* left = node->left;
 
-    if (node->left)  diffNodeDtor(node->left);
-    if (node->right) diffNodeDtor(node->right);
-
-    free(node);
+        if (left) {
+            node->left  = left->right;
+            left->right = node;
+            node        = left;
+        } else {
+            DiffNode_t* right = node->right;
+            diffNodeFree(node);
+            node = right;
+        }
+    }
 }
 
 // TEX
 
-void anyTex(DiffNode_t* node, const char* oper, FILE* file) {
-    if (!node || !oper || !file) return;
+static void anyTex(DiffNode_t* node, const char* oper, DiffEmitter_t* out, WalkEvent_t event) {
+    if (!node || !oper || !out) return;
 
     bool needOper = !(IS_NUM(L(node)) && IS_VAR(R(node)) && IS_MUL_OP(node));
-    bool needLeftBracket  = !(IS_NUM(L(node))  || IS_VAR(L(node)))  && ((L(node))->texSymb == '\0') 
+    bool needLeftBracket  = !(IS_NUM(L(node))  || IS_VAR(L(node)))  && ((L(node))->texSymb == 0) 
                                                                           && (IS_MUL_OP(node)) && !isMulSubtree(L(node));
-    bool needRightBracket = !(IS_NUM(R(node)) || IS_VAR(R(node))) && ((R(node))->texSymb == '\0')
+    bool needRightBracket = !(IS_NUM(R(node)) || IS_VAR(R(node))) && ((R(node))->texSymb == 0)
                                                                           && (IS_MUL_OP(node)) && !isMulSubtree(R(node));
 
-    if (needLeftBracket) fprintf(file, "(");
-    printNodeReplaced(node->left, file);
-    if (needLeftBracket) fprintf(file, ")");
-
-    if (needOper) fprintf(file, "%s", oper);
-
-    if (needRightBracket) fprintf(file, "(");
-    printNodeReplaced(node->right, file);
-    if (needRightBracket) fprintf(file, ")");
+    switch (event) {
+        case WALK_ENTER:
+            if (needLeftBracket) emitChar(out, '(');
+            break;
+        case WALK_INFIX:
+            if (needLeftBracket) emitChar(out, ')');
+            if (needOper) emitText(out, oper);
+            if (needRightBracket) emitChar(out, '(');
+            break;
+        case WALK_LEAVE:
+        default:
+            if (needRightBracket) emitChar(out, ')');
+            break;
+    }
 }
 
-void powTex(DiffNode_t* node, FILE* file) {
-    if (!node || !file) return;
+static void powTex(DiffNode_t* node, DiffEmitter_t* out, WalkEvent_t event) {
+    if (!node || !out) return;
 
-    bool needLeftBracket  = L(node)->texSymb == '\0'  && IS_OP(L(node))
-                        && (!isMulSubtree(L(node)) || IS_TRIG_LN(L(node)) || !IS_POW_OP(L(node))) ;
-    bool needRightBracket = R(node)->texSymb == '\0'  && IS_OP(R(node)) 
-                        && (!isMulSubtree(R(node)) || IS_TRIG_LN(R(node)) || !IS_POW_OP(R(node)));
+    bool needLeftBracket  = L(node)->texSymb == 0  && IS_OP(L(node))
+                        && (!isMulSubtree(L(node)) || IS_FUNC(L(node)) || !IS_POW_OP(L(node))) ;
+    bool needRightBracket = R(node)->texSymb == 0  && IS_OP(R(node)) 
+                        && (!isMulSubtree(R(node)) || IS_FUNC(R(node)) || !IS_POW_OP(R(node)));
 
-    fprintf(file, "{");
-    if (needLeftBracket) fprintf(file, "(");
-    printNodeReplaced(node->left, file);
-    if (needLeftBracket) fprintf(file, ")");
+    switch (event) {
+        case WALK_ENTER:
+            emitChar(out, '{');
+            if (needLeftBracket) emitChar(out, '(');
+            break;
+        case WALK_INFIX:
+            if (needLeftBracket) emitChar(out, ')');
+            emitText(out, "}^{");
+            if (needRightBracket) emitChar(out, '(');
+            break;
+        case WALK_LEAVE:
+        default:
+            if (needRightBracket) emitChar(out, ')');
+            emitChar(out, '}');
+            break;
+    }
+}
 
-    fprintf(file, "}^{");
+static void divTex(DiffEmitter_t* out, WalkEvent_t event) {
+    if (!out) return;
 
-    if (needRightBracket) fprintf(file, "(");
-    printNodeReplaced(node->right, file);
-    if (needRightBracket) fprintf(file, ")");
-    fprintf(file, "}");
+    const char* parts[] = {"\\frac{", "}{", "}"};
+    emitText(out, parts[event]);
 }
 
-void divTex(DiffNode_t* node, FILE* file) {
-    if (!node || !file) return;
+static void funcTex(DiffEmitter_t* out, const DiffOper_t* oper, WalkEvent_t event) {
+    if (!out) return;
 
-    fprintf(file, "\\frac{");
-    printNodeReplaced(node->left, file);
-    fprintf(file, "}{");
-    printNodeReplaced(node->right, file);
-    fprintf(file, "}");
+    if (event == WALK_ENTER) emitText(out, oper->tex);
+    if (event == WALK_LEAVE) emitText(out, oper->texClose);
 }
 
-void triglogTex(DiffNode_t* node, FILE* file, const char* prep) {
-    if (!node || !file) return;
+struct TexWalk_t {
+    DiffEmitter_t* out  = nullptr;
+    DiffNode_t*    root = nullptr;
+};
 
-    fprintf(file, "%s(", prep);
-    printNodeReplaced(node->right, file);
-    fprintf(file, ")");
-}
+// subtrees, replaced by letters, are printed as letters, except of the root itself
+static WalkResult_t texVisit(DiffNode_t* node, WalkEvent_t event, void* context) {
+    const TexWalk_t* walk = (const TexWalk_t*) context;
+    DiffEmitter_t*   out  = walk->out;
 
-void nodeToTex(DiffNode_t* node, FILE *file) {
-    if (!node || !file) return;
+    if (event == WALK_ENTER && node != walk->root && node->texSymb != 0) {
+        printTexSymb(node->texSymb, out);
+        return WALK_SKIP;
+    }
 
     switch (node->type) {
         case OP: 
             {
-                switch (node->value.opt) {
-                    case MUL_OP:
-                        anyTex(node, " \\cdot ", file);
-                        break;
-                    case DIV_OP:
-                        divTex(node, file);
-                        break;
-                    case SUB_OP:
-                        anyTex(node, " - ", file);
-                        break;
-                    case ADD_OP:
-                        anyTex(node, " + ", file);
-                        break;
-                    case POW_OP:
-                        powTex(node, file);
-                        break;
-                    case COS_OP:
-                        triglogTex(node, file, "cos");
+                const DiffOper_t* oper = operFind(node->value.opt);
+                if (!oper) break;
+
+                switch (oper->texStyle) {
+                    case TEX_INFIX:
+                        anyTex(node, oper->tex, out, event);
                         break;
-                    case SIN_OP:
-                        triglogTex(node, file, "sin");
+                    case TEX_FRAC:
+                        divTex(out, event);
                         break;
-                    case LN_OP:
-                        triglogTex(node, file, "ln");
+                    case TEX_POW:
+                        powTex(node, out, event);
                         break;
-                    case OPT_DEFAULT:
+                    case TEX_FUNC:
                     default:
+                        funcTex(out, oper, event);
                         break;
                 }
             };
             break;
         case NUM:
-            if (node->value.num > 0 || compDouble(node->value.num, 0)) fprintf(file, "%lg", node->value.num);
-            else fprintf(file, "(%lg)", node->value.num);
+            if (event != WALK_ENTER) break;
+
+            if (node->value.num > 0 || compDouble(node->value.num, 0)) {
+                emitDouble(out, node->value.num);
+            } else {
+                emitChar(out, '(');
+                emitDouble(out, node->value.num);
+                emitChar(out, ')');
+            }
             break;
         case VAR:
-            fprintf(file, "%c",  node->value.var);
+            if (event == WALK_ENTER) emitChar(out, node->value.var);
             break;
         case NODET_DEFAULT:
             break;
         default:
             break;
     }
+
+    return WALK_NEXT;
+}
+
+void nodeToTex(DiffNode_t* node, DiffEmitter_t* out) {
+    if (!node || !out) return;
+
+    TexWalk_t walk = {};
+    walk.out  = out;
+    walk.root = node;
+
+    treeWalk(node, texVisit, &walk);
+}
+
+// formula is built in buffer and goes to file by one write
+void nodeToTex(DiffNode_t* node, FILE *file) {
+    if (!node || !file) return;
+
+    DiffEmitter_t out;
+    emitterCtor(&out, EMIT_FILE, file);
+    nodeToTex(node, &out);
+    emitterDtor(&out);
 }
 
 bool isMulSubtree(DiffNode_t* node) {
     if (!node) return false;
 
-    if (!IS_MUL_OP(node) && !IS_POW_OP(node) && !IS_TRIG_LN(node) && !IS_NUM(node) && !IS_VAR(node)) return false;
-    if (L(node)) return isMulSubtree(L(node));
-    if (R(node)) return isMulSubtree(R(node));
+    while (node) {
+        if (!IS_MUL_OP(node) && !IS_POW_OP(node) && !IS_FUNC(node) && !IS_NUM(node) && !IS_VAR(node)) return false;
+        node = L(node) ? L(node) : R(node);
+    }
 
     return true;
 }
 
-void printNodeReplaced(DiffNode_t* node, FILE* file) {
-    if (!node || !file) return;
+void printNodeReplaced(DiffNode_t* node, DiffEmitter_t* out) {
+    if (!node || !out) return;
 
-    if (node->texSymb != '\0') {
-        fprintf(file, "%c", node->texSymb);
+    if (node->texSymb != 0) {
+        printTexSymb(node->texSymb, out);
         return;
     }
-    nodeToTex(node, file);
+    nodeToTex(node, out);
 }
 
-void printTexReplaced(DiffNode_t* node, FILE* file, DiffNode_t** replaced, int replacedSize) {
-    if (!node || !file || !replaced) return;
+void printTexReplaced(DiffNode_t* node, DiffEmitter_t* out, const ReplTable_t* table) {
+    if (!node || !out || !table) return;
 
-    fprintf(file, "$");
-    printNodeReplaced(node, file);
-    fprintf(file, "$");
+    emitChar(out, '$');
+    printNodeReplaced(node, out);
+    emitChar(out, '$');
 
-    if (replacedSize != 0) {
-        fprintf(file, ", где:\n\n");
+    // letters from previous steps were already explained
+    if (table->entryCount > table->firstNew) {
+        emitText(out, ", где:\n\n");
     }
-    for (int i = 0; i < replacedSize; i++) {
-        fprintf(file, "%c = $", 65 + i);
-        nodeToTex(replaced[i], file);
-        fprintf(file, "$\n\n");
+    for (size_t i = table->firstNew; i < table->entryCount; i++) {
+        printTexSymb(table->entries[i].symb, out);
+        emitText(out, " = $");
+        nodeToTex(table->entries[i].tree, out);
+        emitText(out, "$\n\n");
     }
 }
 
 DiffNode_t* firstDivNode(DiffNode_t* node) {
-    if (!node) return nullptr;
-
-    if (IS_DIV(node)) return node;
+    while (node) {
+        if (IS_OP(node) && IS_DIV(node)) return node;
 
-    if (L(node)) return firstDivNode(L(node));
-    if (R(node)) return firstDivNode(R(node));
+        node = L(node) ? L(node) : R(node);
+    }
 
     return nullptr;
 }
 
-bool needReplace(DiffNode_t* node, size_t maxTreeWidth) {
-    if (!node) return false;
+bool needReplace(DiffNode_t* node, ReplInfoMap_t* infoMap, size_t maxTreeWidth) {
+    const ReplInfo_t* info = replInfoGet(infoMap, node);
+    if (!info) return false;
 
     double coef = 0;
-    DiffNode_t* firstDiv = firstDivNode(node);
-    if (firstDiv) {
-        size_t leftDiv  = getTreeDepth(L(firstDiv));
-        size_t rightDiv = getTreeDepth(R(firstDiv));
+    if (info->firstDiv) {
+        const ReplInfo_t* leftDiv  = replInfoGet(infoMap, L(info->firstDiv));
+        const ReplInfo_t* rightDiv = replInfoGet(infoMap, R(info->firstDiv));
 
-        if (leftDiv == NEED_TEX_REPLACEMENT || rightDiv == NEED_TEX_REPLACEMENT) {
+        if ((leftDiv  && leftDiv->depth  == NEED_TEX_REPLACEMENT) ||
+            (rightDiv && rightDiv->depth == NEED_TEX_REPLACEMENT)) {
             coef = 1;
         }
     } else {
-        size_t nodeDepth = getTreeDepth(node);
-        if (nodeDepth == NEED_TEX_REPLACEMENT) coef = 1;
+        if (info->depth == NEED_TEX_REPLACEMENT) coef = 1;
     }
 
     if (IS_POW_OP(node)) coef *= POW_REPL_CONST;
 
+    // big tree: it's worth to hide every repeated subtree behind a letter
+    if (info->count > 1 && maxTreeWidth > CRIT_TREE_WIDTH) return true;
 
     return coef * (double) maxTreeWidth > CRIT_TREE_WIDTH;
 }
 
-void replaceNode(DiffNode_t* node, DiffNode_t** replaced, int* replacedIndex, size_t maxTreeWidth) {
-    if (!node || !replaced || !replacedIndex) return;
-    if (getTreeDepth(node) < NEED_TEX_REPLACEMENT) return;
+int replaceNode(DiffNode_t* node, ReplInfoMap_t* infoMap, ReplTable_t* table, size_t maxTreeWidth) {
+    DIFF_CHECK(!node || !infoMap || !table, DIFF_NULL);
+
+    // right subtree goes first, so letters are given in the same order as before
+    WalkStack_t stack = {};
+    walkStackCtor(&stack);
+    int error = walkStackPush(&stack, node);
+
+    while (error == DIFF_OK && stack.count) {
+        DiffNode_t* current = stack.frames[--stack.count].node;
+
+        const ReplInfo_t* info = replInfoGet(infoMap, current);
+        if (!info || info->depth < NEED_TEX_REPLACEMENT) continue;
+
+        if (needReplace(current, infoMap, maxTreeWidth)) {
+            unsigned symb = replTableFind(table, current, info->hash);
+            if (!symb) symb = replTableAdd(table, current, info->hash);
 
-    if (needReplace(node, maxTreeWidth)) {
-        for (int i = 0; i < *replacedIndex; i++) {
-            if (compareSubtrees(node, replaced[i])) {
-                node->texSymb = replaced[i]->texSymb;
-                return;
+            if (symb) {
+                replTableMark(table, current, symb);
+                continue;
             }
         }
 
-        replaced[*replacedIndex] = node;
-        node->texSymb = (char) (65 + *replacedIndex);
-        (*replacedIndex)++;
-        return;
+        if (current->left)                      error = walkStackPush(&stack, current->left);
+        if (error == DIFF_OK && current->right) error = walkStackPush(&stack, current->right);
     }
 
-    replaceNode(node->right, replaced, replacedIndex, maxTreeWidth);
-    replaceNode(node->left, replaced, replacedIndex, maxTreeWidth);
+    walkStackDtor(&stack);
+    return error;
+}
+
+void makeReplacements(DiffNode_t* start, DiffEmitter_t* out) {
+    if (!start || !out) return;
+
+    ReplInfoMap_t infoMap = {};
+    if (replInfoMapCtor(&infoMap, REPL_START_SIZE) != DIFF_OK) return;
+
+    size_t width = 0;
+    collectReplInfo(start, &infoMap, &width);
+    countReplHashes(&infoMap);
+
+    texLetters.firstNew = texLetters.entryCount;
+    // without memory some subtrees don't get letters, they are printed in full
+    replaceNode(start, &infoMap, &texLetters, max(1, width));
+    replInfoMapDtor(&infoMap);
+
+    printTexReplaced(start, out, &texLetters);
 }
 
-void makeReplacements(DiffNode_t* start, FILE* file) {
-    if (!start || !file) return;
+int removeLetters(DiffNode_t* start) {
+    if (!start) return DIFF_OK;
 
-    DiffNode_t** replacedNodes = (DiffNode_t**) calloc(MAX_REPLACE_COUNT, sizeof(DiffNode_t*));
-    int replacedIndex = 0;
-    replaceNode(start, replacedNodes, &replacedIndex, getMaxTreeWidth(start));
+    WalkStack_t stack = {};
+    walkStackCtor(&stack);
+    int error = walkStackPush(&stack, start);
 
-    printTexReplaced(start, file, replacedNodes, replacedIndex);
+    while (error == DIFF_OK && stack.count) {
+        DiffNode_t* node = stack.frames[--stack.count].node;
+        node->texSymb = 0;
+
+        if (L(node))                     error = walkStackPush(&stack, L(node));
+        if (error == DIFF_OK && R(node)) error = walkStackPush(&stack, R(node));
+    }
+
+    walkStackDtor(&stack);
+    return error;
 }
 
-void removeLetters(DiffNode_t* start) {
-    if (!start) return;
+int diffToTex(DiffNode_t* startNode, DiffEmitter_t* out) {
+    DIFF_CHECK(!startNode || !out, DIFF_NULL);
+    DIFF_CHECK(budgetOutput(diffBudget, texFile), DIFF_BUDGET);
+
+    ProfTimer_t timer = {};
+    profStart(&timer, PROF_TEX);
 
-    if (L(start))  removeLetters(L(start));
-    if (R(start)) removeLetters(R(start));
-    start->texSymb = '\0';
+    makeReplacements(startNode, out);
+    replTableUnmark(&texLetters);
+
+    profStop(&timer);
+    return DIFF_OK;
 }
 
 int diffToTex(DiffNode_t* startNode) {
-    DIFF_CHECK(!startNode, DIFF_NULL);
+    DiffEmitter_t out;
+    emitterCtor(&out, EMIT_FILE, texFile);
 
-    makeReplacements(startNode, texFile);
-    removeLetters(startNode);
+    int err = diffToTex(startNode, &out);
+    emitterDtor(&out);
 
-    return DIFF_OK;
+    return err;
 }
 
 void initTex(FILE* file) {
     if (!file) return;
 
-    fprintf(texFile, "\\documentclass{article}\n\n");
-    fprintf(texFile, "\\usepackage{amssymb, amsmath, multicol}\n");
-    fprintf(texFile, "\\usepackage{graphicx}\n");
-    fprintf(texFile, "\\usepackage{float}\n");
-    fprintf(texFile, "\\usepackage{wrapfig}\n");
-    fprintf(texFile, "\\usepackage[utf8]{inputenc}\n");
-    fprintf(texFile, "\\usepackage[T1,T2A]{fontenc}\n");
-    fprintf(texFile, "\\usepackage[russian]{babel}\n");
-    fprintf(texFile, "\\usepackage{minibox}\n");
-
-    fprintf(texFile, "\\title{[АНТИЗОРИЧ]\\\\ Введение в математический анализ. Непрерывность, пределы, дифферинцируемость}\n"
+    fprintf(file, "\\documentclass{article}\n\n");
+    fprintf(file, "\\usepackage{amssymb, amsmath, multicol}\n");
+    fprintf(file, "\\usepackage{graphicx}\n");
+    fprintf(file, "\\usepackage{float}\n");
+    fprintf(file, "\\usepackage{wrapfig}\n");
+    fprintf(file, "\\usepackage[utf8]{inputenc}\n");
+    fprintf(file, "\\usepackage[T1,T2A]{fontenc}\n");
+    fprintf(file, "\\usepackage[russian]{babel}\n");
+    fprintf(file, "\\usepackage{minibox}\n");
+
+    fprintf(file, "\\title{[АНТИЗОРИЧ]\\\\ Введение в математический анализ. Непрерывность, пределы, дифферинцируемость}\n"
                      "\\author{Владимир Антонович Зорич}\n"
                      "\\date{Декабрь 1985 год}\n");
 
-    fprintf(texFile, "\\begin{document}\n\\maketitle\n\\sloppy\n");
-    fprintf(texFile, "\\texttt{Lorem ipsum dolor sit amet, consectetur adipiscing elit, sed do eiusmod tempor incididunt ut labore "
+    fprintf(file, "\\begin{document}\n\\maketitle\n\\sloppy\n");
+    fprintf(file, "\\texttt{Lorem ipsum dolor sit amet, consectetur adipiscing elit, sed do eiusmod tempor incididunt ut labore "
     "et dolore magna aliqua. Ut enim ad minim veniam, quis nostrud exercitation ullamco laboris nisi ut aliquip ex "
     "ea commodo consequat. Duis aute irure dolor in reprehenderit in voluptate velit esse cillum dolore eu fugiat nulla pariatur." 
     "Excepteur sint occaecat cupidatat non proident, sunt in culpa qui officia deserunt mollit anim id est laborum.\\newline"
@@ -951,74 +1524,74 @@ void initTex(FILE* file) {
 void printLineToTex(FILE*file, const char* string) {
     if (!file) return;
 
-    fprintf(texFile, "%s", string);
+    fprintf(file, "%s", string);
 }
 
-void printRandomPhrase(FILE* file) {
-    if (!file) return;
+void printRandomPhrase(DiffEmitter_t* out) {
+    if (!out) return;
 
     int phLen = sizeof(phrases) / sizeof(phrases[0]);
 
-    fprintf(texFile, "%s", phrases[rand() % phLen]);
+    emitText(out, phrases[rand() % phLen]);
 }
 
 // OTHERS
 
-void changeVarToNums(DiffNode_t* node, double num) {
-    if (!node) return;
+int changeVarToNums(DiffNode_t* node, double num) {
+    if (!node) return DIFF_OK;
+
+    WalkStack_t stack = {};
+    walkStackCtor(&stack);
+    int error = walkStackPush(&stack, node);
 
-    if (IS_VAR(node)) {
-        node->type = NUM;
-        node->value.num = num;
+    while (error == DIFF_OK && stack.count) {
+        DiffNode_t* current = stack.frames[--stack.count].node;
+
+        if (IS_VAR(current)) {
+            current->type = NUM;
+            current->value.num = num;
+        }
+
+        if (current->left)                      error = walkStackPush(&stack, current->left);
+        if (error == DIFF_OK && current->right) error = walkStackPush(&stack, current->right);
     }
 
-    changeVarToNums(node->left, num);
-    changeVarToNums(node->right, num);
+    walkStackDtor(&stack);
+    return error;
 }
 
-#define BASIC_OPER(val1, val2, oper) val1 oper val2
-
 double funcValue(DiffNode_t* node, double x) {
-    if (!node) return 0;
+    return treeValue(node, x);
+}
 
-    if (IS_NUM(node)) return node->value.num;
-    if (IS_VAR(node)) return x;
-
-    int oper = node->value.opt;
-    switch(oper) {
-        case ADD_OP:
-            return BASIC_OPER(funcValue(L(node), x), funcValue(R(node), x), +);
-        case MUL_OP:
-            return BASIC_OPER(funcValue(L(node), x), funcValue(R(node), x), *);
-        case DIV_OP:
-            return BASIC_OPER(funcValue(L(node), x), funcValue(R(node), x), /);
-        case SUB_OP:
-            return BASIC_OPER(funcValue(L(node), x), funcValue(R(node), x), -);
-        case POW_OP:
-            return pow(funcValue(L(node), x), funcValue(R(node), x));
-        case SIN_OP:
-            return sin(funcValue(R(node), x));
-        case COS_OP:
-            return cos(funcValue(R(node), x));
-        case LN_OP:
-            return log(funcValue(R(node), x));
-        default:
-            return 0;
+// coefs[i] is value of i-th derivative in x0
+int tailorCoefs(DiffNode_t* node, int pow, double x0, double* coefs) {
+    DIFF_CHECK(!node || !coefs, DIFF_NULL);
+
+    coefs[0] = funcValue(node, x0);
+    DiffNode_t* diffed = node;
+
+    for (int i = 1; i <= pow; i++) {
+        DiffNode_t* next = nodeDiff(diffed, nullptr);
+        if (diffed != node) diffNodeDtor(diffed);
+        diffed = next;
+        if (!diffed) return budgetError();
+
+        coefs[i] = funcValue(diffed, x0);
     }
+    if (diffed != node) diffNodeDtor(diffed);
 
+    return DIFF_OK;
 }
 
-void tailor(DiffNode_t* node, int pow, double x0) {
-    if (!node || pow <= 0) return;
+void printTailor(const double* coefs, int pow, double x0) {
+    if (!coefs) return;
 
-    double funcVal = funcValue(node, x0);
     fprintf(texFile, "\n\n\\bigskip Ну что? Тейлора тебе дать?\n\n\\minibox[frame]{$");
-    if (!compDouble(funcVal, 0)) fprintf(texFile, "%lg + ", funcVal);
-    DiffNode_t* diffed = node;
+    if (!compDouble(coefs[0], 0)) fprintf(texFile, "%lg + ", coefs[0]);
 
     for (int i = 1; i <= pow; i++) {
-        diffed = nodeDiff(diffed, nullptr);
-        funcVal = funcValue(diffed, x0);
+        double funcVal = coefs[i];
         if (!compDouble(funcVal, 0)) {
             if (!compDouble(x0, 0)) fprintf(texFile, "\\frac{%lg}{%lu} \\cdot {(x-%lg)}^{%d} + ", funcVal, factorial(i), x0, i);
             else fprintf(texFile, "\\frac{%lg}{%lu} \\cdot {x}^{%d} + ", funcVal, factorial(i), i);
@@ -1027,93 +1600,182 @@ void tailor(DiffNode_t* node, int pow, double x0) {
     fprintf(texFile, "\\overline{\\overline{o}}({x}^{%d})$}\n\n", pow);
 }
 
-void printPlotOper(DiffNode_t* node, const char* oper, FILE* file) {
-    if (!node || !oper || !file) return;
+// the same as tailorCoefs(), but coefficients are taken from cache and put there
+int tailorCoefsCached(DiffNode_t* node, int pow, double x0, double* coefs) {
+    DIFF_CHECK(!node || !coefs, DIFF_NULL);
+
+    if (diffCacheGetTailor(diffCache, node, pow, x0, coefs) == DIFF_OK) return DIFF_OK;
 
-    if (!(IS_NUM(L(node)) || IS_VAR(L(node)))) fprintf(file, "(");
-    drawNode(node->left, file);
-    if (!(IS_NUM(L(node)) || IS_VAR(L(node)))) fprintf(file, ")");
+    int err = tailorCoefs(node, pow, x0, coefs);
+    if (err == DIFF_OK && diffCache) diffCachePutTailor(diffCache, node, pow, x0, coefs);
 
-    fprintf(file, "%s", oper);
+    return err;
+}
 
-    if (!(IS_NUM(R(node)) || IS_VAR(R(node)))) fprintf(file, "(");
-    drawNode(node->right, file);
-    if (!(IS_NUM(R(node)) || IS_VAR(R(node)))) fprintf(file, ")");
-} 
+void tailor(DiffNode_t* node, int pow, double x0) {
+    if (!node || pow <= 0) return;
 
-void printTrigPlot(DiffNode_t* node, FILE* file, const char* prep) {
-    if (!node || !file || !prep) return;
+    double* coefs = (double*) calloc((size_t) pow + 1, sizeof(double));
+    if (!coefs) return;
 
-    fprintf(file, "%s(", prep);
-    drawNode(node->right, file);
-    fprintf(file, ")");
+    if (tailorCoefsCached(node, pow, x0, coefs) == DIFF_OK) printTailor(coefs, pow, x0);
+    free(coefs);
 }
 
-void drawNode(DiffNode_t* node, FILE* file) {
-    if (!node || !file) return;
+struct InfixWalk_t {
+    DiffEmitter_t* out  = nullptr;
+    bool           plot = false;        // gnuplot names of operators instead of names of parser
+};
+
+// brackets are put around every operator, except of functions, they have their own
+static WalkResult_t infixVisit(DiffNode_t* node, WalkEvent_t event, void* context) {
+    const InfixWalk_t* walk = (const InfixWalk_t*) context;
+    DiffEmitter_t*     out  = walk->out;
 
     if (node->type == NUM) {
-        fprintf(file, "%lg", node->value.num);
-    } else if (node->type == VAR) {
-        fprintf(file, "%c", node->value.var);
-    } else {
-        switch (node->value.opt) {
-            case MUL_OP:
-                printPlotOper(node, " * ", file);
-                break;
-            case DIV_OP:
-                printPlotOper(node, " / ", file);
-                break;
-            case SUB_OP:
-                printPlotOper(node, " - ", file);
-                break;
-            case ADD_OP:
-                printPlotOper(node, " + ", file);
-                break;
-            case POW_OP:
-                printPlotOper(node, " ** ", file);
-                break;
-            case COS_OP:
-                printTrigPlot(node, file, "cos");
-                break;
-            case SIN_OP:
-                printTrigPlot(node, file, "sin");
-                break;
-            case LN_OP:
-                printTrigPlot(node, file, "log");
-                break;
-            case OPT_DEFAULT:
-            default:
-                break;
+        // parser reads all the digits back, gnuplot needs no more than "%lg"
+        if (event == WALK_ENTER && walk->plot) emitDouble(out, node->value.num);
+        if (event == WALK_ENTER && !walk->plot) emitExact(out, node->value.num);
+        return WALK_NEXT;
+    }
+    if (node->type == VAR) {
+        if (event == WALK_ENTER) emitChar(out, node->value.var);
+        return WALK_NEXT;
+    }
+    const DiffOper_t* info = operFind(node->value.opt);
+    if (!info) return WALK_NEXT;
+
+    const char* oper = walk->plot ? info->plot : info->name;
+
+    if (IS_FUNC(node)) {
+        if (event == WALK_ENTER) {
+            emitText(out, oper);
+            emitChar(out, '(');
         }
+        if (event == WALK_LEAVE) emitChar(out, ')');
+        return WALK_NEXT;
+    }
+
+    bool leftBracket  = !(IS_NUM(L(node)) || IS_VAR(L(node)));
+    bool rightBracket = !(IS_NUM(R(node)) || IS_VAR(R(node)));
+
+    switch (event) {
+        case WALK_ENTER:
+            if (leftBracket) emitChar(out, '(');
+            break;
+        case WALK_INFIX:
+            if (leftBracket) emitChar(out, ')');
+            emitText(out, oper);
+            if (rightBracket) emitChar(out, '(');
+            break;
+        case WALK_LEAVE:
+        default:
+            if (rightBracket) emitChar(out, ')');
+            break;
     }
+
+    return WALK_NEXT;
+}
+
+static void infixWrite(DiffNode_t* node, DiffEmitter_t* out, bool plot) {
+    InfixWalk_t walk = {};
+    walk.out  = out;
+    walk.plot = plot;
+
+    treeWalk(node, infixVisit, &walk);
+}
+
+// prints equation in gnuplot syntax
+void drawNode(DiffNode_t* node, DiffEmitter_t* out) {
+    if (!node || !out) return;
+
+    infixWrite(node, out, true);
+}
+
+void drawNode(DiffNode_t* node, FILE* file) {
+    if (!node || !file) return;
+
+    DiffEmitter_t out;
+    emitterCtor(&out, EMIT_FILE, file);
+    drawNode(node, &out);
+    emitterDtor(&out);
+}
+
+// prints equation in the same syntax as parser reads it
+void nodeToInfix(DiffNode_t* node, DiffEmitter_t* out) {
+    if (!node || !out) return;
+
+    infixWrite(node, out, false);
+}
+
+void nodeToInfix(DiffNode_t* node, FILE* file) {
+    if (!node || !file) return;
+
+    DiffEmitter_t out;
+    emitterCtor(&out, EMIT_FILE, file);
+    nodeToInfix(node, &out);
+    emitterDtor(&out);
 }
 
 void drawGraph(DiffNode_t* node, double left, double right) {
     if (!node) return;
 
-    FILE* file = popen("gnuplot -persistent", "w");
-    if (!file) return;
+    if (!renderQueue) renderQueue = renderQueueCtor();
+    if (!renderQueue || renderQueue->mode == RENDER_OFF) return;
+
+    char name  [MAX_ARTIFACT_LENGTH / 2] = "";
+    char script[MAX_ARTIFACT_LENGTH] = "";
+    char image [MAX_ARTIFACT_LENGTH] = "";
+
+    // watch mode: graph of unchanged equation is already rendered
+    if (!diffMemoGetPlot(diffMemo, node, left, right, image, sizeof(image))) {
+        if (renderArtifact(renderQueue, name, sizeof(name), "graph") != DIFF_OK) return;
+        snprintf(script, sizeof(script), "%s.gp",  name);
+        snprintf(image,  sizeof(image),  "%s.png", name);
 
-    fprintf(file, "f(x)=");
-    drawNode(node, file);
-    fprintf(file, "\nset terminal png size 960,720\nset samples 20000\nset output 'graph.png'\n"
-                  "set xzeroaxis \nset yzeroaxis\nplot [%lg:%lg] f(x)\nexit\n", left, right);
-    pclose(file);
+        FILE* file = fopen(script, "w");
+        if (!file) return;
+
+        fprintf(file, "f(x)=");
+        drawNode(node, file);
+        fprintf(file, "\nset terminal png size 960,720\nset samples 20000\nset output '%s'\n"
+                      "set xzeroaxis \nset yzeroaxis\nplot [%lg:%lg] f(x)\nexit\n", image, left, right);
+        fclose(file);
+
+        // script goes away whatever gnuplot did, status of gnuplot is status of command
+        char quotedScript[2 * MAX_ARTIFACT_LENGTH] = "";
+        if (renderQuote(quotedScript, sizeof(quotedScript), script) != DIFF_OK) {
+            remove(script);
+            return;
+        }
+
+        char command[5 * MAX_ARTIFACT_LENGTH] = "";
+        snprintf(command, sizeof(command), "gnuplot %s > /dev/null 2>&1; status=$?; rm -f %s; exit $status",
+                 quotedScript, quotedScript);
+        int pushed = renderQueuePush(renderQueue, command, image);
+
+        // stub renderer doesn't run commands, so there is nobody else to remove script
+        if (pushed != DIFF_OK || renderQueue->mode == RENDER_STUB) remove(script);
+        if (pushed != DIFF_OK) return;
+
+        diffMemoPutPlot(diffMemo, node, left, right, image);
+    }
 
     fprintf(texFile, "\n\n \\bigskip График функции ");
     diffToTex(node);
     fprintf(texFile, "имеет вид:\n\n");
     fprintf(texFile, "\\begin{figure}[h]"
-                        "\\center{\\includegraphics[width=100mm]{graph.png}}"
+                        "\\center{\\includegraphics[width=100mm]{%s}}"
                         "\\label{fig:t}"
-                     "\\end{figure}");
+                     "\\end{figure}", image);
 }
 
 void equTangent(DiffNode_t* node, double x0) {
     if (!node) return;
 
     DiffNode_t* tangent = nodeDiff(node, nullptr);
+    if (!tangent) return;
+
     double k = funcValue(tangent, x0);
     double b = funcValue(node, x0) - k * x0;
     fprintf(texFile, "\n\n \\minibox[frame]{\\centerline{Уравнение касательной в точке x=%lg имеет вид:}\\\\\n", x0);
@@ -1122,112 +1784,146 @@ void equTangent(DiffNode_t* node, double x0) {
     diffNodeDtor(tangent);
 }
 
-// VISUAL DUMP
+void equRoots(DiffNode_t* node, double left, double right) {
+    if (!node) return;
 
-void printNodeVal(DiffNode_t* node, FILE* file) {
-    if (!node || !file) return;
+    RootList_t list = {};
+    if (rootListCtor(&list) != DIFF_OK) return;
 
-    switch (node->type) {
-        case OP: 
-            {
-                switch (node->value.opt) {
-                    case MUL_OP:
-                        fprintf(file, "*");
-                        break;
-                    case DIV_OP:
-                        fprintf(file, "/");
-                        break;
-                    case SUB_OP:
-                        fprintf(file, "-");
-                        break;
-                    case ADD_OP:
-                        fprintf(file, "+");
-                        break;
-                    case POW_OP:
-                        fprintf(file, "^");
-                        break;
-                    case SIN_OP:
-                        fprintf(file, "SIN_OP");
-                        break;
-                    case COS_OP:
-                        fprintf(file, "COS_OP");
-                        break;
-                    case LN_OP:
-                        fprintf(file, "LN_OP");
-                        break;
-                    case OPT_DEFAULT:
-                        break;
-                    default:
-                        break;
-                }
-            };
+    int workers = diffOptions.rootWorkers ? diffOptions.rootWorkers : DEFAULT_ROOT_WORKERS;
+    if (findRoots(node, left, right, &list, workers) != DIFF_OK) {
+        fprintf(stderr, "Can't find roots on [%lg, %lg]\n", left, right);
+        rootListDtor(&list);
+        return;
+    }
+
+    const char* kindNames[] = {"нуль", "минимум", "максимум", "стационарная точка"};
+
+    fprintf(texFile, "\n\n \\bigskip Нули и экстремумы функции на отрезке $[%lg, %lg]$", left, right);
+    if (!list.count) {
+        fprintf(texFile, " не найдены.\n\n");
+    } else {
+        fprintf(texFile, ":\n\\begin{itemize}\n");
+        for (size_t i = 0; i < list.count; i++) {
+            const RootPoint_t* point = &list.points[i];
+            fprintf(texFile, "\\item $x = %.12lg$, $f(x) = %.12lg$ --- %s\n", point->x, point->y, kindNames[point->kind]);
+        }
+        fprintf(texFile, "\\end{itemize}\n");
+        if (list.full) fprintf(texFile, "Найдено больше %zu точек, показаны не все.\n", list.count);
+        fprintf(texFile, "\n");
+    }
+
+    rootListDtor(&list);
+}
+
+void equIntegral(DiffNode_t* node, double left, double right) {
+    if (!node) return;
+
+    // graph range may be given in any order
+    double from = fmin(left, right), to = fmax(left, right);
+
+    IntegralResult_t result = {};
+    int workers = diffOptions.integralWorkers ? diffOptions.integralWorkers : DEFAULT_INTEGRAL_WORKERS;
+    if (integrate(node, from, to, &result, workers) != DIFF_OK) {
+        fprintf(stderr, "Can't integrate on [%lg, %lg]\n", from, to);
+        return;
+    }
+
+    fprintf(texFile, "\n\n \\bigskip Интеграл функции по отрезку $[%lg, %lg]$:\n", from, to);
+    fprintf(texFile, "$$\\int_{%lg}^{%lg} f(x)\\,dx \\approx %.12lg \\pm %.2lg$$\n", from, to, result.value, result.error);
+
+    switch (result.status) {
+        case INTEGRAL_OK:
             break;
-        case NUM:
-            fprintf(file, "%lg", node->value.num);
+        case INTEGRAL_INACCURATE:
+            fprintf(texFile, "Заданная точность не достигнута, оценка погрешности может быть занижена.\n");
             break;
-        case VAR:
-            fprintf(file, "%c",  node->value.var);
+        case INTEGRAL_SINGULAR:
+            fprintf(texFile, "Около $x = %.12lg$ функция неограничена, интеграл может расходиться.\n", result.point);
+            break;
+        case INTEGRAL_DOMAIN:
+            if (result.defined > 0) {
+                fprintf(texFile, "Функция определена не на всём отрезке (граница области определения $x \\approx %.12lg$), "
+                                 "посчитан интеграл по области определения.\n", result.point);
+            } else {
+                fprintf(texFile, "Функция не определена на этом отрезке.\n");
+            }
             break;
-        case NODET_DEFAULT:
         default:
             break;
     }
+    fprintf(texFile, "\n");
 }
 
-void graphNode(DiffNode_t *node, FILE *tempFile) {
-    if (!node || !tempFile) return;
+// approximations of f and f' go to TeX with their pieces, degrees and error bounds
+void equCheb(DiffNode_t* node, double left, double right) {
+    if (!node) return;
+
+    double from      = fmin(left, right), to = fmax(left, right);
+    double tolerance = diffOptions.chebTolerance > 0 ? diffOptions.chebTolerance : CHEB_DEFAULT_TOLERANCE;
 
-    fprintf(
-                tempFile, 
-                "\tlabel%p[shape=record, style=\"rounded, filled\", fillcolor=red, label=\"{ {val: ",
-                node
-            );
+    fprintf(texFile, "\n\n \\bigskip Кусочно-чебышёвское приближение на отрезке $[%lg, %lg]$ "
+                     "(относительная точность %lg):\n\\begin{itemize}\n", from, to, tolerance);
 
-    printNodeVal(node, tempFile);
-    
-    fprintf(
-                tempFile, 
-                " | {left: %p | right: %p} | current: %p | prev %p | type: %d }}\"];\n", 
-                node->left,
-                node->right,
-                node,
-                node->prev,
-                node->type
-            );
+    const char* names[] = {"f(x)", "f'(x)"};
+    for (int order = 0; order < 2; order++) {
+        const DiffCheb_t* cheb = nullptr;
+        if (chebCacheGet(&chebCache, node, order, from, to, tolerance, &cheb) != DIFF_OK) {
+            fprintf(stderr, "Can't approximate %s on [%lg, %lg]\n", names[order], from, to);
+            continue;
+        }
 
-    if (node->left) {
-        fprintf(tempFile, "\tlabel%p->label%p [color=\"red\", style=\"dashed\",arrowhead=\"none\"]", node->left, node);
+        fprintf(texFile, "\\item $%s$: кусков %zu, степень до %d, погрешность не больше %.2lg", names[order],
+                         cheb->count, cheb->maxDegree, cheb->error);
+        if (cheb->exactCount) fprintf(texFile, " (на %zu кусках у особых точек и вне области определения функция считается по дереву)", cheb->exactCount);
+        fprintf(texFile, "\n");
     }
-    if (node->right) {
-        fprintf(tempFile, "\tlabel%p->label%p [color=\"red\", style=\"dashed\",arrowhead=\"none\"]", node->right, node);
+
+    fprintf(texFile, "\\end{itemize}\n\n");
+}
+
+// document of one job is finished and rendered, viewer is opened only if view
+void finishTex(bool view) {
+    if (traceFile) {
+        fclose(traceFile);
+        traceFile = nullptr;
     }
 
-    if (node->left) graphNode(node->left, tempFile);
+    diffCacheClose(diffCache);
+    diffCache = nullptr;
 
-    if (node->right) graphNode(node->right, tempFile);
-}
+    if (!texFile) return;
 
-void graphDump(DiffNode_t *node) {
-    if (!node) return;
+    fprintf(texFile, "\n\\end{document}");
+    fclose(texFile);
+    texFile = nullptr;
+    replTableDtor(&texLetters);
+
+    if (!renderQueue) renderQueue = renderQueueCtor();
 
-    FILE *tempFile = fopen("temp.dot", "w");
-    if (!tempFile) return;
-    fprintf(tempFile, "digraph tree {\n");
-    fprintf(tempFile, "\trankdir=HR;\n");
+    // pdflatex needs all the graphics, so wait for them first
+    renderQueueWait(renderQueue);
 
-    graphNode(node, tempFile);
+    char pdfPath[MAX_ARTIFACT_LENGTH] = "";
+    size_t nameLen = strlen(texPath);
+    if (nameLen > 4 && !strcmp(texPath + nameLen - 4, ".tex")) nameLen -= 4;
+    snprintf(pdfPath, sizeof(pdfPath), "%.*s.pdf", (int) nameLen, texPath);
 
-    fprintf(tempFile, "}");
-    fclose(tempFile);
+    // name of document may be given by caller of openDiffFile()
+    char quotedTex[2 * MAX_ARTIFACT_LENGTH] = "";
+    char quotedPdf[2 * MAX_ARTIFACT_LENGTH] = "";
+    if (renderQuote(quotedTex, sizeof(quotedTex), texPath) != DIFF_OK || renderQuote(quotedPdf, sizeof(quotedPdf), pdfPath) != DIFF_OK) return;
 
-    system("dot -Tsvg temp.dot > graph.png && xdg-open graph.png");
+    char command[5 * MAX_ARTIFACT_LENGTH] = "";
+    snprintf(command, sizeof(command), "pdflatex %s > /dev/null 2>&1%s%s", quotedTex, view ? " && xdg-open " : "", view ? quotedPdf : "");
+    renderQueuePush(renderQueue, command, pdfPath);
 }
 
 void closeLogfile(void) {
-    if (texFile) {
-        fprintf(texFile, "\n\\end{document}");
-        fclose(texFile);
+    finishTex(true);
 
-        system("pdflatex zorich.tex > /dev/null 2>&1 && xdg-open zorich.pdf");
-    }
-}
\ No newline at end of file
+    renderQueueDtor(renderQueue);
+    renderQueue = nullptr;
+
+    chebCacheDtor(&chebCache);
+}
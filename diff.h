@@ -8,12 +8,17 @@
 #include <string.h>
 #include <time.h>
 #include <sys/stat.h>
+#include <atomic>
 
 const int MAX_WORD_LENGTH = 4096;
 
-const double EPSILON = 1e-12;
+const size_t TEXT_CHUNK_SIZE = 1 << 16;     // input, that can't be mapped, is read by such chunks
+
+const size_t DIFF_NUMBER_SIZE = 512;        // longest number in equation, printed ones are below EMIT_EXACT_SIZE
 
-const int MAX_REPLACE_COUNT = 52;
+const int SYNTAX_CONTEXT_LENGTH = 64;       // symbols after syntax error, that are printed
+
+const double EPSILON = 1e-12;
 
 const int NEED_TEX_REPLACEMENT = 4;
 
@@ -53,6 +58,9 @@ enum DiffError_t {
     DIFF_NULL       = 2 << 2,
     DIFF_VALUE_NULL = 2 << 3,
     DIFF_NO_MEM     = 2 << 4,
+    DIFF_RENDER     = 2 << 5,
+    DIFF_SYNTAX     = 2 << 6,
+    DIFF_BUDGET     = 2 << 7,       // job was stopped by its limits (see budget.h)
 };
 
 enum NodeType_t {
@@ -71,9 +79,20 @@ enum OpType_t {
     SIN_OP         =  5,
     COS_OP         =  6,
     LN_OP          =  7,
+    TAN_OP         =  8,
+    EXP_OP         =  9,
+    SQRT_OP        = 10,
+    ASIN_OP        = 11,
+    ACOS_OP        = 12,
+    ATAN_OP        = 13,
+    SINH_OP        = 14,
+    COSH_OP        = 15,
+    ABS_OP         = 16,
     OPT_DEFAULT = -1,
 };
 
+const int OP_COUNT = 17;        // operators are numbered from 0, description of every one is in oper.h
+
 struct DiffNode_t {
     NodeType_t  type = NODET_DEFAULT;
 
@@ -88,7 +107,45 @@ struct DiffNode_t {
     DiffNode_t *right = nullptr;
     DiffNode_t *prev  = nullptr;
 
-    char texSymb = '\0';
+    unsigned texSymb = 0;     // number of letter, that replaces subtree in TeX
+};
+
+// counters of tree nodes, for benchmarks and profile: usual runs don't turn them on and don't pay for atomics
+struct DiffStats_t {
+    bool                enabled   = false;  // set before threads are started
+    std::atomic<size_t> allocated {0};
+    std::atomic<size_t> freed     {0};
+    std::atomic<size_t> copied    {0};      // nodes made by nodeCopy
+    std::atomic<size_t> peak      {0};      // max count of live nodes
+};
+
+extern DiffStats_t diffStats;
+
+struct DumpOptions_t;
+
+struct DiffLimits_t;
+
+enum DiffOutput_t {
+    OUTPUT_TEX   = 0,       // narrated zorich.tex, rendered by pdflatex
+    OUTPUT_JSON  = 1,       // one JSON line to stdout: derivative, tailor, tangent, timings
+    OUTPUT_INFIX = 2,       // only derivative in syntax of parser
+};
+
+struct DiffOptions_t {
+    const char* traceName = nullptr;        // JSON trace of differentiation steps
+    const char* savePath  = nullptr;        // binary image with equation and its simplified derivative
+    const char* cacheDir  = nullptr;        // on-disk cache of derivatives and tailor coefficients
+    size_t      cacheSize = 0;              // max size of cache in bytes, 0 for default
+    const char* dumpPath  = nullptr;        // DOT/JSON dump of simplified derivative
+    const DumpOptions_t* dumpOptions = nullptr;
+    const char* profilePath = nullptr;      // JSON line with phase timings and node counters is appended here
+    bool        roots       = false;        // zeros and extrema on graph range go to TeX
+    int         rootWorkers = 0;            // threads of root finder, 0 for default
+    bool        integral    = false;        // definite integral over graph range goes to TeX
+    int         integralWorkers = 0;        // threads of integrator, 0 for default
+    double      chebTolerance   = 0;        // Chebyshev approximation of f and f' on graph range, 0 - none
+    const DiffLimits_t* limits = nullptr;   // nodes, memory, time and output of job, nullptr - no limits
+    DiffOutput_t output = OUTPUT_TEX;
 };
 
 // FOR DSL
@@ -101,9 +158,7 @@ DiffNode_t* newNodeOper(OpType_t oper, DiffNode_t* left, DiffNode_t* right);
 #define RR(node) R(R(node))
 #define LL(node) L(L(node))
 
-#define dL nodeDiff(L(startNode), file)
 #define cL nodeCopy(L(startNode))
-#define dR nodeDiff(R(startNode), file)
 #define cR nodeCopy(R(startNode))
 
 #define IS_OP(node)  (node->type == OP)
@@ -111,14 +166,10 @@ DiffNode_t* newNodeOper(OpType_t oper, DiffNode_t* left, DiffNode_t* right);
 #define IS_VAR(node) (node->type == VAR)
 #define IS_POSITIVE(node) ((node)->value.num > 0)
 
-#define IS_COS_OP(node) node->value.opt == COS_OP
-#define IS_SIN_OP(node) node->value.opt == SIN_OP
-#define IS_LN_OP(node) node->value.opt == LN_OP
 #define IS_DIV(node) node->value.opt == DIV_OP
 #define IS_MUL_OP(node) (node->value.opt == MUL_OP)
 #define IS_ADD_OP(node) node->value.opt == ADD_OP
 #define IS_POW_OP(node) (node->value.opt == POW_OP)
-#define IS_TRIG_LN(node) (node->value.opt == COS_OP || node->value.opt == SIN_OP || node->value.opt == LN_OP)
 
 #define ADD(node1, node2) newNodeOper(ADD_OP, node1,   node2)
 #define SUB(node1, node2) newNodeOper(SUB_OP, node1,   node2)
@@ -128,6 +179,9 @@ DiffNode_t* newNodeOper(OpType_t oper, DiffNode_t* left, DiffNode_t* right);
 #define COS(node)         newNodeOper(COS_OP, nullptr, node)
 #define SIN(node)         newNodeOper(SIN_OP, nullptr, node)
 #define LN(node)          newNodeOper(LN_OP,  nullptr, node)
+#define SQRT(node)        newNodeOper(SQRT_OP, nullptr, node)
+#define SINH(node)        newNodeOper(SINH_OP, nullptr, node)
+#define COSH(node)        newNodeOper(COSH_OP, nullptr, node)
 
 #define SET_MUL_OP(node) {     \
     node->type      = OP;       \
@@ -152,18 +206,26 @@ DiffNode_t* newNodeOper(OpType_t oper, DiffNode_t* left, DiffNode_t* right);
 
 DiffNode_t* diffNodeCtor(DiffNode_t* left, DiffNode_t* right, DiffNode_t* prev, int* err = nullptr);
 
+void diffNodeFree(DiffNode_t* node);
+
+void diffNodePool(size_t limit);
+
+void diffStatsReset(void);
+
 DiffNode_t* newNumNode(DiffNode_t* left, DiffNode_t* right, DiffNode_t* prev, double value);
 
 bool compDouble(const double value1, const double value2);
 
 size_t max(size_t first, size_t second);
 
-size_t getTreeDepth(DiffNode_t* node);
+size_t getTreeDepth(DiffNode_t* node, int* err = nullptr);
 
 size_t getMaxTreeWidth(DiffNode_t* node);
 
 size_t getTreeWidth(DiffNode_t* node);
 
+size_t getTreeSize(DiffNode_t* node, int* err = nullptr);
+
 bool isNodeInList(const DiffNode_t* node, DiffNode_t** replaced, const int* replacedIndex);
 
 bool compareSubtrees(DiffNode_t* node1, DiffNode_t* node2);
@@ -172,27 +234,39 @@ size_t factorial(int pow);
 
 // READ TREE FROM FILE
 
-void addPrevs(DiffNode_t* start);
+// Text of input file. Regular file is mapped to memory and parsed right there, pipes (and files, that fill
+// their last page, so there is no place for '\0') are read by chunks. Text always ends with '\0'.
+struct DiffText_t {
+    char*  text   = nullptr;
+    size_t size   = 0;
+    size_t mapped = 0;              // length of mapping, 0 - text lies in heap
+};
 
-DiffNode_t* getG(char** s);
+int diffTextOpen(DiffText_t* text, FILE* file);
 
-DiffNode_t* getE(char** s);
+void diffTextClose(DiffText_t* text);
 
-DiffNode_t* getT(char** s);
+// equation of input file and stream of lines after it (tailor, graph and tangent arguments)
+struct DiffInput_t {
+    DiffText_t  text = {};
+    DiffNode_t* root = nullptr;         // nullptr - syntax error
+    FILE*       args = nullptr;
+    char*       line = nullptr;         // MAX_WORD_LENGTH symbols for mGetline
+};
 
-DiffNode_t* getP(char** s);
+int diffInputOpen(DiffInput_t* input, FILE* readFile);
 
-DiffNode_t* parseTrig(OpType_t oper, char** s);
+void diffInputClose(DiffInput_t* input);
 
-DiffNode_t* getX(char** s);
+int addPrevs(DiffNode_t* start);
+
+DiffNode_t* getG(char** s, bool quiet = false);
 
 DiffNode_t* setOper(DiffNode_t* val1, DiffNode_t* val2, OpType_t oper);
 
 DiffNode_t* getN(char** s);
 
-DiffNode_t* getSt(char** s);
-
-DiffNode_t* parseEquation(char** s);
+DiffNode_t* parseEquation(char** s, bool quiet = false);
 
 DiffNode_t* nodeCopy(DiffNode_t* nodeToCopy);
 
@@ -210,11 +284,15 @@ void easierEqu(DiffNode_t* start);
 
 // ALL FOR DIFF
 
-DiffNode_t* diffPow(DiffNode_t* startNode, FILE* file);
+struct DiffSteps_t;
+
+DiffNode_t* diffPow(DiffNode_t* startNode, DiffNode_t* dLeft, DiffNode_t* dRight, DiffSteps_t* steps);
 
-DiffNode_t* nodeDiff(DiffNode_t* startNode, FILE* file);
+DiffNode_t* nodeDiff(DiffNode_t* startNode, DiffSteps_t* steps, char var = '\0');
 
-int equDiff(DiffNode_t* start);
+int equDerivative(DiffNode_t* start, DiffNode_t** result);
+
+int equDiff(DiffNode_t* start, DiffNode_t** result = nullptr);
 
 void parseTailorArgs(DiffNode_t* root, FILE* readFile, char* line);
 
@@ -222,75 +300,89 @@ void parseGraphArgs(DiffNode_t* root, FILE* readFile, char* line);
 
 void parseTangentArgs(DiffNode_t* root, FILE* readFile, char* line);
 
+void saveDerivative(DiffNode_t* root, DiffNode_t* derivative);
+
 DiffNode_t* parseArgs(FILE* readFile);
 
-char *mGetline(FILE *stream, char *s, char dump = EOF);
+char *mGetline(FILE *stream, char *s, size_t size = MAX_WORD_LENGTH, char dump = EOF);
 
-DiffNode_t* openDiffFile(const char *fileName, const char *texName = "zorich.tex");
+DiffNode_t* openDiffFile(const char *fileName, const char *texName = "zorich.tex", const DiffOptions_t* options = nullptr);
 
 void diffNodeDtor(DiffNode_t* node);
 
 // TEX OUTPUT
 
-void anyTex(DiffNode_t* node, const char* oper, FILE* file);
+struct DiffEmitter_t;
 
-void powTex(DiffNode_t* node, FILE* file);
+void nodeToTex(DiffNode_t* node, FILE *file);
 
-void divTex(DiffNode_t* node, FILE* file);
+void nodeToTex(DiffNode_t* node, DiffEmitter_t* out);
 
-void triglogTex(DiffNode_t* node, FILE* file, const char* prep);
+bool isMulSubtree(DiffNode_t* node);
 
-void nodeToTex(DiffNode_t* node, FILE *file);
+void printNodeReplaced(DiffNode_t* node, DiffEmitter_t* out);
 
-bool isMulSubtree(DiffNode_t* node);
+struct ReplTable_t;
 
-void printNodeReplaced(DiffNode_t* node, FILE* file);
+struct ReplInfoMap_t;
 
-void printTexReplaced(DiffNode_t* node, FILE* file, DiffNode_t** replaced, int replacedSize);
+void printTexReplaced(DiffNode_t* node, DiffEmitter_t* out, const ReplTable_t* table);
 
 DiffNode_t* firstDivNode(DiffNode_t* node);
 
-bool needReplace(DiffNode_t* node, size_t maxTreeWidth);
+bool needReplace(DiffNode_t* node, ReplInfoMap_t* infoMap, size_t maxTreeWidth);
 
-void replaceNode(DiffNode_t* node, DiffNode_t** replaced, int* replacedIndex, size_t maxTreeWidth);
+int replaceNode(DiffNode_t* node, ReplInfoMap_t* infoMap, ReplTable_t* table, size_t maxTreeWidth);
 
-void makeReplacements(DiffNode_t* start, FILE* file);
+void makeReplacements(DiffNode_t* start, DiffEmitter_t* out);
 
-void removeLetters(DiffNode_t* start);
+int removeLetters(DiffNode_t* start);
 
 int diffToTex(DiffNode_t* startNode);
 
+int diffToTex(DiffNode_t* startNode, DiffEmitter_t* out);
+
 void initTex(FILE* file);
 
 void printLineToTex(FILE* file, const char* string);
 
-void printRandomPhrase(FILE* file);
+void printRandomPhrase(DiffEmitter_t* out);
 
 // OTHER FUNCS
 
-void changeVarToNums(DiffNode_t* node, double num);
+int changeVarToNums(DiffNode_t* node, double num);
 
 double funcValue(DiffNode_t* node, double x);
 
-void tailor(DiffNode_t* node, int pow, double x0);
+int tailorCoefs(DiffNode_t* node, int pow, double x0, double* coefs);
+
+void printTailor(const double* coefs, int pow, double x0);
 
-void printPlotOper (DiffNode_t* node, const char* oper, FILE* file);
+int tailorCoefsCached(DiffNode_t* node, int pow, double x0, double* coefs);
 
-void printTrigPlot(DiffNode_t* node, FILE* file, const char* prep);
+void tailor(DiffNode_t* node, int pow, double x0);
 
 void drawNode(DiffNode_t* node, FILE* file);
 
+void drawNode(DiffNode_t* node, DiffEmitter_t* out);
+
+void nodeToInfix(DiffNode_t* node, FILE* file);
+
+void nodeToInfix(DiffNode_t* node, DiffEmitter_t* out);
+
 void drawGraph(DiffNode_t* node, double left = -10, double right = 10);
 
 void equTangent(DiffNode_t* node, double x0);
 
-//
+void equRoots(DiffNode_t* node, double left, double right);
 
-void printNodeVal(DiffNode_t* node, FILE* file);
+void equIntegral(DiffNode_t* node, double left, double right);
 
-void graphNode(DiffNode_t *node, FILE *tempFile);
+void equCheb(DiffNode_t* node, double left, double right);
+
+//
 
-void graphDump(DiffNode_t *node);
+void finishTex(bool view);
 
 void closeLogfile(void);
 
@@ -0,0 +1,295 @@
+#include <stdarg.h>
+
+#include "dump.h"
+#include "hash.h"
+#include "oper.h"
+#include "render.h"
+
+// BUFFERED WRITER
+
+void dumpFlush(DumpBuffer_t* buffer) {
+    if (!buffer || !buffer->file || !buffer->size) return;
+
+    fwrite(buffer->data, sizeof(char), buffer->size, buffer->file);
+    buffer->size = 0;
+}
+
+void dumpPrintf(DumpBuffer_t* buffer, const char* format, ...) {
+    if (!buffer || !buffer->file || !format) return;
+
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(buffer->data + buffer->size, DUMP_BUFFER_SIZE - buffer->size, format, args);
+    va_end(args);
+
+    if (length < 0) return;
+    if ((size_t) length < DUMP_BUFFER_SIZE - buffer->size) {
+        buffer->size += (size_t) length;
+        return;
+    }
+
+    // record didn't fit, so it is written again after flush
+    dumpFlush(buffer);
+
+    va_start(args, format);
+    if ((size_t) length < DUMP_BUFFER_SIZE) buffer->size = (size_t) vsnprintf(buffer->data, DUMP_BUFFER_SIZE, format, args);
+    else                                    vfprintf(buffer->file, format, args);
+    va_end(args);
+}
+
+void dumpLabel(DumpBuffer_t* buffer, const DiffNode_t* node) {
+    if (!buffer || !node) return;
+
+    switch (node->type) {
+        case OP:
+            {
+                const DiffOper_t* oper = operFind(node->value.opt);
+                if (oper) dumpPrintf(buffer, "%s", oper->name);
+            }
+            break;
+        case NUM:
+            dumpPrintf(buffer, "%lg", node->value.num);
+            break;
+        case VAR:
+            dumpPrintf(buffer, "%c", node->value.var);
+            break;
+        case NODET_DEFAULT:
+        default:
+            break;
+    }
+}
+
+// SHARED SUBTREES
+
+static int dumpSharedGrow(DumpSharedMap_t* map) {
+    size_t size = map->size ? map->size * 2 : REPL_START_SIZE;
+
+    DumpShared_t* cells = (DumpShared_t*) calloc(size, sizeof(DumpShared_t));
+    DIFF_CHECK(!cells, DIFF_NO_MEM);
+
+    for (size_t i = 0; i < map->size; i++) {
+        if (!map->cells[i].node) continue;
+
+        size_t slot = hashMix(map->cells[i].hash) & (size - 1);
+        while (cells[slot].node) slot = (slot + 1) & (size - 1);
+        cells[slot] = map->cells[i];
+    }
+
+    free(map->cells);
+    map->cells = cells;
+    map->size  = size;
+
+    return DIFF_OK;
+}
+
+// returns id of equal subtree, that is already written, or 0
+size_t dumpSharedFind(const DumpSharedMap_t* map, DiffNode_t* node, size_t hash) {
+    if (!map || !map->cells || !node) return 0;
+
+    size_t mask = map->size - 1;
+    for (size_t slot = hashMix(hash) & mask; map->cells[slot].node; slot = (slot + 1) & mask) {
+        DumpShared_t* cell = &map->cells[slot];
+        if (cell->hash == hash && compareSubtrees(cell->node, node)) return cell->id;
+    }
+
+    return 0;
+}
+
+int dumpSharedAdd(DumpSharedMap_t* map, DiffNode_t* node, size_t hash, size_t id) {
+    DIFF_CHECK(!map || !node, DIFF_NULL);
+
+    if ((map->count + 1) * 2 > map->size) DIFF_CHECK(dumpSharedGrow(map) != DIFF_OK, DIFF_NO_MEM);
+
+    size_t slot = hashMix(hash) & (map->size - 1);
+    while (map->cells[slot].node) slot = (slot + 1) & (map->size - 1);
+
+    map->cells[slot] = {hash, node, id};
+    map->count++;
+
+    return DIFF_OK;
+}
+
+// RECORDS
+
+static const char* dumpSide(const DumpFrame_t* frame) {
+    if (!frame->parent) return "root";
+    return frame->isLeft ? "left" : "right";
+}
+
+static void dumpJsonSeparator(DumpBuffer_t* buffer, size_t* written) {
+    dumpPrintf(buffer, (*written)++ ? ",\n\t" : "\t");
+}
+
+static void dumpNode(DumpBuffer_t* buffer, DumpFormat_t format, const DumpFrame_t* frame, size_t id, size_t size, size_t* written) {
+    if (format == DUMP_JSON) {
+        dumpJsonSeparator(buffer, written);
+        dumpPrintf(buffer, "{\"id\": %zu, \"parent\": %zu, \"side\": \"%s\", \"type\": %d, \"value\": \"",
+                           id, frame->parent, dumpSide(frame), frame->node->type);
+        dumpLabel(buffer, frame->node);
+        dumpPrintf(buffer, "\", \"size\": %zu}", size);
+        return;
+    }
+
+    dumpPrintf(buffer, "\tnode%zu[shape=record, style=\"rounded, filled\", fillcolor=red, label=\"{ {val: ", id);
+    dumpLabel(buffer, frame->node);
+    dumpPrintf(buffer, "} | type: %d | size: %zu }\"];\n", frame->node->type, size);
+
+    if (frame->parent) dumpPrintf(buffer, "\tnode%zu->node%zu [color=\"red\", style=\"dashed\",arrowhead=\"none\"];\n", id, frame->parent);
+}
+
+static void dumpSummary(DumpBuffer_t* buffer, DumpFormat_t format, const DumpFrame_t* frame, size_t id, size_t size, size_t* written) {
+    if (format == DUMP_JSON) {
+        dumpJsonSeparator(buffer, written);
+        dumpPrintf(buffer, "{\"id\": %zu, \"parent\": %zu, \"side\": \"%s\", \"summary\": %zu}",
+                           id, frame->parent, dumpSide(frame), size);
+        return;
+    }
+
+    dumpPrintf(buffer, "\tnode%zu[shape=box, style=\"dashed\", label=\"... %zu nodes\"];\n", id, size);
+    if (frame->parent) dumpPrintf(buffer, "\tnode%zu->node%zu [color=\"gray\", style=\"dashed\",arrowhead=\"none\"];\n", id, frame->parent);
+}
+
+static void dumpReference(DumpBuffer_t* buffer, DumpFormat_t format, const DumpFrame_t* frame, size_t id, size_t* written) {
+    if (format == DUMP_JSON) {
+        dumpJsonSeparator(buffer, written);
+        dumpPrintf(buffer, "{\"ref\": %zu, \"parent\": %zu, \"side\": \"%s\"}", id, frame->parent, dumpSide(frame));
+        return;
+    }
+
+    dumpPrintf(buffer, "\tnode%zu->node%zu [color=\"blue\", style=\"dashed\",arrowhead=\"none\"];\n", id, frame->parent);
+}
+
+// TRAVERSAL
+
+static int dumpStackPush(DumpFrame_t** stack, size_t* count, size_t* size, DumpFrame_t frame) {
+    if (*count >= *size) {
+        size_t newSize = *size ? *size * 2 : REPL_START_SIZE;
+        DumpFrame_t* newStack = (DumpFrame_t*) realloc(*stack, newSize * sizeof(DumpFrame_t));
+        DIFF_CHECK(!newStack, DIFF_NO_MEM);
+
+        *stack = newStack;
+        *size  = newSize;
+    }
+
+    (*stack)[(*count)++] = frame;
+    return DIFF_OK;
+}
+
+// Pre-order walk with explicit stack, so depth of tree is not limited by call stack.
+// Subtrees deeper than maxDepth or beyond maxNodes records are written as one summary record.
+int treeDump(DiffNode_t* node, FILE* file, const DumpOptions_t* options) {
+    DIFF_CHECK(!node || !file, DIFF_NULL);
+
+    DumpOptions_t defaults = {};
+    if (!options) options = &defaults;
+
+    ReplInfoMap_t infoMap = {};
+    DIFF_CHECK(replInfoMapCtor(&infoMap, REPL_START_SIZE) != DIFF_OK, DIFF_NO_MEM);
+    collectReplInfo(node, &infoMap, nullptr);
+
+    DumpBuffer_t* buffer = (DumpBuffer_t*) calloc(1, sizeof(DumpBuffer_t));
+    if (!buffer) {
+        replInfoMapDtor(&infoMap);
+        return DIFF_NO_MEM;
+    }
+    buffer->file = file;
+
+    DumpSharedMap_t shared    = {};
+    DumpFrame_t*    stack     = nullptr;
+    size_t          stackSize = 0, stackCount = 0;
+    size_t          records   = 0, written = 0;
+    int             error     = dumpStackPush(&stack, &stackCount, &stackSize, {node, 0, 0, false});
+
+    if (options->format == DUMP_JSON) dumpPrintf(buffer, "{\"nodes\": [\n");
+    else                              dumpPrintf(buffer, "digraph tree {\n\trankdir=HR;\n");
+
+    while (error == DIFF_OK && stackCount) {
+        DumpFrame_t frame = stack[--stackCount];
+
+        const ReplInfo_t* info = replInfoGet(&infoMap, frame.node);
+        size_t hash = info ? info->hash : 0;
+        size_t size = info ? info->size : 1;
+
+        bool share = options->share && size > 1;
+        if (share) {
+            size_t sharedId = dumpSharedFind(&shared, frame.node, hash);
+            if (sharedId) {
+                dumpReference(buffer, options->format, &frame, sharedId, &written);
+                continue;
+            }
+        }
+
+        size_t id = ++records;
+        bool summarize = size > 1 && ((options->maxDepth && frame.depth >= options->maxDepth)
+                                   || (options->maxNodes && records > options->maxNodes));
+        if (summarize) {
+            dumpSummary(buffer, options->format, &frame, id, size, &written);
+            continue;
+        }
+
+        dumpNode(buffer, options->format, &frame, id, size, &written);
+        if (share) error = dumpSharedAdd(&shared, frame.node, hash, id);
+
+        if (error == DIFF_OK && frame.node->right) error = dumpStackPush(&stack, &stackCount, &stackSize, {frame.node->right, id, frame.depth + 1, false});
+        if (error == DIFF_OK && frame.node->left)  error = dumpStackPush(&stack, &stackCount, &stackSize, {frame.node->left,  id, frame.depth + 1, true});
+    }
+
+    if (options->format == DUMP_JSON) dumpPrintf(buffer, "\n]}\n");
+    else                              dumpPrintf(buffer, "}\n");
+    dumpFlush(buffer);
+
+    free(stack);
+    free(shared.cells);
+    free(buffer);
+    replInfoMapDtor(&infoMap);
+
+    if (error == DIFF_OK && ferror(file)) error = DIFF_FILE_NULL;
+    return error;
+}
+
+int graphDumpFile(DiffNode_t* node, const char* fileName, const DumpOptions_t* options) {
+    DIFF_CHECK(!node || !fileName, DIFF_NULL);
+
+    FILE* file = fopen(fileName, "w");
+    DIFF_CHECK(!file, DIFF_FILE_NULL);
+
+    int error = treeDump(node, file, options);
+    if (fclose(file) != 0 && error == DIFF_OK) error = DIFF_FILE_NULL;
+
+    if (error != DIFF_OK || !options || !options->view || options->format != DUMP_DOT) return error;
+
+    // viewer is optional and never blocks the dump
+    if (!renderQueue) renderQueue = renderQueueCtor();
+    DIFF_CHECK(!renderQueue, DIFF_NO_MEM);
+
+    char image  [MAX_ARTIFACT_LENGTH]     = "";
+    char command[7 * MAX_ARTIFACT_LENGTH] = "";
+    int  length = snprintf(image, sizeof(image), "%s.svg", fileName);
+    DIFF_CHECK(length < 0 || (size_t) length >= sizeof(image), DIFF_FILE_NULL);
+
+    // name is given by user, it goes to shell only as quoted word
+    char quotedFile [2 * MAX_ARTIFACT_LENGTH] = "";
+    char quotedImage[2 * MAX_ARTIFACT_LENGTH] = "";
+    DIFF_CHECK(renderQuote(quotedFile,  sizeof(quotedFile),  fileName) != DIFF_OK, DIFF_FILE_NULL);
+    DIFF_CHECK(renderQuote(quotedImage, sizeof(quotedImage), image)    != DIFF_OK, DIFF_FILE_NULL);
+
+    snprintf(command, sizeof(command), "dot -Tsvg %s > %s && xdg-open %s", quotedFile, quotedImage, quotedImage);
+    return renderQueuePush(renderQueue, command, image);
+}
+
+void graphDump(DiffNode_t* node, const DumpOptions_t* options) {
+    if (!node) return;
+
+    DumpOptions_t dumpOptions = {};
+    dumpOptions.view = true;
+    if (options) dumpOptions = *options;
+
+    if (!renderQueue) renderQueue = renderQueueCtor();
+
+    char name[MAX_ARTIFACT_LENGTH / 2] = "";
+    char path[MAX_ARTIFACT_LENGTH]     = "";
+    if (renderArtifact(renderQueue, name, sizeof(name), "dump") != DIFF_OK) return;
+    snprintf(path, sizeof(path), "%s.%s", name, dumpOptions.format == DUMP_JSON ? "json" : "dot");
+
+    if (graphDumpFile(node, path, &dumpOptions) != DIFF_OK) fprintf(stderr, "Can't dump tree to %s\n", path);
+}
@@ -0,0 +1,66 @@
+#ifndef DUMP_H
+#define DUMP_H
+
+#include "diff.h"
+#include "replace.h"
+
+const size_t DUMP_BUFFER_SIZE = 1 << 16;
+
+enum DumpFormat_t {
+    DUMP_DOT  = 0,
+    DUMP_JSON = 1,
+};
+
+struct DumpOptions_t {
+    DumpFormat_t format   = DUMP_DOT;
+    size_t       maxDepth = 0;          // deeper subtrees are summarized, 0 - no limit
+    size_t       maxNodes = 0;          // after so many records the rest is summarized, 0 - no limit
+    bool         share    = true;       // equal subtrees are written once and then referenced by edges (DAG)
+    bool         view     = false;      // render dump to svg and open it (only for DOT)
+};
+
+// output is collected in big chunks, so dump of huge tree is not a million of small fprintf
+struct DumpBuffer_t {
+    FILE*  file = nullptr;
+    size_t size = 0;
+    char   data[DUMP_BUFFER_SIZE] = {};
+};
+
+// one pending subtree of iterative traversal
+struct DumpFrame_t {
+    DiffNode_t* node   = nullptr;
+    size_t      parent = 0;         // id of parent record, 0 for root
+    size_t      depth  = 0;
+    bool        isLeft = false;
+};
+
+// subtree already written to dump
+struct DumpShared_t {
+    size_t      hash = 0;
+    DiffNode_t* node = nullptr;
+    size_t      id   = 0;
+};
+
+struct DumpSharedMap_t {
+    DumpShared_t* cells = nullptr;
+    size_t        size  = 0;
+    size_t        count = 0;
+};
+
+void dumpFlush(DumpBuffer_t* buffer);
+
+void dumpPrintf(DumpBuffer_t* buffer, const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+void dumpLabel(DumpBuffer_t* buffer, const DiffNode_t* node);
+
+size_t dumpSharedFind(const DumpSharedMap_t* map, DiffNode_t* node, size_t hash);
+
+int dumpSharedAdd(DumpSharedMap_t* map, DiffNode_t* node, size_t hash, size_t id);
+
+int treeDump(DiffNode_t* node, FILE* file, const DumpOptions_t* options = nullptr);
+
+int graphDumpFile(DiffNode_t* node, const char* fileName, const DumpOptions_t* options = nullptr);
+
+void graphDump(DiffNode_t* node, const DumpOptions_t* options = nullptr);
+
+#endif
@@ -0,0 +1,364 @@
+#include <errno.h>
+#include <float.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "emit.h"
+
+const double EMIT_POW10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9};
+
+const double EMIT_MIN_PLAIN    = 1e-4;      // "%lg" prints numbers from here till EMIT_MAX_PLAIN without exponent
+const double EMIT_MAX_PLAIN    = 999999.5;
+
+const double EMIT_ROUND_MARGIN = 1e-6;      // of the last digit, error of scaling is below 1e-9 of it
+
+void emitterCtor(DiffEmitter_t* out, EmitTarget_t target, FILE* file, int fd) {
+    if (!out) return;
+
+    // inline buffer is not cleared, it is big
+    out->target     = target;
+    out->file       = file;
+    out->fd         = fd;
+    out->data       = out->inlineData;
+    out->size       = 0;
+    out->capacity   = EMIT_BUFFER_SIZE;
+    out->chunkCount = 0;
+    out->written    = 0;
+    out->failed     = false;
+}
+
+// all the collected chunks go to descriptor, partial writes are continued
+static void emitterWritev(DiffEmitter_t* out) {
+    struct iovec pending[EMIT_CHUNKS] = {};
+    memcpy(pending, out->chunks, (size_t) out->chunkCount * sizeof(struct iovec));
+
+    int first = 0;
+    while (first < out->chunkCount && !out->failed) {
+        ssize_t count = writev(out->fd, pending + first, out->chunkCount - first);
+        if (count < 0) {
+            if (errno != EINTR) out->failed = true;
+            continue;
+        }
+
+        out->written += (size_t) count;
+
+        size_t left = (size_t) count;
+        while (first < out->chunkCount && left >= pending[first].iov_len) left -= pending[first++].iov_len;
+
+        if (first < out->chunkCount) {
+            pending[first].iov_base = (char*) pending[first].iov_base + left;
+            pending[first].iov_len -= left;
+        }
+    }
+
+    for (int i = 0; i < out->chunkCount; i++) {
+        if (out->chunks[i].iov_base != out->inlineData) free(out->chunks[i].iov_base);
+    }
+
+    out->chunkCount = 0;
+    out->data       = out->inlineData;
+    out->size       = 0;
+    out->capacity   = EMIT_BUFFER_SIZE;
+}
+
+// EMIT_FD: full chunk waits for writev() and text goes on in new one
+static void emitterNextChunk(DiffEmitter_t* out) {
+    out->chunks[out->chunkCount].iov_base = out->data;
+    out->chunks[out->chunkCount].iov_len  = out->size;
+    out->chunkCount++;
+
+    char* chunk = out->chunkCount < EMIT_CHUNKS ? (char*) malloc(EMIT_BUFFER_SIZE) : nullptr;
+    if (!chunk) {
+        emitterWritev(out);
+        return;
+    }
+
+    out->data     = chunk;
+    out->size     = 0;
+    out->capacity = EMIT_BUFFER_SIZE;
+}
+
+// EMIT_MEMORY: text is moved from inline buffer to heap, when it doesn't fit
+static bool emitterGrow(DiffEmitter_t* out, size_t count) {
+    size_t newCapacity = max(out->capacity * 2, out->size + count);
+
+    bool  isInline = out->data == out->inlineData;
+    char* newData  = (char*) (isInline ? malloc(newCapacity) : realloc(out->data, newCapacity));
+    if (!newData) {
+        out->failed = true;
+        return false;
+    }
+
+    if (isInline) memcpy(newData, out->inlineData, out->size);
+
+    out->data     = newData;
+    out->capacity = newCapacity;
+    return true;
+}
+
+int emitterFlush(DiffEmitter_t* out) {
+    DIFF_CHECK(!out, DIFF_NULL);
+
+    switch (out->target) {
+        case EMIT_FILE:
+            if (out->size && out->file) {
+                size_t count = fwrite(out->data, sizeof(char), out->size, out->file);
+                if (count < out->size) out->failed = true;
+
+                out->written += count;
+            }
+            out->size = 0;
+            break;
+        case EMIT_FD:
+            if (out->size) {
+                out->chunks[out->chunkCount].iov_base = out->data;
+                out->chunks[out->chunkCount].iov_len  = out->size;
+                out->chunkCount++;
+            }
+            if (out->chunkCount) emitterWritev(out);
+            break;
+        case EMIT_MEMORY:
+        default:
+            break;
+    }
+
+    return out->failed ? DIFF_FILE_NULL : DIFF_OK;
+}
+
+void emitterDtor(DiffEmitter_t* out) {
+    if (!out) return;
+
+    emitterFlush(out);
+    if (out->data != out->inlineData) free(out->data);
+
+    out->data     = out->inlineData;
+    out->size     = 0;
+    out->capacity = EMIT_BUFFER_SIZE;
+}
+
+// EMIT_MEMORY: text, that ends with '\0', it is valid till the next emit or emitterDtor()
+const char* emitterText(DiffEmitter_t* out, size_t* size) {
+    if (!out) return nullptr;
+
+    emitChar(out, '\0');
+    out->size--;
+
+    if (size) *size = out->size;
+    return out->data;
+}
+
+void emitBytes(DiffEmitter_t* out, const char* bytes, size_t count) {
+    if (!out || !bytes) return;
+
+    if (out->capacity - out->size >= count) {
+        memcpy(out->data + out->size, bytes, count);
+        out->size += count;
+        return;
+    }
+
+    switch (out->target) {
+        case EMIT_MEMORY:
+            if (!emitterGrow(out, count)) return;
+            break;
+        case EMIT_FILE:
+            emitterFlush(out);
+
+            // bigger than buffer, it is written as it is
+            if (count > out->capacity) {
+                if (out->file) out->written += fwrite(bytes, sizeof(char), count, out->file);
+                return;
+            }
+            break;
+        case EMIT_FD:
+            while (count > out->capacity - out->size) {
+                size_t part = out->capacity - out->size;
+                memcpy(out->data + out->size, bytes, part);
+                out->size += part;
+
+                bytes += part;
+                count -= part;
+                emitterNextChunk(out);
+            }
+            break;
+        default:
+            return;
+    }
+
+    memcpy(out->data + out->size, bytes, count);
+    out->size += count;
+}
+
+void emitText(DiffEmitter_t* out, const char* text) {
+    if (!text) return;
+
+    emitBytes(out, text, strlen(text));
+}
+
+void emitChar(DiffEmitter_t* out, char symb) {
+    if (out && out->size < out->capacity) {
+        out->data[out->size++] = symb;
+        return;
+    }
+
+    emitBytes(out, &symb, 1);
+}
+
+void emitUnsigned(DiffEmitter_t* out, size_t value) {
+    char   digits[EMIT_DOUBLE_SIZE] = "";
+    size_t count = EMIT_DOUBLE_SIZE;
+
+    do {
+        digits[--count] = (char) ('0' + value % 10);
+        value /= 10;
+    } while (value);
+
+    emitBytes(out, digits + count, EMIT_DOUBLE_SIZE - count);
+}
+
+// The same text as "%lg": 6 significant digits without trailing zeros. Number is scaled to integer of 6 digits,
+// numbers, that need exponent or are too close to half of the last digit to round them surely, go to snprintf.
+void emitDouble(DiffEmitter_t* out, double value) {
+    double absValue = fabs(value);
+
+    if (absValue >= EMIT_MIN_PLAIN && absValue < EMIT_MAX_PLAIN) {
+        int exponent = (int) floor(log10(absValue));
+        if (exponent < -4) exponent = -4;
+        if (exponent > 5)  exponent = 5;
+
+        double scaled = absValue * EMIT_POW10[5 - exponent];
+
+        // log10() may be one more near power of 10
+        if (scaled < 99999.5 && exponent > -4) {
+            exponent--;
+            scaled = absValue * EMIT_POW10[5 - exponent];
+        }
+
+        double fraction = scaled - floor(scaled);
+        if (scaled >= 99999.5 && fabs(fraction - 0.5) > EMIT_ROUND_MARGIN) {
+            uint64_t digits = (uint64_t) (scaled + 0.5);
+
+            // 999999.7 is 1000000, one more digit before point
+            if (digits >= 1000000) {
+                digits /= 10;
+                exponent++;
+            }
+
+            if (exponent <= 5) {
+                char text[EMIT_DOUBLE_SIZE] = "";
+                int  length = 0;
+
+                if (value < 0) text[length++] = '-';
+
+                char significant[6] = {};
+                for (int i = 5; i >= 0; i--) {
+                    significant[i] = (char) ('0' + digits % 10);
+                    digits /= 10;
+                }
+
+                int last = 5;
+                int point = exponent + 1;       // digits before point
+                while (last >= point && last > 0 && significant[last] == '0') last--;
+
+                if (point <= 0) {
+                    text[length++] = '0';
+                    text[length++] = '.';
+                    for (int i = point; i < 0; i++) text[length++] = '0';
+                }
+
+                for (int i = 0; i <= last; i++) {
+                    if (i == point && point > 0) text[length++] = '.';
+                    text[length++] = significant[i];
+                }
+
+                emitBytes(out, text, (size_t) length);
+                return;
+            }
+        }
+    }
+
+    char text[EMIT_DOUBLE_SIZE] = "";
+    int  length = snprintf(text, sizeof(text), "%lg", value);
+    if (length > 0) emitBytes(out, text, (size_t) length);
+}
+
+// string in quotes, '"' and '\\' are escaped, control symbols are dropped
+void emitJsonString(DiffEmitter_t* out, const char* string) {
+    if (!out || !string) return;
+
+    emitChar(out, '"');
+    while (*string) {
+        size_t plain = 0;
+        while (string[plain] && string[plain] != '"' && string[plain] != '\\' && (unsigned char) string[plain] >= ' ') plain++;
+
+        emitBytes(out, string, plain);
+        string += plain;
+
+        if (*string == '"' || *string == '\\') {
+            emitChar(out, '\\');
+            emitChar(out, *string);
+        }
+        if (*string) string++;
+    }
+    emitChar(out, '"');
+}
+
+void printJsonString(FILE* file, const char* string) {
+    if (!file || !string) return;
+
+    DiffEmitter_t out;
+    emitterCtor(&out, EMIT_FILE, file);
+    emitJsonString(&out, string);
+    emitterDtor(&out);
+}
+
+// Shortest digits, that strtod() reads back to the same double, but without exponent: parser of equations
+// knows no "1e-05". Text is for programs (infix, JSON), TeX keeps "%lg".
+void emitExact(DiffEmitter_t* out, double value) {
+    if (!isfinite(value)) {
+        emitDouble(out, value);
+        return;
+    }
+
+    char scientific[EMIT_DOUBLE_SIZE] = "";
+    for (int precision = 0; precision < DBL_DECIMAL_DIG; precision++) {
+        snprintf(scientific, sizeof(scientific), "%.*e", precision, value);
+
+        double back = strtod(scientific, nullptr);
+        if (!memcmp(&back, &value, sizeof(value))) break;
+    }
+
+    // "-d.ddde-XX" is split to sign, significant digits and exponent
+    const char* symb = scientific;
+    char digits[EMIT_DOUBLE_SIZE] = "";
+    int  digitCount = 0;
+
+    bool isNeg = *symb == '-';
+    if (isNeg) symb++;
+
+    for (; *symb && *symb != 'e'; symb++) {
+        if (isdigit(*symb)) digits[digitCount++] = *symb;
+    }
+    int exponent = *symb ? atoi(symb + 1) : 0;
+
+    while (digitCount > 1 && digits[digitCount - 1] == '0') digitCount--;
+
+    char text[EMIT_EXACT_SIZE] = "";
+    int  length = 0;
+    if (isNeg) text[length++] = '-';
+
+    if (exponent < 0) {
+        text[length++] = '0';
+        text[length++] = '.';
+        for (int i = exponent + 1; i < 0; i++) text[length++] = '0';
+        for (int i = 0; i < digitCount; i++) text[length++] = digits[i];
+    } else {
+        for (int i = 0; i <= exponent; i++) text[length++] = i < digitCount ? digits[i] : '0';
+        if (digitCount > exponent + 1) {
+            text[length++] = '.';
+            for (int i = exponent + 1; i < digitCount; i++) text[length++] = digits[i];
+        }
+    }
+
+    emitBytes(out, text, (size_t) length);
+}
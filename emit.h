@@ -0,0 +1,67 @@
+#ifndef EMIT_H
+#define EMIT_H
+
+#include <sys/uio.h>
+
+#include "diff.h"
+
+const size_t EMIT_BUFFER_SIZE = 1 << 16;    // inline buffer and every chunk of EMIT_FD
+
+const int    EMIT_CHUNKS      = 16;         // full chunks, that are given to one writev()
+
+const int    EMIT_DOUBLE_SIZE = 32;         // text of "%lg" always fits
+
+const int    EMIT_EXACT_SIZE  = 384;        // emitExact(): 309 digits of DBL_MAX or 0.000...0 of denormal with 17 digits
+
+enum EmitTarget_t {
+    EMIT_MEMORY = 0,        // text grows in heap, emitterText() gives it
+    EMIT_FILE   = 1,        // full buffer goes to FILE* by one fwrite()
+    EMIT_FD     = 2,        // full buffers are collected and written to descriptor by one writev()
+};
+
+// Text of formulas is built here, not by fprintf per bracket and number: appending is memcpy into buffer,
+// numbers are formatted by emitDouble() (the same text as "%lg"). Output of one formula is one write.
+// Emitter is not thread safe, every thread (renderer, server worker) has its own.
+struct DiffEmitter_t {
+    EmitTarget_t target     = EMIT_MEMORY;
+    FILE*        file       = nullptr;
+    int          fd         = -1;
+
+    char*        data       = nullptr;      // current chunk, inlineData till it is full
+    size_t       size       = 0;
+    size_t       capacity   = 0;
+
+    struct iovec chunks[EMIT_CHUNKS] = {};  // EMIT_FD: full chunks waiting for writev()
+    int          chunkCount = 0;
+
+    size_t       written    = 0;            // bytes, that went to file or descriptor
+    bool         failed     = false;
+
+    char         inlineData[EMIT_BUFFER_SIZE];  // not cleared: emitter is declared without "= {}" and set by emitterCtor()
+};
+
+void emitterCtor(DiffEmitter_t* out, EmitTarget_t target, FILE* file = nullptr, int fd = -1);
+
+int emitterFlush(DiffEmitter_t* out);
+
+void emitterDtor(DiffEmitter_t* out);
+
+const char* emitterText(DiffEmitter_t* out, size_t* size = nullptr);
+
+void emitBytes(DiffEmitter_t* out, const char* bytes, size_t count);
+
+void emitText(DiffEmitter_t* out, const char* text);
+
+void emitChar(DiffEmitter_t* out, char symb);
+
+void emitUnsigned(DiffEmitter_t* out, size_t value);
+
+void emitDouble(DiffEmitter_t* out, double value);
+
+void emitExact(DiffEmitter_t* out, double value);
+
+void emitJsonString(DiffEmitter_t* out, const char* string);
+
+void printJsonString(FILE* file, const char* string);
+
+#endif
@@ -0,0 +1,246 @@
+#include "budget.h"
+#include "eval.h"
+#include "oper.h"
+#include "walk.h"
+
+// KERNELS
+
+// operator of DIFF_OPERS for scalar type: one value (tree) and column of values (program)
+template <typename T>
+struct ScalarOper_t {
+    T    (*value)(T left, T right)                 = nullptr;   // left is empty for functions
+    void (*block)(T* left, T* right, size_t count) = nullptr;   // result of binary operator goes to left, of function to right
+};
+
+template <typename T> static T addScalar(T left, T right) { return left + right; }
+template <typename T> static T subScalar(T left, T right) { return left - right; }
+template <typename T> static T mulScalar(T left, T right) { return left * right; }
+template <typename T> static T divScalar(T left, T right) { return left / right; }
+
+template <typename T, T (*F)(T)>
+static T funcScalar(T, T right) {
+    return F(right);
+}
+
+// kernel is template argument, so loops are compiled without calls inside
+template <typename T, T (*F)(T, T)>
+static void binaryBlock(T* left, T* right, size_t count) {
+    for (size_t i = 0; i < count; i++) left[i] = F(left[i], right[i]);
+}
+
+template <typename T, T (*F)(T)>
+static void funcBlock(T*, T* right, size_t count) {
+    for (size_t i = 0; i < count; i++) right[i] = F(right[i]);
+}
+
+// in order of OpType_t, as DIFF_OPERS
+template <typename T>
+const ScalarOper_t<T> SCALAR_OPERS[OP_COUNT] = {
+    {mulScalar<T>,                binaryBlock<T, mulScalar<T>>},
+    {addScalar<T>,                binaryBlock<T, addScalar<T>>},
+    {divScalar<T>,                binaryBlock<T, divScalar<T>>},
+    {subScalar<T>,                binaryBlock<T, subScalar<T>>},
+    {scalarPow,                   binaryBlock<T, scalarPow>},
+    {funcScalar<T, scalarSin>,    funcBlock<T, scalarSin>},
+    {funcScalar<T, scalarCos>,    funcBlock<T, scalarCos>},
+    {funcScalar<T, scalarLn>,     funcBlock<T, scalarLn>},
+    {funcScalar<T, scalarTan>,    funcBlock<T, scalarTan>},
+    {funcScalar<T, scalarExp>,    funcBlock<T, scalarExp>},
+    {funcScalar<T, scalarSqrt>,   funcBlock<T, scalarSqrt>},
+    {funcScalar<T, scalarAsin>,   funcBlock<T, scalarAsin>},
+    {funcScalar<T, scalarAcos>,   funcBlock<T, scalarAcos>},
+    {funcScalar<T, scalarAtan>,   funcBlock<T, scalarAtan>},
+    {funcScalar<T, scalarSinh>,   funcBlock<T, scalarSinh>},
+    {funcScalar<T, scalarCosh>,   funcBlock<T, scalarCosh>},
+    {funcScalar<T, scalarAbs>,    funcBlock<T, scalarAbs>},
+};
+
+// TREE
+
+// results of subtrees, as WalkValues_t, but of scalar type
+template <typename T>
+struct ScalarStack_t {
+    T*     values = nullptr;
+    size_t count  = 0;
+    size_t size   = 0;
+
+    T      inlineValues[WALK_INLINE_SIZE] = {};
+};
+
+template <typename T>
+struct ValueWalk_t {
+    ScalarStack_t<T> values = {};
+    T                x      = {};
+};
+
+template <typename T>
+static bool scalarPush(ScalarStack_t<T>* stack, T value) {
+    if (stack->count >= stack->size) {
+        size_t newSize = stack->size * 2;
+        T* newValues = (T*) malloc(newSize * sizeof(T));
+        if (!newValues) return false;
+
+        for (size_t i = 0; i < stack->count; i++) newValues[i] = stack->values[i];
+        if (stack->values != stack->inlineValues) {
+            budgetFree(stack->size * sizeof(T));
+            free(stack->values);
+        }
+        budgetAlloc(newSize * sizeof(T));
+
+        stack->values = newValues;
+        stack->size   = newSize;
+    }
+
+    stack->values[stack->count++] = value;
+    return true;
+}
+
+template <typename T>
+static T scalarPop(ScalarStack_t<T>* stack) {
+    return stack->count ? stack->values[--stack->count] : T {};
+}
+
+template <typename T>
+static WalkResult_t valueVisit(DiffNode_t* node, WalkEvent_t event, void* context) {
+    if (event != WALK_LEAVE) return WALK_NEXT;
+
+    ValueWalk_t<T>* walk = (ValueWalk_t<T>*) context;
+
+    T value = {};
+    if (IS_NUM(node)) {
+        value = ScalarTraits_t<T>::constant(node->value.num);
+    } else if (IS_VAR(node)) {
+        value = walk->x;
+    } else {
+        T right = R(node) ? scalarPop(&walk->values) : T {};
+        T left  = L(node) ? scalarPop(&walk->values) : T {};
+
+        const DiffOper_t* oper = operFind(node->value.opt);
+        if (oper) value = SCALAR_OPERS<T>[oper->type].value(left, right);
+    }
+
+    return scalarPush(&walk->values, value) ? WALK_NEXT : WALK_STOP;
+}
+
+template <typename T>
+T treeValue(DiffNode_t* node, T x) {
+    if (!node) return T {};
+
+    ValueWalk_t<T> walk = {};
+    walk.x             = x;
+    walk.values.values = walk.values.inlineValues;
+    walk.values.size   = WALK_INLINE_SIZE;
+
+    treeWalk(node, valueVisit<T>, &walk);
+    T value = walk.values.count == 1 ? walk.values.values[0] : T {};
+
+    if (walk.values.values != walk.values.inlineValues) {
+        budgetFree(walk.values.size * sizeof(T));
+        free(walk.values.values);
+    }
+
+    return value;
+}
+
+// PROGRAM
+
+template <typename T>
+void programEval(const DiffProgram_t* program, const T* const* vars, size_t count, T* stack, T* result) {
+    if (!program || !vars || !stack || !result) return;
+
+    size_t top = 0;
+    for (size_t pc = 0; pc < program->length; pc++) {
+        const ProgInstr_t* instr = &program->code[pc];
+
+        if (instr->type == NUM) {
+            T  num  = ScalarTraits_t<T>::constant(instr->num);
+            T* slot = stack + top++ * count;
+            for (size_t i = 0; i < count; i++) slot[i] = num;
+            continue;
+        }
+        if (instr->type == VAR && instr->coefs) {
+            const T* x = vars[instr->var];
+            T* slot = stack + top++ * count;
+
+            T high = ScalarTraits_t<T>::constant(instr->coefs[instr->degree]);
+            for (size_t i = 0; i < count; i++) slot[i] = high;
+            for (int k = instr->degree - 1; k >= 0; k--) {
+                T coef = ScalarTraits_t<T>::constant(instr->coefs[k]);
+                for (size_t i = 0; i < count; i++) slot[i] = slot[i] * x[i] + coef;
+            }
+            continue;
+        }
+        if (instr->type == VAR) {
+            const T* x = vars[instr->var];
+            T* slot = stack + top++ * count;
+            for (size_t i = 0; i < count; i++) slot[i] = x[i];
+            continue;
+        }
+
+        T* right = stack + (top - 1) * count;
+        T* left  = top > 1 ? stack + (top - 2) * count : nullptr;
+
+        const DiffOper_t* oper = operFind(instr->opt);
+        if (!oper) continue;
+
+        SCALAR_OPERS<T>[oper->type].block(left, right, count);
+        if (oper->arity == 2) top--;
+    }
+
+    for (size_t i = 0; i < count; i++) result[i] = stack[i];
+}
+
+// SYSTEM
+
+static const double* systemColumn(const DiffSystem_t* system, uint32_t index, const double* const* vars, size_t count,
+                                  const double* slots) {
+    const SysNode_t* node = &system->nodes[index];
+    return node->type == VAR ? vars[node->var] : slots + node->slot * count;
+}
+
+// operand is copied to slot of result, if it is still needed later, and kernel works there in place
+void systemEval(const DiffSystem_t* system, const double* const* vars, size_t count, double* slots, double* const* results) {
+    if (!system || !vars || !slots || !results) return;
+
+    for (size_t i = 0; i < system->count; i++) {
+        const SysNode_t* node = &system->nodes[i];
+        double*          slot = slots + node->slot * count;
+
+        if (node->type == NUM) {
+            for (size_t row = 0; row < count; row++) slot[row] = node->num;
+            continue;
+        }
+        if (node->type != OP) continue;
+
+        const DiffOper_t* oper = operFind(node->opt);
+        if (!oper) continue;
+
+        const double* right = systemColumn(system, node->right, vars, count, slots);
+        if (oper->arity == 2) {
+            const double* left = systemColumn(system, node->left, vars, count, slots);
+            if (!node->inPlace) memcpy(slot, left, count * sizeof(double));
+
+            SCALAR_OPERS<double>[oper->type].block(slot, const_cast<double*>(right), count);
+        } else {
+            if (!node->inPlace) memcpy(slot, right, count * sizeof(double));
+
+            SCALAR_OPERS<double>[oper->type].block(nullptr, slot, count);
+        }
+    }
+
+    for (int i = 0; i < system->outputCount; i++) {
+        memcpy(results[i], systemColumn(system, system->outputs[i], vars, count, slots), count * sizeof(double));
+    }
+}
+
+template float            treeValue(DiffNode_t* node, float x);
+template double           treeValue(DiffNode_t* node, double x);
+template long double      treeValue(DiffNode_t* node, long double x);
+template Dual_t<double>   treeValue(DiffNode_t* node, Dual_t<double> x);
+template Bounds_t<double> treeValue(DiffNode_t* node, Bounds_t<double> x);
+
+template void programEval(const DiffProgram_t*, const float* const*,            size_t, float*,            float*);
+template void programEval(const DiffProgram_t*, const double* const*,           size_t, double*,           double*);
+template void programEval(const DiffProgram_t*, const long double* const*,      size_t, long double*,      long double*);
+template void programEval(const DiffProgram_t*, const Dual_t<double>* const*,   size_t, Dual_t<double>*,   Dual_t<double>*);
+template void programEval(const DiffProgram_t*, const Bounds_t<double>* const*, size_t, Bounds_t<double>*, Bounds_t<double>*);
@@ -0,0 +1,34 @@
+#ifndef EVAL_H
+#define EVAL_H
+
+#include "column.h"
+#include "scalar.h"
+#include "system.h"
+
+// Evaluation core, templated by scalar type of scalar.h. Templates are instantiated in eval.cpp only for
+// float, double, long double, Dual_t<double> and Bounds_t<double>.
+
+// value of tree, where every variable is x
+template <typename T>
+T treeValue(DiffNode_t* node, T x);
+
+// stack has place for maxStack columns of count rows, vars[i] - column of variable 'a' + i
+template <typename T>
+void programEval(const DiffProgram_t* program, const T* const* vars, size_t count, T* stack, T* result);
+
+// one pass over DAG for all the outputs, slots has place for slotCount columns of count rows
+void systemEval(const DiffSystem_t* system, const double* const* vars, size_t count, double* slots, double* const* results);
+
+extern template float            treeValue(DiffNode_t* node, float x);
+extern template double           treeValue(DiffNode_t* node, double x);
+extern template long double      treeValue(DiffNode_t* node, long double x);
+extern template Dual_t<double>   treeValue(DiffNode_t* node, Dual_t<double> x);
+extern template Bounds_t<double> treeValue(DiffNode_t* node, Bounds_t<double> x);
+
+extern template void programEval(const DiffProgram_t*, const float* const*,            size_t, float*,            float*);
+extern template void programEval(const DiffProgram_t*, const double* const*,           size_t, double*,           double*);
+extern template void programEval(const DiffProgram_t*, const long double* const*,      size_t, long double*,      long double*);
+extern template void programEval(const DiffProgram_t*, const Dual_t<double>* const*,   size_t, Dual_t<double>*,   Dual_t<double>*);
+extern template void programEval(const DiffProgram_t*, const Bounds_t<double>* const*, size_t, Bounds_t<double>*, Bounds_t<double>*);
+
+#endif
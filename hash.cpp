@@ -0,0 +1,71 @@
+#include "hash.h"
+#include "walk.h"
+
+// finalizer of splitmix64
+size_t hashMix(size_t value) {
+    value ^= value >> 30;
+    value *= 0xbf58476d1ce4e5b9ULL;
+    value ^= value >> 27;
+    value *= 0x94d049bb133111ebULL;
+    value ^= value >> 31;
+
+    return value;
+}
+
+// structural hash of node, when hashes of its children are already known
+size_t nodeHash(const DiffNode_t* node, size_t leftHash, size_t rightHash) {
+    if (!node) return HASH_SEED;
+
+    size_t value = 0;
+    switch (node->type) {
+        case OP:
+            value = (size_t) node->value.opt;
+            break;
+        case NUM:
+            {
+                double num = node->value.num;
+                if (compDouble(num, 0)) num = 0;    // -0 and 0 are the same number
+                memcpy(&value, &num, sizeof(num));
+            }
+            break;
+        case VAR:
+            value = (size_t) node->value.var;
+            break;
+        case NODET_DEFAULT:
+        default:
+            break;
+    }
+
+    size_t hash = hashMix(value ^ ((size_t) node->type << 56) ^ HASH_SEED);
+    hash = hashMix(hash ^ leftHash);
+    hash = hashMix(hash + rightHash * 31);
+
+    return hash;
+}
+
+static WalkResult_t hashVisit(DiffNode_t* node, WalkEvent_t event, void* context) {
+    if (event != WALK_LEAVE) return WALK_NEXT;
+
+    WalkValues_t* hashes = (WalkValues_t*) context;
+
+    size_t rightHash = node->right ? walkValuesPop(hashes).hash : HASH_SEED;
+    size_t leftHash  = node->left  ? walkValuesPop(hashes).hash : HASH_SEED;
+
+    WalkValue_t value = {};
+    value.hash = nodeHash(node, leftHash, rightHash);
+
+    return walkValuesPush(hashes, value) == DIFF_OK ? WALK_NEXT : WALK_STOP;
+}
+
+size_t treeHash(const DiffNode_t* node) {
+    if (!node) return HASH_SEED;
+
+    WalkValues_t hashes = {};
+    walkValuesCtor(&hashes);
+
+    size_t hash = HASH_SEED;
+    if (treeWalk(const_cast<DiffNode_t*>(node), hashVisit, &hashes) == DIFF_OK && hashes.count == 1) hash = hashes.values[0].hash;
+
+    walkValuesDtor(&hashes);
+    return hash;
+}
@@ -0,0 +1,14 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include "diff.h"
+
+const size_t HASH_SEED = 0x9e3779b97f4a7c15ULL;
+
+size_t hashMix(size_t value);
+
+size_t nodeHash(const DiffNode_t* node, size_t leftHash, size_t rightHash);
+
+size_t treeHash(const DiffNode_t* node);
+
+#endif
@@ -0,0 +1,377 @@
+#include <float.h>
+#include <math.h>
+#include <new>
+#include <thread>
+
+#include "integral.h"
+
+// Nodes of 15-point Kronrod rule on [-1, 1], rule is symmetric, so only x >= 0 are here.
+// Odd ones (and 0) are nodes of 7-point Gauss rule, difference of two rules is error estimate.
+const double KRONROD_NODES[8] = {
+    0.991455371120812639206854697526329, 0.949107912342758524526189684047851,
+    0.864864423359769072789712788640926, 0.741531185599394439863864773280788,
+    0.586087235467691130294144845693013, 0.405845151377397166906606412076961,
+    0.207784955007898467600689403773245, 0.000000000000000000000000000000000,
+};
+
+const double KRONROD_WEIGHTS[8] = {
+    0.022935322010529224963732008058970, 0.063092092629978553290700663189204,
+    0.104790010322250183839876322541518, 0.140653259715525918745189590510238,
+    0.169004726639267902826583426598550, 0.190350578064785409913256402421014,
+    0.204432940075298892414161999234649, 0.209482141084727828012999174891714,
+};
+
+const double GAUSS_WEIGHTS[4] = {
+    0.129484966168869693270611432679082, 0.279705391489276667901467771423780,
+    0.381830050505118944950369775488975, 0.417959183673469387755102040816327,
+};
+
+struct Interval_t {
+    double left  = 0;
+    double right = 0;
+    double value = 0;
+    double error = 0;
+    int    nans  = 0;               // points, where f is not defined
+    int    infs  = 0;               // points, where f is infinite
+};
+
+enum IntervalKind_t {
+    INTERVAL_DEFINED   = 0,
+    INTERVAL_PARTIAL   = 1,         // edge of domain is inside
+    INTERVAL_UNDEFINED = 2,
+};
+
+// one part of range, it is integrated by its own thread
+struct IntegralPart_t {
+    const DiffProgram_t* program      = nullptr;
+    double               left         = 0;
+    double               right        = 0;
+    double               absTolerance = 0;      // share of this part
+    double               minWidth     = 0;
+    IntegralResult_t     result       = {};
+    IntervalKind_t       firstKind    = INTERVAL_DEFINED;     // kinds of the leftmost and the rightmost intervals,
+    IntervalKind_t       lastKind     = INTERVAL_DEFINED;     // edges of domain may be between parts too
+    bool                 undefined    = false;                // f is not defined on some interval
+    int                  err          = DIFF_OK;
+};
+
+// buffers of one worker
+struct IntegralWork_t {
+    Interval_t* leaves  = nullptr;          // current partition of part, in order of splitting
+    size_t*     fresh   = nullptr;          // indices of leaves, that are not evaluated yet
+    Interval_t* batch   = nullptr;
+    double*     xs      = nullptr;
+    double*     values  = nullptr;
+    double*     stack   = nullptr;
+};
+
+// the worst status stays, point is the leftmost one of it
+static void integralMark(IntegralResult_t* result, IntegralStatus_t status, double point) {
+    if (status < result->status) return;
+
+    if (status > result->status || point < result->point) result->point = point;
+    result->status = status;
+}
+
+static IntervalKind_t intervalKind(const Interval_t* interval) {
+    if (!interval->nans)                      return INTERVAL_DEFINED;
+    if (interval->nans == KRONROD_POINTS)     return INTERVAL_UNDEFINED;
+    return INTERVAL_PARTIAL;
+}
+
+// value of such interval is counted
+static bool intervalFinite(const Interval_t* interval) {
+    return !interval->nans && !interval->infs;
+}
+
+// values are f in KRONROD_POINTS points of interval: left half of nodes, center, right half
+static void kronrodRule(Interval_t* interval, const double* values) {
+    double half   = (interval->right - interval->left) / 2;
+    double center = values[7];
+
+    double kronrod = center * KRONROD_WEIGHTS[7];
+    double gauss   = center * GAUSS_WEIGHTS[3];
+    double absSum  = fabs(center) * KRONROD_WEIGHTS[7];
+
+    for (int j = 0; j < 7; j++) {
+        double sum = values[j] + values[14 - j];
+        kronrod += KRONROD_WEIGHTS[j] * sum;
+        absSum  += KRONROD_WEIGHTS[j] * (fabs(values[j]) + fabs(values[14 - j]));
+        if (j % 2) gauss += GAUSS_WEIGHTS[j / 2] * sum;
+    }
+
+    // deviation from mean value makes estimate of QUADPACK less pessimistic for smooth functions
+    double mean      = kronrod / 2;
+    double deviation = KRONROD_WEIGHTS[7] * fabs(center - mean);
+    for (int j = 0; j < 7; j++) {
+        deviation += KRONROD_WEIGHTS[j] * (fabs(values[j] - mean) + fabs(values[14 - j] - mean));
+    }
+
+    interval->nans = interval->infs = 0;
+    for (int i = 0; i < KRONROD_POINTS; i++) {
+        if (isnan(values[i]))      interval->nans++;
+        else if (isinf(values[i])) interval->infs++;
+    }
+
+    double error = fabs((kronrod - gauss) * half);
+    deviation *= fabs(half);
+    if (fpclassify(deviation) != FP_ZERO && fpclassify(error) != FP_ZERO) {
+        error = deviation * fmin(1, pow(200 * error / deviation, 1.5));
+    }
+
+    interval->value = kronrod * half;
+    interval->error = fmax(error, 50 * DBL_EPSILON * absSum * fabs(half));
+}
+
+// all the intervals of batch are evaluated by one pass of program
+static void evalIntervals(const DiffProgram_t* program, Interval_t* intervals, size_t count, double* xs, double* values, double* stack) {
+    for (size_t i = 0; i < count; i++) {
+        double  center = (intervals[i].left + intervals[i].right) / 2;
+        double  half   = (intervals[i].right - intervals[i].left) / 2;
+        double* points = xs + i * KRONROD_POINTS;
+
+        points[7] = center;
+        for (int j = 0; j < 7; j++) {
+            points[j]      = center - half * KRONROD_NODES[j];
+            points[14 - j] = center + half * KRONROD_NODES[j];
+        }
+    }
+
+    const double* vars[VAR_COUNT] = {};
+    for (int var = 0; var < VAR_COUNT; var++) vars[var] = xs;
+
+    programEvalBlock(program, vars, count * KRONROD_POINTS, stack, values);
+
+    for (size_t i = 0; i < count; i++) kronrodRule(&intervals[i], values + i * KRONROD_POINTS);
+}
+
+static void evalFresh(IntegralPart_t* part, IntegralWork_t* work, size_t freshCount) {
+    for (size_t start = 0; start < freshCount; start += INTEGRAL_BATCH) {
+        size_t count = freshCount - start < INTEGRAL_BATCH ? freshCount - start : INTEGRAL_BATCH;
+
+        for (size_t i = 0; i < count; i++) work->batch[i] = work->leaves[work->fresh[start + i]];
+        evalIntervals(part->program, work->batch, count, work->xs, work->values, work->stack);
+        for (size_t i = 0; i < count; i++) work->leaves[work->fresh[start + i]] = work->batch[i];
+    }
+
+    part->result.intervals   += freshCount;
+    part->result.evaluations += freshCount * KRONROD_POINTS;
+}
+
+static bool canSplit(const IntegralPart_t* part, const Interval_t* interval) {
+    return interval->right - interval->left > part->minWidth && intervalKind(interval) != INTERVAL_UNDEFINED;
+}
+
+static int compareIntervals(const void* first, const void* second) {
+    double left1 = ((const Interval_t*) first)->left;
+    double left2 = ((const Interval_t*) second)->left;
+
+    return (left1 > left2) - (left1 < left2);
+}
+
+// sums up final partition, marks singularities and edges of domain
+static void finishPart(IntegralPart_t* part, Interval_t* leaves, size_t count, double tolerance, bool full) {
+    IntegralResult_t* result = &part->result;
+
+    qsort(leaves, count, sizeof(Interval_t), compareIntervals);
+
+    double maxError = 0;
+    size_t maxIndex = 0;
+    for (size_t i = 0; i < count; i++) {
+        const Interval_t* interval = &leaves[i];
+        if (!intervalFinite(interval)) continue;
+
+        result->value   += interval->value;
+        result->error   += interval->error;
+        result->defined += interval->right - interval->left;
+        if (interval->error > maxError) {
+            maxError = interval->error;
+            maxIndex = i;
+        }
+    }
+    bool converged = result->error <= tolerance;
+
+    for (size_t i = 0; i < count; i++) {
+        const Interval_t* interval = &leaves[i];
+        IntervalKind_t    kind     = intervalKind(interval);
+        double            center   = (interval->left + interval->right) / 2;
+
+        if (kind == INTERVAL_UNDEFINED) part->undefined = true;
+        if (kind == INTERVAL_PARTIAL)   integralMark(result, INTEGRAL_DOMAIN, center);
+        if (kind == INTERVAL_DEFINED && interval->infs) integralMark(result, INTEGRAL_SINGULAR, center);
+
+        // domain ends exactly between two intervals
+        if (i && (kind == INTERVAL_UNDEFINED) != (intervalKind(&leaves[i - 1]) == INTERVAL_UNDEFINED) &&
+            kind != INTERVAL_PARTIAL && intervalKind(&leaves[i - 1]) != INTERVAL_PARTIAL) {
+            integralMark(result, INTEGRAL_DOMAIN, interval->left);
+        }
+
+        // the narrowest intervals, that still keep most of error, are around pole (or something like it)
+        if (!converged && intervalFinite(interval) && !canSplit(part, interval) && interval->error >= INTEGRAL_SPLIT_SHARE * maxError) {
+            integralMark(result, INTEGRAL_SINGULAR, center);
+        }
+    }
+
+    if (!converged && full) integralMark(result, INTEGRAL_INACCURATE, (leaves[maxIndex].left + leaves[maxIndex].right) / 2);
+
+    part->firstKind = intervalKind(&leaves[0]);
+    part->lastKind  = intervalKind(&leaves[count - 1]);
+}
+
+// Every round evaluates all the new intervals by batches, then intervals with the biggest errors are split in halves,
+// till the sum of errors is below tolerance (so as in QUADPACK, but many intervals are split at once).
+// Intervals with infinite values or edge of domain inside are always split, till they are narrower than minWidth,
+// intervals, where f is not defined at all, are never split.
+static int integratePart(IntegralPart_t* part, IntegralWork_t* work) {
+    Interval_t* leaves = work->leaves;
+    size_t*     fresh  = work->fresh;
+
+    leaves[0] = {};
+    leaves[0].left  = part->left;
+    leaves[0].right = part->right;
+    fresh[0]        = 0;
+
+    size_t count      = 1;
+    size_t freshCount = 1;
+    double tolerance  = part->absTolerance;
+    bool   full       = false;
+
+    while (freshCount) {
+        evalFresh(part, work, freshCount);
+
+        double value = 0, error = 0, freeError = 0, maxError = 0;
+        for (size_t i = 0; i < count; i++) {
+            if (!intervalFinite(&leaves[i])) continue;
+
+            value += leaves[i].value;
+            error += leaves[i].error;
+            if (canSplit(part, &leaves[i])) {
+                freeError += leaves[i].error;
+                maxError   = fmax(maxError, leaves[i].error);
+            }
+        }
+        tolerance = fmax(part->absTolerance, INTEGRAL_REL_TOLERANCE * fabs(value));
+
+        // when error stays only in intervals, that can't be split, there is no sense to go on
+        bool refine = error > tolerance && freeError > tolerance / 2;
+
+        freshCount = 0;
+        size_t oldCount = count;
+        for (size_t i = 0; i < oldCount; i++) {
+            Interval_t* interval = &leaves[i];
+            if (!canSplit(part, interval)) continue;
+
+            bool bad = intervalKind(interval) == INTERVAL_PARTIAL || interval->infs;
+            bool big = refine && intervalFinite(interval) && interval->error >= INTEGRAL_SPLIT_SHARE * maxError;
+            if (!bad && !big) continue;
+
+            if (count == INTEGRAL_MAX_INTERVALS) {
+                full = true;
+                break;
+            }
+
+            double middle = (interval->left + interval->right) / 2;
+            leaves[count]       = {};
+            leaves[count].left  = middle;
+            leaves[count].right = interval->right;
+            interval->right     = middle;
+
+            fresh[freshCount++] = i;
+            fresh[freshCount++] = count++;
+        }
+    }
+
+    finishPart(part, leaves, count, tolerance, full);
+
+    return DIFF_OK;
+}
+
+static void integralWorker(IntegralPart_t* part) {
+    size_t points   = INTEGRAL_BATCH * KRONROD_POINTS;
+    size_t maxStack = max(part->program->maxStack, 1);
+
+    IntegralWork_t work = {};
+    work.leaves = (Interval_t*) calloc(INTEGRAL_MAX_INTERVALS, sizeof(Interval_t));
+    work.fresh  = (size_t*)     calloc(INTEGRAL_MAX_INTERVALS, sizeof(size_t));
+    work.batch  = (Interval_t*) calloc(INTEGRAL_BATCH,         sizeof(Interval_t));
+    work.xs     = (double*)     calloc(points,                 sizeof(double));
+    work.values = (double*)     calloc(points,                 sizeof(double));
+    work.stack  = (double*)     calloc(maxStack * points,      sizeof(double));
+
+    if (!work.leaves || !work.fresh || !work.batch || !work.xs || !work.values || !work.stack) part->err = DIFF_NO_MEM;
+    else                                                                                    part->err = integratePart(part, &work);
+
+    free(work.leaves);
+    free(work.fresh);
+    free(work.batch);
+    free(work.xs);
+    free(work.values);
+    free(work.stack);
+}
+
+// Definite integral of equation on [left, right] by adaptive Gauss-Kronrod quadrature, every thread takes its own part of range.
+// Every variable is x, as in graph. Error estimate is absolute, status tells about singularities and edges of domain.
+int integrate(DiffNode_t* root, double left, double right, IntegralResult_t* result, int workers) {
+    DIFF_CHECK(!root || !result, DIFF_NULL);
+    DIFF_CHECK(!(left < right), DIFF_VALUE_NULL);
+
+    *result = {};
+
+    DiffProgram_t program = {};
+    int err = programCompile(&program, root);
+    if (err != DIFF_OK) return err;
+
+    if (workers < 1)                    workers = 1;
+    if (workers > MAX_INTEGRAL_WORKERS) workers = MAX_INTEGRAL_WORKERS;
+
+    size_t partCount = (size_t) workers;
+    IntegralPart_t* parts   = new (std::nothrow) IntegralPart_t[partCount];
+    std::thread*    threads = new (std::nothrow) std::thread[partCount];
+    if (!parts || !threads) err = DIFF_NO_MEM;
+
+    // near big x doubles are sparse, intervals can't be narrower than a few of their steps
+    double width    = right - left;
+    double minWidth = fmax(INTEGRAL_MIN_WIDTH * width, 4 * DBL_EPSILON * fmax(fabs(left), fabs(right)));
+
+    for (size_t i = 0; i < partCount && err == DIFF_OK; i++) {
+        IntegralPart_t* part = &parts[i];
+        part->program      = &program;
+        part->left         = left + width * (double) i / (double) partCount;
+        part->right        = i + 1 == partCount ? right : left + width * (double) (i + 1) / (double) partCount;
+        part->absTolerance = INTEGRAL_ABS_TOLERANCE / (double) partCount;
+        part->minWidth     = minWidth;
+    }
+
+    if (err == DIFF_OK) {
+        for (size_t i = 0; i < partCount; i++) threads[i] = std::thread(integralWorker, &parts[i]);
+        for (size_t i = 0; i < partCount; i++) threads[i].join();
+    }
+
+    for (size_t i = 0; parts && i < partCount && err == DIFF_OK; i++) {
+        const IntegralResult_t* partResult = &parts[i].result;
+        err = parts[i].err;
+
+        result->value       += partResult->value;
+        result->error       += partResult->error;
+        result->intervals   += partResult->intervals;
+        result->evaluations += partResult->evaluations;
+        result->defined     += partResult->defined;
+        if (partResult->status != INTEGRAL_OK) integralMark(result, partResult->status, partResult->point);
+
+        if (i && (parts[i].firstKind == INTERVAL_UNDEFINED) != (parts[i - 1].lastKind == INTERVAL_UNDEFINED) &&
+            parts[i].firstKind != INTERVAL_PARTIAL && parts[i - 1].lastKind != INTERVAL_PARTIAL) {
+            integralMark(result, INTEGRAL_DOMAIN, parts[i].left);
+        }
+    }
+
+    // f is not defined on the whole range, there are no edges
+    for (size_t i = 0; parts && i < partCount && err == DIFF_OK; i++) {
+        if (parts[i].undefined && result->status != INTEGRAL_DOMAIN) integralMark(result, INTEGRAL_DOMAIN, left);
+    }
+
+    delete[] threads;
+    delete[] parts;
+    programDtor(&program);
+
+    return err;
+}
@@ -0,0 +1,45 @@
+#ifndef INTEGRAL_H
+#define INTEGRAL_H
+
+#include "column.h"
+
+const int    DEFAULT_INTEGRAL_WORKERS = 4;
+
+const int    MAX_INTEGRAL_WORKERS     = 64;
+
+const int    KRONROD_POINTS           = 15;         // Gauss-Kronrod 7-15 rule
+
+const size_t INTEGRAL_BATCH           = 64;         // intervals evaluated at once (by KRONROD_POINTS points)
+
+const size_t INTEGRAL_MAX_INTERVALS   = 1 << 14;    // intervals of one worker, refinement stops after it
+
+const double INTEGRAL_SPLIT_SHARE     = 0.25;       // in one round intervals with bigger share of the biggest error are split
+
+const double INTEGRAL_ABS_TOLERANCE   = 1e-12;
+
+const double INTEGRAL_REL_TOLERANCE   = 1e-10;
+
+const double INTEGRAL_MIN_WIDTH       = 1e-12;      // relative to range, narrower intervals are not split anymore
+
+enum IntegralStatus_t {
+    INTEGRAL_OK         = 0,
+    INTEGRAL_INACCURATE = 1,    // intervals are over before tolerance was reached
+    INTEGRAL_SINGULAR   = 2,    // f is infinite or integral doesn't converge near point
+    INTEGRAL_DOMAIN     = 3,    // f is not defined on part of range (ln of negative number, 0/0), point is edge of domain
+};
+
+const char INTEGRAL_STATUS_NAMES[][16] = {"ok", "inaccurate", "singular", "domain"};
+
+struct IntegralResult_t {
+    double           value       = 0;       // over the part of range, where f is defined
+    double           error       = 0;       // estimate of absolute error
+    size_t           intervals   = 0;
+    size_t           evaluations = 0;
+    IntegralStatus_t status      = INTEGRAL_OK;
+    double           point       = 0;       // leftmost singularity or edge of domain
+    double           defined     = 0;       // length of part of range, where f is defined
+};
+
+int integrate(DiffNode_t* root, double left, double right, IntegralResult_t* result, int workers = DEFAULT_INTEGRAL_WORKERS);
+
+#endif
@@ -0,0 +1,206 @@
+#include "emit.h"
+#include "libdiff.h"
+
+// errorPos is offset of the first symbol, that parser can't read
+int diffParse(const char* text, DiffNode_t** expr, size_t* errorPos) {
+    DIFF_CHECK(!text || !expr, DIFF_NULL);
+
+    // parser only moves pointer, text is not changed
+    char* cursor = const_cast<char*>(text);
+
+    *expr = parseEquation(&cursor, true);
+    if (errorPos) *errorPos = *expr ? 0 : (size_t) (cursor - text);
+    DIFF_CHECK(!*expr, DIFF_SYNTAX);
+
+    return DIFF_OK;
+}
+
+int diffCopy(DiffNode_t* expr, DiffNode_t** result) {
+    DIFF_CHECK(!expr || !result, DIFF_NULL);
+
+    *result = nodeCopy(expr);
+    DIFF_CHECK(!*result, DIFF_NO_MEM);
+
+    if (addPrevs(*result) != DIFF_OK) {
+        diffNodeDtor(*result);
+        *result = nullptr;
+        return DIFF_NO_MEM;
+    }
+
+    return DIFF_OK;
+}
+
+int diffSimplify(DiffNode_t* expr) {
+    DIFF_CHECK(!expr, DIFF_NULL);
+
+    DIFF_CHECK(addPrevs(expr) != DIFF_OK, DIFF_NO_MEM);
+    easierEqu(expr);
+
+    // tree is right, but not simplified till the end
+    DIFF_CHECK(budgetExceeded(), DIFF_BUDGET);
+
+    return DIFF_OK;
+}
+
+// derivative of given order, every intermediate derivative is simplified
+int diffDerivative(DiffNode_t* expr, int order, DiffNode_t** result) {
+    DIFF_CHECK(!expr || !result, DIFF_NULL);
+    DIFF_CHECK(order < 0, DIFF_VALUE_NULL);
+
+    *result = nullptr;
+
+    DiffNode_t* current = nullptr;
+    int err = diffCopy(expr, &current);
+    if (err != DIFF_OK) return err;
+
+    for (int i = 0; i < order; i++) {
+        DiffNode_t* next = nodeDiff(current, nullptr);
+        diffNodeDtor(current);
+        current = next;
+        DIFF_CHECK(!current, budgetError());
+
+        err = diffSimplify(current);
+        if (err != DIFF_OK) {
+            diffNodeDtor(current);
+            return err;
+        }
+    }
+
+    *result = current;
+    return DIFF_OK;
+}
+
+int diffEval(DiffNode_t* expr, double x, double* value) {
+    DIFF_CHECK(!expr || !value, DIFF_NULL);
+
+    *value = funcValue(expr, x);
+    return DIFF_OK;
+}
+
+// value and exact value of first derivative in x by dual numbers, tree is not differentiated
+int diffEvalDual(DiffNode_t* expr, double x, double* value, double* deriv) {
+    DIFF_CHECK(!expr || !value || !deriv, DIFF_NULL);
+
+    Dual_t<double> result = treeValue(expr, Dual_t<double> {x, 1});
+
+    *value = result.value;
+    *deriv = result.deriv;
+    return DIFF_OK;
+}
+
+// [low, high] contains all the values of expr on [left, right] (bounds may be wider than real range)
+int diffEvalBounds(DiffNode_t* expr, double left, double right, double* low, double* high) {
+    DIFF_CHECK(!expr || !low || !high, DIFF_NULL);
+    DIFF_CHECK(left > right, DIFF_VALUE_NULL);
+
+    Bounds_t<double> result = treeValue(expr, Bounds_t<double> {left, right});
+
+    *low  = result.low;
+    *high = result.high;
+    return DIFF_OK;
+}
+
+// coefs[i] (i = 0..order) is value of i-th derivative in x0
+int diffTailor(DiffNode_t* expr, int order, double x0, double* coefs) {
+    DIFF_CHECK(!expr || !coefs, DIFF_NULL);
+    DIFF_CHECK(order < 0, DIFF_VALUE_NULL);
+
+    return tailorCoefs(expr, order, x0, coefs);
+}
+
+// value over [left, right] with error estimate, status and point of the first singularity (see integral.h)
+int diffIntegral(DiffNode_t* expr, double left, double right, IntegralResult_t* result) {
+    DIFF_CHECK(!expr || !result, DIFF_NULL);
+
+    return integrate(expr, left, right, result);
+}
+
+// Piecewise Chebyshev approximation of expr^(order) on [left, right] (see cheb.h), it is owned by cache and
+// is built only once for equal expressions, so expensive derivative may be evaluated millions of times cheaply.
+int diffApprox(DiffChebCache_t* cache, DiffNode_t* expr, int order, double left, double right, double tolerance, const DiffCheb_t** approx) {
+    DIFF_CHECK(!cache || !expr || !approx, DIFF_NULL);
+
+    return chebCacheGet(cache, expr, order, left, right, tolerance, approx);
+}
+
+int diffApproxEval(const DiffCheb_t* approx, double x, double* value) {
+    DIFF_CHECK(!approx || !value, DIFF_NULL);
+
+    *value = chebValue(approx, x);
+    return DIFF_OK;
+}
+
+static int diffEmit(DiffNode_t* expr, DiffFormat_t format, DiffEmitter_t* out) {
+    switch (format) {
+        case DIFF_FORMAT_INFIX:
+            nodeToInfix(expr, out);
+            break;
+        case DIFF_FORMAT_TEX:
+            nodeToTex(expr, out);
+            break;
+        case DIFF_FORMAT_GNUPLOT:
+            drawNode(expr, out);
+            break;
+        default:
+            return DIFF_VALUE_NULL;
+    }
+
+    return DIFF_OK;
+}
+
+int diffPrint(DiffNode_t* expr, DiffFormat_t format, FILE* file) {
+    DIFF_CHECK(!expr || !file, DIFF_NULL);
+
+    DiffEmitter_t out;
+    emitterCtor(&out, EMIT_FILE, file);
+
+    int err = diffEmit(expr, format, &out);
+    if (emitterFlush(&out) != DIFF_OK && err == DIFF_OK) err = DIFF_FILE_NULL;
+    emitterDtor(&out);
+
+    if (err != DIFF_OK) return err;
+    return ferror(file) ? DIFF_FILE_NULL : DIFF_OK;
+}
+
+// text goes to descriptor by writev() of whole buffers, without stdio
+int diffPrintFd(DiffNode_t* expr, DiffFormat_t format, int fd) {
+    DIFF_CHECK(!expr || fd < 0, DIFF_NULL);
+
+    DiffEmitter_t out;
+    emitterCtor(&out, EMIT_FD, nullptr, fd);
+
+    int err = diffEmit(expr, format, &out);
+    if (emitterFlush(&out) != DIFF_OK && err == DIFF_OK) err = DIFF_FILE_NULL;
+    emitterDtor(&out);
+
+    return err;
+}
+
+// text is allocated by malloc, caller frees it
+int diffToString(DiffNode_t* expr, DiffFormat_t format, char** text) {
+    DIFF_CHECK(!expr || !text, DIFF_NULL);
+
+    *text = nullptr;
+
+    DiffEmitter_t out;
+    emitterCtor(&out, EMIT_MEMORY);
+
+    int err = diffEmit(expr, format, &out);
+
+    size_t      size   = 0;
+    const char* result = emitterText(&out, &size);
+    if (err == DIFF_OK && out.failed) err = DIFF_NO_MEM;
+
+    if (err == DIFF_OK) {
+        *text = (char*) malloc(size + 1);
+        if (*text) memcpy(*text, result, size + 1);
+        else       err = DIFF_NO_MEM;
+    }
+
+    emitterDtor(&out);
+    return err;
+}
+
+void diffFree(DiffNode_t* expr) {
+    diffNodeDtor(expr);
+}
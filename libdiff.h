@@ -0,0 +1,56 @@
+#ifndef LIBDIFF_H
+#define LIBDIFF_H
+
+#include "budget.h"
+#include "diff.h"
+#include "cheb.h"
+#include "eval.h"
+#include "integral.h"
+
+// Embeddable API: parse -> differentiate -> simplify -> evaluate / print.
+// Functions return DiffError_t codes, trees they give are owned by caller and freed by diffFree().
+// Nothing goes to stderr or TeX document, no external programs are launched.
+// Different trees may be processed in different threads at once, but it is not free of global state:
+// pool of nodes and budget are per thread, diffStats are shared atomic counters (totals of all the threads,
+// counted only after diffStats.enabled is set), diffMemo (--watch), diffCache (--cache) and chebCache of CLI
+// are global and are not locked, so they must stay unset, as they are till CLI sets them. DiffChebCache_t of diffApprox() belongs to one thread too.
+// Calls of one thread between diffBudgetBegin() and diffBudgetEnd() are limited by its budget (see budget.h),
+// they return DIFF_BUDGET after any limit.
+
+enum DiffFormat_t {
+    DIFF_FORMAT_INFIX   = 0,        // the same syntax as parser reads
+    DIFF_FORMAT_TEX     = 1,
+    DIFF_FORMAT_GNUPLOT = 2,
+};
+
+int diffParse(const char* text, DiffNode_t** expr, size_t* errorPos = nullptr);
+
+int diffCopy(DiffNode_t* expr, DiffNode_t** result);
+
+int diffSimplify(DiffNode_t* expr);
+
+int diffDerivative(DiffNode_t* expr, int order, DiffNode_t** result);
+
+int diffEval(DiffNode_t* expr, double x, double* value);
+
+int diffEvalDual(DiffNode_t* expr, double x, double* value, double* deriv);
+
+int diffEvalBounds(DiffNode_t* expr, double left, double right, double* low, double* high);
+
+int diffTailor(DiffNode_t* expr, int order, double x0, double* coefs);
+
+int diffIntegral(DiffNode_t* expr, double left, double right, IntegralResult_t* result);
+
+int diffApprox(DiffChebCache_t* cache, DiffNode_t* expr, int order, double left, double right, double tolerance, const DiffCheb_t** approx);
+
+int diffApproxEval(const DiffCheb_t* approx, double x, double* value);
+
+int diffPrint(DiffNode_t* expr, DiffFormat_t format, FILE* file);
+
+int diffPrintFd(DiffNode_t* expr, DiffFormat_t format, int fd);
+
+int diffToString(DiffNode_t* expr, DiffFormat_t format, char** text);
+
+void diffFree(DiffNode_t* expr);
+
+#endif
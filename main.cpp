@@ -1,19 +1,179 @@
 #include <stdio.h>
 
+#include "budget.h"
+#include "cheb.h"
+#include "column.h"
 #include "diff.h"
+#include "dump.h"
+#include "profile.h"
+#include "render.h"
+#include "server.h"
+#include "watch.h"
 
 int main(int argc, char *argv[]) {
-    if (argc == 2) {
-        DiffNode_t* res = openDiffFile(argv[1]);
+    // TeX document is finished and rendered when program ends
+    atexit(closeLogfile);
+
+    const char*   fileName = nullptr;
+    DiffOptions_t options  = {};
+    DumpOptions_t dump     = {};
+    DiffLimits_t  limits   = {};
+
+    RenderMode_t renderMode    = RENDER_ON;
+    int          renderWorkers = DEFAULT_RENDER_WORKERS;
+
+    bool        serve          = false;
+    const char* serveSocket    = nullptr;
+    int         serveWorkers   = DEFAULT_SERVER_WORKERS;
+    int         serveDeadline  = DEFAULT_SERVER_DEADLINE;
+    size_t      serveMaxNodes  = DEFAULT_SERVER_MAX_NODES;
+
+    bool        watch          = false;
+    int         watchRuns      = 0;
+
+    const char*     columnsIn  = nullptr;
+    const char*     columnsOut = nullptr;
+    ColumnOptions_t columns    = {};
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--trace") && i + 1 < argc) {
+            options.traceName = argv[++i];
+        } else if (!strcmp(argv[i], "--save") && i + 1 < argc) {
+            options.savePath = argv[++i];
+        } else if (!strcmp(argv[i], "--cache") && i + 1 < argc) {
+            options.cacheDir = argv[++i];
+        } else if (!strcmp(argv[i], "--cache-size") && i + 1 < argc) {
+            options.cacheSize = (size_t) atol(argv[++i]) << 20;
+        } else if (!strcmp(argv[i], "--dump") && i + 1 < argc) {
+            options.dumpPath    = argv[++i];
+            options.dumpOptions = &dump;
+        } else if (!strcmp(argv[i], "--dump-format") && i + 1 < argc) {
+            i++;
+            if      (!strcmp(argv[i], "dot"))  dump.format = DUMP_DOT;
+            else if (!strcmp(argv[i], "json")) dump.format = DUMP_JSON;
+            else {
+                fprintf(stderr, "Incorrect arguments provided\n");
+                return 1;
+            }
+        } else if (!strcmp(argv[i], "--dump-depth") && i + 1 < argc) {
+            dump.maxDepth = (size_t) atol(argv[++i]);
+        } else if (!strcmp(argv[i], "--dump-nodes") && i + 1 < argc) {
+            dump.maxNodes = (size_t) atol(argv[++i]);
+        } else if (!strcmp(argv[i], "--dump-tree")) {
+            dump.share = false;
+        } else if (!strcmp(argv[i], "--dump-view")) {
+            dump.view = true;
+        } else if (!strcmp(argv[i], "--profile") && i + 1 < argc) {
+            options.profilePath = argv[++i];
+        } else if (!strcmp(argv[i], "--profile-report") && i + 1 < argc) {
+            return diffProfileReport(argv[++i], stdout) == DIFF_OK ? 0 : 1;
+        } else if (!strcmp(argv[i], "--output") && i + 1 < argc) {
+            i++;
+            if      (!strcmp(argv[i], "tex"))   options.output = OUTPUT_TEX;
+            else if (!strcmp(argv[i], "json"))  options.output = OUTPUT_JSON;
+            else if (!strcmp(argv[i], "infix")) options.output = OUTPUT_INFIX;
+            else {
+                fprintf(stderr, "Incorrect arguments provided\n");
+                return 1;
+            }
+        } else if (!strcmp(argv[i], "--no-render")) {
+            renderMode = RENDER_OFF;
+        } else if (!strcmp(argv[i], "--stub-render")) {
+            renderMode = RENDER_STUB;
+        } else if (!strcmp(argv[i], "--render-jobs") && i + 1 < argc) {
+            renderWorkers = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--roots")) {
+            options.roots = true;
+        } else if (!strcmp(argv[i], "--root-jobs") && i + 1 < argc) {
+            options.rootWorkers = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--integral")) {
+            options.integral = true;
+        } else if (!strcmp(argv[i], "--integral-jobs") && i + 1 < argc) {
+            options.integralWorkers = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--cheb")) {
+            options.chebTolerance = i + 1 < argc && atof(argv[i + 1]) > 0 ? atof(argv[++i]) : CHEB_DEFAULT_TOLERANCE;
+        } else if (!strcmp(argv[i], "--max-nodes") && i + 1 < argc) {
+            limits.nodes   = (size_t) atol(argv[++i]);
+            options.limits = &limits;
+        } else if (!strcmp(argv[i], "--max-memory") && i + 1 < argc) {
+            limits.bytes   = (size_t) atol(argv[++i]) << 20;
+            options.limits = &limits;
+        } else if (!strcmp(argv[i], "--max-time") && i + 1 < argc) {
+            limits.timeMs  = (uint64_t) atol(argv[++i]);
+            options.limits = &limits;
+        } else if (!strcmp(argv[i], "--max-output") && i + 1 < argc) {
+            limits.output  = (size_t) atol(argv[++i]) << 20;
+            options.limits = &limits;
+        } else if (!strcmp(argv[i], "--serve")) {
+            serve = true;
+        } else if (!strcmp(argv[i], "--serve-socket") && i + 1 < argc) {
+            serveSocket = argv[++i];
+        } else if (!strcmp(argv[i], "--serve-workers") && i + 1 < argc) {
+            serveWorkers = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--serve-deadline") && i + 1 < argc) {
+            serveDeadline = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--serve-max-nodes") && i + 1 < argc) {
+            serveMaxNodes = (size_t) atol(argv[++i]);
+        } else if (!strcmp(argv[i], "--watch")) {
+            watch = true;
+        } else if (!strcmp(argv[i], "--watch-runs") && i + 1 < argc) {
+            watch     = true;
+            watchRuns = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--columns") && i + 2 < argc) {
+            columnsIn  = argv[++i];
+            columnsOut = argv[++i];
+        } else if (!strcmp(argv[i], "--expr") && i + 1 < argc && columns.exprCount < MAX_COLUMN_EXPRS) {
+            columns.exprs[columns.exprCount++] = argv[++i];
+        } else if (!strcmp(argv[i], "--system") && i + 1 < argc) {
+            columns.systemPath = argv[++i];
+        } else if (!strcmp(argv[i], "--grad")) {
+            columns.gradient = true;
+        } else if (!strcmp(argv[i], "--column-type") && i + 1 < argc) {
+            i++;
+            if      (!strcmp(argv[i], SCALAR_TYPE_NAMES[SCALAR_FLOAT]))       columns.scalar = SCALAR_FLOAT;
+            else if (!strcmp(argv[i], SCALAR_TYPE_NAMES[SCALAR_DOUBLE]))      columns.scalar = SCALAR_DOUBLE;
+            else if (!strcmp(argv[i], SCALAR_TYPE_NAMES[SCALAR_LONG_DOUBLE])) columns.scalar = SCALAR_LONG_DOUBLE;
+            else {
+                fprintf(stderr, "Incorrect arguments provided\n");
+                return 1;
+            }
+        } else if (!strcmp(argv[i], "--block") && i + 1 < argc) {
+            columns.block = (size_t) atol(argv[++i]);
+        } else if (!fileName) {
+            fileName = argv[i];
+        } else {
+            fileName = nullptr;
+            break;
+        }
+    }
+
+    if (columnsIn)   return evalColumns(columnsIn, columnsOut, &columns)                              == DIFF_OK ? 0 : 1;
+    if (serveSocket) return diffServeSocket(serveSocket, serveWorkers, serveDeadline, serveMaxNodes) == DIFF_OK ? 0 : 1;
+    if (serve)       return diffServeStdin(serveWorkers, serveDeadline, serveMaxNodes)               == DIFF_OK ? 0 : 1;
+
+    if (fileName) {
+        renderQueue = renderQueueCtor(renderMode, renderWorkers);
+
+        // document of every job has its own name, as graphs do, so jobs in one directory don't mix their pdf
+        char texName[MAX_ARTIFACT_LENGTH] = "";
+        if (renderArtifact(renderQueue, texName, sizeof(texName) - 4, "zorich") != DIFF_OK) return 1;
+        strcat(texName, ".tex");
+
+        if (watch) return watchDiffFile(fileName, texName, &options, watchRuns) == DIFF_OK ? 0 : 1;
+
+        DiffNode_t* res = openDiffFile(fileName, texName, &options);
         if (!res) {
-            fprintf(stderr, "File %s not found!\n", argv[1]);
-            return 0;
+            fprintf(stderr, "File %s not found!\n", fileName);
+            return 1;
         }
 
         diffNodeDtor(res);
+
+        // job was stopped by its limits
+        if (budgetLimit(&jobBudget) != BUDGET_NONE) return 2;
     } else {
         fprintf(stderr, "Incorrect arguments provided\n");
     }
 
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,182 @@
+#include "oper.h"
+#include "scalar.h"
+
+// DERIVATIVES
+
+static DiffNode_t* numNode(double value) {
+    return newNumNode(nullptr, nullptr, nullptr, value);
+}
+
+static DiffNode_t* diffAdd(DiffNode_t*, DiffNode_t* dLeft, DiffNode_t* dRight, DiffSteps_t*, DiffRule_t*) {
+    return ADD(dLeft, dRight);
+}
+
+static DiffNode_t* diffSub(DiffNode_t*, DiffNode_t* dLeft, DiffNode_t* dRight, DiffSteps_t*, DiffRule_t*) {
+    return SUB(dLeft, dRight);
+}
+
+static DiffNode_t* diffMul(DiffNode_t* startNode, DiffNode_t* dLeft, DiffNode_t* dRight, DiffSteps_t*, DiffRule_t*) {
+    return ADD(MUL(dLeft, cR), MUL(cL, dRight));
+}
+
+static DiffNode_t* diffDiv(DiffNode_t* startNode, DiffNode_t* dLeft, DiffNode_t* dRight, DiffSteps_t*, DiffRule_t*) {
+    return DIV(SUB(MUL(dLeft, cR), MUL(cL, dRight)), POW(cR, numNode(2)));
+}
+
+static DiffNode_t* diffPower(DiffNode_t* startNode, DiffNode_t* dLeft, DiffNode_t* dRight, DiffSteps_t* steps, DiffRule_t* rule) {
+    if (IS_NUM(R(startNode))) *rule = IS_NUM(L(startNode)) ? RULE_CONST : RULE_POW_NUM;
+    else                      *rule = IS_NUM(L(startNode)) ? RULE_EXP   : RULE_POW_FUNC;
+
+    return diffPow(startNode, dLeft, dRight, steps);
+}
+
+static DiffNode_t* diffSin(DiffNode_t* startNode, DiffNode_t*, DiffNode_t* dRight, DiffSteps_t*, DiffRule_t*) {
+    return MUL(COS(cR), dRight);
+}
+
+static DiffNode_t* diffCos(DiffNode_t* startNode, DiffNode_t*, DiffNode_t* dRight, DiffSteps_t*, DiffRule_t*) {
+    return MUL(MUL(numNode(-1), SIN(cR)), dRight);
+}
+
+static DiffNode_t* diffLn(DiffNode_t* startNode, DiffNode_t*, DiffNode_t* dRight, DiffSteps_t*, DiffRule_t*) {
+    return DIV(dRight, cR);
+}
+
+static DiffNode_t* diffTan(DiffNode_t* startNode, DiffNode_t*, DiffNode_t* dRight, DiffSteps_t*, DiffRule_t*) {
+    return DIV(dRight, POW(COS(cR), numNode(2)));
+}
+
+// exp(f)' = exp(f) * f', without ln of base as for c^f
+static DiffNode_t* diffExp(DiffNode_t* startNode, DiffNode_t*, DiffNode_t* dRight, DiffSteps_t*, DiffRule_t*) {
+    return MUL(nodeCopy(startNode), dRight);
+}
+
+static DiffNode_t* diffSqrt(DiffNode_t* startNode, DiffNode_t*, DiffNode_t* dRight, DiffSteps_t*, DiffRule_t*) {
+    return DIV(dRight, MUL(numNode(2), nodeCopy(startNode)));
+}
+
+static DiffNode_t* diffAsin(DiffNode_t* startNode, DiffNode_t*, DiffNode_t* dRight, DiffSteps_t*, DiffRule_t*) {
+    return DIV(dRight, SQRT(SUB(numNode(1), POW(cR, numNode(2)))));
+}
+
+static DiffNode_t* diffAcos(DiffNode_t* startNode, DiffNode_t*, DiffNode_t* dRight, DiffSteps_t*, DiffRule_t*) {
+    return DIV(MUL(numNode(-1), dRight), SQRT(SUB(numNode(1), POW(cR, numNode(2)))));
+}
+
+static DiffNode_t* diffAtan(DiffNode_t* startNode, DiffNode_t*, DiffNode_t* dRight, DiffSteps_t*, DiffRule_t*) {
+    return DIV(dRight, ADD(numNode(1), POW(cR, numNode(2))));
+}
+
+static DiffNode_t* diffSinh(DiffNode_t* startNode, DiffNode_t*, DiffNode_t* dRight, DiffSteps_t*, DiffRule_t*) {
+    return MUL(COSH(cR), dRight);
+}
+
+static DiffNode_t* diffCosh(DiffNode_t* startNode, DiffNode_t*, DiffNode_t* dRight, DiffSteps_t*, DiffRule_t*) {
+    return MUL(SINH(cR), dRight);
+}
+
+// |f|' = f / |f| * f', it is not defined where f = 0
+static DiffNode_t* diffAbs(DiffNode_t* startNode, DiffNode_t*, DiffNode_t* dRight, DiffSteps_t*, DiffRule_t*) {
+    return MUL(DIV(cR, nodeCopy(startNode)), dRight);
+}
+
+// VALUES
+
+static double addValue(double left, double right) { return left + right; }
+static double subValue(double left, double right) { return left - right; }
+static double mulValue(double left, double right) { return left * right; }
+static double divValue(double left, double right) { return left / right; }
+static double powValue(double left, double right) { return pow(left, right); }
+
+template <double (*F)(double)>
+static double funcOperValue(double, double right) {
+    return F(right);
+}
+
+// TABLE
+
+// constexpr: size of parser trie is checked against names at compile time
+constexpr DiffOper_t DIFF_OPERS[OP_COUNT] = {
+//   type     name    arity prior rule           diff       value                        tex style  tex          close  plot
+    {MUL_OP,  "*",    2,    2,    RULE_MUL,      diffMul,   mulValue,                    TEX_INFIX, " \\cdot ",  "",    " * "},
+    {ADD_OP,  "+",    2,    1,    RULE_ADD,      diffAdd,   addValue,                    TEX_INFIX, " + ",       "",    " + "},
+    {DIV_OP,  "/",    2,    2,    RULE_DIV,      diffDiv,   divValue,                    TEX_FRAC,  "",          "",    " / "},
+    {SUB_OP,  "-",    2,    1,    RULE_SUB,      diffSub,   subValue,                    TEX_INFIX, " - ",       "",    " - "},
+    {POW_OP,  "^",    2,    3,    RULE_POW_FUNC, diffPower, powValue,                    TEX_POW,   "",          "",    " ** "},
+    {SIN_OP,  "sin",  1,    0,    RULE_SIN,      diffSin,   funcOperValue<scalarSin>,    TEX_FUNC,  "sin(",      ")",   "sin"},
+    {COS_OP,  "cos",  1,    0,    RULE_COS,      diffCos,   funcOperValue<scalarCos>,    TEX_FUNC,  "cos(",      ")",   "cos"},
+    {LN_OP,   "ln",   1,    0,    RULE_LN,       diffLn,    funcOperValue<scalarLn>,     TEX_FUNC,  "ln(",       ")",   "log"},
+    {TAN_OP,  "tan",  1,    0,    RULE_TAN,      diffTan,   funcOperValue<scalarTan>,    TEX_FUNC,  "tg(",       ")",   "tan"},
+    {EXP_OP,  "exp",  1,    0,    RULE_NAT_EXP,  diffExp,   funcOperValue<scalarExp>,    TEX_FUNC,  "e^{",       "}",   "exp"},
+    {SQRT_OP, "sqrt", 1,    0,    RULE_SQRT,     diffSqrt,  funcOperValue<scalarSqrt>,   TEX_FUNC,  "\\sqrt{",   "}",   "sqrt"},
+    {ASIN_OP, "asin", 1,    0,    RULE_ASIN,     diffAsin,  funcOperValue<scalarAsin>,   TEX_FUNC,  "arcsin(",   ")",   "asin"},
+    {ACOS_OP, "acos", 1,    0,    RULE_ACOS,     diffAcos,  funcOperValue<scalarAcos>,   TEX_FUNC,  "arccos(",   ")",   "acos"},
+    {ATAN_OP, "atan", 1,    0,    RULE_ATAN,     diffAtan,  funcOperValue<scalarAtan>,   TEX_FUNC,  "arctg(",    ")",   "atan"},
+    {SINH_OP, "sinh", 1,    0,    RULE_SINH,     diffSinh,  funcOperValue<scalarSinh>,   TEX_FUNC,  "sh(",       ")",   "sinh"},
+    {COSH_OP, "cosh", 1,    0,    RULE_COSH,     diffCosh,  funcOperValue<scalarCosh>,   TEX_FUNC,  "ch(",       ")",   "cosh"},
+    {ABS_OP,  "abs",  1,    0,    RULE_ABS,      diffAbs,   funcOperValue<scalarAbs>,    TEX_FUNC,  "|",         "|",   "abs"},
+};
+
+// PARSER
+
+// root and one node per symbol of every name is the most, that trie may take
+static constexpr size_t operTrieMaxNodes(void) {
+    size_t nodes = 1;
+    for (int oper = 0; oper < OP_COUNT; oper++) {
+        for (const char* c = DIFF_OPERS[oper].name; *c; c++) nodes++;
+    }
+
+    return nodes;
+}
+
+static_assert(operTrieMaxNodes() <= OPER_TRIE_SIZE, "names of operators don't fit into OPER_TRIE_SIZE");
+static_assert(OPER_TRIE_SIZE <= UINT8_MAX + 1, "children of trie are uint8_t");
+
+// names of all the operators, node keeps operator, whose name ends there
+struct OperTrie_t {
+    uint8_t  next[OPER_TRIE_SIZE][OPER_TRIE_CHARS] = {};    // 0 - no child (root is never a child)
+    OpType_t opers[OPER_TRIE_SIZE] = {};
+    size_t   count = 0;
+};
+
+static OperTrie_t operTrieCtor(void) {
+    OperTrie_t trie = {};
+    for (size_t i = 0; i < OPER_TRIE_SIZE; i++) trie.opers[i] = OPT_DEFAULT;
+    trie.count = 1;
+
+    for (int oper = 0; oper < OP_COUNT; oper++) {
+        size_t node = 0;
+        for (const char* c = DIFF_OPERS[oper].name; *c; c++) {
+            uint8_t* child = &trie.next[node][(unsigned char) *c];
+            if (!*child) *child = (uint8_t) trie.count++;
+
+            node = *child;
+        }
+
+        trie.opers[node] = DIFF_OPERS[oper].type;
+    }
+
+    return trie;
+}
+
+// the longest name of operator with given arity at the start of text (sinh, not sin), length is its length
+OpType_t operParse(const char* s, int arity, size_t* length) {
+    // built once, before the first parse of any thread
+    static const OperTrie_t trie = operTrieCtor();
+
+    OpType_t found = OPT_DEFAULT;
+    size_t   node  = 0;
+
+    for (size_t i = 0; s[i] > 0 && s[i] < OPER_TRIE_CHARS; i++) {
+        node = trie.next[node][(unsigned char) s[i]];
+        if (!node) break;
+
+        OpType_t oper = trie.opers[node];
+        if (oper != OPT_DEFAULT && DIFF_OPERS[oper].arity == arity) {
+            found = oper;
+            if (length) *length = i + 1;
+        }
+    }
+
+    return found;
+}
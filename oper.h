@@ -0,0 +1,60 @@
+#ifndef OPER_H
+#define OPER_H
+
+#include "steps.h"
+
+const size_t OPER_TRIE_SIZE = 64;       // nodes of parser trie, names of all the operators fit into it
+
+const int    OPER_TRIE_CHARS = 128;
+
+// Derivative of the same equation changes with rules of DIFF_OPERS and simplifier (easierEqu), so cached
+// results of older rules are not taken. Bump it with every change of them.
+const uint32_t DIFF_RULES_VERSION = 6;
+
+enum OperTex_t {
+    TEX_INFIX = 0,      // left, sign, right (factors of product get brackets)
+    TEX_FRAC  = 1,
+    TEX_POW   = 2,
+    TEX_FUNC  = 3,      // opening, argument, closing
+};
+
+// derivative of operator, derivatives of children are already taken (dLeft is nullptr for functions),
+// rule is the rule of operator, it may be changed to more exact one (power)
+typedef DiffNode_t* (*OperDiff_t)(DiffNode_t* startNode, DiffNode_t* dLeft, DiffNode_t* dRight, DiffSteps_t* steps, DiffRule_t* rule);
+
+// value in doubles, left is 0 for functions
+typedef double (*OperValue_t)(double left, double right);
+
+// Everything about one operator: parser, derivative, folding of constants, evaluation, TeX and gnuplot
+// take it from here by OpType_t, so new function is one line of DIFF_OPERS (and its kernels in scalar.h).
+struct DiffOper_t {
+    OpType_t    type     = OPT_DEFAULT;
+    const char* name     = nullptr;     // token of parser and infix output
+    int         arity    = 0;           // 2 - binary operator, 1 - function of right child
+    int         priority = 0;           // of binary operator, function takes one primary
+    DiffRule_t  rule     = RULE_DEFAULT;
+    OperDiff_t  diff     = nullptr;
+    OperValue_t value    = nullptr;
+    OperTex_t   texStyle = TEX_FUNC;
+    const char* tex      = nullptr;     // sign of TEX_INFIX or opening of TEX_FUNC
+    const char* texClose = nullptr;
+    const char* plot     = nullptr;     // gnuplot
+};
+
+// indexed by OpType_t
+extern const DiffOper_t DIFF_OPERS[OP_COUNT];
+
+inline const DiffOper_t* operFind(OpType_t oper) {
+    return oper >= 0 && oper < OP_COUNT ? &DIFF_OPERS[oper] : nullptr;
+}
+
+inline bool operIsFunc(const DiffNode_t* node) {
+    const DiffOper_t* oper = node->type == OP ? operFind(node->value.opt) : nullptr;
+    return oper && oper->arity == 1;
+}
+
+#define IS_FUNC(node) operIsFunc(node)
+
+OpType_t operParse(const char* s, int arity, size_t* length);
+
+#endif
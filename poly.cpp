@@ -0,0 +1,530 @@
+#include "hash.h"
+#include "oper.h"
+#include "poly.h"
+#include "walk.h"
+
+int polyCtor(Poly_t* poly, int degree, char var) {
+    DIFF_CHECK(!poly, DIFF_NULL);
+    DIFF_CHECK(degree < 0 || degree > MAX_POLY_DEGREE, DIFF_VALUE_NULL);
+
+    *poly = {};
+    poly->coefs = (double*) calloc((size_t) degree + 1, sizeof(double));
+    DIFF_CHECK(!poly->coefs, DIFF_NO_MEM);
+
+    poly->degree = degree;
+    poly->var    = degree ? var : '\0';
+
+    return DIFF_OK;
+}
+
+void polyDtor(Poly_t* poly) {
+    if (!poly) return;
+
+    free(poly->coefs);
+    *poly = {};
+}
+
+// leading zeros are dropped, so degree is real one
+static void polyTrim(Poly_t* poly) {
+    while (poly->degree > 0 && compDouble(poly->coefs[poly->degree], 0)) poly->degree--;
+    if (!poly->degree) poly->var = '\0';
+}
+
+// polynomials in different variables can't be mixed, constant goes with any
+static bool polySameVar(const Poly_t* first, const Poly_t* second, char* var) {
+    if (first->var && second->var && first->var != second->var) return false;
+
+    *var = first->var ? first->var : second->var;
+    return true;
+}
+
+// Operations below write to result->coefs, that has place for MAX_POLY_DEGREE + 1 coefficients,
+// and return false, if result is not a polynomial (or its degree is too big).
+
+static bool polyAdd(const Poly_t* left, const Poly_t* right, double sign, Poly_t* result) {
+    if (!polySameVar(left, right, &result->var)) return false;
+
+    result->degree = left->degree > right->degree ? left->degree : right->degree;
+    for (int i = 0; i <= result->degree; i++) {
+        result->coefs[i] = (i <= left->degree  ? left->coefs[i]         : 0)
+                         + (i <= right->degree ? sign * right->coefs[i] : 0);
+    }
+
+    polyTrim(result);
+    return true;
+}
+
+static bool polyMul(const Poly_t* left, const Poly_t* right, Poly_t* result) {
+    if (!polySameVar(left, right, &result->var)) return false;
+    if (left->degree + right->degree > MAX_POLY_DEGREE) return false;
+
+    result->degree = left->degree + right->degree;
+    for (int i = 0; i <= result->degree; i++) result->coefs[i] = 0;
+
+    for (int i = 0; i <= left->degree; i++) {
+        for (int j = 0; j <= right->degree; j++) result->coefs[i + j] += left->coefs[i] * right->coefs[j];
+    }
+
+    polyTrim(result);
+    return true;
+}
+
+static bool polyConst(Poly_t* result, double value) {
+    result->degree   = 0;
+    result->var      = '\0';
+    result->coefs[0] = value;
+
+    return true;
+}
+
+// only natural powers of polynomials, any power of constant; temp has place for MAX_POLY_DEGREE + 1 coefficients
+static bool polyPow(const Poly_t* base, const Poly_t* exponent, Poly_t* result, double* temp) {
+    if (exponent->var) return false;
+
+    double power = exponent->coefs[0];
+    if (!base->var) return polyConst(result, pow(base->coefs[0], power));
+
+    if (power < 0 || power > MAX_POLY_DEGREE || !compDouble(power, floor(power))) return false;
+    if (base->degree * (int) power > MAX_POLY_DEGREE) return false;
+
+    polyConst(result, 1);
+    for (int i = 0; i < (int) power; i++) {
+        Poly_t current = *result;
+        current.coefs = temp;
+        memcpy(temp, result->coefs, ((size_t) result->degree + 1) * sizeof(double));
+
+        polyMul(&current, base, result);
+    }
+
+    return true;
+}
+
+// polynomial of operator out of polynomials of its children, left is empty for functions
+static bool polyOper(const DiffNode_t* node, const Poly_t* left, const Poly_t* right, Poly_t* result, double* temp) {
+    // function of constant is constant
+    if (IS_FUNC(node)) {
+        if (right->var) return false;
+        return polyConst(result, DIFF_OPERS[node->value.opt].value(0, right->coefs[0]));
+    }
+
+    switch (node->value.opt) {
+        case ADD_OP:
+            return polyAdd(left, right, 1, result);
+        case SUB_OP:
+            return polyAdd(left, right, -1, result);
+        case MUL_OP:
+            return polyMul(left, right, result);
+        case DIV_OP:
+            {
+                if (right->var || compDouble(right->coefs[0], 0)) return false;
+
+                // only power of two has exact reciprocal, x^2/3 keeps its exact fraction instead of 0.333...
+                int    exponent = 0;
+                double mantissa = fabs(frexp(right->coefs[0], &exponent));
+                double half     = 0.5;
+                double scale    = 1 / right->coefs[0];
+                if (memcmp(&mantissa, &half, sizeof(half)) || !isnormal(scale)) return false;
+
+                Poly_t scalePoly = {&scale, 0, '\0'};
+                return polyMul(left, &scalePoly, result);
+            }
+        case POW_OP:
+            return polyPow(left, right, result, temp);
+        case SIN_OP:
+        case COS_OP:
+        case LN_OP:
+        case TAN_OP:
+        case EXP_OP:
+        case SQRT_OP:
+        case ASIN_OP:
+        case ACOS_OP:
+        case ATAN_OP:
+        case SINH_OP:
+        case COSH_OP:
+        case ABS_OP:
+        case OPT_DEFAULT:
+        default:
+            return false;
+    }
+}
+
+// result of subtree in post-order pass, coefficients lie in arena of walk
+struct PolyValue_t {
+    size_t            offset = 0;
+    int               degree = -1;
+    char              var    = '\0';
+    const DiffNode_t* leaf   = nullptr;     // polynomial of leaf is made only when its parent needs it
+    size_t            size   = 0;           // nodes in subtree
+    bool              worth  = false;       // operator, that is polynomial not bigger than its subtree
+};
+
+// Arena is a stack too: coefficients of children lie at its top, so parent puts its own ones in their place.
+// Nothing is allocated per node, small trees don't touch heap at all.
+struct PolyWalk_t {
+    PolyValue_t* values = nullptr;
+    size_t       count  = 0;
+    size_t       size   = 0;
+
+    double* arena      = nullptr;
+    size_t  arenaCount = 0;
+    size_t  arenaSize  = 0;
+
+    double result[MAX_POLY_DEGREE + 1] = {};
+    double temp  [MAX_POLY_DEGREE + 1] = {};
+
+    PolyMap_t* map    = nullptr;     // nullptr - only polynomial of the whole tree is needed
+    bool       failed = false;
+
+    PolyValue_t inlineValues[WALK_INLINE_SIZE]    = {};
+    double      inlineArena [POLY_ARENA_INLINE_SIZE] = {};
+};
+
+// poly is a view: its coefs are in arena (or in leafCoefs for leaves), it is valid till next push
+static void polyView(const PolyWalk_t* walk, const PolyValue_t* value, Poly_t* poly, double* leafCoefs) {
+    poly->degree = value->degree;
+    poly->var    = value->var;
+    poly->coefs  = walk->arena + value->offset;
+
+    if (!value->leaf) return;
+
+    poly->coefs = leafCoefs;
+    if (value->leaf->type == NUM) {
+        leafCoefs[0] = value->leaf->value.num;
+        poly->degree = 0;
+        poly->var    = '\0';
+    } else {
+        leafCoefs[0] = 0;
+        leafCoefs[1] = 1;
+        poly->degree = 1;
+        poly->var    = value->leaf->value.var;
+    }
+}
+
+static int polyMapAdd(PolyMap_t* map, const DiffNode_t* node, const Poly_t* poly);
+
+// polynomial of subtree is copied to map, if it is worth it (see PolyValue_t::worth)
+static void polyWalkKeep(PolyWalk_t* walk, const DiffNode_t* node, const PolyValue_t* value) {
+    if (!walk->map || !value->worth) return;
+
+    Poly_t poly = {};
+    polyView(walk, value, &poly, nullptr);
+
+    if (polyMapAdd(walk->map, node, &poly) != DIFF_OK) walk->failed = true;
+}
+
+// moves buffer to bigger heap one, inline buffer is not freed
+static void* polyWalkGrow(void* buffer, const void* inlineBuffer, size_t count, size_t newSize, size_t elemSize) {
+    void* newBuffer = malloc(newSize * elemSize);
+    if (!newBuffer) return nullptr;
+
+    memcpy(newBuffer, buffer, count * elemSize);
+    if (buffer != inlineBuffer) free(buffer);
+
+    return newBuffer;
+}
+
+static bool polyWalkReserve(PolyWalk_t* walk, size_t coefCount) {
+    if (walk->count == walk->size) {
+        PolyValue_t* values = (PolyValue_t*) polyWalkGrow(walk->values, walk->inlineValues, walk->count,
+                                                          walk->size * 2, sizeof(PolyValue_t));
+        if (!values) return false;
+
+        walk->values = values;
+        walk->size  *= 2;
+    }
+
+    if (walk->arenaCount + coefCount > walk->arenaSize) {
+        size_t newSize = max(walk->arenaSize * 2, walk->arenaCount + coefCount);
+        double* arena = (double*) polyWalkGrow(walk->arena, walk->inlineArena, walk->arenaCount, newSize, sizeof(double));
+        if (!arena) return false;
+
+        walk->arena     = arena;
+        walk->arenaSize = newSize;
+    }
+
+    return true;
+}
+
+static WalkResult_t polyWalkPush(PolyWalk_t* walk, const PolyValue_t* value) {
+    if (!polyWalkReserve(walk, 0)) {
+        walk->failed = true;
+        return WALK_STOP;
+    }
+
+    walk->values[walk->count++] = *value;
+    return WALK_NEXT;
+}
+
+static WalkResult_t polyVisit(DiffNode_t* node, WalkEvent_t event, void* context) {
+    if (event != WALK_LEAVE) return WALK_NEXT;
+
+    PolyWalk_t* walk = (PolyWalk_t*) context;
+    PolyValue_t value = {};
+    value.offset = walk->arenaCount;
+    value.size   = 1;
+
+    if (node->type == NUM || node->type == VAR) {
+        value.leaf   = node;
+        value.degree = 0;
+        return polyWalkPush(walk, &value);
+    }
+
+    PolyValue_t right = walk->values[--walk->count];
+    PolyValue_t left  = {};
+    if (node->left) left = walk->values[--walk->count];
+
+    double leftCoefs[2] = {}, rightCoefs[2] = {};
+    Poly_t leftPoly = {}, rightPoly = {};
+    polyView(walk, &left,  &leftPoly,  leftCoefs);
+    polyView(walk, &right, &rightPoly, rightCoefs);
+
+    Poly_t result = {walk->result, -1, '\0'};
+    bool isPoly = rightPoly.degree >= 0 && (!node->left || leftPoly.degree >= 0) &&
+                  polyOper(node, &leftPoly, &rightPoly, &result, walk->temp);
+
+    value.size += left.size + right.size;
+    if (isPoly) {
+        value.degree = result.degree;
+        value.var    = result.var;
+        value.worth  = polyTreeSize(&result) <= value.size;
+    }
+
+    // only the biggest polynomial subtrees are needed, children of such one are not
+    if (!value.worth) {
+        if (node->left) polyWalkKeep(walk, node->left, &left);
+        polyWalkKeep(walk, node->right, &right);
+    }
+
+    // children are not needed any more, their place in arena goes to parent
+    size_t coefCount = isPoly ? (size_t) result.degree + 1 : 0;
+    value.offset     = node->left ? left.offset : right.offset;
+    walk->arenaCount = value.offset;
+    if (!polyWalkReserve(walk, coefCount)) {
+        walk->failed = true;
+        return WALK_STOP;
+    }
+
+    memcpy(walk->arena + value.offset, result.coefs, coefCount * sizeof(double));
+    walk->arenaCount += coefCount;
+
+    return walk->failed ? WALK_STOP : polyWalkPush(walk, &value);
+}
+
+static int polyWalk(DiffNode_t* root, PolyMap_t* map, Poly_t* poly) {
+    PolyWalk_t walk = {};
+    walk.values    = walk.inlineValues;
+    walk.size      = WALK_INLINE_SIZE;
+    walk.arena     = walk.inlineArena;
+    walk.arenaSize = POLY_ARENA_INLINE_SIZE;
+    walk.map       = map;
+
+    int err = treeWalk(root, polyVisit, &walk);
+    if (walk.failed) err = DIFF_NO_MEM;
+
+    if (err == DIFF_OK && walk.count == 1) {
+        double leafCoefs[2] = {};
+        Poly_t view = {};
+        polyView(&walk, &walk.values[0], &view, leafCoefs);
+
+        if (poly && view.degree >= 0) {
+            err = polyCtor(poly, view.degree, view.var);
+            if (err == DIFF_OK) memcpy(poly->coefs, view.coefs, ((size_t) view.degree + 1) * sizeof(double));
+        } else if (!poly) {
+            polyWalkKeep(&walk, root, &walk.values[0]);
+        }
+    }
+
+    if (walk.values != walk.inlineValues) free(walk.values);
+    if (walk.arena  != walk.inlineArena)  free(walk.arena);
+
+    return walk.failed ? DIFF_NO_MEM : err;
+}
+
+// degree of poly is -1, if subtree is not a polynomial
+int polyFromTree(DiffNode_t* node, Poly_t* poly) {
+    DIFF_CHECK(!node || !poly, DIFF_NULL);
+
+    *poly = {};
+    return polyWalk(node, nullptr, poly);
+}
+
+int polyDiff(const Poly_t* poly, Poly_t* result) {
+    DIFF_CHECK(!poly || !result || poly->degree < 0, DIFF_NULL);
+
+    int err = polyCtor(result, poly->degree ? poly->degree - 1 : 0, poly->var);
+    if (err != DIFF_OK) return err;
+
+    for (int i = 1; i <= poly->degree; i++) result->coefs[i - 1] = i * poly->coefs[i];
+
+    polyTrim(result);
+    return DIFF_OK;
+}
+
+// Horner's method
+double polyEval(const Poly_t* poly, double x) {
+    if (!poly || poly->degree < 0) return NAN;
+
+    double value = poly->coefs[poly->degree];
+    for (int i = poly->degree - 1; i >= 0; i--) value = value * x + poly->coefs[i];
+
+    return value;
+}
+
+// nodes of polyToTree()
+size_t polyTreeSize(const Poly_t* poly) {
+    if (!poly || poly->degree < 0) return 0;
+
+    size_t size = 0;
+    for (int i = poly->degree; i >= 0; i--) {
+        double coef = poly->coefs[i];
+        if (compDouble(coef, 0)) continue;
+
+        // sign of all the terms but the first one goes to + or -
+        if (size) coef = fabs(coef);
+
+        bool   needCoef = !i || !compDouble(coef, 1);
+        size_t power    = i == 0 ? 0 : i == 1 ? 1 : 3;
+
+        if (size) size++;
+        size += (needCoef ? 1 : 0) + power + (needCoef && power ? 1 : 0);
+    }
+
+    return size ? size : 1;
+}
+
+// c_n * x^n + ... + c_1 * x + c_0, zero terms are skipped, negative ones are subtracted
+DiffNode_t* polyToTree(const Poly_t* poly) {
+    if (!poly || poly->degree < 0) return nullptr;
+
+    DiffNode_t* result = nullptr;
+    for (int i = poly->degree; i >= 0; i--) {
+        double coef = poly->coefs[i];
+        if (compDouble(coef, 0)) continue;
+
+        bool negative = result && coef < 0;
+        if (negative) coef = -coef;
+
+        DiffNode_t* term = nullptr;
+        if (i) {
+            DiffNode_t* var = diffNodeCtor(nullptr, nullptr, nullptr);
+            if (var) {
+                var->type      = VAR;
+                var->value.var = poly->var;
+            }
+
+            term = i == 1 ? var : POW(var, newNumNode(nullptr, nullptr, nullptr, i));
+            if (!compDouble(coef, 1)) term = MUL(newNumNode(nullptr, nullptr, nullptr, coef), term);
+        } else {
+            term = newNumNode(nullptr, nullptr, nullptr, coef);
+        }
+
+        if (!result)       result = term;
+        else if (negative) result = SUB(result, term);
+        else               result = ADD(result, term);
+    }
+
+    if (!result) result = newNumNode(nullptr, nullptr, nullptr, 0);
+    if (addPrevs(result) != DIFF_OK) {
+        diffNodeDtor(result);
+        return nullptr;
+    }
+
+    return result;
+}
+
+// MAP
+
+static size_t polySlot(const PolyMap_t* map, const DiffNode_t* node) {
+    size_t mask = map->size - 1;
+    size_t slot = hashMix((uintptr_t) node) & mask;
+
+    while (map->nodes[slot] && map->nodes[slot] != node) slot = (slot + 1) & mask;
+    return slot;
+}
+
+static int polyMapAdd(PolyMap_t* map, const DiffNode_t* node, const Poly_t* poly) {
+    // load factor stays under 1/2
+    if (2 * (map->count + 1) > map->size) {
+        PolyMap_t bigger = *map;
+        bigger.size    = map->size ? map->size * 2 : POLY_MAP_START_SIZE;
+        bigger.nodes   = (const DiffNode_t**) calloc(bigger.size, sizeof(DiffNode_t*));
+        bigger.polys   = (Poly_t*) calloc(bigger.size, sizeof(Poly_t));
+        bigger.offsets = (size_t*) calloc(bigger.size, sizeof(size_t));
+        if (!bigger.nodes || !bigger.polys || !bigger.offsets) {
+            free(bigger.nodes);
+            free(bigger.polys);
+            free(bigger.offsets);
+            return DIFF_NO_MEM;
+        }
+
+        for (size_t i = 0; i < map->size; i++) {
+            if (!map->nodes[i]) continue;
+
+            size_t slot = polySlot(&bigger, map->nodes[i]);
+            bigger.nodes  [slot] = map->nodes[i];
+            bigger.polys  [slot] = map->polys[i];
+            bigger.offsets[slot] = map->offsets[i];
+        }
+
+        free(map->nodes);
+        free(map->polys);
+        free(map->offsets);
+        *map = bigger;
+    }
+
+    size_t coefCount = (size_t) poly->degree + 1;
+    if (map->poolCount + coefCount > map->poolSize) {
+        size_t newSize = max(map->poolSize * 2, map->poolCount + coefCount);
+        double* pool = (double*) realloc(map->pool, newSize * sizeof(double));
+        DIFF_CHECK(!pool, DIFF_NO_MEM);
+
+        map->pool     = pool;
+        map->poolSize = newSize;
+    }
+    memcpy(map->pool + map->poolCount, poly->coefs, coefCount * sizeof(double));
+
+    size_t slot = polySlot(map, node);
+    map->nodes  [slot] = node;
+    map->polys  [slot] = {nullptr, poly->degree, poly->var};
+    map->offsets[slot] = map->poolCount;
+    map->poolCount += coefCount;
+    map->count++;
+
+    return DIFF_OK;
+}
+
+int polyMapCtor(PolyMap_t* map, DiffNode_t* root) {
+    DIFF_CHECK(!map, DIFF_NULL);
+
+    *map = {};
+    if (!root) return DIFF_OK;
+
+    int err = polyWalk(root, map, nullptr);
+    if (err != DIFF_OK) {
+        polyMapDtor(map);
+        return err;
+    }
+
+    for (size_t i = 0; i < map->size; i++) {
+        if (map->nodes[i]) map->polys[i].coefs = map->pool + map->offsets[i];
+    }
+
+    return DIFF_OK;
+}
+
+void polyMapDtor(PolyMap_t* map) {
+    if (!map) return;
+
+    free(map->nodes);
+    free(map->polys);
+    free(map->offsets);
+    free(map->pool);
+    *map = {};
+}
+
+const Poly_t* polyMapFind(const PolyMap_t* map, const DiffNode_t* node) {
+    if (!map || !map->count || !node) return nullptr;
+
+    size_t slot = polySlot(map, node);
+    return map->nodes[slot] ? &map->polys[slot] : nullptr;
+}
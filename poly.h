@@ -0,0 +1,55 @@
+#ifndef POLY_H
+#define POLY_H
+
+#include "diff.h"
+
+const int    MAX_POLY_DEGREE        = 64;
+
+const size_t POLY_MAP_START_SIZE    = 16;      // power of 2
+
+const size_t POLY_ARENA_INLINE_SIZE = 4 * (MAX_POLY_DEGREE + 1);
+
+// dense polynomial in one variable, coefs[i] is coefficient of var^i
+struct Poly_t {
+    double* coefs  = nullptr;
+    int     degree = -1;        // -1 - subtree is not a polynomial
+    char    var    = '\0';      // '\0' - constant
+};
+
+// Polynomial subtrees of one tree (operators only, leaves are cheap anyway): node address -> polynomial.
+// Subtree gets here only if polynomial is not bigger than subtree itself, so (x+1)^10 stays as it is.
+// Only the biggest such subtrees get here, their parts don't.
+// Coefficients of all the polynomials lie in one pool.
+struct PolyMap_t {
+    const DiffNode_t** nodes     = nullptr;
+    Poly_t*            polys     = nullptr;
+    size_t*            offsets   = nullptr;     // place of coefficients in pool, pool moves while map is built
+    size_t             size      = 0;
+    size_t             count     = 0;
+
+    double*            pool      = nullptr;
+    size_t             poolCount = 0;
+    size_t             poolSize  = 0;
+};
+
+int polyCtor(Poly_t* poly, int degree, char var);
+
+void polyDtor(Poly_t* poly);
+
+int polyFromTree(DiffNode_t* node, Poly_t* poly);
+
+int polyDiff(const Poly_t* poly, Poly_t* result);
+
+double polyEval(const Poly_t* poly, double x);
+
+size_t polyTreeSize(const Poly_t* poly);
+
+DiffNode_t* polyToTree(const Poly_t* poly);
+
+int polyMapCtor(PolyMap_t* map, DiffNode_t* root);
+
+void polyMapDtor(PolyMap_t* map);
+
+const Poly_t* polyMapFind(const PolyMap_t* map, const DiffNode_t* node);
+
+#endif
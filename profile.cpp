@@ -0,0 +1,132 @@
+#include <sys/resource.h>
+
+#include "emit.h"
+#include "profile.h"
+
+DiffProfile_t diffProfile = {};
+
+uint64_t clockNs(clockid_t clock) {
+    timespec time = {};
+    clock_gettime(clock, &time);
+
+    return (uint64_t) time.tv_sec * 1000000000ull + (uint64_t) time.tv_nsec;
+}
+
+void diffProfileStart(const char* job) {
+    diffProfile.enabled = true;
+    snprintf(diffProfile.job, sizeof(diffProfile.job), "%s", job ? job : "");
+
+    for (int i = 0; i < PROF_PHASE_COUNT; i++) diffProfile.phases[i] = {};
+    diffProfile.treeBefore = diffProfile.treeAfter = 0;
+
+    diffStatsReset();
+    diffStats.enabled = true;
+}
+
+void profStart(ProfTimer_t* timer, ProfPhase_t phase) {
+    if (!diffProfile.enabled || !timer) return;
+
+    timer->phase  = phase;
+    timer->wallNs = clockNs(CLOCK_MONOTONIC);
+    timer->cpuNs  = clockNs(CLOCK_PROCESS_CPUTIME_ID);
+}
+
+void profStop(const ProfTimer_t* timer) {
+    if (!diffProfile.enabled || !timer || !timer->wallNs) return;
+
+    ProfPhaseStat_t* stat = &diffProfile.phases[timer->phase];
+    stat->calls++;
+    stat->wallNs += clockNs(CLOCK_MONOTONIC)          - timer->wallNs;
+    stat->cpuNs  += clockNs(CLOCK_PROCESS_CPUTIME_ID) - timer->cpuNs;
+}
+
+void profTreeSizes(size_t before, size_t after) {
+    diffProfile.treeBefore += before;
+    diffProfile.treeAfter  += after;
+}
+
+// appends one JSON line with statistics of current job
+int diffProfileDump(const char* fileName) {
+    DIFF_CHECK(!fileName, DIFF_NULL);
+
+    FILE* file = fopen(fileName, "a");
+    DIFF_CHECK(!file, DIFF_FILE_NULL);
+
+    rusage usage = {};
+    getrusage(RUSAGE_SELF, &usage);
+
+    fprintf(file, "{\"job\": ");
+    printJsonString(file, diffProfile.job);
+
+    fprintf(file, ", \"phases\": {");
+    for (int i = 0; i < PROF_PHASE_COUNT; i++) {
+        const ProfPhaseStat_t* stat = &diffProfile.phases[i];
+        fprintf(file, "%s\"%s\": {\"calls\": %lu, \"wall_ns\": %lu, \"cpu_ns\": %lu}",
+                      i ? ", " : "", PROF_PHASE_NAMES[i], stat->calls, stat->wallNs, stat->cpuNs);
+    }
+
+    size_t peak = diffStats.peak;
+    fprintf(file, "}, \"nodes\": {\"allocated\": %zu, \"freed\": %zu, \"copied\": %zu, \"peak\": %zu, \"peak_bytes\": %zu}",
+                  diffStats.allocated.load(), diffStats.freed.load(), diffStats.copied.load(), peak, peak * sizeof(DiffNode_t));
+    fprintf(file, ", \"tree\": {\"before\": %zu, \"after\": %zu}, \"maxrss_kb\": %ld}\n",
+                  diffProfile.treeBefore, diffProfile.treeAfter, usage.ru_maxrss);
+
+    return fclose(file) == 0 ? DIFF_OK : DIFF_FILE_NULL;
+}
+
+static size_t readField(const char* line, const char* key) {
+    const char* found = strstr(line, key);
+    if (!found) return 0;
+
+    return (size_t) strtoull(found + strlen(key), nullptr, 10);
+}
+
+// sums up JSON lines, written by diffProfileDump (several jobs of batch run)
+int diffProfileReport(const char* fileName, FILE* output) {
+    DIFF_CHECK(!fileName || !output, DIFF_NULL);
+
+    FILE* file = fopen(fileName, "r");
+    DIFF_CHECK(!file, DIFF_FILE_NULL);
+
+    ProfPhaseStat_t total[PROF_PHASE_COUNT]   = {};
+    uint64_t        maxWall[PROF_PHASE_COUNT] = {};
+
+    size_t jobs = 0, peakMax = 0, before = 0, after = 0, rssMax = 0;
+
+    char line[MAX_WORD_LENGTH] = "";
+    while (fgets(line, sizeof(line), file)) {
+        if (!strstr(line, "\"phases\"")) continue;
+        jobs++;
+
+        for (int i = 0; i < PROF_PHASE_COUNT; i++) {
+            char key[256] = "";
+            snprintf(key, sizeof(key), "\"%s\": {", PROF_PHASE_NAMES[i]);
+
+            const char* phase = strstr(line, key);
+            if (!phase) continue;
+
+            uint64_t wall = readField(phase, "\"wall_ns\": ");
+            total[i].calls  += readField(phase, "\"calls\": ");
+            total[i].wallNs += wall;
+            total[i].cpuNs  += readField(phase, "\"cpu_ns\": ");
+            if (wall > maxWall[i]) maxWall[i] = wall;
+        }
+
+        peakMax = max(peakMax, readField(line, "\"peak\": "));
+        rssMax  = max(rssMax,  readField(line, "\"maxrss_kb\": "));
+        before += readField(line, "\"before\": ");
+        after  += readField(line, "\"after\": ");
+    }
+    fclose(file);
+
+    fprintf(output, "{\"jobs\": %zu, \"phases\": {", jobs);
+    for (int i = 0; i < PROF_PHASE_COUNT; i++) {
+        fprintf(output, "%s\"%s\": {\"calls\": %lu, \"wall_ns\": %lu, \"wall_ns_mean\": %lu, \"wall_ns_max\": %lu, \"cpu_ns\": %lu}",
+                        i ? ", " : "", PROF_PHASE_NAMES[i], total[i].calls, total[i].wallNs,
+                        jobs ? total[i].wallNs / jobs : 0, maxWall[i], total[i].cpuNs);
+    }
+    fprintf(output, "}, \"peak_nodes_max\": %zu, \"tree\": {\"before\": %zu, \"after\": %zu}, \"maxrss_kb_max\": %zu}\n",
+                    peakMax, before, after, rssMax);
+
+    return DIFF_OK;
+}
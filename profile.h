@@ -0,0 +1,66 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+
+#include "diff.h"
+
+const int MAX_PROFILE_JOB = 256;
+
+enum ProfPhase_t {
+    PROF_PARSE_ARGS = 0,
+    PROF_EQU_DIFF   = 1,
+    PROF_EASIER     = 2,
+    PROF_TAILOR     = 3,
+    PROF_DRAW_GRAPH = 4,
+    PROF_TEX        = 5,
+    PROF_ROOTS      = 6,
+    PROF_INTEGRAL   = 7,
+    PROF_CHEB       = 8,
+    PROF_PHASE_COUNT,
+};
+
+const char PROF_PHASE_NAMES[PROF_PHASE_COUNT][16] = {"parseArgs", "equDiff", "easierEqu", "tailor", "drawGraph", "diffToTex", "roots", "integral", "cheb"};
+
+struct ProfPhaseStat_t {
+    uint64_t calls  = 0;
+    uint64_t wallNs = 0;
+    uint64_t cpuNs  = 0;        // cpu time of whole process, so renderer threads are counted too
+};
+
+// Times are inclusive: equDiff contains easierEqu and diffToTex, parseArgs contains everything.
+// When profile is disabled, timers only check one flag.
+struct DiffProfile_t {
+    bool enabled = false;
+    char job[MAX_PROFILE_JOB] = "";
+
+    ProfPhaseStat_t phases[PROF_PHASE_COUNT] = {};
+
+    size_t treeBefore = 0;      // derivative size before simplification
+    size_t treeAfter  = 0;      // and after it
+};
+
+struct ProfTimer_t {
+    ProfPhase_t phase  = PROF_PARSE_ARGS;
+    uint64_t    wallNs = 0;
+    uint64_t    cpuNs  = 0;
+};
+
+extern DiffProfile_t diffProfile;
+
+// nanoseconds of clock, monotonic one is for deadlines and durations everywhere
+uint64_t clockNs(clockid_t clock = CLOCK_MONOTONIC);
+
+void diffProfileStart(const char* job);
+
+void profStart(ProfTimer_t* timer, ProfPhase_t phase);
+
+void profStop(const ProfTimer_t* timer);
+
+void profTreeSizes(size_t before, size_t after);
+
+int diffProfileDump(const char* fileName);
+
+int diffProfileReport(const char* fileName, FILE* output);
+
+#endif
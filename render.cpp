@@ -0,0 +1,189 @@
+#include <new>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "render.h"
+
+extern char** environ;
+
+RenderQueue_t* renderQueueCtor(RenderMode_t mode, int workerCount) {
+    RenderQueue_t* queue = new (std::nothrow) RenderQueue_t;
+    if (!queue) return nullptr;
+
+    queue->mode = mode;
+    if (mode == RENDER_OFF) return queue;
+
+    if (workerCount < 1)                  workerCount = 1;
+    if (workerCount > MAX_RENDER_WORKERS) workerCount = MAX_RENDER_WORKERS;
+
+    queue->workers = new (std::nothrow) std::thread[workerCount];
+    if (!queue->workers) {
+        delete queue;
+        return nullptr;
+    }
+
+    queue->workerCount = workerCount;
+    for (int i = 0; i < workerCount; i++) {
+        queue->workers[i] = std::thread(renderWorker, queue);
+    }
+
+    return queue;
+}
+
+void renderQueueDtor(RenderQueue_t* queue) {
+    if (!queue) return;
+
+    {
+        std::lock_guard<std::mutex> guard(queue->lock);
+        queue->stop = true;
+    }
+    queue->hasJob.notify_all();
+
+    for (int i = 0; i < queue->workerCount; i++) {
+        if (queue->workers[i].joinable()) queue->workers[i].join();
+    }
+    delete[] queue->workers;
+
+    // workers finish all queued jobs before stopping, so only jobs pushed to stopped queue may remain
+    while (queue->first) {
+        RenderJob_t* next = queue->first->next;
+        free(queue->first->command);
+        free(queue->first->artifact);
+        free(queue->first);
+        queue->first = next;
+    }
+
+    delete queue;
+}
+
+// gives unique name (without extension) for artifacts of a new job
+int renderArtifact(RenderQueue_t* queue, char* buffer, size_t size, const char* prefix) {
+    DIFF_CHECK(!queue || !buffer || !prefix, DIFF_NULL);
+
+    size_t id = 0;
+    {
+        std::lock_guard<std::mutex> guard(queue->lock);
+        id = queue->jobCount++;
+    }
+
+    int written = snprintf(buffer, size, "%s_%d_%lu", prefix, getpid(), id);
+    DIFF_CHECK(written < 0 || (size_t) written >= size, DIFF_NO_MEM);
+
+    return DIFF_OK;
+}
+
+// text as one word of /bin/sh: in single quotes, quote itself is '\''
+int renderQuote(char* buffer, size_t size, const char* text) {
+    DIFF_CHECK(!buffer || !text, DIFF_NULL);
+    DIFF_CHECK(size < 3, DIFF_NO_MEM);
+
+    size_t length = 0;
+    buffer[length++] = '\'';
+
+    for (; *text; text++) {
+        const char* symbs = *text == '\'' ? "'\\''" : text;
+        size_t      count = *text == '\'' ? 4 : 1;
+        DIFF_CHECK(length + count + 2 > size, DIFF_NO_MEM);
+
+        memcpy(buffer + length, symbs, count);
+        length += count;
+    }
+
+    buffer[length++] = '\'';
+    buffer[length]   = '\0';
+
+    return DIFF_OK;
+}
+
+int renderQueuePush(RenderQueue_t* queue, const char* command, const char* artifact) {
+    DIFF_CHECK(!queue || !command, DIFF_NULL);
+    if (queue->mode == RENDER_OFF) return DIFF_OK;
+
+    RenderJob_t* job = (RenderJob_t*) calloc(1, sizeof(RenderJob_t));
+    DIFF_CHECK(!job, DIFF_NO_MEM);
+
+    job->command  = strdup(command);
+    job->artifact = artifact ? strdup(artifact) : nullptr;
+    if (!job->command || (artifact && !job->artifact)) {
+        free(job->command);
+        free(job->artifact);
+        free(job);
+        return DIFF_NO_MEM;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(queue->lock);
+        if (queue->last) queue->last->next = job;
+        else             queue->first      = job;
+        queue->last = job;
+        queue->pending++;
+    }
+    queue->hasJob.notify_one();
+
+    return DIFF_OK;
+}
+
+void renderQueueWait(RenderQueue_t* queue) {
+    if (!queue) return;
+
+    std::unique_lock<std::mutex> guard(queue->lock);
+    queue->allDone.wait(guard, [queue] { return queue->pending == 0; });
+}
+
+void renderWorker(RenderQueue_t* queue) {
+    if (!queue) return;
+
+    while (true) {
+        RenderJob_t* job = nullptr;
+        {
+            std::unique_lock<std::mutex> guard(queue->lock);
+            queue->hasJob.wait(guard, [queue] { return queue->first || queue->stop; });
+            if (!queue->first) return;
+
+            job = queue->first;
+            queue->first = job->next;
+            if (!queue->first) queue->last = nullptr;
+        }
+
+        int res = runRenderJob(queue->mode, job);
+
+        free(job->command);
+        free(job->artifact);
+        free(job);
+
+        {
+            std::lock_guard<std::mutex> guard(queue->lock);
+            if (res != DIFF_OK) queue->failed++;
+            queue->pending--;
+        }
+        queue->allDone.notify_all();
+    }
+}
+
+int runRenderJob(RenderMode_t mode, const RenderJob_t* job) {
+    DIFF_CHECK(!job || !job->command, DIFF_NULL);
+
+    if (mode == RENDER_STUB) {
+        if (!job->artifact) return DIFF_OK;
+
+        FILE* artifact = fopen(job->artifact, "w");
+        DIFF_CHECK(!artifact, DIFF_FILE_NULL);
+        fclose(artifact);
+
+        return DIFF_OK;
+    }
+
+    // posix_spawn instead of system(): it doesn't touch signal dispositions, so several workers may run at once
+    char shell[] = "/bin/sh", flag[] = "-c";
+    char* args[] = {shell, flag, job->command, nullptr};
+
+    pid_t pid = 0;
+    DIFF_CHECK(posix_spawn(&pid, shell, nullptr, nullptr, args, environ), DIFF_RENDER);
+
+    int status = 0;
+    DIFF_CHECK(waitpid(pid, &status, 0) < 0, DIFF_RENDER);
+    DIFF_CHECK(!WIFEXITED(status) || WEXITSTATUS(status) != 0, DIFF_RENDER);
+
+    return DIFF_OK;
+}
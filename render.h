@@ -0,0 +1,67 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "diff.h"
+
+const int DEFAULT_RENDER_WORKERS = 2;
+
+const int MAX_RENDER_WORKERS = 64;
+
+const int MAX_ARTIFACT_LENGTH = 256;
+
+enum RenderMode_t {
+    RENDER_ON   = 0,       // launch external programs (gnuplot, pdflatex)
+    RENDER_OFF  = 1,       // skip rendering at all
+    RENDER_STUB = 2,       // only create empty artifacts, for testing without TeX
+};
+
+struct RenderJob_t {
+    char* command  = nullptr;
+    char* artifact = nullptr;
+
+    RenderJob_t* next = nullptr;
+};
+
+// External renderers are launched by bounded pool of workers, so main computation never waits for them.
+struct RenderQueue_t {
+    RenderMode_t mode = RENDER_ON;
+
+    std::mutex              lock = {};
+    std::condition_variable hasJob  = {};
+    std::condition_variable allDone = {};
+
+    RenderJob_t* first = nullptr;
+    RenderJob_t* last  = nullptr;
+
+    size_t pending  = 0;
+    size_t jobCount = 0;
+    size_t failed   = 0;
+    bool   stop     = false;
+
+    std::thread* workers     = nullptr;
+    int          workerCount = 0;
+};
+
+extern RenderQueue_t* renderQueue;
+
+RenderQueue_t* renderQueueCtor(RenderMode_t mode = RENDER_ON, int workerCount = DEFAULT_RENDER_WORKERS);
+
+void renderQueueDtor(RenderQueue_t* queue);
+
+int renderArtifact(RenderQueue_t* queue, char* buffer, size_t size, const char* prefix);
+
+int renderQuote(char* buffer, size_t size, const char* text);
+
+int renderQueuePush(RenderQueue_t* queue, const char* command, const char* artifact);
+
+void renderQueueWait(RenderQueue_t* queue);
+
+void renderWorker(RenderQueue_t* queue);
+
+int runRenderJob(RenderMode_t mode, const RenderJob_t* job);
+
+#endif
@@ -0,0 +1,283 @@
+#include "emit.h"
+#include "hash.h"
+#include "replace.h"
+#include "walk.h"
+
+// INFO MAP
+
+int replInfoMapCtor(ReplInfoMap_t* map, size_t size) {
+    DIFF_CHECK(!map, DIFF_NULL);
+
+    size_t cells = REPL_START_SIZE;
+    while (cells < size * 2) cells *= 2;
+
+    map->cells = (ReplInfo_t*) calloc(cells, sizeof(ReplInfo_t));
+    DIFF_CHECK(!map->cells, DIFF_NO_MEM);
+
+    map->size  = cells;
+    map->count = 0;
+
+    return DIFF_OK;
+}
+
+void replInfoMapDtor(ReplInfoMap_t* map) {
+    if (!map) return;
+
+    free(map->cells);
+    map->cells = nullptr;
+    map->size  = map->count = 0;
+}
+
+static size_t addressSlot(const ReplInfoMap_t* map, const DiffNode_t* node) {
+    return hashMix((size_t) node) & (map->size - 1);
+}
+
+ReplInfo_t* replInfoGet(ReplInfoMap_t* map, const DiffNode_t* node) {
+    if (!map || !map->cells || !node) return nullptr;
+
+    for (size_t slot = addressSlot(map, node); map->cells[slot].node; slot = (slot + 1) & (map->size - 1)) {
+        if (map->cells[slot].node == node) return &map->cells[slot];
+    }
+
+    return nullptr;
+}
+
+static int replInfoMapGrow(ReplInfoMap_t* map) {
+    ReplInfoMap_t bigger = {};
+    DIFF_CHECK(replInfoMapCtor(&bigger, map->size) != DIFF_OK, DIFF_NO_MEM);
+
+    for (size_t i = 0; i < map->size; i++) {
+        if (!map->cells[i].node) continue;
+
+        ReplInfo_t* cell = replInfoAdd(&bigger, map->cells[i].node);
+        *cell = map->cells[i];
+    }
+
+    replInfoMapDtor(map);
+    *map = bigger;
+
+    return DIFF_OK;
+}
+
+ReplInfo_t* replInfoAdd(ReplInfoMap_t* map, const DiffNode_t* node) {
+    if (!map || !map->cells || !node) return nullptr;
+
+    if ((map->count + 1) * 2 > map->size && replInfoMapGrow(map) != DIFF_OK) return nullptr;
+
+    size_t slot = addressSlot(map, node);
+    while (map->cells[slot].node && map->cells[slot].node != node) slot = (slot + 1) & (map->size - 1);
+
+    if (!map->cells[slot].node) {
+        map->cells[slot].node = node;
+        map->count++;
+    }
+
+    return &map->cells[slot];
+}
+
+struct ReplWalk_t {
+    ReplInfoMap_t* map   = nullptr;
+    size_t*        width = nullptr;
+};
+
+static WalkResult_t replInfoVisit(DiffNode_t* node, WalkEvent_t event, void* context) {
+    if (event != WALK_LEAVE) return WALK_NEXT;
+
+    const ReplWalk_t* walk = (const ReplWalk_t*) context;
+    if (walk->width) *walk->width += (node->left ? 0 : 1) + (node->right ? 0 : 1);
+
+    ReplInfo_t* info = replInfoAdd(walk->map, node);
+    if (!info) return WALK_NEXT;
+
+    // children are already in map, their hashes are taken from there
+    const ReplInfo_t* left  = replInfoGet(walk->map, node->left);
+    const ReplInfo_t* right = replInfoGet(walk->map, node->right);
+
+    info->hash  = nodeHash(node, left ? left->hash : HASH_SEED, right ? right->hash : HASH_SEED);
+    info->depth = max(left ? left->depth : 0, right ? right->depth : 0) + 1;
+    info->size  = (left ? left->size : 0) + (right ? right->size : 0) + 1;
+
+    if (IS_OP(node) && IS_DIV(node)) info->firstDiv = node;
+    else if (left)                    info->firstDiv = left->firstDiv;
+    else if (right)                   info->firstDiv = right->firstDiv;
+
+    return WALK_NEXT;
+}
+
+// one post-order pass: hash, depth and first division of every subtree, returns hash of node
+size_t collectReplInfo(DiffNode_t* node, ReplInfoMap_t* map, size_t* width) {
+    if (!node) {
+        if (width) (*width)++;
+        return HASH_SEED;
+    }
+
+    ReplWalk_t walk = {};
+    walk.map   = map;
+    walk.width = width;
+    treeWalk(node, replInfoVisit, &walk);
+
+    const ReplInfo_t* info = replInfoGet(map, node);
+    return info ? info->hash : HASH_SEED;
+}
+
+// how many times each subtree occurs in tree
+void countReplHashes(ReplInfoMap_t* map) {
+    if (!map || !map->cells) return;
+
+    size_t  size   = map->size;
+    size_t* hashes = (size_t*) calloc(size, sizeof(size_t));
+    size_t* counts = (size_t*) calloc(size, sizeof(size_t));
+    if (!hashes || !counts) {
+        free(hashes);
+        free(counts);
+        return;
+    }
+
+    for (int pass = 0; pass < 2; pass++) {
+        for (size_t i = 0; i < map->size; i++) {
+            if (!map->cells[i].node) continue;
+
+            size_t hash = map->cells[i].hash;
+            size_t slot = hashMix(hash) & (size - 1);
+            while (counts[slot] && hashes[slot] != hash) slot = (slot + 1) & (size - 1);
+
+            if (pass == 0) {
+                hashes[slot] = hash;
+                counts[slot]++;
+            } else {
+                map->cells[i].count = counts[slot];
+            }
+        }
+    }
+
+    free(hashes);
+    free(counts);
+}
+
+// LETTERS TABLE
+
+void replTableDtor(ReplTable_t* table) {
+    if (!table) return;
+
+    for (size_t i = 0; i < table->entryCount; i++) {
+        diffNodeDtor(table->entries[i].tree);
+    }
+
+    free(table->entries);
+    free(table->buckets);
+    free(table->marked);
+
+    *table = {};
+}
+
+unsigned replTableFind(ReplTable_t* table, DiffNode_t* node, size_t hash) {
+    if (!table || !node || !table->bucketCount) return 0;
+
+    size_t mask = table->bucketCount - 1;
+    for (size_t slot = hashMix(hash) & mask; table->buckets[slot]; slot = (slot + 1) & mask) {
+        ReplEntry_t* entry = &table->entries[table->buckets[slot] - 1];
+        if (entry->hash == hash && compareSubtrees(entry->tree, node)) return entry->symb;
+    }
+
+    return 0;
+}
+
+static int replTableRehash(ReplTable_t* table, size_t bucketCount) {
+    size_t* buckets = (size_t*) calloc(bucketCount, sizeof(size_t));
+    DIFF_CHECK(!buckets, DIFF_NO_MEM);
+
+    for (size_t i = 0; i < table->entryCount; i++) {
+        size_t slot = hashMix(table->entries[i].hash) & (bucketCount - 1);
+        while (buckets[slot]) slot = (slot + 1) & (bucketCount - 1);
+        buckets[slot] = i + 1;
+    }
+
+    free(table->buckets);
+    table->buckets     = buckets;
+    table->bucketCount = bucketCount;
+
+    return DIFF_OK;
+}
+
+// gives new letter to subtree, returns 0 if failed
+unsigned replTableAdd(ReplTable_t* table, DiffNode_t* node, size_t hash) {
+    if (!table || !node) return 0;
+
+    if (table->entryCount >= table->entrySize) {
+        size_t newSize = table->entrySize ? table->entrySize * 2 : REPL_START_SIZE;
+        ReplEntry_t* entries = (ReplEntry_t*) realloc(table->entries, newSize * sizeof(ReplEntry_t));
+        if (!entries) return 0;
+
+        table->entries   = entries;
+        table->entrySize = newSize;
+    }
+
+    DiffNode_t* copy = nodeCopy(node);
+    if (!copy) return 0;
+    if (removeLetters(copy) != DIFF_OK) {
+        diffNodeDtor(copy);
+        return 0;
+    }
+
+    ReplEntry_t* entry = &table->entries[table->entryCount];
+    entry->hash = hash;
+    entry->tree = copy;
+    entry->symb = (unsigned) table->entryCount + 1;
+    table->entryCount++;
+
+    if (table->entryCount * 2 > table->bucketCount) {
+        size_t newCount = table->bucketCount ? table->bucketCount * 2 : REPL_START_SIZE;
+        if (replTableRehash(table, newCount) != DIFF_OK) {
+            diffNodeDtor(copy);
+            table->entryCount--;
+            return 0;
+        }
+    } else {
+        size_t slot = hashMix(hash) & (table->bucketCount - 1);
+        while (table->buckets[slot]) slot = (slot + 1) & (table->bucketCount - 1);
+        table->buckets[slot] = table->entryCount;
+    }
+
+    return entry->symb;
+}
+
+int replTableMark(ReplTable_t* table, DiffNode_t* node, unsigned symb) {
+    DIFF_CHECK(!table || !node, DIFF_NULL);
+
+    if (table->markedCount >= table->markedSize) {
+        size_t newSize = table->markedSize ? table->markedSize * 2 : REPL_START_SIZE;
+        DiffNode_t** marked = (DiffNode_t**) realloc(table->marked, newSize * sizeof(DiffNode_t*));
+        DIFF_CHECK(!marked, DIFF_NO_MEM);
+
+        table->marked     = marked;
+        table->markedSize = newSize;
+    }
+
+    node->texSymb = symb;
+    table->marked[table->markedCount++] = node;
+
+    return DIFF_OK;
+}
+
+void replTableUnmark(ReplTable_t* table) {
+    if (!table) return;
+
+    for (size_t i = 0; i < table->markedCount; i++) {
+        table->marked[i]->texSymb = 0;
+    }
+    table->markedCount = 0;
+}
+
+// first letters are A..Z, then A_{1}, A_{2}, ...
+void printTexSymb(unsigned symb, DiffEmitter_t* out) {
+    if (!symb || !out) return;
+
+    if (symb <= LETTERS_COUNT) {
+        emitChar(out, (char) ('A' + (int) symb - 1));
+        return;
+    }
+
+    emitText(out, "A_{");
+    emitUnsigned(out, symb - LETTERS_COUNT);
+    emitChar(out, '}');
+}
@@ -0,0 +1,75 @@
+#ifndef REPLACE_H
+#define REPLACE_H
+
+#include "diff.h"
+
+const size_t REPL_START_SIZE = 64;
+
+const unsigned LETTERS_COUNT = 26;
+
+// what we know about subtree after one post-order pass
+struct ReplInfo_t {
+    const DiffNode_t* node     = nullptr;
+    const DiffNode_t* firstDiv = nullptr;
+
+    size_t hash  = 0;
+    size_t depth = 0;
+    size_t size  = 0;       // nodes in subtree
+    size_t count = 0;       // how many subtrees with the same hash are there in tree
+};
+
+// open addressing map: node address -> info
+struct ReplInfoMap_t {
+    ReplInfo_t* cells = nullptr;
+    size_t      size  = 0;
+    size_t      count = 0;
+};
+
+// letter, that was given to subtree
+struct ReplEntry_t {
+    size_t      hash = 0;
+    DiffNode_t* tree = nullptr;      // own copy, so letter may be reused after original subtree is gone
+    unsigned    symb = 0;
+};
+
+// All the letters of one derivation: subtree, that was once replaced, gets the same letter in all further steps.
+struct ReplTable_t {
+    ReplEntry_t* entries    = nullptr;
+    size_t       entryCount = 0;
+    size_t       entrySize  = 0;
+
+    size_t* buckets     = nullptr;  // entry index + 1, 0 is empty
+    size_t  bucketCount = 0;
+
+    DiffNode_t** marked      = nullptr;  // nodes, which texSymb was set during current print
+    size_t       markedCount = 0;
+    size_t       markedSize  = 0;
+
+    size_t firstNew = 0;            // entries from this index on were created during current print
+};
+
+int replInfoMapCtor(ReplInfoMap_t* map, size_t size);
+
+void replInfoMapDtor(ReplInfoMap_t* map);
+
+ReplInfo_t* replInfoGet(ReplInfoMap_t* map, const DiffNode_t* node);
+
+ReplInfo_t* replInfoAdd(ReplInfoMap_t* map, const DiffNode_t* node);
+
+size_t collectReplInfo(DiffNode_t* node, ReplInfoMap_t* map, size_t* width);
+
+void countReplHashes(ReplInfoMap_t* map);
+
+void replTableDtor(ReplTable_t* table);
+
+unsigned replTableFind(ReplTable_t* table, DiffNode_t* node, size_t hash);
+
+unsigned replTableAdd(ReplTable_t* table, DiffNode_t* node, size_t hash);
+
+int replTableMark(ReplTable_t* table, DiffNode_t* node, unsigned symb);
+
+void replTableUnmark(ReplTable_t* table);
+
+void printTexSymb(unsigned symb, DiffEmitter_t* out);
+
+#endif
@@ -0,0 +1,274 @@
+#include "budget.h"
+#include "emit.h"
+#include "oper.h"
+#include "profile.h"
+#include "report.h"
+#include "walk.h"
+
+// the shortest digits, that read back to the same double (as infix has them), JSON has no inf and nan
+static void emitJsonNumber(DiffEmitter_t* out, double value) {
+    if (!isfinite(value)) {
+        emitText(out, "null");
+        return;
+    }
+
+    emitExact(out, value);
+}
+
+static void emitJsonKey(DiffEmitter_t* out, const char* key) {
+    emitText(out, ", \"");
+    emitText(out, key);
+    emitText(out, "\": ");
+}
+
+// NODES
+
+struct NodesWalk_t {
+    DiffEmitter_t* out     = nullptr;
+    WalkValues_t   indices = {};
+    uint32_t       count   = 0;
+};
+
+static WalkResult_t nodesVisit(DiffNode_t* node, WalkEvent_t event, void* context) {
+    if (event != WALK_LEAVE) return WALK_NEXT;
+
+    NodesWalk_t*   walk = (NodesWalk_t*) context;
+    DiffEmitter_t* out  = walk->out;
+
+    if (walk->count) emitText(out, ", ");
+
+    switch (node->type) {
+        case NUM:
+            emitText(out, "{\"num\": ");
+            emitJsonNumber(out, node->value.num);
+            emitChar(out, '}');
+            break;
+        case VAR:
+            emitText(out, "{\"var\": \"");
+            emitChar(out, node->value.var);
+            emitText(out, "\"}");
+            break;
+        case OP:
+            {
+                uint32_t right = node->right ? walkValuesPop(&walk->indices).index : 0;
+                uint32_t left  = node->left  ? walkValuesPop(&walk->indices).index : 0;
+
+                const DiffOper_t* oper = operFind(node->value.opt);
+                emitText(out, "{\"op\": \"");
+                emitText(out, oper ? oper->name : "?");
+                emitText(out, "\", \"args\": [");
+                if (node->left) {
+                    emitUnsigned(out, left);
+                    emitText(out, ", ");
+                }
+                emitUnsigned(out, right);
+                emitText(out, "]}");
+            }
+            break;
+        case NODET_DEFAULT:
+        default:
+            emitText(out, "{}");
+            break;
+    }
+
+    WalkValue_t value = {};
+    value.index = walk->count++;
+
+    return walkValuesPush(&walk->indices, value) == DIFF_OK ? WALK_NEXT : WALK_STOP;
+}
+
+static void emitNodes(DiffEmitter_t* out, DiffNode_t* node) {
+    NodesWalk_t walk = {};
+    walk.out = out;
+    walkValuesCtor(&walk.indices);
+
+    emitChar(out, '[');
+    treeWalk(node, nodesVisit, &walk);
+    emitChar(out, ']');
+
+    walkValuesDtor(&walk.indices);
+}
+
+// ARGUMENTS
+
+// phases of job, in microseconds
+struct ReportTimes_t {
+    uint64_t start      = 0;
+    uint64_t parse      = 0;
+    uint64_t derivative = 0;
+    uint64_t tailor     = 0;
+    uint64_t tangent    = 0;
+};
+
+static void emitTailor(DiffEmitter_t* out, DiffNode_t* root, DiffInput_t* input) {
+    mGetline(input->args, input->line);
+
+    int    pow   = 0;
+    double point = 0;
+    if (sscanf(input->line, "%d %lf", &pow, &point) != 2 || pow <= 0 || budgetExceeded()) return;
+
+    double* coefs = (double*) calloc((size_t) pow + 1, sizeof(double));
+    if (!coefs) return;
+
+    ProfTimer_t timer = {};
+    profStart(&timer, PROF_TAILOR);
+    int err = tailorCoefsCached(root, pow, point, coefs);
+    profStop(&timer);
+
+    // coefs[i] is i-th derivative in point, as in TeX
+    if (err == DIFF_OK) {
+        emitJsonKey(out, "tailor");
+        emitText(out, "{\"x0\": ");
+        emitJsonNumber(out, point);
+        emitText(out, ", \"coefs\": [");
+        for (int i = 0; i <= pow; i++) {
+            if (i) emitText(out, ", ");
+            emitJsonNumber(out, coefs[i]);
+        }
+        emitText(out, "]}");
+    }
+
+    free(coefs);
+}
+
+// graph is not drawn, range is only given back
+static void emitRange(DiffEmitter_t* out, DiffInput_t* input) {
+    mGetline(input->args, input->line);
+
+    double left = 0, right = 0;
+    if (sscanf(input->line, "%lf %lf", &left, &right) != 2) return;
+
+    emitJsonKey(out, "range");
+    emitChar(out, '[');
+    emitJsonNumber(out, left);
+    emitText(out, ", ");
+    emitJsonNumber(out, right);
+    emitChar(out, ']');
+}
+
+// tangent takes simplified derivative, it is already made
+static void emitTangent(DiffEmitter_t* out, DiffNode_t* root, DiffNode_t* derivative, DiffInput_t* input) {
+    mGetline(input->args, input->line);
+
+    double point = 0;
+    if (!derivative || sscanf(input->line, "%lf", &point) != 1) return;
+
+    double k = funcValue(derivative, point);
+    double b = funcValue(root, point) - k * point;
+
+    emitJsonKey(out, "tangent");
+    emitText(out, "{\"x0\": ");
+    emitJsonNumber(out, point);
+    emitText(out, ", \"k\": ");
+    emitJsonNumber(out, k);
+    emitText(out, ", \"b\": ");
+    emitJsonNumber(out, b);
+    emitChar(out, '}');
+}
+
+static void emitTimes(DiffEmitter_t* out, const ReportTimes_t* times) {
+    const char*    names[] = {"parse", "derivative", "tailor", "tangent"};
+    const uint64_t ends[]  = {times->parse, times->derivative, times->tailor, times->tangent};
+
+    emitJsonKey(out, "us");
+    emitChar(out, '{');
+
+    uint64_t from = times->start;
+    for (size_t i = 0; i < sizeof(ends) / sizeof(ends[0]); i++) {
+        emitChar(out, '"');
+        emitText(out, names[i]);
+        emitText(out, "\": ");
+        emitUnsigned(out, (ends[i] - from) / 1000);
+        emitText(out, ", ");
+        from = ends[i];
+    }
+
+    emitText(out, "\"total\": ");
+    emitUnsigned(out, (times->tangent - times->start) / 1000);
+    emitChar(out, '}');
+}
+
+DiffNode_t* reportArgs(FILE* readFile, FILE* output, DiffOutput_t format) {
+    if (!readFile || !output) return nullptr;
+
+    ReportTimes_t times = {};
+    times.start = clockNs();
+
+    DiffInput_t input = {};
+    if (diffInputOpen(&input, readFile) != DIFF_OK) return nullptr;
+
+    DiffNode_t* root = input.root;
+    times.parse = clockNs();
+
+    DiffEmitter_t out;
+    emitterCtor(&out, EMIT_FILE, output);
+
+    // message with position of syntax error is already in stderr
+    if (!root) {
+        if (format == OUTPUT_JSON) emitText(&out, "{\"status\": \"syntax\"}\n");
+
+        emitterDtor(&out);
+        diffInputClose(&input);
+        return nullptr;
+    }
+
+    ProfTimer_t timer = {};
+    profStart(&timer, PROF_EQU_DIFF);
+    DiffNode_t* derivative = nullptr;
+    int err = equDerivative(root, &derivative);
+    profStop(&timer);
+    times.derivative = clockNs();
+
+    if (format == OUTPUT_INFIX) {
+        if (derivative) {
+            nodeToInfix(derivative, &out);
+            emitChar(&out, '\n');
+        }
+    } else {
+        emitText(&out, "{\"equation\": \"");
+        nodeToInfix(root, &out);
+        emitChar(&out, '"');
+
+        if (derivative) {
+            emitJsonKey(&out, "derivative");
+            emitChar(&out, '"');
+            nodeToInfix(derivative, &out);
+            emitChar(&out, '"');
+
+            emitJsonKey(&out, "nodes");
+            emitNodes(&out, derivative);
+        }
+
+        emitTailor(&out, root, &input);
+        times.tailor = clockNs();
+
+        emitRange(&out, &input);
+        emitTangent(&out, root, derivative, &input);
+        times.tangent = clockNs();
+
+        emitJsonKey(&out, "status");
+        if      (budgetExceeded()) emitText(&out, "\"budget\"");
+        else if (err != DIFF_OK)   emitText(&out, "\"error\"");
+        else                       emitText(&out, "\"ok\"");
+
+        if (budgetExceeded()) {
+            emitJsonKey(&out, "limit");
+            emitChar(&out, '"');
+            emitText(&out, BUDGET_LIMIT_NAMES[budgetLimit(diffBudget)]);
+            emitChar(&out, '"');
+        }
+
+        emitTimes(&out, &times);
+        emitText(&out, "}\n");
+    }
+
+    emitterDtor(&out);
+    fflush(output);
+
+    saveDerivative(root, derivative);
+
+    diffNodeDtor(derivative);
+    diffInputClose(&input);
+
+    return root;
+}
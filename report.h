@@ -0,0 +1,12 @@
+#ifndef REPORT_H
+#define REPORT_H
+
+#include "diff.h"
+
+// Result of job for programs: the same infix printer and emitter as everywhere, but no TeX preamble, phrases,
+// letters of replacements, graph and pdflatex. JSON is one line:
+// {"equation": ..., "derivative": ..., "nodes": [...], "tailor": {...}, "range": [...], "tangent": {...}, "status": ..., "us": {...}}
+// nodes are in post-order, "args" are indices of earlier nodes, the last node is root.
+DiffNode_t* reportArgs(FILE* readFile, FILE* output, DiffOutput_t format);
+
+#endif
@@ -0,0 +1,306 @@
+#include <math.h>
+#include <new>
+#include <thread>
+
+#include "eval.h"
+#include "libdiff.h"
+#include "roots.h"
+
+// one part of grid, it is scanned by its own thread
+struct RootChunk_t {
+    const RootFunc_t* func  = nullptr;
+    double            left  = 0;
+    double            step  = 0;
+    size_t            begin = 0;        // grid intervals [begin, end), node i is left + i * step
+    size_t            end   = 0;
+    bool              last  = false;    // chunk also checks the last node of grid
+    RootList_t        list  = {};
+    int               err   = DIFF_OK;
+};
+
+int rootFuncCtor(RootFunc_t* func, DiffNode_t* root) {
+    DIFF_CHECK(!func || !root, DIFF_NULL);
+
+    *func = {};
+    int err = programCompile(&func->programs[0], root);
+    if (err != DIFF_OK) return err;
+    func->symbolic[0] = true;
+
+    // f' and f'' are symbolic while they can be built and compiled, dual numbers (or central difference) are used otherwise
+    DiffNode_t* current = root;
+    for (int order = 1; order < 3; order++) {
+        DiffNode_t* next = nullptr;
+        if (diffDerivative(current, 1, &next) != DIFF_OK) break;
+
+        func->symbolic[order] = programCompile(&func->programs[order], next) == DIFF_OK;
+        if (current != root) diffFree(current);
+        current = next;
+
+        if (!func->symbolic[order]) break;
+    }
+    if (current != root) diffFree(current);
+
+    return DIFF_OK;
+}
+
+void rootFuncDtor(RootFunc_t* func) {
+    if (!func) return;
+
+    for (int order = 0; order < 3; order++) programDtor(&func->programs[order]);
+    *func = {};
+}
+
+int rootListCtor(RootList_t* list, size_t capacity) {
+    DIFF_CHECK(!list, DIFF_NULL);
+
+    *list = {};
+    list->points = (RootPoint_t*) calloc(max(capacity, 1), sizeof(RootPoint_t));
+    DIFF_CHECK(!list->points, DIFF_NO_MEM);
+
+    list->capacity = capacity;
+    return DIFF_OK;
+}
+
+void rootListDtor(RootList_t* list) {
+    if (!list) return;
+
+    free(list->points);
+    *list = {};
+}
+
+static void rootListAdd(RootList_t* list, double x, double y, RootKind_t kind) {
+    if (list->count == list->capacity) {
+        list->full = true;
+        return;
+    }
+
+    list->points[list->count++] = {x, y, kind};
+}
+
+// dual numbers need twice more place, and their own columns of x and result
+static size_t rootFuncStack(const RootFunc_t* func) {
+    size_t maxStack = 1;
+    for (int order = 0; order < 3; order++) maxStack = max(maxStack, func->programs[order].maxStack);
+
+    return 2 * (maxStack + 2);
+}
+
+// xs gives every variable, stack has place for rootFuncStack() columns of count rows
+static void rootFuncBlock(const RootFunc_t* func, int order, const double* xs, size_t count, double* stack, double* result);
+
+static double rootFuncValue(const RootFunc_t* func, int order, double x, double* stack) {
+    double result = 0;
+    rootFuncBlock(func, order, &x, 1, stack, &result);
+
+    return result;
+}
+
+static void rootFuncBlock(const RootFunc_t* func, int order, const double* xs, size_t count, double* stack, double* result) {
+    if (func->symbolic[order]) {
+        const double* vars[VAR_COUNT] = {};
+        for (int var = 0; var < VAR_COUNT; var++) vars[var] = xs;
+
+        programEvalBlock(&func->programs[order], vars, count, stack, result);
+        return;
+    }
+
+    // derivative of the last symbolic order by dual numbers, it is as exact as symbolic one
+    if (func->symbolic[order - 1]) {
+        Dual_t<double>* dualXs     = (Dual_t<double>*) stack;
+        Dual_t<double>* dualResult = dualXs + count;
+        Dual_t<double>* dualStack  = dualResult + count;
+        for (size_t i = 0; i < count; i++) dualXs[i] = {xs[i], 1};
+
+        const Dual_t<double>* vars[VAR_COUNT] = {};
+        for (int var = 0; var < VAR_COUNT; var++) vars[var] = dualXs;
+
+        programEval(&func->programs[order - 1], vars, count, dualStack, dualResult);
+        for (size_t i = 0; i < count; i++) result[i] = dualResult[i].deriv;
+        return;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        double h = ROOT_DIFF_STEP * fmax(1, fabs(xs[i]));
+        result[i] = (rootFuncValue(func, order - 1, xs[i] + h, stack) -
+                     rootFuncValue(func, order - 1, xs[i] - h, stack)) / (2 * h);
+    }
+}
+
+// g = f^(order) changes its sign on [a, b]: Newton steps by g' while they stay in bracket, bisection otherwise
+static bool refineRoot(const RootFunc_t* func, int order, double a, double b, double* root, double* stack) {
+    double ga   = rootFuncValue(func, order, a, stack);
+    double step = b - a;
+
+    double x = (a + b) / 2;
+    for (int i = 0; i < ROOT_MAX_ITERATIONS; i++) {
+        double g = rootFuncValue(func, order, x, stack);
+        if (fpclassify(g) == FP_ZERO) break;
+
+        if ((g < 0) == (ga < 0)) {
+            a  = x;
+            ga = g;
+        } else {
+            b  = x;
+        }
+        if (b - a <= ROOT_TOLERANCE * fmax(1, fabs(x))) break;
+
+        double next = x - g / rootFuncValue(func, order + 1, x, stack);
+        if (!(next > a && next < b)) next = (a + b) / 2;
+
+        bool converged = fabs(next - x) <= ROOT_TOLERANCE * fmax(1, fabs(x));
+        x = next;
+        if (converged) break;
+    }
+
+    // sign of 1/x changes too, but near the pole it is bigger than one grid step away, not smaller
+    *root = x;
+    double value = fabs(rootFuncValue(func, order, x, stack));
+    return isfinite(value) && value <= fabs(rootFuncValue(func, order, x - step, stack)) &&
+                              value <= fabs(rootFuncValue(func, order, x + step, stack));
+}
+
+// f' = 0 in x0 with unknown sign change, f'' tells what it is
+static RootKind_t extremumKind(const RootFunc_t* func, double x0, double* stack) {
+    double second = rootFuncValue(func, 2, x0, stack);
+
+    if (second > 0) return ROOT_MIN;
+    if (second < 0) return ROOT_MAX;
+    return ROOT_STATIONARY;
+}
+
+// Extremum, where f touches axis, is zero of even multiplicity, like (x-1)^2: f doesn't change its sign there,
+// so only f' finds it. zeroAdded - the same x is already in the list as zero.
+static void addExtremum(RootList_t* list, double x, double y, RootKind_t kind, bool zeroAdded) {
+    if ((kind == ROOT_MIN || kind == ROOT_MAX) && fabs(y) <= ROOT_VALUE_TOLERANCE) {
+        if (!zeroAdded) rootListAdd(list, x, y, ROOT_ZERO);
+        return;
+    }
+
+    rootListAdd(list, x, y, kind);
+}
+
+static void checkInterval(RootChunk_t* chunk, double x0, double x1, const double* values0, const double* values1, double* stack) {
+    const RootFunc_t* func = chunk->func;
+    double x = 0;
+
+    // zeros of f
+    if (fpclassify(values0[0]) == FP_ZERO) {
+        rootListAdd(&chunk->list, x0, 0, ROOT_ZERO);
+    } else if (values0[0] * values1[0] < 0 && refineRoot(func, 0, x0, x1, &x, stack)) {
+        rootListAdd(&chunk->list, x, rootFuncValue(func, 0, x, stack), ROOT_ZERO);
+    }
+
+    // zeros of f'
+    if (fpclassify(values0[1]) == FP_ZERO) {
+        bool zeroAdded = fpclassify(values0[0]) == FP_ZERO;
+        addExtremum(&chunk->list, x0, rootFuncValue(func, 0, x0, stack), extremumKind(func, x0, stack), zeroAdded);
+    } else if (values0[1] * values1[1] < 0 && refineRoot(func, 1, x0, x1, &x, stack)) {
+        double y = rootFuncValue(func, 0, x, stack);
+        if (isfinite(y)) addExtremum(&chunk->list, x, y, values0[1] < 0 ? ROOT_MIN : ROOT_MAX, false);
+    }
+}
+
+static void rootWorker(RootChunk_t* chunk) {
+    size_t  maxStack = rootFuncStack(chunk->func);
+    double* xs     = (double*) calloc(ROOT_BLOCK + 1, sizeof(double));
+    double* values = (double*) calloc(2 * (ROOT_BLOCK + 1), sizeof(double));
+    double* stack  = (double*) calloc(maxStack * (ROOT_BLOCK + 1), sizeof(double));
+
+    if (!xs || !values || !stack) {
+        chunk->err = DIFF_NO_MEM;
+    } else {
+        // block holds nodes [start, start + count], so the next block starts with the last node of this one
+        for (size_t start = chunk->begin; start < chunk->end; start += ROOT_BLOCK) {
+            size_t count = chunk->end - start < ROOT_BLOCK ? chunk->end - start : ROOT_BLOCK;
+            for (size_t i = 0; i <= count; i++) xs[i] = chunk->left + (double) (start + i) * chunk->step;
+
+            rootFuncBlock(chunk->func, 0, xs, count + 1, stack, values);
+            rootFuncBlock(chunk->func, 1, xs, count + 1, stack, values + ROOT_BLOCK + 1);
+
+            for (size_t i = 0; i < count; i++) {
+                double current[] = {values[i],     values[ROOT_BLOCK + 1 + i]};
+                double next[]    = {values[i + 1], values[ROOT_BLOCK + 2 + i]};
+                checkInterval(chunk, xs[i], xs[i + 1], current, next, stack);
+            }
+        }
+
+        if (chunk->last) {
+            double x = chunk->left + (double) chunk->end * chunk->step;
+            double y         = rootFuncValue(chunk->func, 0, x, stack);
+            bool   zeroAdded = fpclassify(y) == FP_ZERO;
+            if (zeroAdded) rootListAdd(&chunk->list, x, 0, ROOT_ZERO);
+            if (fpclassify(rootFuncValue(chunk->func, 1, x, stack)) == FP_ZERO) {
+                addExtremum(&chunk->list, x, y, extremumKind(chunk->func, x, stack), zeroAdded);
+            }
+        }
+    }
+
+    free(xs);
+    free(values);
+    free(stack);
+}
+
+static int rootPointCmp(const void* first, const void* second) {
+    double x1 = ((const RootPoint_t*) first)->x;
+    double x2 = ((const RootPoint_t*) second)->x;
+
+    return (x1 > x2) - (x1 < x2);
+}
+
+// roots of f and f' on [left, right] sorted by x, every thread scans its own part of grid
+int findRoots(DiffNode_t* root, double left, double right, RootList_t* list, int workers) {
+    DIFF_CHECK(!root || !list || !list->points, DIFF_NULL);
+    DIFF_CHECK(!(left < right), DIFF_VALUE_NULL);
+
+    list->count = 0;
+    list->full  = false;
+
+    RootFunc_t func = {};
+    int err = rootFuncCtor(&func, root);
+    if (err != DIFF_OK) return err;
+
+    if (workers < 1)                workers = 1;
+    if (workers > MAX_ROOT_WORKERS) workers = MAX_ROOT_WORKERS;
+
+    size_t chunkCount = (size_t) workers;
+    RootChunk_t* chunks  = new (std::nothrow) RootChunk_t[chunkCount];
+    std::thread* threads = new (std::nothrow) std::thread[chunkCount];
+    if (!chunks || !threads) err = DIFF_NO_MEM;
+
+    double step = (right - left) / (double) ROOT_SAMPLES;
+    for (size_t i = 0; i < chunkCount && err == DIFF_OK; i++) {
+        RootChunk_t* chunk = &chunks[i];
+        chunk->func  = &func;
+        chunk->left  = left;
+        chunk->step  = step;
+        chunk->begin = ROOT_SAMPLES * i       / chunkCount;
+        chunk->end   = ROOT_SAMPLES * (i + 1) / chunkCount;
+        chunk->last  = i + 1 == chunkCount;
+
+        err = rootListCtor(&chunk->list, list->capacity);
+    }
+
+    if (err == DIFF_OK) {
+        for (size_t i = 0; i < chunkCount; i++) threads[i] = std::thread(rootWorker, &chunks[i]);
+        for (size_t i = 0; i < chunkCount; i++) threads[i].join();
+    }
+
+    for (size_t i = 0; chunks && i < chunkCount; i++) {
+        if (err == DIFF_OK) err = chunks[i].err;
+
+        for (size_t j = 0; j < chunks[i].list.count; j++) {
+            const RootPoint_t* point = &chunks[i].list.points[j];
+            rootListAdd(list, point->x, point->y, point->kind);
+        }
+        list->full |= chunks[i].list.full;
+
+        rootListDtor(&chunks[i].list);
+    }
+    qsort(list->points, list->count, sizeof(RootPoint_t), rootPointCmp);
+
+    delete[] threads;
+    delete[] chunks;
+    rootFuncDtor(&func);
+
+    return err;
+}
@@ -0,0 +1,62 @@
+#ifndef ROOTS_H
+#define ROOTS_H
+
+#include "column.h"
+
+const int    DEFAULT_ROOT_WORKERS = 4;
+
+const int    MAX_ROOT_WORKERS     = 64;
+
+const size_t ROOT_SAMPLES         = 1 << 16;    // grid on [left, right], sign changes are searched between its nodes
+
+const size_t ROOT_BLOCK           = 1024;       // grid nodes evaluated at once
+
+const int    ROOT_MAX_ITERATIONS  = 100;
+
+const double ROOT_TOLERANCE       = 1e-14;      // relative width of bracket, where refinement stops
+
+const double ROOT_DIFF_STEP       = 6e-6;       // relative step of central difference, ~cbrt(DBL_EPSILON)
+
+const double ROOT_VALUE_TOLERANCE = 1e-12;      // |f| of minimum or maximum, below which it is a zero of f
+
+const size_t MAX_ROOTS            = 256;
+
+enum RootKind_t {
+    ROOT_ZERO       = 0,        // f(x) = 0, also minimum or maximum with f(x) ~ 0 (even multiplicity)
+    ROOT_MIN        = 1,        // f'(x) = 0, f' goes from - to +
+    ROOT_MAX        = 2,        // f'(x) = 0, f' goes from + to -
+    ROOT_STATIONARY = 3,        // f'(x) = 0, f' keeps its sign
+};
+
+const char ROOT_KIND_NAMES[][16] = {"zero", "minimum", "maximum", "stationary"};
+
+struct RootPoint_t {
+    double     x    = 0;
+    double     y    = 0;        // f(x)
+    RootKind_t kind = ROOT_ZERO;
+};
+
+struct RootList_t {
+    RootPoint_t* points   = nullptr;
+    size_t       count    = 0;
+    size_t       capacity = 0;
+    bool         full     = false;      // more than MAX_ROOTS points were found, the rest is dropped
+};
+
+// f, f' and f'' compiled once, every worker evaluates them with its own stack
+struct RootFunc_t {
+    DiffProgram_t programs[3] = {};
+    bool          symbolic[3] = {};     // false - derivative is evaluated by dual numbers (or central difference)
+};
+
+int rootFuncCtor(RootFunc_t* func, DiffNode_t* root);
+
+void rootFuncDtor(RootFunc_t* func);
+
+int rootListCtor(RootList_t* list, size_t capacity = MAX_ROOTS);
+
+void rootListDtor(RootList_t* list);
+
+int findRoots(DiffNode_t* root, double left, double right, RootList_t* list, int workers = DEFAULT_ROOT_WORKERS);
+
+#endif
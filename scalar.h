@@ -0,0 +1,391 @@
+#ifndef SCALAR_H
+#define SCALAR_H
+
+#include <math.h>
+
+#include "diff.h"
+
+// Scalar types of evaluator. Tree walk and compiled program are templates over them (see eval.h), every type has
+// the same set of functions here (scalarSin(), ..., ScalarTraits_t), so instantiation is plain code without virtual calls.
+// Constants of tree stay double, they are converted once per instruction.
+
+enum ScalarType_t {
+    SCALAR_DOUBLE      = 0,
+    SCALAR_FLOAT       = 1,
+    SCALAR_LONG_DOUBLE = 2,
+};
+
+const char SCALAR_TYPE_NAMES[][16] = {"double", "float", "long"};
+
+const float       FLOAT_EPSILON       = 1e-5f;
+
+const long double LONG_DOUBLE_EPSILON = 1e-15L;
+
+// value and derivative by x (forward mode of automatic differentiation)
+template <typename T>
+struct Dual_t {
+    T value = 0;
+    T deriv = 0;
+};
+
+// all the values of f on range of x, bounds are rounded outward by one ulp after every operation
+template <typename T>
+struct Bounds_t {
+    T low  = 0;
+    T high = 0;
+};
+
+// REAL TYPES
+
+inline float       scalarSin(float value)       { return sinf(value); }
+inline double      scalarSin(double value)      { return sin(value);  }
+inline long double scalarSin(long double value) { return sinl(value); }
+
+inline float       scalarCos(float value)       { return cosf(value); }
+inline double      scalarCos(double value)      { return cos(value);  }
+inline long double scalarCos(long double value) { return cosl(value); }
+
+inline float       scalarLn(float value)       { return logf(value); }
+inline double      scalarLn(double value)      { return log(value);  }
+inline long double scalarLn(long double value) { return logl(value); }
+
+inline float       scalarPow(float base, float power)             { return powf(base, power); }
+inline double      scalarPow(double base, double power)           { return pow(base, power);  }
+inline long double scalarPow(long double base, long double power) { return powl(base, power); }
+
+inline float       scalarTan(float value)       { return tanf(value); }
+inline double      scalarTan(double value)      { return tan(value);  }
+inline long double scalarTan(long double value) { return tanl(value); }
+
+inline float       scalarExp(float value)       { return expf(value); }
+inline double      scalarExp(double value)      { return exp(value);  }
+inline long double scalarExp(long double value) { return expl(value); }
+
+inline float       scalarSqrt(float value)       { return sqrtf(value); }
+inline double      scalarSqrt(double value)      { return sqrt(value);  }
+inline long double scalarSqrt(long double value) { return sqrtl(value); }
+
+inline float       scalarAsin(float value)       { return asinf(value); }
+inline double      scalarAsin(double value)      { return asin(value);  }
+inline long double scalarAsin(long double value) { return asinl(value); }
+
+inline float       scalarAcos(float value)       { return acosf(value); }
+inline double      scalarAcos(double value)      { return acos(value);  }
+inline long double scalarAcos(long double value) { return acosl(value); }
+
+inline float       scalarAtan(float value)       { return atanf(value); }
+inline double      scalarAtan(double value)      { return atan(value);  }
+inline long double scalarAtan(long double value) { return atanl(value); }
+
+inline float       scalarSinh(float value)       { return sinhf(value); }
+inline double      scalarSinh(double value)      { return sinh(value);  }
+inline long double scalarSinh(long double value) { return sinhl(value); }
+
+inline float       scalarCosh(float value)       { return coshf(value); }
+inline double      scalarCosh(double value)      { return cosh(value);  }
+inline long double scalarCosh(long double value) { return coshl(value); }
+
+inline float       scalarAbs(float value)       { return fabsf(value); }
+inline double      scalarAbs(double value)      { return fabs(value);  }
+inline long double scalarAbs(long double value) { return fabsl(value); }
+
+template <typename T>
+struct ScalarTraits_t {
+    static T constant(double num) { return static_cast<T>(num); }
+};
+
+template <typename T>
+bool scalarEqual(T value1, T value2);
+
+template <>
+inline bool scalarEqual(double value1, double value2) { return fabs(value1 - value2) < EPSILON; }
+
+template <>
+inline bool scalarEqual(float value1, float value2) { return fabsf(value1 - value2) < FLOAT_EPSILON; }
+
+template <>
+inline bool scalarEqual(long double value1, long double value2) { return fabsl(value1 - value2) < LONG_DOUBLE_EPSILON; }
+
+// DUAL NUMBERS
+
+template <typename T>
+struct ScalarTraits_t<Dual_t<T>> {
+    static Dual_t<T> constant(double num) { return {ScalarTraits_t<T>::constant(num), 0}; }
+};
+
+template <typename T>
+Dual_t<T> operator+(Dual_t<T> left, Dual_t<T> right) {
+    return {left.value + right.value, left.deriv + right.deriv};
+}
+
+template <typename T>
+Dual_t<T> operator-(Dual_t<T> left, Dual_t<T> right) {
+    return {left.value - right.value, left.deriv - right.deriv};
+}
+
+template <typename T>
+Dual_t<T> operator*(Dual_t<T> left, Dual_t<T> right) {
+    return {left.value * right.value, left.deriv * right.value + left.value * right.deriv};
+}
+
+template <typename T>
+Dual_t<T> operator/(Dual_t<T> left, Dual_t<T> right) {
+    return {left.value / right.value, (left.deriv * right.value - left.value * right.deriv) / (right.value * right.value)};
+}
+
+template <typename T>
+Dual_t<T> scalarSin(Dual_t<T> value) {
+    return {scalarSin(value.value), scalarCos(value.value) * value.deriv};
+}
+
+template <typename T>
+Dual_t<T> scalarCos(Dual_t<T> value) {
+    return {scalarCos(value.value), -scalarSin(value.value) * value.deriv};
+}
+
+template <typename T>
+Dual_t<T> scalarLn(Dual_t<T> value) {
+    return {scalarLn(value.value), value.deriv / value.value};
+}
+
+// constant power is taken as n * x^(n-1), so negative base (x^2 at x = -1) doesn't need ln
+template <typename T>
+Dual_t<T> scalarPow(Dual_t<T> base, Dual_t<T> power) {
+    T value = scalarPow(base.value, power.value);
+
+    if (fpclassify(power.deriv) == FP_ZERO) {
+        T deriv = fpclassify(base.deriv) == FP_ZERO ? 0 : power.value * scalarPow(base.value, power.value - 1) * base.deriv;
+        return {value, deriv};
+    }
+
+    return {value, value * (power.deriv * scalarLn(base.value) + power.value * base.deriv / base.value)};
+}
+
+template <typename T>
+Dual_t<T> scalarTan(Dual_t<T> value) {
+    T cosValue = scalarCos(value.value);
+    return {scalarTan(value.value), value.deriv / (cosValue * cosValue)};
+}
+
+template <typename T>
+Dual_t<T> scalarExp(Dual_t<T> value) {
+    T expValue = scalarExp(value.value);
+    return {expValue, expValue * value.deriv};
+}
+
+template <typename T>
+Dual_t<T> scalarSqrt(Dual_t<T> value) {
+    T sqrtValue = scalarSqrt(value.value);
+    return {sqrtValue, value.deriv / (2 * sqrtValue)};
+}
+
+template <typename T>
+Dual_t<T> scalarAsin(Dual_t<T> value) {
+    return {scalarAsin(value.value), value.deriv / scalarSqrt(1 - value.value * value.value)};
+}
+
+template <typename T>
+Dual_t<T> scalarAcos(Dual_t<T> value) {
+    return {scalarAcos(value.value), -value.deriv / scalarSqrt(1 - value.value * value.value)};
+}
+
+template <typename T>
+Dual_t<T> scalarAtan(Dual_t<T> value) {
+    return {scalarAtan(value.value), value.deriv / (1 + value.value * value.value)};
+}
+
+template <typename T>
+Dual_t<T> scalarSinh(Dual_t<T> value) {
+    return {scalarSinh(value.value), scalarCosh(value.value) * value.deriv};
+}
+
+template <typename T>
+Dual_t<T> scalarCosh(Dual_t<T> value) {
+    return {scalarCosh(value.value), scalarSinh(value.value) * value.deriv};
+}
+
+// the same as symbolic x / |x| * x', so it is not defined in 0
+template <typename T>
+Dual_t<T> scalarAbs(Dual_t<T> value) {
+    T absValue = scalarAbs(value.value);
+    return {absValue, value.value / absValue * value.deriv};
+}
+
+// BOUNDS
+
+template <typename T>
+struct ScalarTraits_t<Bounds_t<T>> {
+    static Bounds_t<T> constant(double num) { return {ScalarTraits_t<T>::constant(num), ScalarTraits_t<T>::constant(num)}; }
+};
+
+template <typename T>
+Bounds_t<T> boundsWiden(T low, T high) {
+    return {nextafter(low, -static_cast<T>(INFINITY)), nextafter(high, static_cast<T>(INFINITY))};
+}
+
+template <typename T>
+Bounds_t<T> boundsOf(T value1, T value2, T value3, T value4) {
+    return boundsWiden(fmin(fmin(value1, value2), fmin(value3, value4)), fmax(fmax(value1, value2), fmax(value3, value4)));
+}
+
+template <typename T>
+Bounds_t<T> boundsNan(void) {
+    return {static_cast<T>(NAN), static_cast<T>(NAN)};
+}
+
+template <typename T>
+Bounds_t<T> operator+(Bounds_t<T> left, Bounds_t<T> right) {
+    return boundsWiden(left.low + right.low, left.high + right.high);
+}
+
+template <typename T>
+Bounds_t<T> operator-(Bounds_t<T> left, Bounds_t<T> right) {
+    return boundsWiden(left.low - right.high, left.high - right.low);
+}
+
+template <typename T>
+Bounds_t<T> operator*(Bounds_t<T> left, Bounds_t<T> right) {
+    return boundsOf(left.low * right.low, left.low * right.high, left.high * right.low, left.high * right.high);
+}
+
+// divisor, that contains 0, gives the whole line
+template <typename T>
+Bounds_t<T> operator/(Bounds_t<T> left, Bounds_t<T> right) {
+    if (right.low <= 0 && right.high >= 0) {
+        if (right.low >= 0 && right.high <= 0) return boundsNan<T>();
+        return {-static_cast<T>(INFINITY), static_cast<T>(INFINITY)};
+    }
+
+    return boundsOf(left.low / right.low, left.low / right.high, left.high / right.low, left.high / right.high);
+}
+
+// sin on [low, low + period] reaches its max at maxPoint + 2 pi k and min at maxPoint + pi + 2 pi k
+template <typename T>
+Bounds_t<T> boundsPeriodic(Bounds_t<T> value, T low, T high, T maxPoint) {
+    const T period = static_cast<T>(2 * M_PI);
+    if (!(value.high - value.low < period)) return {-1, 1};
+
+    T firstMax = maxPoint + period * ceil((value.low - maxPoint) / period);
+    T firstMin = maxPoint + static_cast<T>(M_PI) + period * ceil((value.low - maxPoint - static_cast<T>(M_PI)) / period);
+
+    if (firstMax <= value.high) high = 1;
+    if (firstMin <= value.high) low  = -1;
+
+    Bounds_t<T> result = boundsWiden(low, high);
+    return {fmax(result.low, static_cast<T>(-1)), fmin(result.high, static_cast<T>(1))};
+}
+
+template <typename T>
+Bounds_t<T> scalarSin(Bounds_t<T> value) {
+    T first = scalarSin(value.low), second = scalarSin(value.high);
+    return boundsPeriodic(value, fmin(first, second), fmax(first, second), static_cast<T>(M_PI / 2));
+}
+
+template <typename T>
+Bounds_t<T> scalarCos(Bounds_t<T> value) {
+    T first = scalarCos(value.low), second = scalarCos(value.high);
+    return boundsPeriodic(value, fmin(first, second), fmax(first, second), static_cast<T>(0));
+}
+
+template <typename T>
+Bounds_t<T> scalarLn(Bounds_t<T> value) {
+    if (!(value.high > 0)) return boundsNan<T>();
+    if (value.low <= 0)    return {-static_cast<T>(INFINITY), nextafter(scalarLn(value.high), static_cast<T>(INFINITY))};
+
+    return boundsWiden(scalarLn(value.low), scalarLn(value.high));
+}
+
+template <typename T>
+Bounds_t<T> boundsIncreasing(Bounds_t<T> value, T (*func)(T)) {
+    return boundsWiden(func(value.low), func(value.high));
+}
+
+// tan is increasing between poles pi/2 + pi k, range with pole inside gives the whole line
+template <typename T>
+Bounds_t<T> scalarTan(Bounds_t<T> value) {
+    const T halfPi = static_cast<T>(M_PI / 2);
+    T firstPole = halfPi + static_cast<T>(M_PI) * ceil((value.low - halfPi) / static_cast<T>(M_PI));
+
+    if (!(firstPole > value.high)) return {-static_cast<T>(INFINITY), static_cast<T>(INFINITY)};
+    return boundsIncreasing<T>(value, scalarTan);
+}
+
+template <typename T>
+Bounds_t<T> scalarExp(Bounds_t<T> value) {
+    Bounds_t<T> result = boundsIncreasing<T>(value, scalarExp);
+    return {fmax(result.low, static_cast<T>(0)), result.high};
+}
+
+// functions with bounded domain are taken on its part, that is inside range
+template <typename T>
+Bounds_t<T> scalarSqrt(Bounds_t<T> value) {
+    if (!(value.high >= 0)) return boundsNan<T>();
+
+    Bounds_t<T> result = boundsIncreasing<T>({fmax(value.low, static_cast<T>(0)), value.high}, scalarSqrt);
+    return {fmax(result.low, static_cast<T>(0)), result.high};
+}
+
+template <typename T>
+Bounds_t<T> scalarAsin(Bounds_t<T> value) {
+    if (!(value.high >= -1 && value.low <= 1)) return boundsNan<T>();
+    return boundsIncreasing<T>({fmax(value.low, static_cast<T>(-1)), fmin(value.high, static_cast<T>(1))}, scalarAsin);
+}
+
+template <typename T>
+Bounds_t<T> scalarAcos(Bounds_t<T> value) {
+    if (!(value.high >= -1 && value.low <= 1)) return boundsNan<T>();
+    return boundsWiden(scalarAcos(fmin(value.high, static_cast<T>(1))), scalarAcos(fmax(value.low, static_cast<T>(-1))));
+}
+
+template <typename T>
+Bounds_t<T> scalarAtan(Bounds_t<T> value) {
+    return boundsIncreasing<T>(value, scalarAtan);
+}
+
+template <typename T>
+Bounds_t<T> scalarSinh(Bounds_t<T> value) {
+    return boundsIncreasing<T>(value, scalarSinh);
+}
+
+// cosh and |x| have their min in 0
+template <typename T>
+Bounds_t<T> scalarCosh(Bounds_t<T> value) {
+    T first = scalarCosh(value.low), second = scalarCosh(value.high);
+    if (value.low <= 0 && value.high >= 0) return {1, nextafter(fmax(first, second), static_cast<T>(INFINITY))};
+
+    return boundsWiden(fmin(first, second), fmax(first, second));
+}
+
+template <typename T>
+Bounds_t<T> scalarAbs(Bounds_t<T> value) {
+    if (value.low >= 0) return value;
+    if (value.high <= 0) return {-value.high, -value.low};
+
+    return {0, fmax(-value.low, value.high)};
+}
+
+// x^y is monotonic by x and by y for x > 0, so bounds are in corners, integer power also takes negative base
+template <typename T>
+Bounds_t<T> scalarPow(Bounds_t<T> base, Bounds_t<T> power) {
+    if (base.low > 0 || (base.low >= 0 && power.low > 0)) {
+        return boundsOf(scalarPow(base.low, power.low),  scalarPow(base.low, power.high),
+                        scalarPow(base.high, power.low), scalarPow(base.high, power.high));
+    }
+
+    bool integer = fpclassify(power.high - power.low) == FP_ZERO && fpclassify(power.low - round(power.low)) == FP_ZERO;
+    if (!integer) return boundsNan<T>();
+
+    T n = power.low;
+    if (fpclassify(n) == FP_ZERO) return ScalarTraits_t<Bounds_t<T>>::constant(1);
+    if (n < 0) return ScalarTraits_t<Bounds_t<T>>::constant(1) / scalarPow(base, Bounds_t<T> {-n, -n});
+
+    T first = scalarPow(base.low, n), second = scalarPow(base.high, n);
+    bool even = fpclassify(fmod(n, static_cast<T>(2))) == FP_ZERO;
+
+    // even power of range with 0 inside has its min in 0
+    if (even && base.high >= 0) return boundsWiden(static_cast<T>(0), fmax(first, second));
+
+    return boundsWiden(fmin(first, second), fmax(first, second));
+}
+
+#endif
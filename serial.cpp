@@ -0,0 +1,461 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "hash.h"
+#include "oper.h"
+#include "serial.h"
+#include "walk.h"
+
+const size_t IMAGE_START_SIZE = 64;
+
+// everything the writer collects before image goes to file
+struct ImageBuilder_t {
+    DiffImageNode_t* nodes     = nullptr;
+    uint32_t         nodeCount = 0;
+    uint32_t         nodeSize  = 0;
+
+    double*  consts     = nullptr;
+    uint32_t constCount = 0;
+    uint32_t constSize  = 0;
+
+    char     vars[256]        = {};
+    uint32_t varIndex[256]    = {};
+    uint32_t varCount         = 0;
+
+    // node address -> index of written node, so shared subtrees are written once
+    const DiffNode_t** written      = nullptr;
+    uint32_t*          writtenIndex = nullptr;
+    size_t             writtenSize  = 0;
+};
+
+size_t imageSize(uint32_t nodeCount, uint32_t rootCount, uint32_t constCount, uint32_t varCount) {
+    size_t size = sizeof(DiffImageHeader_t) + nodeCount * sizeof(DiffImageNode_t) + rootCount * sizeof(uint32_t);
+    size = (size + sizeof(double) - 1) / sizeof(double) * sizeof(double);
+
+    return size + constCount * sizeof(double) + varCount;
+}
+
+static bool growArray(void** array, uint32_t* size, size_t elemSize) {
+    uint32_t newSize = *size ? *size * 2 : (uint32_t) IMAGE_START_SIZE;
+
+    void* newArray = realloc(*array, newSize * elemSize);
+    if (!newArray) return false;
+
+    *array = newArray;
+    *size  = newSize;
+
+    return true;
+}
+
+static uint32_t* writtenSlot(ImageBuilder_t* builder, const DiffNode_t* node, bool* found) {
+    size_t mask = builder->writtenSize - 1;
+    size_t slot = hashMix((size_t) node) & mask;
+
+    while (builder->written[slot] && builder->written[slot] != node) slot = (slot + 1) & mask;
+
+    *found = builder->written[slot] == node;
+    builder->written[slot] = node;
+
+    return &builder->writtenIndex[slot];
+}
+
+static uint32_t imageConst(ImageBuilder_t* builder, double value) {
+    // constants pool is small, numbers repeat a lot (0, 1, 2, -1)
+    for (uint32_t i = 0; i < builder->constCount; i++) {
+        if (!memcmp(&builder->consts[i], &value, sizeof(double))) return i;
+    }
+
+    if (builder->constCount >= builder->constSize &&
+        !growArray((void**) &builder->consts, &builder->constSize, sizeof(double))) return IMAGE_NO_ARG;
+
+    builder->consts[builder->constCount] = value;
+    return builder->constCount++;
+}
+
+static uint32_t imageVar(ImageBuilder_t* builder, char var) {
+    unsigned char index = (unsigned char) var;
+
+    if (!builder->varIndex[index]) {
+        builder->vars[builder->varCount] = var;
+        builder->varIndex[index] = ++builder->varCount;
+    }
+
+    return builder->varIndex[index] - 1;
+}
+
+struct ImageWalk_t {
+    ImageBuilder_t* builder = nullptr;
+    WalkValues_t    indices = {};       // indices of written subtrees, that wait for their parent
+    bool            failed  = false;
+};
+
+static WalkResult_t imageVisit(DiffNode_t* node, WalkEvent_t event, void* context) {
+    ImageWalk_t*    walk    = (ImageWalk_t*) context;
+    ImageBuilder_t* builder = walk->builder;
+
+    WalkValue_t value = {};
+    bool found = false;
+
+    if (event == WALK_ENTER) {
+        // shared subtree is already written, only its index is needed
+        uint32_t* index = writtenSlot(builder, node, &found);
+        if (!found) return WALK_NEXT;
+
+        value.index = *index;
+        if (walkValuesPush(&walk->indices, value) != DIFF_OK) walk->failed = true;
+
+        return walk->failed ? WALK_STOP : WALK_SKIP;
+    }
+    if (event != WALK_LEAVE) return WALK_NEXT;
+
+    DiffImageNode_t written = {};
+    written.type  = (uint8_t) node->type;
+    written.right = node->right ? walkValuesPop(&walk->indices).index : IMAGE_NO_CHILD;
+    written.left  = node->left  ? walkValuesPop(&walk->indices).index : IMAGE_NO_CHILD;
+
+    switch (node->type) {
+        case OP:
+            written.opt = (uint8_t) node->value.opt;
+            written.arg = IMAGE_NO_ARG;
+            break;
+        case NUM:
+            written.arg = imageConst(builder, node->value.num);
+            break;
+        case VAR:
+            written.arg = imageVar(builder, node->value.var);
+            break;
+        case NODET_DEFAULT:
+        default:
+            written.arg = IMAGE_NO_ARG;
+            break;
+    }
+
+    if (builder->nodeCount >= builder->nodeSize &&
+        !growArray((void**) &builder->nodes, &builder->nodeSize, sizeof(DiffImageNode_t))) {
+        walk->failed = true;
+        return WALK_STOP;
+    }
+
+    // table of written nodes never grows, so slot was reserved on WALK_ENTER
+    *writtenSlot(builder, node, &found) = builder->nodeCount;
+    builder->nodes[builder->nodeCount] = written;
+
+    value.index = builder->nodeCount++;
+    if (walkValuesPush(&walk->indices, value) != DIFF_OK) {
+        walk->failed = true;
+        return WALK_STOP;
+    }
+
+    return WALK_NEXT;
+}
+
+// writes subtree in post-order, returns its index
+static uint32_t imageNode(ImageBuilder_t* builder, DiffNode_t* node) {
+    if (!node) return IMAGE_NO_CHILD;
+
+    ImageWalk_t walk = {};
+    walk.builder = builder;
+    walkValuesCtor(&walk.indices);
+
+    if (treeWalk(node, imageVisit, &walk) != DIFF_OK) walk.failed = true;
+
+    uint32_t index = IMAGE_NO_CHILD;
+    if (!walk.failed && walk.indices.count == 1) index = walk.indices.values[0].index;
+
+    walkValuesDtor(&walk.indices);
+    return index;
+}
+
+int diffImageWrite(FILE* file, DiffNode_t* const* roots, uint32_t rootCount) {
+    DIFF_CHECK(!file || !roots, DIFF_NULL);
+
+    int sizeErr = DIFF_OK;
+    size_t maxNodes = 0;
+    for (uint32_t i = 0; i < rootCount; i++) maxNodes += getTreeSize(roots[i], &sizeErr);
+    DIFF_CHECK(sizeErr != DIFF_OK, sizeErr);
+
+    ImageBuilder_t builder = {};
+    builder.writtenSize = IMAGE_START_SIZE;
+    while (builder.writtenSize < maxNodes * 2) builder.writtenSize *= 2;
+
+    builder.written      = (const DiffNode_t**) calloc(builder.writtenSize, sizeof(DiffNode_t*));
+    builder.writtenIndex = (uint32_t*)          calloc(builder.writtenSize, sizeof(uint32_t));
+    uint32_t* rootIndex  = (uint32_t*)          calloc(rootCount + 1,       sizeof(uint32_t));
+
+    int err = DIFF_OK;
+    if (!builder.written || !builder.writtenIndex || !rootIndex) err = DIFF_NO_MEM;
+
+    for (uint32_t i = 0; i < rootCount && err == DIFF_OK; i++) {
+        rootIndex[i] = imageNode(&builder, roots[i]);
+        if (roots[i] && rootIndex[i] == IMAGE_NO_CHILD) err = DIFF_NO_MEM;
+    }
+
+    if (err == DIFF_OK) {
+        DiffImageHeader_t header = {};
+        memcpy(header.magic, IMAGE_MAGIC, sizeof(IMAGE_MAGIC));
+        header.version    = IMAGE_VERSION;
+        header.nodeCount  = builder.nodeCount;
+        header.rootCount  = rootCount;
+        header.constCount = builder.constCount;
+        header.varCount   = builder.varCount;
+
+        size_t written = sizeof(DiffImageHeader_t) + builder.nodeCount * sizeof(DiffImageNode_t) + rootCount * sizeof(uint32_t);
+        size_t padding = imageSize(builder.nodeCount, rootCount, 0, 0) - written;
+        const char zeros[sizeof(double)] = {};
+
+        bool ok = fwrite(&header,        sizeof(header),          1,                 file) == 1
+               && fwrite(builder.nodes,  sizeof(DiffImageNode_t), builder.nodeCount, file) == builder.nodeCount
+               && fwrite(rootIndex,      sizeof(uint32_t),        rootCount,         file) == rootCount
+               && fwrite(zeros,          1,                       padding,           file) == padding
+               && fwrite(builder.consts, sizeof(double),          builder.constCount, file) == builder.constCount
+               && fwrite(builder.vars,   1,                       builder.varCount,  file) == builder.varCount;
+
+        if (!ok) err = DIFF_FILE_NULL;
+    }
+
+    free(builder.nodes);
+    free(builder.consts);
+    free(builder.written);
+    free(builder.writtenIndex);
+    free(rootIndex);
+
+    return err;
+}
+
+int diffImageSave(const char* fileName, DiffNode_t* const* roots, uint32_t rootCount) {
+    DIFF_CHECK(!fileName || !roots, DIFF_NULL);
+
+    FILE* file = fopen(fileName, "wb");
+    DIFF_CHECK(!file, DIFF_FILE_NULL);
+
+    int err = diffImageWrite(file, roots, rootCount);
+    if (fclose(file) != 0 && err == DIFF_OK) err = DIFF_FILE_NULL;
+
+    return err;
+}
+
+static bool isValidNode(const DiffImage_t* image, uint32_t index) {
+    const DiffImageNode_t* node = &image->nodes[index];
+
+    // children go before parent, so evaluation is a single sweep and there are no cycles
+    if (node->left  != IMAGE_NO_CHILD && node->left  >= index) return false;
+    if (node->right != IMAGE_NO_CHILD && node->right >= index) return false;
+
+    switch (node->type) {
+        case OP:
+            if (node->opt >= OP_COUNT || node->right == IMAGE_NO_CHILD) return false;
+
+            // binary operator has both children, function has only right one
+            return DIFF_OPERS[node->opt].arity == 2 ? node->left != IMAGE_NO_CHILD : node->left == IMAGE_NO_CHILD;
+        case NUM:
+            return node->arg < image->header->constCount;
+        case VAR:
+            return node->arg < image->header->varCount;
+        default:
+            return false;
+    }
+}
+
+// checks image and makes view of it, buffer is not copied
+int diffImageFromBuffer(DiffImage_t* image, const void* buffer, size_t size) {
+    DIFF_CHECK(!image || !buffer, DIFF_NULL);
+    DIFF_CHECK(size < sizeof(DiffImageHeader_t), DIFF_FILE_NULL);
+    DIFF_CHECK((size_t) buffer % sizeof(double), DIFF_FILE_NULL);
+
+    const DiffImageHeader_t* header = (const DiffImageHeader_t*) buffer;
+    DIFF_CHECK(memcmp(header->magic, IMAGE_MAGIC, sizeof(IMAGE_MAGIC)) || header->version != IMAGE_VERSION, DIFF_FILE_NULL);
+    DIFF_CHECK(header->nodeCount >= IMAGE_NO_CHILD, DIFF_FILE_NULL);
+    DIFF_CHECK(imageSize(header->nodeCount, header->rootCount, header->constCount, header->varCount) > size, DIFF_FILE_NULL);
+
+    const char* data = (const char*) buffer;
+    size_t constOffset = imageSize(header->nodeCount, header->rootCount, 0, 0);
+
+    image->header = header;
+    image->nodes  = (const DiffImageNode_t*) (data + sizeof(DiffImageHeader_t));
+    image->roots  = (const uint32_t*)        (data + sizeof(DiffImageHeader_t) + header->nodeCount * sizeof(DiffImageNode_t));
+    image->consts = (const double*)          (data + constOffset);
+    image->vars   =                           data + constOffset + header->constCount * sizeof(double);
+
+    for (uint32_t i = 0; i < header->nodeCount; i++) {
+        DIFF_CHECK(!isValidNode(image, i), DIFF_FILE_NULL);
+    }
+    for (uint32_t i = 0; i < header->rootCount; i++) {
+        DIFF_CHECK(image->roots[i] != IMAGE_NO_CHILD && image->roots[i] >= header->nodeCount, DIFF_FILE_NULL);
+    }
+
+    return DIFF_OK;
+}
+
+int diffImageOpen(DiffImage_t* image, const char* fileName) {
+    DIFF_CHECK(!image || !fileName, DIFF_NULL);
+
+    int fd = open(fileName, O_RDONLY);
+    DIFF_CHECK(fd < 0, DIFF_FILE_NULL);
+
+    struct stat fileStat = {};
+    if (fstat(fd, &fileStat) < 0 || fileStat.st_size <= 0) {
+        close(fd);
+        return DIFF_FILE_NULL;
+    }
+
+    size_t size = (size_t) fileStat.st_size;
+    void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    DIFF_CHECK(mapped == MAP_FAILED, DIFF_FILE_NULL);
+
+    int err = diffImageFromBuffer(image, mapped, size);
+    if (err != DIFF_OK) {
+        munmap(mapped, size);
+        return err;
+    }
+
+    image->mapped     = mapped;
+    image->mappedSize = size;
+
+    return DIFF_OK;
+}
+
+void diffImageClose(DiffImage_t* image) {
+    if (!image) return;
+
+    if (image->mapped) munmap(image->mapped, image->mappedSize);
+    *image = {};
+}
+
+static DiffNode_t* imageLeaf(const DiffImage_t* image, uint32_t index) {
+    const DiffImageNode_t* imageNode = &image->nodes[index];
+
+    DiffNode_t* node = diffNodeCtor(nullptr, nullptr, nullptr);
+    if (!node) return nullptr;
+
+    node->type = (NodeType_t) imageNode->type;
+    switch (node->type) {
+        case OP:
+            node->value.opt = (OpType_t) imageNode->opt;
+            break;
+        case NUM:
+            node->value.num = image->consts[imageNode->arg];
+            break;
+        case VAR:
+            node->value.var = image->vars[imageNode->arg];
+            break;
+        case NODET_DEFAULT:
+        default:
+            break;
+    }
+
+    return node;
+}
+
+// takes built child, or copies it when it is already hung to another parent
+static DiffNode_t* imageChild(DiffNode_t** trees, bool* used, uint32_t index) {
+    if (index == IMAGE_NO_CHILD) return nullptr;
+    if (!used[index]) {
+        used[index] = true;
+        return trees[index];
+    }
+
+    return nodeCopy(trees[index]);
+}
+
+// children go before parents, so tree is built by one forward sweep without recursion
+static DiffNode_t* imageSubtree(const DiffImage_t* image, uint32_t index) {
+    if (index == IMAGE_NO_CHILD) return nullptr;
+
+    DiffNode_t** trees = (DiffNode_t**) calloc(index + 1, sizeof(DiffNode_t*));
+    bool*        need  = (bool*)        calloc(index + 1, sizeof(bool));
+    bool*        used  = (bool*)        calloc(index + 1, sizeof(bool));
+
+    DiffNode_t* root = nullptr;
+    if (trees && need && used) {
+        // only nodes, reachable from root, are built
+        need[index] = true;
+        for (uint32_t i = index + 1; i-- > 0;) {
+            if (!need[i]) continue;
+
+            if (image->nodes[i].left  != IMAGE_NO_CHILD) need[image->nodes[i].left]  = true;
+            if (image->nodes[i].right != IMAGE_NO_CHILD) need[image->nodes[i].right] = true;
+        }
+
+        bool ok = true;
+        for (uint32_t i = 0; i <= index; i++) {
+            if (!need[i]) continue;
+
+            trees[i] = imageLeaf(image, i);
+            ok = trees[i] != nullptr;
+            if (!ok) break;
+
+            trees[i]->left  = imageChild(trees, used, image->nodes[i].left);
+            trees[i]->right = imageChild(trees, used, image->nodes[i].right);
+        }
+
+        if (ok) {
+            root = trees[index];
+            used[index] = true;
+        }
+
+        // trees, that were not hung anywhere (after error)
+        for (uint32_t i = 0; i <= index; i++) {
+            if (!used[i]) diffNodeDtor(trees[i]);
+        }
+    }
+
+    free(trees);
+    free(need);
+    free(used);
+
+    return root;
+}
+
+// makes usual tree from image, shared subtrees are copied
+DiffNode_t* diffImageTree(const DiffImage_t* image, uint32_t root) {
+    if (!image || !image->header || root >= image->header->rootCount) return nullptr;
+
+    DiffNode_t* tree = imageSubtree(image, image->roots[root]);
+    if (addPrevs(tree) != DIFF_OK) {
+        diffNodeDtor(tree);
+        return nullptr;
+    }
+
+    return tree;
+}
+
+// evaluates expression right on the image: one sweep over nodes, that go before root
+double diffImageValue(const DiffImage_t* image, uint32_t root, double x) {
+    if (!image || !image->header || root >= image->header->rootCount) return 0;
+
+    uint32_t rootIndex = image->roots[root];
+    if (rootIndex == IMAGE_NO_CHILD) return 0;
+
+    double* values = (double*) calloc(rootIndex + 1, sizeof(double));
+    if (!values) return 0;
+
+    for (uint32_t i = 0; i <= rootIndex; i++) {
+        const DiffImageNode_t* node = &image->nodes[i];
+
+        double left  = node->left  != IMAGE_NO_CHILD ? values[node->left]  : 0;
+        double right = node->right != IMAGE_NO_CHILD ? values[node->right] : 0;
+
+        switch (node->type) {
+            case NUM:
+                values[i] = image->consts[node->arg];
+                break;
+            case VAR:
+                values[i] = x;
+                break;
+            case OP:
+                // operator was checked by isValidNode()
+                values[i] = DIFF_OPERS[node->opt].value(left, right);
+                break;
+            default:
+                values[i] = 0;
+                break;
+        }
+    }
+
+    double result = values[rootIndex];
+    free(values);
+
+    return result;
+}
@@ -0,0 +1,62 @@
+#ifndef SERIAL_H
+#define SERIAL_H
+
+#include <stdint.h>
+
+#include "diff.h"
+
+const char     IMAGE_MAGIC[4]  = {'D', 'I', 'F', 'B'};
+const uint32_t IMAGE_VERSION   = 1;
+const uint32_t IMAGE_NO_CHILD  = UINT32_MAX;
+const uint32_t IMAGE_NO_ARG    = UINT32_MAX;
+
+// Binary image of expression trees (or DAG: shared subtree is written once):
+//     header | nodes[nodeCount] | roots[rootCount] | padding to 8 | consts[constCount] | vars[varCount]
+// Nodes are in post-order, so children always go before their parents.
+struct DiffImageHeader_t {
+    char     magic[4]   = {};
+    uint32_t version    = 0;
+    uint32_t nodeCount  = 0;
+    uint32_t rootCount  = 0;
+    uint32_t constCount = 0;
+    uint32_t varCount   = 0;
+};
+
+struct DiffImageNode_t {
+    uint8_t  type  = 0;         // NodeType_t
+    uint8_t  opt   = 0;         // OpType_t, if type is OP
+    uint16_t flags = 0;
+    uint32_t arg   = 0;         // index in consts (NUM) or vars (VAR)
+    uint32_t left  = 0;
+    uint32_t right = 0;
+};
+
+// read-only view of image, nodes and constants are used right from the buffer (e.g. mmap'ed file)
+struct DiffImage_t {
+    const DiffImageHeader_t* header = nullptr;
+    const DiffImageNode_t*   nodes  = nullptr;
+    const uint32_t*          roots  = nullptr;
+    const double*            consts = nullptr;
+    const char*              vars   = nullptr;
+
+    void*  mapped     = nullptr;
+    size_t mappedSize = 0;
+};
+
+size_t imageSize(uint32_t nodeCount, uint32_t rootCount, uint32_t constCount, uint32_t varCount);
+
+int diffImageWrite(FILE* file, DiffNode_t* const* roots, uint32_t rootCount);
+
+int diffImageSave(const char* fileName, DiffNode_t* const* roots, uint32_t rootCount);
+
+int diffImageFromBuffer(DiffImage_t* image, const void* buffer, size_t size);
+
+int diffImageOpen(DiffImage_t* image, const char* fileName);
+
+void diffImageClose(DiffImage_t* image);
+
+DiffNode_t* diffImageTree(const DiffImage_t* image, uint32_t root);
+
+double diffImageValue(const DiffImage_t* image, uint32_t root, double x);
+
+#endif
@@ -0,0 +1,595 @@
+#include <new>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "budget.h"
+#include "emit.h"
+#include "hash.h"
+#include "profile.h"
+#include "server.h"
+
+static volatile sig_atomic_t serverStopped = 0;
+
+// QUEUE
+
+DiffServer_t* diffServerCtor(int workerCount, int deadlineMs, size_t maxNodes) {
+    DiffServer_t* server = new (std::nothrow) DiffServer_t;
+    if (!server) return nullptr;
+
+    if (workerCount < 1)                  workerCount = 1;
+    if (workerCount > MAX_SERVER_WORKERS) workerCount = MAX_SERVER_WORKERS;
+
+    server->deadlineMs = deadlineMs > 0 ? deadlineMs : DEFAULT_SERVER_DEADLINE;
+    server->maxNodes   = maxNodes;
+    server->memo       = (ServerMemo_t*) calloc(SERVER_MEMO_SIZE, sizeof(ServerMemo_t));
+    server->workers    = new (std::nothrow) std::thread[workerCount];
+    if (!server->memo || !server->workers) {
+        free(server->memo);
+        delete[] server->workers;
+        delete server;
+        return nullptr;
+    }
+
+    server->workerCount = workerCount;
+    for (int i = 0; i < workerCount; i++) {
+        server->workers[i] = std::thread(serverWorker, server);
+    }
+
+    return server;
+}
+
+static void serverClientRelease(DiffServer_t* server, ServerClient_t* client) {
+    if (!client) return;
+
+    bool last = false;
+    {
+        std::lock_guard<std::mutex> guard(server->lock);
+        last = --client->refs == 0;
+    }
+
+    if (last) {
+        close(client->fd);
+        free(client);
+    }
+}
+
+void diffServerDtor(DiffServer_t* server) {
+    if (!server) return;
+
+    {
+        std::lock_guard<std::mutex> guard(server->lock);
+        server->stop = true;
+    }
+    server->hasRequest.notify_all();
+
+    for (int i = 0; i < server->workerCount; i++) {
+        if (server->workers[i].joinable()) server->workers[i].join();
+    }
+    delete[] server->workers;
+
+    // workers answer all queued requests before stopping, so only requests pushed to stopped server may remain
+    while (server->first) {
+        ServerRequest_t* next = server->first->next;
+        serverClientRelease(server, server->first->client);
+        free(server->first->line);
+        free(server->first);
+        server->first = next;
+    }
+
+    for (size_t i = 0; i < SERVER_MEMO_SIZE; i++) {
+        diffNodeDtor(server->memo[i].equation);
+        diffNodeDtor(server->memo[i].derivative);
+    }
+    free(server->memo);
+
+    delete server;
+}
+
+int diffServerPush(DiffServer_t* server, const char* line, ServerClient_t* client, bool tooLong) {
+    DIFF_CHECK(!server || !line, DIFF_NULL);
+
+    ServerRequest_t* request = (ServerRequest_t*) calloc(1, sizeof(ServerRequest_t));
+    DIFF_CHECK(!request, DIFF_NO_MEM);
+
+    request->line     = strdup(line);
+    request->client   = client;
+    request->received = clockNs();
+    request->tooLong  = tooLong;
+    if (!request->line) {
+        free(request);
+        return DIFF_NO_MEM;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(server->lock);
+        if (client) client->refs++;
+
+        if (server->last) server->last->next = request;
+        else              server->first      = request;
+        server->last = request;
+        server->pending++;
+    }
+    server->hasRequest.notify_one();
+
+    return DIFF_OK;
+}
+
+void diffServerWait(DiffServer_t* server) {
+    if (!server) return;
+
+    std::unique_lock<std::mutex> guard(server->lock);
+    server->allDone.wait(guard, [server] { return server->pending == 0; });
+}
+
+// MEMO
+
+static size_t memoSlot(size_t hash, int order) {
+    return hashMix(hash + (size_t) order) & (SERVER_MEMO_SIZE - 1);
+}
+
+// copy of the highest memorized derivative, that is not higher than order
+static DiffNode_t* memoGet(DiffServer_t* server, DiffNode_t* equation, size_t hash, int order, int* found) {
+    std::lock_guard<std::mutex> guard(server->memoLock);
+
+    for (; order > 0; order--) {
+        const ServerMemo_t* memo = &server->memo[memoSlot(hash, order)];
+        if (!memo->derivative || memo->hash != hash || memo->order != order) continue;
+        if (!compareSubtrees(memo->equation, equation)) continue;
+
+        *found = order;
+        server->memoHits++;
+
+        return nodeCopy(memo->derivative);
+    }
+
+    return nullptr;
+}
+
+static void memoPut(DiffServer_t* server, DiffNode_t* equation, size_t hash, int order, DiffNode_t* derivative) {
+    ServerMemo_t memo = {};
+    memo.hash       = hash;
+    memo.order      = order;
+    memo.equation   = nodeCopy(equation);
+    memo.derivative = nodeCopy(derivative);
+
+    if (memo.equation && memo.derivative) {
+        std::lock_guard<std::mutex> guard(server->memoLock);
+
+        ServerMemo_t* slot = &server->memo[memoSlot(hash, order)];
+        ServerMemo_t  old  = *slot;
+        *slot = memo;
+        memo  = old;
+    }
+
+    // trees, pushed out of memo, are freed without lock
+    diffNodeDtor(memo.equation);
+    diffNodeDtor(memo.derivative);
+}
+
+// JOBS
+
+int parseServerJob(ServerJob_t* job, char* line) {
+    DIFF_CHECK(!job || !line, DIFF_NULL);
+
+    char* save  = nullptr;
+    char* token = strtok_r(line, " \t\r\n", &save);
+    DIFF_CHECK(!token || strlen(token) >= MAX_SERVER_ID, DIFF_VALUE_NULL);
+    strcpy(job->id, token);
+
+    job->equation = strtok_r(nullptr, " \t\r\n", &save);
+    DIFF_CHECK(!job->equation, DIFF_VALUE_NULL);
+
+    while ((token = strtok_r(nullptr, " \t\r\n", &save))) {
+        if (!strncmp(token, "order=", 6)) {
+            job->order = atoi(token + 6);
+            DIFF_CHECK(job->order < 0 || job->order > MAX_SERVER_ORDER, DIFF_VALUE_NULL);
+        } else if (!strncmp(token, "at=", 3)) {
+            char* point = token + 3;
+            while (*point) {
+                char* end = nullptr;
+                double value = strtod(point, &end);
+                DIFF_CHECK(end == point || job->pointCount >= MAX_SERVER_POINTS, DIFF_VALUE_NULL);
+                DIFF_CHECK(*end && *end != ',', DIFF_VALUE_NULL);
+
+                job->points[job->pointCount++] = value;
+                point = *end ? end + 1 : end;
+            }
+        } else if (!strncmp(token, "format=", 7)) {
+            if      (!strcmp(token + 7, "infix")) job->format = SERVER_INFIX;
+            else if (!strcmp(token + 7, "tex"))   job->format = SERVER_TEX;
+            else if (!strcmp(token + 7, "none"))  job->format = SERVER_NONE;
+            else return DIFF_VALUE_NULL;
+        } else if (!strncmp(token, "deadline=", 9)) {
+            job->deadlineMs = atoi(token + 9);
+            DIFF_CHECK(job->deadlineMs <= 0, DIFF_VALUE_NULL);
+        } else {
+            return DIFF_VALUE_NULL;
+        }
+    }
+
+    return DIFF_OK;
+}
+
+// status of job, that was stopped by its budget
+static ServerStatus_t budgetStatus(const DiffBudget_t* budget) {
+    switch (budgetLimit(budget)) {
+        case BUDGET_NONE:
+            return SERVER_NO_MEM;
+        case BUDGET_TIME:
+            return SERVER_TIMEOUT;
+        case BUDGET_NODES:
+        case BUDGET_BYTES:
+        case BUDGET_OUTPUT:
+        default:
+            return SERVER_BUDGET;
+    }
+}
+
+// SERVER_NO_MEM is turned to status of exceeded limit by serveJob()
+static ServerStatus_t serveBudgeted(DiffServer_t* server, const ServerJob_t* job, ServerResult_t* result) {
+    char* text = job->equation;
+    DiffNode_t* equation = parseEquation(&text, true);
+    if (!equation) return SERVER_SYNTAX;
+
+    size_t hash = treeHash(equation);
+
+    int done = 0;
+    DiffNode_t* current = memoGet(server, equation, hash, job->order, &done);
+    if (current) result->memo = true;
+    else         current = nodeCopy(equation);
+
+    ServerStatus_t status = current ? SERVER_DONE : SERVER_NO_MEM;
+    while (status == SERVER_DONE && done < job->order) {
+        if (clockNs() > job->deadline) {
+            status = SERVER_TIMEOUT;
+            break;
+        }
+
+        DiffNode_t* next = nodeDiff(current, nullptr);
+        diffNodeDtor(current);
+        current = next;
+        if (!current) {
+            status = SERVER_NO_MEM;
+            break;
+        }
+
+        if (addPrevs(current) != DIFF_OK) {
+            status = SERVER_NO_MEM;
+            break;
+        }
+        easierEqu(current);
+
+        // half simplified derivative doesn't go to memo
+        if (budgetExceeded()) {
+            status = SERVER_NO_MEM;
+            break;
+        }
+
+        memoPut(server, equation, hash, ++done, current);
+    }
+
+    if (status == SERVER_DONE && clockNs() > job->deadline) status = SERVER_TIMEOUT;
+
+    if (status == SERVER_DONE) {
+        for (int i = 0; i < job->pointCount; i++) result->values[i] = funcValue(current, job->points[i]);
+        result->derivative = current;
+    } else {
+        diffNodeDtor(current);
+    }
+
+    diffNodeDtor(equation);
+    return status;
+}
+
+// Deadline and node limit are checked by budget (see budget.h) inside of derivatives too,
+// so one huge derivative doesn't hold worker after them.
+ServerStatus_t serveJob(DiffServer_t* server, const ServerJob_t* job, ServerResult_t* result) {
+    if (!server || !job || !result) return SERVER_BAD;
+
+    DiffLimits_t limits = {};
+    limits.nodes = server->maxNodes;
+
+    DiffBudget_t budget = {};
+    diffBudgetCtor(&budget, &limits);
+    budget.deadline = job->deadline;
+    diffBudgetBegin(&budget);
+
+    ServerStatus_t status = serveBudgeted(server, job, result);
+    if (status == SERVER_NO_MEM) status = budgetStatus(&budget);
+
+    diffBudgetEnd();
+    return status;
+}
+
+static void emitServerResult(DiffEmitter_t* out, const ServerJob_t* job, const ServerResult_t* result) {
+    emitText    (out, ", \"order\": ");
+    emitUnsigned(out, (size_t) job->order);
+    emitText    (out, ", \"memo\": ");
+    emitText    (out, result->memo ? "true" : "false");
+
+    if (job->format != SERVER_NONE) {
+        DiffEmitter_t text;
+        emitterCtor(&text, EMIT_MEMORY);
+
+        if (job->format == SERVER_TEX) nodeToTex  (result->derivative, &text);
+        else                           nodeToInfix(result->derivative, &text);
+
+        if (!text.failed) {
+            emitText      (out, ", \"derivative\": ");
+            emitJsonString(out, emitterText(&text));
+        }
+        emitterDtor(&text);
+    }
+
+    // all the digits, that read back to the same double, JSON has no inf and nan
+    emitText(out, ", \"values\": [");
+    for (int i = 0; i < job->pointCount; i++) {
+        if (i) emitText(out, ", ");
+
+        if (isfinite(result->values[i])) emitExact(out, result->values[i]);
+        else                             emitText (out, "null");
+    }
+    emitChar(out, ']');
+}
+
+static void serverAnswer(DiffServer_t* server, const ServerRequest_t* request, const char* text, size_t size) {
+    std::lock_guard<std::mutex> guard(server->outputLock);
+
+    if (!request->client) {
+        fwrite(text, 1, size, stdout);
+        fflush(stdout);
+        return;
+    }
+
+    while (size > 0) {
+        ssize_t sent = send(request->client->fd, text, size, MSG_NOSIGNAL);
+        if (sent <= 0) return;
+
+        text += sent;
+        size -= (size_t) sent;
+    }
+}
+
+// answer is one JSON line: {"id": ..., "status": ..., [order, memo, derivative, values,] "us": ...}
+static void serveRequest(DiffServer_t* server, const ServerRequest_t* request) {
+    ServerJob_t    job    = {};
+    ServerResult_t result = {};
+    ServerStatus_t status = SERVER_BAD;
+
+    // id of too long request is taken from its beginning, the rest of it is lost
+    if (parseServerJob(&job, request->line) == DIFF_OK && !request->tooLong) {
+        uint64_t deadlineMs = (uint64_t) (job.deadlineMs ? job.deadlineMs : server->deadlineMs);
+        job.deadline = request->received + deadlineMs * 1000000;
+
+        // request waited in queue for too long
+        status = clockNs() > job.deadline ? SERVER_TIMEOUT : serveJob(server, &job, &result);
+    }
+
+    DiffEmitter_t out;
+    emitterCtor(&out, EMIT_MEMORY);
+
+    emitText(&out, "{\"id\": ");
+    if (*job.id) emitJsonString(&out, job.id);
+    else         emitText(&out, "null");
+
+    emitText(&out, ", \"status\": \"");
+    emitText(&out, SERVER_STATUS_NAMES[status]);
+    emitChar(&out, '"');
+    if (status == SERVER_DONE) emitServerResult(&out, &job, &result);
+    emitText    (&out, ", \"us\": ");
+    emitUnsigned(&out, (clockNs() - request->received) / 1000);
+    emitText    (&out, "}\n");
+
+    diffNodeDtor(result.derivative);
+
+    // answer without memory for all of it is not sent: half of JSON line is worse than nothing
+    size_t      size = 0;
+    const char* text = emitterText(&out, &size);
+    if (!out.failed) serverAnswer(server, request, text, size);
+    emitterDtor(&out);
+
+    std::lock_guard<std::mutex> guard(server->lock);
+    server->served++;
+    if      (status == SERVER_TIMEOUT) server->timeouts++;
+    else if (status == SERVER_BUDGET)  server->budgets++;
+    else if (status != SERVER_DONE)    server->failed++;
+}
+
+void serverWorker(DiffServer_t* server) {
+    if (!server) return;
+
+    diffNodePool(SERVER_NODE_POOL);
+
+    while (true) {
+        ServerRequest_t* request = nullptr;
+        {
+            std::unique_lock<std::mutex> guard(server->lock);
+            server->hasRequest.wait(guard, [server] { return server->first || server->stop; });
+            if (!server->first) break;
+
+            request = server->first;
+            server->first = request->next;
+            if (!server->first) server->last = nullptr;
+        }
+
+        serveRequest(server, request);
+
+        serverClientRelease(server, request->client);
+        free(request->line);
+        free(request);
+
+        {
+            std::lock_guard<std::mutex> guard(server->lock);
+            server->pending--;
+        }
+        server->allDone.notify_all();
+    }
+
+    diffNodePool(0);
+}
+
+static void serverReport(const DiffServer_t* server) {
+    fprintf(stderr, "Served %zu requests (%zu failed, %zu timeouts, %zu over budget), memo hits: %zu\n",
+                    server->served, server->failed, server->timeouts, server->budgets, server->memoHits);
+}
+
+// FRONTENDS
+
+// one request per line, answers go to stdout, until EOF
+int diffServeStdin(int workerCount, int deadlineMs, size_t maxNodes) {
+    DiffServer_t* server = diffServerCtor(workerCount, deadlineMs, maxNodes);
+    DIFF_CHECK(!server, DIFF_NO_MEM);
+
+    char line[MAX_WORD_LENGTH] = "";
+    while (fgets(line, sizeof(line), stdin)) {
+        size_t length  = strcspn(line, "\n");
+        bool   tooLong = !line[length] && length == sizeof(line) - 1 && !feof(stdin);
+        line[length] = '\0';
+
+        // one answer for the whole line, its rest is dropped
+        if (tooLong) {
+            int symb = 0;
+            while ((symb = getchar()) != EOF && symb != '\n') {}
+        }
+
+        if (*line) diffServerPush(server, line, nullptr, tooLong);
+    }
+
+    diffServerWait(server);
+    serverReport(server);
+    diffServerDtor(server);
+
+    return DIFF_OK;
+}
+
+static void stopServer(int signal) {
+    (void) signal;
+    serverStopped = 1;
+}
+
+// pushes all complete lines of client buffer
+static void readClient(DiffServer_t* server, ServerClient_t* client) {
+    char*  start = client->buffer;
+    char*  end   = nullptr;
+
+    // beginning of too long line is already answered
+    if (client->skipping) {
+        end = (char*) memchr(start, '\n', client->length);
+        if (!end) {
+            client->length = 0;
+            return;
+        }
+
+        client->skipping = false;
+        start = end + 1;
+    }
+
+    while ((end = (char*) memchr(start, '\n', client->length - (size_t) (start - client->buffer)))) {
+        *end = '\0';
+        if (end > start) diffServerPush(server, start, client);
+        start = end + 1;
+    }
+
+    client->length -= (size_t) (start - client->buffer);
+    memmove(client->buffer, start, client->length);
+
+    // line is too long: it gets one bad request with its id, the rest is dropped
+    if (client->length >= sizeof(client->buffer) - 1) {
+        client->buffer[client->length] = '\0';
+        diffServerPush(server, client->buffer, client, true);
+        client->length   = 0;
+        client->skipping = true;
+    }
+}
+
+// clients connect to Unix socket and send the same lines as to stdin, until SIGINT or SIGTERM
+int diffServeSocket(const char* path, int workerCount, int deadlineMs, size_t maxNodes) {
+    DIFF_CHECK(!path, DIFF_NULL);
+
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    DIFF_CHECK(strlen(path) >= sizeof(address.sun_path), DIFF_FILE_NULL);
+    strcpy(address.sun_path, path);
+
+    int listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    DIFF_CHECK(listenFd < 0, DIFF_FILE_NULL);
+
+    unlink(path);
+    if (bind(listenFd, (const sockaddr*) &address, sizeof(address)) < 0 || listen(listenFd, MAX_SERVER_CLIENTS) < 0) {
+        fprintf(stderr, "Can't listen on %s\n", path);
+        close(listenFd);
+        return DIFF_FILE_NULL;
+    }
+
+    DiffServer_t* server = diffServerCtor(workerCount, deadlineMs, maxNodes);
+    if (!server) {
+        close(listenFd);
+        unlink(path);
+        return DIFF_NO_MEM;
+    }
+
+    struct sigaction action = {};
+    action.sa_handler = stopServer;
+    sigaction(SIGINT,  &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+
+    ServerClient_t* clients[MAX_SERVER_CLIENTS] = {};
+    int clientCount = 0;
+
+    while (!serverStopped) {
+        pollfd fds[MAX_SERVER_CLIENTS + 1] = {};
+        fds[0].fd     = listenFd;
+        fds[0].events = POLLIN;
+        for (int i = 0; i < clientCount; i++) {
+            fds[i + 1].fd     = clients[i]->fd;
+            fds[i + 1].events = POLLIN;
+        }
+
+        if (poll(fds, (nfds_t) clientCount + 1, -1) < 0) continue;
+
+        for (int i = clientCount - 1; i >= 0; i--) {
+            if (!fds[i + 1].revents) continue;
+
+            ServerClient_t* client = clients[i];
+            ssize_t got = read(client->fd, client->buffer + client->length, sizeof(client->buffer) - 1 - client->length);
+            if (got > 0) {
+                client->length += (size_t) got;
+                readClient(server, client);
+                continue;
+            }
+
+            // answers to queued requests are still sent, connection is closed by the last of them
+            clients[i] = clients[--clientCount];
+            serverClientRelease(server, client);
+        }
+
+        if (fds[0].revents & POLLIN) {
+            int fd = accept(listenFd, nullptr, nullptr);
+            if (fd < 0) continue;
+
+            ServerClient_t* client = clientCount < MAX_SERVER_CLIENTS ? (ServerClient_t*) calloc(1, sizeof(ServerClient_t)) : nullptr;
+            if (!client) {
+                close(fd);
+                continue;
+            }
+
+            client->fd   = fd;
+            client->refs = 1;
+            clients[clientCount++] = client;
+        }
+    }
+
+    for (int i = 0; i < clientCount; i++) serverClientRelease(server, clients[i]);
+
+    diffServerWait(server);
+    serverReport(server);
+    diffServerDtor(server);
+
+    close(listenFd);
+    unlink(path);
+
+    return DIFF_OK;
+}
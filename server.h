@@ -0,0 +1,140 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "diff.h"
+
+const int DEFAULT_SERVER_WORKERS  = 4;
+
+const int MAX_SERVER_WORKERS      = 64;
+
+const int DEFAULT_SERVER_DEADLINE = 1000;       // ms from receiving request to response
+
+const int MAX_SERVER_ORDER        = 32;
+
+const int MAX_SERVER_POINTS       = 64;
+
+const int MAX_SERVER_CLIENTS      = 64;
+
+const int MAX_SERVER_ID           = 64;
+
+const size_t SERVER_MEMO_SIZE     = 1024;       // slots of derivative memo, power of 2
+
+const size_t SERVER_NODE_POOL     = 1 << 16;    // freed nodes, kept by every worker
+
+const size_t DEFAULT_SERVER_MAX_NODES = 1 << 24;    // live nodes of one job (768 MB), 0 - no limit
+
+enum ServerFormat_t {
+    SERVER_INFIX = 0,
+    SERVER_TEX   = 1,
+    SERVER_NONE  = 2,       // only values in points
+};
+
+enum ServerStatus_t {
+    SERVER_DONE     = 0,
+    SERVER_BAD      = 1,    // request can't be parsed
+    SERVER_SYNTAX   = 2,    // equation can't be parsed
+    SERVER_TIMEOUT  = 3,
+    SERVER_NO_MEM   = 4,
+    SERVER_BUDGET   = 5,    // job made too many nodes
+};
+
+const char SERVER_STATUS_NAMES[][16] = {"ok", "bad request", "syntax", "timeout", "no memory", "budget"};
+
+// connection of socket server, it lives while reader or queued requests need it
+struct ServerClient_t {
+    int    fd     = -1;
+    size_t refs   = 0;
+    size_t length = 0;
+    bool   skipping = false;                // rest of too long line is dropped till '\n'
+    char   buffer[MAX_WORD_LENGTH] = "";
+};
+
+struct ServerRequest_t {
+    char*           line     = nullptr;
+    ServerClient_t* client   = nullptr;     // nullptr - answer goes to stdout
+    uint64_t        received = 0;           // ns of monotonic clock
+    bool            tooLong  = false;       // only beginning of line is kept, it is answered as bad request
+
+    ServerRequest_t* next = nullptr;
+};
+
+// one parsed request: <id> <equation> [order=N] [at=x1,x2,...] [format=infix|tex|none] [deadline=ms]
+struct ServerJob_t {
+    char           id[MAX_SERVER_ID] = "";
+    char*          equation   = nullptr;
+    int            order      = 1;
+    double         points[MAX_SERVER_POINTS] = {};
+    int            pointCount = 0;
+    ServerFormat_t format     = SERVER_INFIX;
+    int            deadlineMs = 0;          // 0 - default of server
+    uint64_t       deadline   = 0;          // ns of monotonic clock
+};
+
+struct ServerResult_t {
+    DiffNode_t* derivative = nullptr;
+    double      values[MAX_SERVER_POINTS] = {};
+    bool        memo = false;               // derivative was taken from memo
+};
+
+// n-th derivative of equation, already simplified
+struct ServerMemo_t {
+    size_t      hash       = 0;
+    int         order      = 0;
+    DiffNode_t* equation   = nullptr;
+    DiffNode_t* derivative = nullptr;
+};
+
+// Requests are answered by pool of workers, so answers may go not in order of requests (they have ids).
+// Workers live as long as server does, so their node pools and derivative memo stay warm between requests.
+struct DiffServer_t {
+    std::mutex              lock = {};
+    std::condition_variable hasRequest = {};
+    std::condition_variable allDone    = {};
+
+    ServerRequest_t* first = nullptr;
+    ServerRequest_t* last  = nullptr;
+
+    size_t pending = 0;
+    bool   stop    = false;
+
+    std::mutex   outputLock = {};
+
+    std::mutex    memoLock = {};
+    ServerMemo_t* memo     = nullptr;
+
+    std::thread* workers     = nullptr;
+    int          workerCount = 0;
+    int          deadlineMs  = DEFAULT_SERVER_DEADLINE;
+    size_t       maxNodes    = DEFAULT_SERVER_MAX_NODES;
+
+    size_t served   = 0;
+    size_t failed   = 0;
+    size_t timeouts = 0;
+    size_t budgets  = 0;
+    size_t memoHits = 0;
+};
+
+DiffServer_t* diffServerCtor(int workerCount = DEFAULT_SERVER_WORKERS, int deadlineMs = DEFAULT_SERVER_DEADLINE,
+                             size_t maxNodes = DEFAULT_SERVER_MAX_NODES);
+
+void diffServerDtor(DiffServer_t* server);
+
+int diffServerPush(DiffServer_t* server, const char* line, ServerClient_t* client, bool tooLong = false);
+
+void diffServerWait(DiffServer_t* server);
+
+void serverWorker(DiffServer_t* server);
+
+int parseServerJob(ServerJob_t* job, char* line);
+
+ServerStatus_t serveJob(DiffServer_t* server, const ServerJob_t* job, ServerResult_t* result);
+
+int diffServeStdin(int workerCount, int deadlineMs, size_t maxNodes = DEFAULT_SERVER_MAX_NODES);
+
+int diffServeSocket(const char* path, int workerCount, int deadlineMs, size_t maxNodes = DEFAULT_SERVER_MAX_NODES);
+
+#endif
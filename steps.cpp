@@ -0,0 +1,247 @@
+#include "emit.h"
+#include "steps.h"
+
+int diffStepsCtor(DiffSteps_t* steps, FILE* texFile, FILE* traceFile, bool async) {
+    DIFF_CHECK(!steps, DIFF_NULL);
+
+    steps->queue = (DiffStep_t*) calloc(STEP_QUEUE_SIZE, sizeof(DiffStep_t));
+    DIFF_CHECK(!steps->queue, DIFF_NO_MEM);
+
+    steps->head.store(0);
+    steps->tail.store(0);
+    steps->done.store(false);
+
+    steps->retired      = nullptr;
+    steps->retiredCount = 0;
+    steps->retiredSize  = 0;
+
+    steps->texFile   = texFile;
+    steps->traceFile = traceFile;
+    steps->stepCount = 0;
+    steps->budget    = diffBudget;
+
+    if (async) steps->renderer = std::thread(renderLoop, steps);
+
+    return DIFF_OK;
+}
+
+// seq_cst stores of head, tail and done and loads of sleeping keep waiter from missing its wake up:
+// either notifier sees sleeping thread or sleeping thread sees the change
+static void waitSteps(DiffSteps_t* steps, bool (*ready)(const DiffSteps_t*)) {
+    if (ready(steps)) return;
+
+    std::unique_lock<std::mutex> guard(steps->lock);
+    steps->sleeping++;
+    while (!ready(steps)) steps->wake.wait(guard);
+    steps->sleeping--;
+}
+
+static void wakeSteps(DiffSteps_t* steps) {
+    if (!steps->sleeping.load()) return;
+
+    // waiter holds lock till it sleeps, so notify can't come between its check and its sleep
+    { std::lock_guard<std::mutex> guard(steps->lock); }
+    steps->wake.notify_all();
+}
+
+static bool hasPlace(const DiffSteps_t* steps) {
+    return steps->tail.load() - steps->head.load() < STEP_QUEUE_SIZE;
+}
+
+static bool isRendered(const DiffSteps_t* steps) {
+    return steps->head.load() == steps->tail.load();
+}
+
+static bool hasWork(const DiffSteps_t* steps) {
+    return steps->head.load() != steps->tail.load() || steps->done.load();
+}
+
+static void renderOldest(DiffSteps_t* steps) {
+    size_t head = steps->head.load(std::memory_order_relaxed);
+
+    renderStep(steps, &steps->queue[head & (STEP_QUEUE_SIZE - 1)]);
+    steps->head.store(head + 1, std::memory_order_release);
+}
+
+void diffStepsPush(DiffSteps_t* steps, DiffNode_t* input, DiffNode_t* result, DiffRule_t rule) {
+    if (!steps || !steps->queue) return;
+
+    size_t tail = steps->tail.load(std::memory_order_relaxed);
+    if (steps->renderer.joinable()) {
+        waitSteps(steps, hasPlace);
+    } else {
+        // no renderer thread: render oldest step ourselves to free place
+        while (tail - steps->head.load(std::memory_order_relaxed) >= STEP_QUEUE_SIZE) renderOldest(steps);
+    }
+
+    DiffStep_t* step = &steps->queue[tail & (STEP_QUEUE_SIZE - 1)];
+    step->input  = input;
+    step->result = result;
+    step->rule   = rule;
+
+    steps->tail.store(tail + 1);
+    wakeSteps(steps);
+}
+
+void diffStepsRetire(DiffSteps_t* steps, DiffNode_t* node) {
+    if (!node) return;
+
+    if (!steps) {
+        diffNodeDtor(node);
+        return;
+    }
+
+    if (steps->retiredCount >= steps->retiredSize) {
+        size_t newSize = steps->retiredSize ? steps->retiredSize * 2 : RETIRED_START_SIZE;
+        DiffNode_t** newRetired = (DiffNode_t**) realloc(steps->retired, newSize * sizeof(DiffNode_t*));
+        if (!newRetired) {
+            // can't postpone: wait till renderer is done with all steps
+            diffStepsFlush(steps);
+            diffNodeDtor(node);
+            return;
+        }
+
+        steps->retired     = newRetired;
+        steps->retiredSize = newSize;
+    }
+
+    steps->retired[steps->retiredCount++] = node;
+}
+
+void diffStepsFlush(DiffSteps_t* steps) {
+    if (!steps || !steps->queue) return;
+
+    if (steps->renderer.joinable()) {
+        waitSteps(steps, isRendered);
+    } else {
+        while (steps->head.load(std::memory_order_relaxed) != steps->tail.load(std::memory_order_relaxed)) {
+            renderOldest(steps);
+        }
+    }
+
+    for (size_t i = 0; i < steps->retiredCount; i++) {
+        diffNodeDtor(steps->retired[i]);
+    }
+    steps->retiredCount = 0;
+}
+
+void diffStepsDtor(DiffSteps_t* steps) {
+    if (!steps) return;
+
+    diffStepsFlush(steps);
+
+    steps->done.store(true);
+    wakeSteps(steps);
+    if (steps->renderer.joinable()) steps->renderer.join();
+
+    free(steps->queue);
+    free(steps->retired);
+    steps->queue   = nullptr;
+    steps->retired = nullptr;
+    steps->retiredSize = 0;
+}
+
+void renderStep(DiffSteps_t* steps, const DiffStep_t* step) {
+    if (!steps || !step) return;
+
+    // text of step is built in buffer and goes to file by one write
+    DiffEmitter_t out;
+
+    if (steps->texFile && !budgetOutput(steps->budget, steps->texFile)) {
+        emitterCtor(&out, EMIT_FILE, steps->texFile);
+
+        printRandomPhrase(&out);
+        emitText(&out, "$(");
+        nodeToTex(step->input, &out);
+        emitText(&out, ")'$ = ");
+        diffToTex(step->result, &out);
+        emitText(&out, "\n\n");
+
+        emitterDtor(&out);
+    }
+
+    if (steps->traceFile) {
+        emitterCtor(&out, EMIT_FILE, steps->traceFile);
+
+        emitText(&out, "{\"step\": ");
+        emitUnsigned(&out, steps->stepCount);
+        emitText(&out, ", \"rule\": \"");
+        emitText(&out, ruleName(step->rule));
+        emitText(&out, "\", \"input\": \"");
+        nodeToInfix(step->input, &out);
+        emitText(&out, "\", \"result\": \"");
+        nodeToInfix(step->result, &out);
+        emitText(&out, "\"}\n");
+
+        emitterDtor(&out);
+    }
+
+    steps->stepCount++;
+}
+
+void renderLoop(DiffSteps_t* steps) {
+    if (!steps) return;
+
+    while (true) {
+        waitSteps(steps, hasWork);
+
+        size_t head = steps->head.load(std::memory_order_relaxed);
+        if (head == steps->tail.load()) return;     // done and nothing is left
+
+        renderStep(steps, &steps->queue[head & (STEP_QUEUE_SIZE - 1)]);
+        steps->head.store(head + 1);
+        wakeSteps(steps);
+    }
+}
+
+const char* ruleName(DiffRule_t rule) {
+    switch (rule) {
+        case RULE_ADD:
+            return "add";
+        case RULE_SUB:
+            return "sub";
+        case RULE_MUL:
+            return "mul";
+        case RULE_DIV:
+            return "div";
+        case RULE_POW_NUM:
+            return "pow_num";
+        case RULE_POW_FUNC:
+            return "pow_func";
+        case RULE_EXP:
+            return "exp";
+        case RULE_CONST:
+            return "const";
+        case RULE_SIN:
+            return "sin";
+        case RULE_COS:
+            return "cos";
+        case RULE_LN:
+            return "ln";
+        case RULE_POLY:
+            return "poly";
+        case RULE_MEMO:
+            return "memo";
+        case RULE_TAN:
+            return "tan";
+        case RULE_NAT_EXP:
+            return "nat_exp";
+        case RULE_SQRT:
+            return "sqrt";
+        case RULE_ASIN:
+            return "asin";
+        case RULE_ACOS:
+            return "acos";
+        case RULE_ATAN:
+            return "atan";
+        case RULE_SINH:
+            return "sinh";
+        case RULE_COSH:
+            return "cosh";
+        case RULE_ABS:
+            return "abs";
+        case RULE_DEFAULT:
+        default:
+            return "unknown";
+    }
+}
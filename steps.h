@@ -0,0 +1,93 @@
+#ifndef STEPS_H
+#define STEPS_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "budget.h"
+#include "diff.h"
+
+// must be power of two
+const size_t STEP_QUEUE_SIZE = 1 << 12;
+
+const size_t RETIRED_START_SIZE = 16;
+
+enum DiffRule_t {
+    RULE_ADD       =  0,
+    RULE_SUB       =  1,
+    RULE_MUL       =  2,
+    RULE_DIV       =  3,
+    RULE_POW_NUM   =  4,     // f^c
+    RULE_POW_FUNC  =  5,     // f^g
+    RULE_EXP       =  6,     // c^f
+    RULE_CONST     =  7,     // c^c
+    RULE_SIN       =  8,
+    RULE_COS       =  9,
+    RULE_LN        = 10,
+    RULE_POLY      = 11,     // polynomial, coefficients are shifted
+    RULE_MEMO      = 12,     // the same subtree was differentiated by previous run of watch mode
+    RULE_TAN       = 13,
+    RULE_NAT_EXP   = 14,     // exp(f)
+    RULE_SQRT      = 15,
+    RULE_ASIN      = 16,
+    RULE_ACOS      = 17,
+    RULE_ATAN      = 18,
+    RULE_SINH      = 19,
+    RULE_COSH      = 20,
+    RULE_ABS       = 21,
+    RULE_DEFAULT   = -1,
+};
+
+struct DiffStep_t {
+    DiffNode_t* input  = nullptr;
+    DiffNode_t* result = nullptr;
+    DiffRule_t  rule   = RULE_DEFAULT;
+};
+
+// Steps are produced by nodeDiff and consumed by renderer thread (single producer, single consumer).
+// Nodes of steps must stay alive and unchanged till diffStepsFlush(), so
+// temporary trees should be passed to diffStepsRetire() instead of diffNodeDtor().
+// Thread, that has to wait (renderer for steps, producer for place or flush), sleeps on wake, the other one
+// notifies it only when sleeping is not 0, so queue without waiters costs no locks.
+struct DiffSteps_t {
+    DiffStep_t*         queue = nullptr;
+    std::atomic<size_t> head  = {0};
+    std::atomic<size_t> tail  = {0};
+    std::atomic<bool>   done  = {false};
+
+    std::mutex              lock     = {};
+    std::condition_variable wake     = {};
+    std::atomic<int>        sleeping = {0};
+
+    DiffNode_t** retired      = nullptr;
+    size_t       retiredCount = 0;
+    size_t       retiredSize  = 0;
+
+    FILE*  texFile   = nullptr;
+    FILE*  traceFile = nullptr;
+    size_t stepCount = 0;
+
+    DiffBudget_t* budget = nullptr;         // of job, that makes steps, renderer stops printing TeX after its output limit
+
+    std::thread renderer = {};
+};
+
+int diffStepsCtor(DiffSteps_t* steps, FILE* texFile, FILE* traceFile, bool async = true);
+
+void diffStepsPush(DiffSteps_t* steps, DiffNode_t* input, DiffNode_t* result, DiffRule_t rule);
+
+void diffStepsRetire(DiffSteps_t* steps, DiffNode_t* node);
+
+void diffStepsFlush(DiffSteps_t* steps);
+
+void diffStepsDtor(DiffSteps_t* steps);
+
+void renderStep(DiffSteps_t* steps, const DiffStep_t* step);
+
+void renderLoop(DiffSteps_t* steps);
+
+const char* ruleName(DiffRule_t rule);
+
+#endif
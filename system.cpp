@@ -0,0 +1,238 @@
+#include "hash.h"
+#include "system.h"
+#include "walk.h"
+
+int systemCtor(DiffSystem_t* system) {
+    DIFF_CHECK(!system, DIFF_NULL);
+
+    *system = {};
+
+    system->nodes = (SysNode_t*) calloc(SYSTEM_START_SIZE, sizeof(SysNode_t));
+    system->table = (uint32_t*)  calloc(2 * SYSTEM_START_SIZE, sizeof(uint32_t));
+    if (!system->nodes || !system->table) {
+        systemDtor(system);
+        return DIFF_NO_MEM;
+    }
+
+    system->size      = SYSTEM_START_SIZE;
+    system->tableSize = 2 * SYSTEM_START_SIZE;
+
+    return DIFF_OK;
+}
+
+void systemDtor(DiffSystem_t* system) {
+    if (!system) return;
+
+    free(system->nodes);
+    free(system->table);
+    *system = {};
+}
+
+// DAG
+
+static size_t sysNodeHash(const SysNode_t* node) {
+    size_t value = 0;
+    switch (node->type) {
+        case OP:
+            value = (size_t) node->opt;
+            break;
+        case NUM:
+            memcpy(&value, &node->num, sizeof(node->num));
+            break;
+        case VAR:
+            value = (size_t) node->var;
+            break;
+        case NODET_DEFAULT:
+        default:
+            break;
+    }
+
+    size_t hash = hashMix(value ^ ((size_t) node->type << 56) ^ HASH_SEED);
+    hash = hashMix(hash ^ node->left);
+    hash = hashMix(hash + (size_t) node->right * 31);
+
+    return hash;
+}
+
+// numbers are equal bit by bit, -0 was made 0 before
+static bool sysNodeEqual(const SysNode_t* first, const SysNode_t* second) {
+    return first->type  == second->type && first->opt == second->opt && first->var == second->var
+        && first->left  == second->left && first->right == second->right
+        && !memcmp(&first->num, &second->num, sizeof(first->num));
+}
+
+static int systemGrowTable(DiffSystem_t* system) {
+    size_t    newSize  = system->tableSize * 2;
+    uint32_t* newTable = (uint32_t*) calloc(newSize, sizeof(uint32_t));
+    DIFF_CHECK(!newTable, DIFF_NO_MEM);
+
+    for (size_t i = 0; i < system->count; i++) {
+        size_t pos = sysNodeHash(&system->nodes[i]) & (newSize - 1);
+        while (newTable[pos]) pos = (pos + 1) & (newSize - 1);
+
+        newTable[pos] = (uint32_t) (i + 1);
+    }
+
+    free(system->table);
+    system->table     = newTable;
+    system->tableSize = newSize;
+
+    return DIFF_OK;
+}
+
+// index of equal node, new node is added only if there is no such one
+static uint32_t systemIntern(DiffSystem_t* system, const SysNode_t* node) {
+    size_t mask = system->tableSize - 1;
+    size_t pos  = sysNodeHash(node) & mask;
+
+    while (system->table[pos]) {
+        uint32_t index = system->table[pos] - 1;
+        if (sysNodeEqual(&system->nodes[index], node)) return index;
+
+        pos = (pos + 1) & mask;
+    }
+
+    if (system->count >= system->size) {
+        SysNode_t* newNodes = (SysNode_t*) realloc(system->nodes, system->size * 2 * sizeof(SysNode_t));
+        if (!newNodes) return SYSTEM_NO_NODE;
+
+        system->nodes = newNodes;
+        system->size *= 2;
+    }
+
+    uint32_t index = (uint32_t) system->count++;
+    system->nodes[index] = *node;
+    system->table[pos]   = index + 1;
+
+    // table is at most half full
+    if (2 * system->count > system->tableSize && systemGrowTable(system) != DIFF_OK) return SYSTEM_NO_NODE;
+
+    return index;
+}
+
+struct InternWalk_t {
+    DiffSystem_t* system = nullptr;
+    WalkValues_t  values = {};
+    bool          failed = false;
+};
+
+static WalkResult_t internVisit(DiffNode_t* node, WalkEvent_t event, void* context) {
+    if (event != WALK_LEAVE) return WALK_NEXT;
+
+    InternWalk_t* walk = (InternWalk_t*) context;
+
+    SysNode_t sysNode = {};
+    sysNode.type = node->type;
+
+    switch (node->type) {
+        case NUM:
+            sysNode.num = compDouble(node->value.num, 0) ? 0 : node->value.num;
+            break;
+        case VAR:
+            if (node->value.var < 'a' || node->value.var > 'z') {
+                walk->failed = true;
+                return WALK_STOP;
+            }
+            sysNode.var = node->value.var - 'a';
+            break;
+        case OP:
+            sysNode.opt   = node->value.opt;
+            sysNode.right = node->right ? walkValuesPop(&walk->values).index : SYSTEM_NO_NODE;
+            sysNode.left  = node->left  ? walkValuesPop(&walk->values).index : SYSTEM_NO_NODE;
+
+            // a + b and b + a are one node
+            if ((sysNode.opt == ADD_OP || sysNode.opt == MUL_OP) && sysNode.left > sysNode.right) {
+                uint32_t left = sysNode.left;
+                sysNode.left  = sysNode.right;
+                sysNode.right = left;
+            }
+            break;
+        case NODET_DEFAULT:
+        default:
+            walk->failed = true;
+            return WALK_STOP;
+    }
+
+    WalkValue_t value = {};
+    value.index = systemIntern(walk->system, &sysNode);
+    if (value.index == SYSTEM_NO_NODE || walkValuesPush(&walk->values, value) != DIFF_OK) {
+        walk->failed = true;
+        return WALK_STOP;
+    }
+
+    return WALK_NEXT;
+}
+
+// tree is merged into DAG and becomes the next output, tree itself is not kept
+int systemAddOutput(DiffSystem_t* system, DiffNode_t* tree) {
+    DIFF_CHECK(!system || !tree, DIFF_NULL);
+    DIFF_CHECK(system->outputCount >= MAX_COLUMN_OUTPUTS, DIFF_VALUE_NULL);
+
+    InternWalk_t walk = {};
+    walk.system = system;
+    walkValuesCtor(&walk.values);
+
+    int err = treeWalk(tree, internVisit, &walk);
+    if (err == DIFF_OK && (walk.failed || walk.values.count != 1)) err = DIFF_VALUE_NULL;
+
+    if (err == DIFF_OK) system->outputs[system->outputCount++] = walk.values.values[0].index;
+
+    walkValuesDtor(&walk.values);
+    return err;
+}
+
+// SLOTS
+
+static bool sysNeedsSlot(const SysNode_t* node) {
+    return node->type != VAR;
+}
+
+// Every operator gets slot by linear scan: slot of value, that is not needed after the node, goes to free list,
+// operand of function or left operand, that dies here, gives its slot to result. Numbers and outputs keep their slots.
+int systemFinish(DiffSystem_t* system) {
+    DIFF_CHECK(!system, DIFF_NULL);
+
+    const size_t KEEP = SIZE_MAX;
+
+    size_t* lastUse   = (size_t*) calloc(system->count + 1, sizeof(size_t));
+    size_t* freeSlots = (size_t*) calloc(system->count + 1, sizeof(size_t));
+    if (!lastUse || !freeSlots) {
+        free(lastUse);
+        free(freeSlots);
+        return DIFF_NO_MEM;
+    }
+
+    for (size_t i = 0; i < system->count; i++) {
+        const SysNode_t* node = &system->nodes[i];
+        if (node->type == NUM) lastUse[i] = KEEP;
+        if (node->left  != SYSTEM_NO_NODE && lastUse[node->left]  != KEEP) lastUse[node->left]  = i;
+        if (node->right != SYSTEM_NO_NODE && lastUse[node->right] != KEEP) lastUse[node->right] = i;
+    }
+    for (int i = 0; i < system->outputCount; i++) lastUse[system->outputs[i]] = KEEP;
+
+    size_t freeCount = 0;
+    system->slotCount = 0;
+
+    for (size_t i = 0; i < system->count; i++) {
+        SysNode_t* node = &system->nodes[i];
+        if (!sysNeedsSlot(node)) continue;
+
+        uint32_t first = node->left != SYSTEM_NO_NODE ? node->left : node->right;
+        node->inPlace = first != SYSTEM_NO_NODE && lastUse[first] == i && sysNeedsSlot(&system->nodes[first]);
+
+        if (node->inPlace)  node->slot = system->nodes[first].slot;
+        else if (freeCount) node->slot = freeSlots[--freeCount];
+        else                node->slot = system->slotCount++;
+
+        // the same operand twice (x * x) is not freed, its slot is taken by result
+        if (node->right != SYSTEM_NO_NODE && node->right != first && lastUse[node->right] == i
+                                          && sysNeedsSlot(&system->nodes[node->right])) {
+            freeSlots[freeCount++] = system->nodes[node->right].slot;
+        }
+    }
+
+    free(lastUse);
+    free(freeSlots);
+
+    return DIFF_OK;
+}
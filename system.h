@@ -0,0 +1,47 @@
+#ifndef SYSTEM_H
+#define SYSTEM_H
+
+#include "column.h"
+
+const size_t SYSTEM_START_SIZE = 64;        // nodes, size of table is power of 2 and twice bigger
+
+const uint32_t SYSTEM_NO_NODE  = UINT32_MAX;
+
+// One node of shared DAG, operands are indices of earlier nodes (right - operand of function).
+// Value of operator goes to its slot, column of block, slots of dead values are reused.
+struct SysNode_t {
+    NodeType_t type    = NODET_DEFAULT;
+    OpType_t   opt     = OPT_DEFAULT;
+    int        var     = 0;             // index of variable, 0 for 'a'
+    double     num     = 0;
+    uint32_t   left    = SYSTEM_NO_NODE;
+    uint32_t   right   = SYSTEM_NO_NODE;
+    size_t     slot    = 0;
+    bool       inPlace = false;         // operand dies here, so its slot is overwritten without copying
+};
+
+// Expressions of system and nonzero entries of their Jacobian in one DAG: equal subexpressions of all the
+// outputs (f0 and f1, f0 and df0/dx, ...) are one node, so one pass evaluates every of them once per row.
+struct DiffSystem_t {
+    SysNode_t* nodes = nullptr;         // in topological order: operands go before operator
+    size_t     count = 0;
+    size_t     size  = 0;
+
+    uint32_t*  table     = nullptr;     // open addressing: index of node + 1, 0 - empty
+    size_t     tableSize = 0;
+
+    uint32_t   outputs[MAX_COLUMN_OUTPUTS] = {};
+    int        outputCount = 0;
+
+    size_t     slotCount = 0;           // set by systemFinish()
+};
+
+int systemCtor(DiffSystem_t* system);
+
+void systemDtor(DiffSystem_t* system);
+
+int systemAddOutput(DiffSystem_t* system, DiffNode_t* tree);
+
+int systemFinish(DiffSystem_t* system);
+
+#endif
@@ -0,0 +1,150 @@
+#include "walk.h"
+#include "budget.h"
+
+// STACK
+
+void walkStackCtor(WalkStack_t* stack) {
+    if (!stack) return;
+
+    stack->frames = stack->inlineFrames;
+    stack->count  = 0;
+    stack->size   = WALK_INLINE_SIZE;
+}
+
+void walkStackDtor(WalkStack_t* stack) {
+    if (!stack) return;
+
+    if (stack->frames != stack->inlineFrames) {
+        budgetFree(stack->size * sizeof(WalkFrame_t));
+        free(stack->frames);
+    }
+    stack->frames = nullptr;
+    stack->count  = stack->size = 0;
+}
+
+int walkStackPush(WalkStack_t* stack, DiffNode_t* node, size_t state, DiffNode_t* other) {
+    DIFF_CHECK(!stack || !stack->frames, DIFF_NULL);
+
+    if (stack->count >= stack->size) {
+        size_t newSize = stack->size * 2;
+        WalkFrame_t* frames = (WalkFrame_t*) malloc(newSize * sizeof(WalkFrame_t));
+        DIFF_CHECK(!frames, DIFF_NO_MEM);
+
+        memcpy(frames, stack->frames, stack->count * sizeof(WalkFrame_t));
+        if (stack->frames != stack->inlineFrames) {
+            budgetFree(stack->size * sizeof(WalkFrame_t));
+            free(stack->frames);
+        }
+        budgetAlloc(newSize * sizeof(WalkFrame_t));
+
+        stack->frames = frames;
+        stack->size   = newSize;
+    }
+
+    WalkFrame_t* frame = &stack->frames[stack->count++];
+    frame->node  = node;
+    frame->other = other;
+    frame->state = state;
+
+    return DIFF_OK;
+}
+
+// VALUES
+
+void walkValuesCtor(WalkValues_t* values) {
+    if (!values) return;
+
+    values->values = values->inlineValues;
+    values->count  = 0;
+    values->size   = WALK_INLINE_SIZE;
+}
+
+void walkValuesDtor(WalkValues_t* values) {
+    if (!values) return;
+
+    if (values->values != values->inlineValues) {
+        budgetFree(values->size * sizeof(WalkValue_t));
+        free(values->values);
+    }
+    values->values = nullptr;
+    values->count  = values->size = 0;
+}
+
+int walkValuesPush(WalkValues_t* values, WalkValue_t value) {
+    DIFF_CHECK(!values || !values->values, DIFF_NULL);
+
+    if (values->count >= values->size) {
+        size_t newSize = values->size * 2;
+        WalkValue_t* newValues = (WalkValue_t*) malloc(newSize * sizeof(WalkValue_t));
+        DIFF_CHECK(!newValues, DIFF_NO_MEM);
+
+        memcpy(newValues, values->values, values->count * sizeof(WalkValue_t));
+        if (values->values != values->inlineValues) {
+            budgetFree(values->size * sizeof(WalkValue_t));
+            free(values->values);
+        }
+        budgetAlloc(newSize * sizeof(WalkValue_t));
+
+        values->values = newValues;
+        values->size   = newSize;
+    }
+
+    values->values[values->count++] = value;
+    return DIFF_OK;
+}
+
+WalkValue_t walkValuesPop(WalkValues_t* values) {
+    WalkValue_t value = {};
+    if (!values || !values->count) return value;
+
+    return values->values[--values->count];
+}
+
+// WALKER
+
+// Euler tour: every node gets WALK_ENTER, WALK_INFIX between its children and WALK_LEAVE,
+// so one visitor can be pre-order (printers), in-order or post-order (evaluation, derivatives)
+int treeWalk(DiffNode_t* root, WalkVisitor_t visitor, void* context, WalkOrder_t order) {
+    DIFF_CHECK(!visitor, DIFF_NULL);
+    if (!root) return DIFF_OK;
+
+    WalkStack_t stack = {};
+    walkStackCtor(&stack);
+
+    int error = walkStackPush(&stack, root, WALK_ENTER);
+
+    while (error == DIFF_OK && stack.count) {
+        WalkFrame_t* frame = &stack.frames[stack.count - 1];
+        DiffNode_t*  node  = frame->node;
+        WalkEvent_t  event = (WalkEvent_t) frame->state;
+
+        DiffNode_t* first  = order == WALK_LEFT_FIRST ? node->left  : node->right;
+        DiffNode_t* second = order == WALK_LEFT_FIRST ? node->right : node->left;
+
+        WalkResult_t result = visitor(node, event, context);
+        if (result == WALK_STOP) break;
+
+        switch (event) {
+            case WALK_ENTER:
+                if (result == WALK_SKIP) {
+                    stack.count--;
+                    break;
+                }
+
+                frame->state = WALK_INFIX;
+                if (first) error = walkStackPush(&stack, first, WALK_ENTER);
+                break;
+            case WALK_INFIX:
+                frame->state = WALK_LEAVE;
+                if (second) error = walkStackPush(&stack, second, WALK_ENTER);
+                break;
+            case WALK_LEAVE:
+            default:
+                stack.count--;
+                break;
+        }
+    }
+
+    walkStackDtor(&stack);
+    return error;
+}
@@ -0,0 +1,77 @@
+#ifndef WALK_H
+#define WALK_H
+
+#include <stdint.h>
+
+#include "diff.h"
+
+// frames and values of small trees are kept inside of stack object, without malloc
+const size_t WALK_INLINE_SIZE = 64;
+
+enum WalkEvent_t {
+    WALK_ENTER = 0,     // before first child
+    WALK_INFIX = 1,     // between children (also called for leaves and unary operators)
+    WALK_LEAVE = 2,     // after second child
+};
+
+enum WalkResult_t {
+    WALK_NEXT = 0,
+    WALK_SKIP = 1,      // returned on WALK_ENTER: children, WALK_INFIX and WALK_LEAVE of node are skipped
+    WALK_STOP = 2,
+};
+
+enum WalkOrder_t {
+    WALK_LEFT_FIRST  = 0,
+    WALK_RIGHT_FIRST = 1,
+};
+
+typedef WalkResult_t (*WalkVisitor_t)(DiffNode_t* node, WalkEvent_t event, void* context);
+
+struct WalkFrame_t {
+    DiffNode_t* node  = nullptr;
+    DiffNode_t* other = nullptr;        // second tree for paired walks (copy, compare)
+    size_t      state = 0;              // next event or any other number (depth, ...)
+};
+
+// explicit stack instead of call stack, so depth of tree is limited only by memory
+struct WalkStack_t {
+    WalkFrame_t* frames = nullptr;
+    size_t       count  = 0;
+    size_t       size   = 0;
+
+    WalkFrame_t  inlineFrames[WALK_INLINE_SIZE] = {};
+};
+
+union WalkValue_t {
+    double      num;
+    size_t      hash;
+    uint32_t    index;
+    DiffNode_t* node;
+};
+
+// results of subtrees for post-order passes
+struct WalkValues_t {
+    WalkValue_t* values = nullptr;
+    size_t       count  = 0;
+    size_t       size   = 0;
+
+    WalkValue_t  inlineValues[WALK_INLINE_SIZE] = {};
+};
+
+void walkStackCtor(WalkStack_t* stack);
+
+void walkStackDtor(WalkStack_t* stack);
+
+int walkStackPush(WalkStack_t* stack, DiffNode_t* node, size_t state = 0, DiffNode_t* other = nullptr);
+
+void walkValuesCtor(WalkValues_t* values);
+
+void walkValuesDtor(WalkValues_t* values);
+
+int walkValuesPush(WalkValues_t* values, WalkValue_t value);
+
+WalkValue_t walkValuesPop(WalkValues_t* values);
+
+int treeWalk(DiffNode_t* root, WalkVisitor_t visitor, void* context, WalkOrder_t order = WALK_LEFT_FIRST);
+
+#endif
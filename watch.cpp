@@ -0,0 +1,383 @@
+#include <signal.h>
+
+#include "hash.h"
+#include "profile.h"
+#include "walk.h"
+#include "watch.h"
+
+DiffMemo_t* diffMemo = nullptr;
+
+static volatile sig_atomic_t watchStopped = 0;
+
+// MEMO
+
+int diffMemoCtor(DiffMemo_t* memo) {
+    DIFF_CHECK(!memo, DIFF_NULL);
+
+    *memo = {};
+    memo->entries = (MemoEntry_t*) calloc(MEMO_START_SIZE, sizeof(MemoEntry_t));
+    DIFF_CHECK(!memo->entries, DIFF_NO_MEM);
+
+    memo->size = MEMO_START_SIZE;
+    return DIFF_OK;
+}
+
+static void memoEntryDtor(MemoEntry_t* entry) {
+    diffNodeDtor(entry->equation);
+    diffNodeDtor(entry->derivative);
+    *entry = {};
+}
+
+void diffMemoDtor(DiffMemo_t* memo) {
+    if (!memo) return;
+
+    for (size_t i = 0; i < memo->size; i++) memoEntryDtor(&memo->entries[i]);
+    free(memo->entries);
+
+    diffNodeDtor(memo->equation);
+    diffNodeDtor(memo->simplified);
+    diffNodeDtor(memo->plotEquation);
+    *memo = {};
+}
+
+// entry with the same hash or empty one, where it should be
+static MemoEntry_t* memoSlot(const DiffMemo_t* memo, size_t hash) {
+    size_t mask = memo->size - 1;
+    size_t slot = hashMix(hash) & mask;
+
+    while (memo->entries[slot].derivative && memo->entries[slot].hash != hash) slot = (slot + 1) & mask;
+    return &memo->entries[slot];
+}
+
+// entries are moved to new table of given size, empty ones are skipped
+static int memoRehash(DiffMemo_t* memo, size_t size) {
+    MemoEntry_t* entries = (MemoEntry_t*) calloc(size, sizeof(MemoEntry_t));
+    DIFF_CHECK(!entries, DIFF_NO_MEM);
+
+    MemoEntry_t* old     = memo->entries;
+    size_t       oldSize = memo->size;
+
+    memo->entries = entries;
+    memo->size    = size;
+    for (size_t i = 0; i < oldSize; i++) {
+        if (old[i].derivative) *memoSlot(memo, old[i].hash) = old[i];
+    }
+
+    free(old);
+    return DIFF_OK;
+}
+
+// copy of derivative of equation, made by one of previous runs
+DiffNode_t* diffMemoGet(DiffMemo_t* memo, size_t hash, DiffNode_t* equation) {
+    if (!memo || !memo->entries || !equation) return nullptr;
+
+    MemoEntry_t* entry = memoSlot(memo, hash);
+    if (!entry->derivative || entry->born == memo->generation || !compareSubtrees(entry->equation, equation)) {
+        memo->misses++;
+        return nullptr;
+    }
+
+    DiffNode_t* derivative = nodeCopy(entry->derivative);
+    if (!derivative) return nullptr;
+
+    entry->used = memo->generation;
+    memo->hits++;
+    memo->reused += entry->nodes;
+
+    return derivative;
+}
+
+void diffMemoPut(DiffMemo_t* memo, size_t hash, DiffNode_t* equation, DiffNode_t* derivative) {
+    if (!memo || !memo->entries || !equation || !derivative) return;
+
+    // load factor stays under 1/2
+    if (2 * (memo->count + 1) > memo->size && memoRehash(memo, memo->size * 2) != DIFF_OK) return;
+
+    // the same subtree is already here (or another one with the same hash, then it stays)
+    MemoEntry_t* entry = memoSlot(memo, hash);
+    if (entry->derivative) {
+        entry->used = memo->generation;
+        return;
+    }
+
+    int sizeErr = DIFF_OK;
+    size_t nodes = getTreeSize(equation, &sizeErr) + getTreeSize(derivative, &sizeErr);
+    if (sizeErr != DIFF_OK || memo->nodes + nodes > MEMO_MAX_NODES) return;
+
+    entry->equation   = nodeCopy(equation);
+    entry->derivative = nodeCopy(derivative);
+    if (!entry->equation || !entry->derivative) {
+        memoEntryDtor(entry);
+        return;
+    }
+
+    // letters of TeX belong to document of this run
+    if (removeLetters(entry->equation) != DIFF_OK || removeLetters(entry->derivative) != DIFF_OK) {
+        memoEntryDtor(entry);
+        return;
+    }
+
+    entry->hash  = hash;
+    entry->nodes = nodes;
+    entry->born  = entry->used = memo->generation;
+
+    memo->count++;
+    memo->nodes += nodes;
+}
+
+DiffNode_t* diffMemoGetSimplified(DiffMemo_t* memo, DiffNode_t* equation) {
+    if (!memo || !memo->simplified || !compareSubtrees(memo->equation, equation)) return nullptr;
+
+    return nodeCopy(memo->simplified);
+}
+
+void diffMemoPutSimplified(DiffMemo_t* memo, DiffNode_t* equation, DiffNode_t* simplified) {
+    if (!memo || !equation || !simplified) return;
+    if (memo->simplified && compareSubtrees(memo->equation, equation)) return;
+
+    diffNodeDtor(memo->equation);
+    diffNodeDtor(memo->simplified);
+    memo->equation   = nodeCopy(equation);
+    memo->simplified = nodeCopy(simplified);
+
+    if (removeLetters(memo->equation) != DIFF_OK || removeLetters(memo->simplified) != DIFF_OK) {
+        diffNodeDtor(memo->equation);
+        diffNodeDtor(memo->simplified);
+        memo->equation   = nullptr;
+        memo->simplified = nullptr;
+    }
+}
+
+// graph of the same equation on the same range is already rendered by previous run
+bool diffMemoGetPlot(const DiffMemo_t* memo, DiffNode_t* equation, double left, double right, char* image, size_t size) {
+    if (!memo || !image || !memo->plotEquation) return false;
+    if (!compDouble(memo->plotLeft, left) || !compDouble(memo->plotRight, right)) return false;
+    if (!compareSubtrees(memo->plotEquation, equation)) return false;
+
+    snprintf(image, size, "%s", memo->plotImage);
+    return true;
+}
+
+void diffMemoPutPlot(DiffMemo_t* memo, DiffNode_t* equation, double left, double right, const char* image) {
+    if (!memo || !equation || !image) return;
+
+    diffNodeDtor(memo->plotEquation);
+    memo->plotEquation = nodeCopy(equation);
+    if (removeLetters(memo->plotEquation) != DIFF_OK) {
+        diffNodeDtor(memo->plotEquation);
+        memo->plotEquation = nullptr;
+    }
+
+    memo->plotLeft  = left;
+    memo->plotRight = right;
+    snprintf(memo->plotImage, sizeof(memo->plotImage), "%s", image);
+}
+
+// entries, that were not needed by this run, are freed: equation has moved away from them
+void diffMemoSweep(DiffMemo_t* memo) {
+    if (!memo || !memo->entries) return;
+
+    for (size_t i = 0; i < memo->size; i++) {
+        MemoEntry_t* entry = &memo->entries[i];
+        if (!entry->derivative || entry->used == memo->generation) continue;
+
+        memo->nodes -= entry->nodes;
+        memo->count--;
+        memoEntryDtor(entry);
+    }
+
+    // holes break chains of linear probing
+    memoRehash(memo, memo->size);
+
+    memo->generation++;
+    memo->hits = memo->misses = memo->reused = 0;
+}
+
+// INDEX
+
+static size_t indexSlot(const MemoIndex_t* index, const DiffNode_t* node) {
+    size_t mask = index->size - 1;
+    size_t slot = hashMix((uintptr_t) node) & mask;
+
+    while (index->nodes[slot] && index->nodes[slot] != node) slot = (slot + 1) & mask;
+    return slot;
+}
+
+static int memoIndexAdd(MemoIndex_t* index, const DiffNode_t* node, size_t hash) {
+    if (2 * (index->count + 1) > index->size) {
+        MemoIndex_t bigger = {};
+        bigger.size   = index->size ? index->size * 2 : MEMO_START_SIZE;
+        bigger.nodes  = (const DiffNode_t**) calloc(bigger.size, sizeof(DiffNode_t*));
+        bigger.hashes = (size_t*) calloc(bigger.size, sizeof(size_t));
+        if (!bigger.nodes || !bigger.hashes) {
+            free(bigger.nodes);
+            free(bigger.hashes);
+            return DIFF_NO_MEM;
+        }
+
+        for (size_t i = 0; i < index->size; i++) {
+            if (!index->nodes[i]) continue;
+
+            size_t slot = indexSlot(&bigger, index->nodes[i]);
+            bigger.nodes [slot] = index->nodes[i];
+            bigger.hashes[slot] = index->hashes[i];
+        }
+        bigger.count = index->count;
+
+        memoIndexDtor(index);
+        *index = bigger;
+    }
+
+    size_t slot = indexSlot(index, node);
+    index->nodes [slot] = node;
+    index->hashes[slot] = hash;
+    index->count++;
+
+    return DIFF_OK;
+}
+
+struct MemoWalk_t {
+    WalkValues_t hashes = {};
+    WalkValues_t sizes  = {};       // sizes of subtrees, in hash field
+    MemoIndex_t* index  = nullptr;
+    DiffMemo_t*  memo   = nullptr;
+    bool         failed = false;
+};
+
+static WalkResult_t memoIndexVisit(DiffNode_t* node, WalkEvent_t event, void* context) {
+    if (event != WALK_LEAVE) return WALK_NEXT;
+
+    MemoWalk_t* walk = (MemoWalk_t*) context;
+
+    size_t rightHash = HASH_SEED, leftHash = HASH_SEED;
+    WalkValue_t size = {};
+    size.hash = 1;
+
+    if (node->right) {
+        rightHash  = walkValuesPop(&walk->hashes).hash;
+        size.hash += walkValuesPop(&walk->sizes).hash;
+    }
+    if (node->left) {
+        leftHash   = walkValuesPop(&walk->hashes).hash;
+        size.hash += walkValuesPop(&walk->sizes).hash;
+    }
+
+    WalkValue_t hash = {};
+    hash.hash = nodeHash(node, leftHash, rightHash);
+
+    if (size.hash >= MEMO_MIN_SUBTREE) {
+        if (memoIndexAdd(walk->index, node, hash.hash) != DIFF_OK) walk->failed = true;
+
+        // subtree of memorized one may be skipped by nodeDiff(), but it is still needed by the next edit
+        MemoEntry_t* entry = walk->memo ? memoSlot(walk->memo, hash.hash) : nullptr;
+        if (entry && entry->derivative) entry->used = walk->memo->generation;
+    }
+    if (walkValuesPush(&walk->hashes, hash) != DIFF_OK || walkValuesPush(&walk->sizes, size) != DIFF_OK) walk->failed = true;
+
+    return walk->failed ? WALK_STOP : WALK_NEXT;
+}
+
+// one pass over tree gives hashes of all subtrees, that are big enough for memo, their entries in memo are kept by this run
+int memoIndexCtor(MemoIndex_t* index, DiffNode_t* root, DiffMemo_t* memo) {
+    DIFF_CHECK(!index, DIFF_NULL);
+
+    *index = {};
+    if (!root) return DIFF_OK;
+
+    MemoWalk_t walk = {};
+    walk.index = index;
+    walk.memo  = memo;
+    walkValuesCtor(&walk.hashes);
+    walkValuesCtor(&walk.sizes);
+
+    int err = treeWalk(root, memoIndexVisit, &walk);
+    if (walk.failed) err = DIFF_NO_MEM;
+
+    walkValuesDtor(&walk.hashes);
+    walkValuesDtor(&walk.sizes);
+
+    if (err != DIFF_OK) memoIndexDtor(index);
+    return err;
+}
+
+void memoIndexDtor(MemoIndex_t* index) {
+    if (!index) return;
+
+    free(index->nodes);
+    free(index->hashes);
+    *index = {};
+}
+
+bool memoIndexFind(const MemoIndex_t* index, const DiffNode_t* node, size_t* hash) {
+    if (!index || !index->count || !node || !hash) return false;
+
+    size_t slot = indexSlot(index, node);
+    if (!index->nodes[slot]) return false;
+
+    *hash = index->hashes[slot];
+    return true;
+}
+
+// WATCH
+
+static void stopWatch(int signal) {
+    (void) signal;
+    watchStopped = 1;
+}
+
+// editors often write file several times, so only mtime is compared, not the contents
+static bool fileChanged(const char* fileName, timespec* mtime) {
+    struct stat info = {};
+    if (stat(fileName, &info) != 0) return false;
+
+    if (info.st_mtim.tv_sec == mtime->tv_sec && info.st_mtim.tv_nsec == mtime->tv_nsec) return false;
+
+    *mtime = info.st_mtim;
+    return true;
+}
+
+// Job is done again after every change of file (until SIGINT/SIGTERM or given count of runs), every run rewrites TeX document.
+// Derivatives of unchanged subtrees, simplified derivative and graph of unchanged equation come from memo of previous runs.
+int watchDiffFile(const char* fileName, const char* texName, const DiffOptions_t* options, int runs) {
+    DIFF_CHECK(!fileName || !texName, DIFF_NULL);
+
+    DiffMemo_t memo = {};
+    int err = diffMemoCtor(&memo);
+    if (err != DIFF_OK) return err;
+    diffMemo = &memo;
+
+    struct sigaction action = {};
+    action.sa_handler = stopWatch;
+    sigaction(SIGINT,  &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+
+    timespec mtime = {};
+    for (int run = 0; !watchStopped && (runs <= 0 || run < runs); ) {
+        if (!fileChanged(fileName, &mtime)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(WATCH_POLL_MS));
+            continue;
+        }
+
+        uint64_t start = clockNs();
+
+        DiffNode_t* root = openDiffFile(fileName, texName, options);
+        if (!root) fprintf(stderr, "File %s can't be parsed, waiting for next change\n", fileName);
+        diffNodeDtor(root);
+
+        // viewer is opened once, it reloads pdf by itself; next run must not rewrite TeX under pdflatex
+        finishTex(run == 0);
+        renderQueueWait(renderQueue);
+
+        printf("{\"run\": %d, \"ms\": %.3f, \"memo_hits\": %lu, \"memo_misses\": %lu, \"reused_nodes\": %lu, \"memo_entries\": %lu}\n",
+               run, (double) (clockNs() - start) / 1e6, memo.hits, memo.misses, memo.reused, memo.count);
+        fflush(stdout);
+
+        diffMemoSweep(&memo);
+        run++;
+    }
+
+    diffMemo = nullptr;
+    diffMemoDtor(&memo);
+
+    return DIFF_OK;
+}
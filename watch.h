@@ -0,0 +1,85 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+#include "diff.h"
+#include "render.h"
+
+const int    WATCH_POLL_MS    = 200;        // input file is checked for changes this often
+
+const size_t MEMO_MIN_SUBTREE = 8;          // smaller subtrees are differentiated again, it is as cheap as lookup
+
+const size_t MEMO_START_SIZE  = 256;        // power of 2
+
+const size_t MEMO_MAX_NODES   = 1 << 22;    // nodes kept by memo, new entries are dropped after it
+
+// derivative of one subtree, made by one of previous runs
+struct MemoEntry_t {
+    size_t      hash       = 0;
+    DiffNode_t* equation   = nullptr;       // copy of subtree, hash collisions are checked by it
+    DiffNode_t* derivative = nullptr;       // not simplified, as nodeDiff() makes it
+    size_t      nodes      = 0;
+    unsigned    born       = 0;             // run, that made entry, it is not reused by the same run
+    unsigned    used       = 0;             // last run, that needed entry, others are swept after run
+};
+
+// Derivatives of subtrees by structural hash, they live between runs of watch mode. Edited equation differs from
+// previous one only on the spine from root to edit, subtrees hanging from it are found here and are not differentiated again.
+// Simplified derivative and graph of the whole equation are kept too, they are reused while equation stays the same.
+struct DiffMemo_t {
+    MemoEntry_t* entries    = nullptr;
+    size_t       size       = 0;
+    size_t       count      = 0;
+    size_t       nodes      = 0;
+    unsigned     generation = 1;            // current run
+
+    DiffNode_t*  equation   = nullptr;      // equation of last run and its simplified derivative
+    DiffNode_t*  simplified = nullptr;
+
+    DiffNode_t* plotEquation = nullptr;     // graph of last run
+    double      plotLeft     = 0;
+    double      plotRight    = 0;
+    char        plotImage[MAX_ARTIFACT_LENGTH] = "";
+
+    size_t hits   = 0;                      // of current run
+    size_t misses = 0;
+    size_t reused = 0;                      // derivative nodes taken from memo
+};
+
+// node of tree -> structural hash of its subtree, only for subtrees that may be in memo
+struct MemoIndex_t {
+    const DiffNode_t** nodes  = nullptr;
+    size_t*            hashes = nullptr;
+    size_t             size   = 0;
+    size_t             count  = 0;
+};
+
+// memo of watch mode, nullptr otherwise (only main thread uses it)
+extern DiffMemo_t* diffMemo;
+
+int diffMemoCtor(DiffMemo_t* memo);
+
+void diffMemoDtor(DiffMemo_t* memo);
+
+DiffNode_t* diffMemoGet(DiffMemo_t* memo, size_t hash, DiffNode_t* equation);
+
+void diffMemoPut(DiffMemo_t* memo, size_t hash, DiffNode_t* equation, DiffNode_t* derivative);
+
+DiffNode_t* diffMemoGetSimplified(DiffMemo_t* memo, DiffNode_t* equation);
+
+void diffMemoPutSimplified(DiffMemo_t* memo, DiffNode_t* equation, DiffNode_t* simplified);
+
+bool diffMemoGetPlot(const DiffMemo_t* memo, DiffNode_t* equation, double left, double right, char* image, size_t size);
+
+void diffMemoPutPlot(DiffMemo_t* memo, DiffNode_t* equation, double left, double right, const char* image);
+
+void diffMemoSweep(DiffMemo_t* memo);
+
+int memoIndexCtor(MemoIndex_t* index, DiffNode_t* root, DiffMemo_t* memo = nullptr);
+
+void memoIndexDtor(MemoIndex_t* index);
+
+bool memoIndexFind(const MemoIndex_t* index, const DiffNode_t* node, size_t* hash);
+
+int watchDiffFile(const char* fileName, const char* texName, const DiffOptions_t* options, int runs = 0);
+
+#endif